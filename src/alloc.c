@@ -0,0 +1,212 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sodium.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OTRNG_ALLOC_PRIVATE
+
+#include "alloc.h"
+
+#define SECURE_POOL_MIN_SLOT 64
+#define SECURE_POOL_CLASSES 7
+#define SECURE_POOL_DIRECT ((size_t)-1)
+
+/* Every secure allocation is preceded by this header. It keeps the payload
+ * aligned to 16 bytes. */
+typedef union secure_header_u {
+  size_t slot_class;
+  uint8_t padding[16];
+} secure_header_u;
+
+typedef struct secure_slot_s {
+  struct secure_slot_s *next;
+} secure_slot_s;
+
+/* Shared by every client of the process, and not locked: see alloc.h */
+static otrng_allocator_s current_allocator = {NULL, NULL, NULL, NULL};
+
+static struct {
+  secure_slot_s *free_slots[SECURE_POOL_CLASSES];
+  otrng_secure_pool_stats_s stats;
+} secure_pool;
+
+API void otrng_set_allocator(const otrng_allocator_s *allocator) {
+  if (!allocator) {
+    memset(&current_allocator, 0, sizeof(otrng_allocator_s));
+    return;
+  }
+
+  current_allocator = *allocator;
+
+  if (!current_allocator.secure_alloc || !current_allocator.secure_free) {
+    current_allocator.secure_alloc = NULL;
+    current_allocator.secure_free = NULL;
+  }
+}
+
+API void otrng_secure_pool_get_stats(otrng_secure_pool_stats_s *stats) {
+  if (!stats) {
+    return;
+  }
+
+  *stats = secure_pool.stats;
+}
+
+INTERNAL void *otrng_mem_alloc(size_t size) {
+  if (current_allocator.malloc) {
+    return current_allocator.malloc(size);
+  }
+
+  return malloc(size);
+}
+
+INTERNAL void otrng_mem_free(void *ptr) {
+  if (current_allocator.free) {
+    current_allocator.free(ptr);
+    return;
+  }
+
+  free(ptr);
+}
+
+static size_t slot_size(size_t slot_class) {
+  return (size_t)SECURE_POOL_MIN_SLOT << slot_class;
+}
+
+static size_t find_slot_class(size_t size) {
+  size_t total = size + sizeof(secure_header_u);
+  size_t slot_class = 0;
+
+  while (slot_class < SECURE_POOL_CLASSES && slot_size(slot_class) < total) {
+    slot_class++;
+  }
+
+  if (slot_class == SECURE_POOL_CLASSES) {
+    return SECURE_POOL_DIRECT;
+  }
+
+  return slot_class;
+}
+
+static int secure_pool_grow(size_t slot_class) {
+  uint8_t *slab = sodium_malloc(OTRNG_SECURE_POOL_SLAB_SIZE);
+  if (!slab) {
+    return 0;
+  }
+
+  size_t size = slot_size(slot_class);
+  size_t count = OTRNG_SECURE_POOL_SLAB_SIZE / size;
+  for (size_t i = 0; i < count; i++) {
+    secure_slot_s *slot = (secure_slot_s *)(slab + i * size);
+    slot->next = secure_pool.free_slots[slot_class];
+    secure_pool.free_slots[slot_class] = slot;
+  }
+
+  secure_pool.stats.slabs++;
+  secure_pool.stats.reserved_bytes += OTRNG_SECURE_POOL_SLAB_SIZE;
+
+  return 1;
+}
+
+tstatic void *secure_pool_alloc(size_t size) {
+  if (sodium_init() < 0) {
+    return NULL;
+  }
+
+  secure_header_u *header = NULL;
+  size_t slot_class = find_slot_class(size);
+
+  if (slot_class == SECURE_POOL_DIRECT) {
+    size_t total = size + sizeof(secure_header_u);
+    /* Keep the region aligned, as sodium_malloc places it against a guard
+     * page */
+    total = (total + 15) & ~(size_t)15;
+    header = sodium_malloc(total);
+    if (!header) {
+      return NULL;
+    }
+
+    secure_pool.stats.direct_allocations++;
+  } else {
+    if (!secure_pool.free_slots[slot_class] && !secure_pool_grow(slot_class)) {
+      return NULL;
+    }
+
+    secure_slot_s *slot = secure_pool.free_slots[slot_class];
+    secure_pool.free_slots[slot_class] = slot->next;
+    header = (secure_header_u *)slot;
+
+    secure_pool.stats.slots_in_use++;
+    secure_pool.stats.slot_bytes_in_use += slot_size(slot_class);
+  }
+
+  header->slot_class = slot_class;
+  return header + 1;
+}
+
+tstatic void secure_pool_free(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+
+  secure_header_u *header = (secure_header_u *)ptr - 1;
+  size_t slot_class = header->slot_class;
+
+  if (slot_class == SECURE_POOL_DIRECT) {
+    /* sodium_free wipes the region */
+    sodium_free(header);
+    secure_pool.stats.direct_allocations--;
+    return;
+  }
+
+  sodium_memzero(header, slot_size(slot_class));
+
+  secure_slot_s *slot = (secure_slot_s *)header;
+  slot->next = secure_pool.free_slots[slot_class];
+  secure_pool.free_slots[slot_class] = slot;
+
+  secure_pool.stats.slots_in_use--;
+  secure_pool.stats.slot_bytes_in_use -= slot_size(slot_class);
+}
+
+INTERNAL void *otrng_secure_alloc(size_t size) {
+  if (current_allocator.secure_alloc) {
+    return current_allocator.secure_alloc(size);
+  }
+
+  return secure_pool_alloc(size);
+}
+
+INTERNAL void otrng_secure_free(void *ptr, size_t size) {
+  if (!ptr) {
+    return;
+  }
+
+  if (current_allocator.secure_free) {
+    sodium_memzero(ptr, size);
+    current_allocator.secure_free(ptr);
+    return;
+  }
+
+  secure_pool_free(ptr);
+}
@@ -0,0 +1,103 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_ALLOC_H
+#define OTRNG_ALLOC_H
+
+#include <stddef.h>
+
+#include "shared.h"
+
+/* Biggest slot of the secure pool, bookkeeping included. Bigger secure
+ * allocations get their own sodium_malloc region. */
+#define OTRNG_SECURE_POOL_MAX_SLOT 4096
+
+/* Size of each locked slab the secure pool carves slots from */
+#define OTRNG_SECURE_POOL_SLAB_SIZE 16384
+
+/*
+ * The allocator used for the library's own scratch and key memory. Members
+ * left as NULL fall back to the default implementation: libc for malloc and
+ * free, and a pool of locked slabs (backed by sodium_malloc) for the secure
+ * ones.
+ *
+ * malloc and free only serve the blocks of the per-connection scratch arena.
+ * Every other buffer, and in particular the ones handed to the caller or
+ * exchanged with libotr and gcrypt, still uses libc malloc and free.
+ *
+ * secure_alloc and secure_free must be set together: memory returned by one
+ * is only ever given back to the other.
+ *
+ * Neither the allocator nor the default secure pool is locked. A client that
+ * uses the library from more than one thread must serialize its calls into
+ * it.
+ */
+typedef struct otrng_allocator_s {
+  void *(*malloc)(size_t size);
+  void (*free)(void *ptr);
+
+  /* Used for key material. Should keep the memory out of swap. */
+  void *(*secure_alloc)(size_t size);
+  void (*secure_free)(void *ptr);
+} otrng_allocator_s, otrng_allocator_p[1];
+
+typedef struct otrng_secure_pool_stats_s {
+  /* Slabs requested from sodium_malloc */
+  size_t slabs;
+  /* Bytes reserved by those slabs */
+  size_t reserved_bytes;
+  /* Slots currently handed out, and the bytes they account for */
+  size_t slots_in_use;
+  size_t slot_bytes_in_use;
+  /* Live allocations too big for a slot, served directly by sodium_malloc */
+  size_t direct_allocations;
+} otrng_secure_pool_stats_s, otrng_secure_pool_stats_p[1];
+
+/**
+ * @brief Replaces the allocator used by the library.
+ *
+ * This must be called before any other function of the library, and before
+ * other threads use it, since memory allocated with one allocator can not be
+ * released with another.
+ *
+ * @param [allocator] The allocator, or NULL to restore the default one.
+ */
+API void otrng_set_allocator(const otrng_allocator_s *allocator);
+
+API void otrng_secure_pool_get_stats(otrng_secure_pool_stats_s *stats);
+
+INTERNAL void *otrng_mem_alloc(size_t size);
+
+INTERNAL void otrng_mem_free(void *ptr);
+
+INTERNAL void *otrng_secure_alloc(size_t size);
+
+/* The memory is wiped before it is released */
+INTERNAL void otrng_secure_free(void *ptr, size_t size);
+
+#ifdef OTRNG_ALLOC_PRIVATE
+
+tstatic void *secure_pool_alloc(size_t size);
+
+tstatic void secure_pool_free(void *ptr);
+
+#endif
+
+#endif
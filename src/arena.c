@@ -0,0 +1,197 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sodium.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OTRNG_ARENA_PRIVATE
+
+#include "alloc.h"
+#include "arena.h"
+#include "error.h"
+
+tstatic arena_block_s *arena_block_new(size_t size) {
+  arena_block_s *block = otrng_mem_alloc(sizeof(arena_block_s) + size);
+  if (!block) {
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  block->data = (uint8_t *)(block + 1);
+
+  return block;
+}
+
+static void arena_block_free(arena_block_s *block) {
+  sodium_memzero(block->data, block->used);
+  otrng_mem_free(block);
+}
+
+INTERNAL void otrng_arena_init(otrng_arena_s *arena, size_t block_size) {
+  if (block_size <= OTRNG_ARENA_ALIGNMENT) {
+    block_size = OTRNG_ARENA_BLOCK_SIZE;
+  }
+
+  arena->blocks = NULL;
+  arena->block_size = block_size;
+  arena->depth = 0;
+  arena->allocations = 0;
+  arena->heap_allocations = 0;
+  arena->resets = 0;
+}
+
+static size_t arena_padding(const arena_block_s *block) {
+  uintptr_t next = (uintptr_t)(block->data + block->used);
+  return (OTRNG_ARENA_ALIGNMENT - (next % OTRNG_ARENA_ALIGNMENT)) %
+         OTRNG_ARENA_ALIGNMENT;
+}
+
+INTERNAL void *otrng_arena_alloc(otrng_arena_s *arena, size_t size) {
+  if (!arena) {
+    return NULL;
+  }
+
+  /* A zero-byte request is still given a pointer of its own, so callers do
+   * not have to tell it apart from a failure */
+  arena_block_s *block = arena->blocks;
+  if (block) {
+    size_t padding = arena_padding(block);
+    if (block->size - block->used >= padding &&
+        block->size - block->used - padding >= size) {
+      block->used += padding;
+      void *ret = block->data + block->used;
+      block->used += size;
+      arena->allocations++;
+      return ret;
+    }
+  }
+
+  /* Oversized requests get a block of their own, which is kept behind the
+   * current block so its free space can still be used */
+  size_t block_size = arena->block_size;
+  otrng_bool oversized = otrng_false;
+  if (size > block_size - OTRNG_ARENA_ALIGNMENT) {
+    block_size = size + OTRNG_ARENA_ALIGNMENT;
+    oversized = otrng_true;
+  }
+
+  block = arena_block_new(block_size);
+  if (!block) {
+    return NULL;
+  }
+
+  if (oversized && arena->blocks) {
+    block->next = arena->blocks->next;
+    arena->blocks->next = block;
+  } else {
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  arena->heap_allocations++;
+
+  block->used = arena_padding(block);
+  void *ret = block->data + block->used;
+  block->used += size;
+  arena->allocations++;
+
+  return ret;
+}
+
+INTERNAL void *otrng_arena_calloc(otrng_arena_s *arena, size_t size) {
+  void *ret = otrng_arena_alloc(arena, size);
+  if (!ret) {
+    return NULL;
+  }
+
+  memset(ret, 0, size);
+  return ret;
+}
+
+INTERNAL void otrng_arena_reset(otrng_arena_s *arena) {
+  if (!arena) {
+    return;
+  }
+
+  arena_block_s *keep = NULL;
+  arena_block_s *current = arena->blocks;
+  while (current) {
+    arena_block_s *next = current->next;
+
+    /* Keep a single regular-sized block around for the next message */
+    if (!keep && current->size == arena->block_size) {
+      sodium_memzero(current->data, current->used);
+      current->used = 0;
+      current->next = NULL;
+      keep = current;
+    } else {
+      arena_block_free(current);
+    }
+
+    current = next;
+  }
+
+  arena->blocks = keep;
+  arena->resets++;
+}
+
+INTERNAL void otrng_arena_enter(otrng_arena_s *arena) { arena->depth++; }
+
+INTERNAL void otrng_arena_leave(otrng_arena_s *arena) {
+  if (arena->depth > 0) {
+    arena->depth--;
+  }
+
+  if (arena->depth == 0) {
+    otrng_arena_reset(arena);
+  }
+}
+
+INTERNAL void otrng_arena_destroy(otrng_arena_s *arena) {
+  if (!arena) {
+    return;
+  }
+
+  arena_block_s *current = arena->blocks;
+  while (current) {
+    arena_block_s *next = current->next;
+    arena_block_free(current);
+    current = next;
+  }
+
+  arena->blocks = NULL;
+  arena->depth = 0;
+}
+
+INTERNAL void otrng_arena_get_stats(otrng_arena_stats_s *stats,
+                                    const otrng_arena_s *arena) {
+  const arena_block_s *current = NULL;
+
+  stats->allocations = arena->allocations;
+  stats->heap_allocations = arena->heap_allocations;
+  stats->resets = arena->resets;
+
+  stats->bytes = 0;
+  for (current = arena->blocks; current; current = current->next) {
+    stats->bytes += sizeof(arena_block_s) + current->size;
+  }
+}
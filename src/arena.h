@@ -0,0 +1,118 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OTRNG_ARENA_H
+#define OTRNG_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared.h"
+
+/* Size of every block the arena requests from the heap. Requests bigger than
+ * this get a block of their own. */
+#define OTRNG_ARENA_BLOCK_SIZE 4096
+
+/* All allocations are aligned to this many bytes */
+#define OTRNG_ARENA_ALIGNMENT 16
+
+typedef struct arena_block_s {
+  struct arena_block_s *next;
+  size_t size;
+  size_t used;
+  uint8_t *data;
+} arena_block_s;
+
+/*
+ * A scratch arena for objects that only live during a single call to
+ * otrng_receive_message or otrng_send_message. Nothing allocated from it is
+ * freed individually: everything is wiped and released at once when the
+ * outermost call leaves the arena.
+ *
+ * Only flat buffers are taken from it: the decrypted and the padded
+ * plaintexts, and the decoded message. Structures with their own free
+ * functions, such as data_message_s, receiving_ratchet_s and the TLV lists
+ * handed to the application, are still allocated on the heap.
+ */
+typedef struct otrng_arena_s {
+  arena_block_s *blocks;
+  size_t block_size;
+
+  /* Nesting level of otrng_arena_enter calls */
+  unsigned int depth;
+
+  /* Allocations served from the arena since it was initialized */
+  size_t allocations;
+  /* Heap allocations the arena needed to serve them */
+  size_t heap_allocations;
+  /* Number of times the arena has been reset */
+  size_t resets;
+} otrng_arena_s, otrng_arena_p[1];
+
+/* what a scratch arena served, and what it holds */
+typedef struct otrng_arena_stats_s {
+  size_t allocations;      /* served from the arena, so far */
+  size_t heap_allocations; /* blocks it requested to serve them, so far */
+  size_t resets;
+  size_t bytes; /* memory held by its blocks right now */
+} otrng_arena_stats_s, otrng_arena_stats_p[1];
+
+INTERNAL void otrng_arena_init(otrng_arena_s *arena, size_t block_size);
+
+/**
+ * @brief Allocates [size] bytes from the arena.
+ *
+ * @param [arena] The arena.
+ * @param [size]  The number of bytes.
+ *
+ * @return A pointer valid until the next reset, or NULL if the memory could
+ *         not be allocated. If [size] is 0, the pointer is valid but must not
+ *         be written to.
+ */
+INTERNAL void *otrng_arena_alloc(otrng_arena_s *arena, size_t size);
+
+INTERNAL void *otrng_arena_calloc(otrng_arena_s *arena, size_t size);
+
+/* Wipes every byte handed out so far and keeps only the first block */
+INTERNAL void otrng_arena_reset(otrng_arena_s *arena);
+
+INTERNAL void otrng_arena_enter(otrng_arena_s *arena);
+
+/* Resets the arena when leaving the outermost call */
+INTERNAL void otrng_arena_leave(otrng_arena_s *arena);
+
+INTERNAL void otrng_arena_destroy(otrng_arena_s *arena);
+
+/**
+ * @brief Count the allocations the arena served, and the memory it holds.
+ *
+ * @param [stats]  The counters.
+ * @param [arena]  The arena.
+ */
+INTERNAL void otrng_arena_get_stats(otrng_arena_stats_s *stats,
+                                    const otrng_arena_s *arena);
+
+#ifdef OTRNG_ARENA_PRIVATE
+
+tstatic arena_block_s *arena_block_new(size_t size);
+
+#endif
+
+#endif
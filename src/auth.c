@@ -88,11 +88,12 @@ static void calculate_ri(goldilocks_448_scalar_p dst,
 }
 
 INTERNAL void otrng_rsig_calculate_c_with_usage_and_domain(
-    uint8_t usage_auth, const char *domain_sep, goldilocks_448_scalar_p dst,
-    const goldilocks_448_point_p A1, const goldilocks_448_point_p A2,
-    const goldilocks_448_point_p A3, const goldilocks_448_point_p T1,
-    const goldilocks_448_point_p T2, const goldilocks_448_point_p T3,
-    const uint8_t *message, size_t message_len) {
+    uint8_t usage_auth, otrng_shake_domain domain_sep,
+    goldilocks_448_scalar_p dst, const goldilocks_448_point_p A1,
+    const goldilocks_448_point_p A2, const goldilocks_448_point_p A3,
+    const goldilocks_448_point_p T1, const goldilocks_448_point_p T2,
+    const goldilocks_448_point_p T3, const uint8_t *message,
+    size_t message_len) {
   goldilocks_shake256_ctx_p hd;
   uint8_t hash[HASH_BYTES];
   uint8_t point_buff[ED448_POINT_BYTES];
@@ -128,7 +129,7 @@ INTERNAL void otrng_rsig_calculate_c_with_usage_and_domain(
 }
 
 INTERNAL void otrng_rsig_calculate_c_from_sigma_with_usage_and_domain(
-    uint8_t usage, const char *domain_sep, goldilocks_448_scalar_p c,
+    uint8_t usage, otrng_shake_domain domain_sep, goldilocks_448_scalar_p c,
     const ring_sig_p src, const rsig_pubkey_p A1, const rsig_pubkey_p A2,
     const rsig_pubkey_p A3, const uint8_t *message, size_t message_len) {
   rsig_pubkey_p gr1, gr2, gr3, A1c1, A2c2, A3c3;
@@ -159,7 +160,7 @@ INTERNAL otrng_result otrng_rsig_authenticate(
 }
 
 INTERNAL otrng_result otrng_rsig_authenticate_with_usage_and_domain(
-    uint8_t usage, const char *domain_sep, ring_sig_p dst,
+    uint8_t usage, otrng_shake_domain domain_sep, ring_sig_p dst,
     const rsig_privkey_p secret, const rsig_pubkey_p pub,
     const rsig_pubkey_p A1, const rsig_pubkey_p A2, const rsig_pubkey_p A3,
     const uint8_t *message, size_t message_len) {
@@ -275,7 +276,7 @@ INTERNAL otrng_bool otrng_rsig_verify(
 }
 
 INTERNAL otrng_bool otrng_rsig_verify_with_usage_and_domain(
-    uint8_t usage, const char *domain_sep, const ring_sig_p src,
+    uint8_t usage, otrng_shake_domain domain_sep, const ring_sig_p src,
     const rsig_pubkey_p A1, const rsig_pubkey_p A2, const rsig_pubkey_p A3,
     const uint8_t *message, size_t message_len) {
   goldilocks_448_scalar_p c;
@@ -25,10 +25,11 @@
 
 #include "ed448.h"
 #include "keys.h"
+#include "shake.h"
 #include "shared.h"
 
 #define OTRNG_PROTOCOL_USAGE_AUTH 0x1C
-#define OTRNG_PROTOCOL_DOMAIN_SEPARATION "OTRv4"
+#define OTRNG_PROTOCOL_DOMAIN_SEPARATION OTRNG_SHAKE_DOMAIN_OTRV4
 
 /* The size of the ring signature. */
 #define RING_SIG_BYTES 6 * ED448_SCALAR_BYTES
@@ -123,25 +124,26 @@ INTERNAL void otrng_ring_sig_destroy(ring_sig_p src);
  * @param [msg_len] The length of the message.
  */
 INTERNAL void otrng_rsig_calculate_c_with_usage_and_domain(
-    uint8_t usage_auth, const char *domain_sep, goldilocks_448_scalar_p dst,
-    const goldilocks_448_point_p A1, const goldilocks_448_point_p A2,
-    const goldilocks_448_point_p A3, const goldilocks_448_point_p T1,
-    const goldilocks_448_point_p T2, const goldilocks_448_point_p T3,
-    const uint8_t *message, size_t message_len);
+    uint8_t usage_auth, otrng_shake_domain domain_sep,
+    goldilocks_448_scalar_p dst, const goldilocks_448_point_p A1,
+    const goldilocks_448_point_p A2, const goldilocks_448_point_p A3,
+    const goldilocks_448_point_p T1, const goldilocks_448_point_p T2,
+    const goldilocks_448_point_p T3, const uint8_t *message,
+    size_t message_len);
 
 INTERNAL void otrng_rsig_calculate_c_from_sigma_with_usage_and_domain(
-    uint8_t usage, const char *domain_sep, goldilocks_448_scalar_p c,
+    uint8_t usage, otrng_shake_domain domain_sep, goldilocks_448_scalar_p c,
     const ring_sig_p src, const rsig_pubkey_p A1, const rsig_pubkey_p A2,
     const rsig_pubkey_p A3, const uint8_t *message, size_t message_len);
 
 INTERNAL otrng_result otrng_rsig_authenticate_with_usage_and_domain(
-    uint8_t usage, const char *domain_sep, ring_sig_p dst,
+    uint8_t usage, otrng_shake_domain domain_sep, ring_sig_p dst,
     const rsig_privkey_p secret, const rsig_pubkey_p pub,
     const rsig_pubkey_p A1, const rsig_pubkey_p A2, const rsig_pubkey_p A3,
     const uint8_t *message, size_t message_len);
 
 INTERNAL otrng_bool otrng_rsig_verify_with_usage_and_domain(
-    uint8_t usage, const char *domain_sep, const ring_sig_p src,
+    uint8_t usage, otrng_shake_domain domain_sep, const ring_sig_p src,
     const rsig_pubkey_p A1, const rsig_pubkey_p A2, const rsig_pubkey_p A3,
     const uint8_t *message, size_t message_len);
 
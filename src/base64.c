@@ -1,13 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "base64.h"
 
-char *otrng_base64_encode(uint8_t *src, size_t src_len) {
+static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#define BASE64_SKIP 0xff
+#define BASE64_END 0xfe
+
+/* Maps every byte to its 6-bit value, to BASE64_END for '=' and to
+ * BASE64_SKIP for anything outside the alphabet, so that a group of four
+ * characters is checked with a single test. */
+static const uint8_t base64_values[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff,
+    0xff, 0xfe, 0xff, 0xff, 0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12,
+    0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24,
+    0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff,};
+
+char *otrng_base64_encode(const uint8_t *src, size_t src_len) {
   char *dst = malloc(OTRNG_BASE64_ENCODE_LEN(src_len) + 1);
   if (!dst) {
     return NULL;
   }
 
-  size_t l = otrl_base64_encode(dst, src, src_len);
+  size_t l = otrng_base64_encode_into(dst, src, src_len);
   dst[l] = '\0';
 
   return dst;
 }
+
+static size_t encode_groups(char *dst, const uint8_t *src, size_t groups) {
+  for (size_t i = 0; i < groups; i++) {
+    uint32_t v = ((uint32_t)src[0] << 16) | ((uint32_t)src[1] << 8) | src[2];
+    dst[0] = base64_alphabet[v >> 18];
+    dst[1] = base64_alphabet[(v >> 12) & 0x3f];
+    dst[2] = base64_alphabet[(v >> 6) & 0x3f];
+    dst[3] = base64_alphabet[v & 0x3f];
+
+    src += 3;
+    dst += 4;
+  }
+
+  return groups * 4;
+}
+
+static size_t encode_last_group(char *dst, const uint8_t *src, size_t len) {
+  if (len == 0) {
+    return 0;
+  }
+
+  uint32_t v = (uint32_t)src[0] << 16;
+  if (len > 1) {
+    v |= (uint32_t)src[1] << 8;
+  }
+
+  dst[0] = base64_alphabet[v >> 18];
+  dst[1] = base64_alphabet[(v >> 12) & 0x3f];
+  dst[2] = len > 1 ? base64_alphabet[(v >> 6) & 0x3f] : '=';
+  dst[3] = '=';
+
+  return 4;
+}
+
+INTERNAL size_t otrng_base64_encode_into(char *dst, const uint8_t *src,
+                                         size_t src_len) {
+  size_t groups = src_len / 3;
+  size_t written = encode_groups(dst, src, groups);
+
+  return written +
+         encode_last_group(dst + written, src + groups * 3, src_len % 3);
+}
+
+/* Decodes len (0 to 4) 6-bit values, as otrl_base64_decode does for a
+ * truncated group */
+static size_t decode_group(uint8_t *dst, const uint8_t *values, size_t len) {
+  if (len > 1) {
+    dst[0] = (uint8_t)(values[0] << 2 | values[1] >> 4);
+  }
+
+  if (len > 2) {
+    dst[1] = (uint8_t)(values[1] << 4 | values[2] >> 2);
+  }
+
+  if (len > 3) {
+    dst[2] = (uint8_t)(values[2] << 6 | values[3]);
+  }
+
+  return len > 1 ? len - 1 : 0;
+}
+
+INTERNAL size_t otrng_base64_decode_into(uint8_t *dst, const char *src,
+                                         size_t src_len) {
+  otrng_base64_decoder_p decoder;
+  otrng_base64_decoder_init(decoder);
+
+  size_t written = otrng_base64_decoder_update(decoder, dst, src, src_len);
+  return written + otrng_base64_decoder_final(decoder, dst + written);
+}
+
+INTERNAL char *otrng_base64_otr_encode(const uint8_t *src, size_t src_len) {
+  /* "?OTR:" + base64 + "." + NUL */
+  char *dst = malloc(5 + OTRNG_BASE64_ENCODE_LEN(src_len) + 2);
+  if (!dst) {
+    return NULL;
+  }
+
+  memcpy(dst, "?OTR:", 5);
+  size_t l = 5 + otrng_base64_encode_into(dst + 5, src, src_len);
+  dst[l] = '.';
+  dst[l + 1] = '\0';
+
+  return dst;
+}
+
+INTERNAL void otrng_base64_encoder_init(otrng_base64_encoder_s *encoder) {
+  memset(encoder->pending, 0, sizeof(encoder->pending));
+  encoder->pending_len = 0;
+}
+
+INTERNAL size_t otrng_base64_encoder_update(otrng_base64_encoder_s *encoder,
+                                            char *dst, const uint8_t *src,
+                                            size_t src_len) {
+  size_t written = 0;
+
+  if (encoder->pending_len) {
+    while (encoder->pending_len < 3 && src_len) {
+      encoder->pending[encoder->pending_len++] = *src++;
+      src_len--;
+    }
+
+    if (encoder->pending_len < 3) {
+      return 0;
+    }
+
+    written = encode_groups(dst, encoder->pending, 1);
+    encoder->pending_len = 0;
+  }
+
+  size_t groups = src_len / 3;
+  written += encode_groups(dst + written, src, groups);
+
+  encoder->pending_len = src_len % 3;
+  memcpy(encoder->pending, src + groups * 3, encoder->pending_len);
+
+  return written;
+}
+
+INTERNAL size_t otrng_base64_encoder_final(otrng_base64_encoder_s *encoder,
+                                           char *dst) {
+  size_t written =
+      encode_last_group(dst, encoder->pending, encoder->pending_len);
+  otrng_base64_encoder_init(encoder);
+
+  return written;
+}
+
+INTERNAL void otrng_base64_decoder_init(otrng_base64_decoder_s *decoder) {
+  memset(decoder->quad, 0, sizeof(decoder->quad));
+  decoder->quad_len = 0;
+  decoder->done = otrng_false;
+}
+
+INTERNAL size_t otrng_base64_decoder_update(otrng_base64_decoder_s *decoder,
+                                            uint8_t *dst, const char *src,
+                                            size_t src_len) {
+  const uint8_t *in = (const uint8_t *)src;
+  const uint8_t *end = in + src_len;
+  uint8_t *out = dst;
+
+  while (!decoder->done && in < end) {
+    /* Fast path: whole groups of alphabet characters, with nothing held
+     * from a previous group */
+    if (decoder->quad_len == 0) {
+      while (end - in >= 4) {
+        uint8_t a = base64_values[in[0]];
+        uint8_t b = base64_values[in[1]];
+        uint8_t c = base64_values[in[2]];
+        uint8_t d = base64_values[in[3]];
+
+        if ((a | b | c | d) & 0x80) {
+          break;
+        }
+
+        out[0] = (uint8_t)(a << 2 | b >> 4);
+        out[1] = (uint8_t)(b << 4 | c >> 2);
+        out[2] = (uint8_t)(c << 6 | d);
+
+        in += 4;
+        out += 3;
+      }
+
+      if (in == end) {
+        break;
+      }
+    }
+
+    uint8_t value = base64_values[*in++];
+    if (value == BASE64_SKIP) {
+      continue;
+    }
+
+    if (value == BASE64_END) {
+      out += decode_group(out, decoder->quad, decoder->quad_len);
+      decoder->quad_len = 0;
+      decoder->done = otrng_true;
+      break;
+    }
+
+    decoder->quad[decoder->quad_len++] = value;
+    if (decoder->quad_len == 4) {
+      out += decode_group(out, decoder->quad, 4);
+      decoder->quad_len = 0;
+    }
+  }
+
+  return out - dst;
+}
+
+INTERNAL size_t otrng_base64_decoder_final(otrng_base64_decoder_s *decoder,
+                                           uint8_t *dst) {
+  size_t written = decode_group(dst, decoder->quad, decoder->quad_len);
+  otrng_base64_decoder_init(decoder);
+
+  return written;
+}
@@ -1,4 +1,3 @@
-
 #ifndef OTRNG_B64_H
 #define OTRNG_B64_H
 
@@ -6,8 +5,97 @@
 #define OTRNG_BASE64_DECODE_LEN(x) (((x + 3) / 4) * 3)
 
 #include <libotr/b64.h>
+#include <stddef.h>
 #include <stdint.h>
 
-char *otrng_base64_encode(uint8_t *src, size_t src_len);
+#include "error.h"
+#include "shared.h"
+
+/* State of an incremental encoder. Input that does not complete a 3-byte
+ * group is held until the next call. */
+typedef struct otrng_base64_encoder_s {
+  uint8_t pending[3];
+  size_t pending_len;
+} otrng_base64_encoder_s, otrng_base64_encoder_p[1];
+
+/* State of an incremental decoder. */
+typedef struct otrng_base64_decoder_s {
+  uint8_t quad[4];
+  size_t quad_len;
+  otrng_bool done;
+} otrng_base64_decoder_s, otrng_base64_decoder_p[1];
+
+char *otrng_base64_encode(const uint8_t *src, size_t src_len);
+
+/**
+ * @brief Encodes src into dst, which must have room for
+ *        OTRNG_BASE64_ENCODE_LEN(src_len) bytes. No NUL is written.
+ *
+ * @return The number of characters written.
+ */
+INTERNAL size_t otrng_base64_encode_into(char *dst, const uint8_t *src,
+                                         size_t src_len);
+
+/**
+ * @brief Decodes src into dst, which must have room for
+ *        OTRNG_BASE64_DECODE_LEN(src_len) bytes.
+ *
+ * It accepts the same input as otrl_base64_decode: characters outside the
+ * alphabet are skipped and a '=' ends the input.
+ *
+ * @return The number of bytes written.
+ */
+INTERNAL size_t otrng_base64_decode_into(uint8_t *dst, const char *src,
+                                         size_t src_len);
+
+/**
+ * @brief Encodes src as an OTR encoded message ("?OTR:<base64>.").
+ *
+ * @return A NUL-terminated string, to be freed by the caller, or NULL.
+ */
+INTERNAL char *otrng_base64_otr_encode(const uint8_t *src, size_t src_len);
+
+INTERNAL void otrng_base64_encoder_init(otrng_base64_encoder_s *encoder);
+
+/**
+ * @brief Encodes the next chunk of a payload.
+ *
+ * dst must have room for OTRNG_BASE64_ENCODE_LEN(src_len + 2) bytes.
+ *
+ * @return The number of characters written.
+ */
+INTERNAL size_t otrng_base64_encoder_update(otrng_base64_encoder_s *encoder,
+                                            char *dst, const uint8_t *src,
+                                            size_t src_len);
+
+/**
+ * @brief Writes the last, padded, group. dst must have room for 4 bytes.
+ *
+ * @return The number of characters written.
+ */
+INTERNAL size_t otrng_base64_encoder_final(otrng_base64_encoder_s *encoder,
+                                           char *dst);
+
+INTERNAL void otrng_base64_decoder_init(otrng_base64_decoder_s *decoder);
+
+/**
+ * @brief Decodes the next chunk of a payload.
+ *
+ * dst must have room for OTRNG_BASE64_DECODE_LEN(src_len + 3) bytes.
+ *
+ * @return The number of bytes written.
+ */
+INTERNAL size_t otrng_base64_decoder_update(otrng_base64_decoder_s *decoder,
+                                            uint8_t *dst, const char *src,
+                                            size_t src_len);
+
+/**
+ * @brief Decodes what is left of a payload that did not end in a complete
+ *        group. dst must have room for 3 bytes.
+ *
+ * @return The number of bytes written.
+ */
+INTERNAL size_t otrng_base64_decoder_final(otrng_base64_decoder_s *decoder,
+                                           uint8_t *dst);
 
 #endif
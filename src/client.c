@@ -19,6 +19,7 @@
  */
 
 #include <libotr/privkey.h>
+#include <string.h>
 #include <time.h>
 
 #define OTRNG_CLIENT_PRIVATE
@@ -41,6 +42,11 @@ tstatic otrng_conversation_s *new_conversation_with(const char *recipient,
   conv->recipient = otrng_strdup(recipient);
   conv->conn = conn;
 
+  conv->sent_message = NULL;
+  conv->sent_span.data = NULL;
+  conv->sent_span.len = 0;
+  otrng_fragment_buffer_init(conv->sent_fragments);
+
   return conv;
 }
 
@@ -49,6 +55,8 @@ tstatic void conversation_free(void *data) {
 
   free(conv->recipient);
   otrng_free(conv->conn);
+  free(conv->sent_message);
+  otrng_fragment_buffer_destroy(conv->sent_fragments);
   free(conv);
 }
 
@@ -199,6 +207,17 @@ otrng_client_get_conversation(int force_create, const char *recipient,
   return get_conversation_with(recipient, client->conversations);
 }
 
+API otrng_result otrng_client_prepare_dake(const char *recipient,
+                                          otrng_client_s *client) {
+  otrng_conversation_s *conv =
+      get_or_create_conversation_with(recipient, client);
+  if (!conv) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_prepare_dake(conv->conn);
+}
+
 // TODO: @client this should allow TLVs to be added to the message
 tstatic otrng_result send_message(char **newmsg, const char *message,
                                   const char *recipient,
@@ -268,6 +287,88 @@ API otrng_result otrng_client_send_fragment(
   return ret;
 }
 
+API otrng_result otrng_client_send_spans(const otrng_span_s **spans,
+                                         int *num_spans, const char *message,
+                                         int mms, const char *recipient,
+                                         otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+  conv = get_or_create_conversation_with(recipient, client);
+  if (!conv) {
+    return OTRNG_ERROR;
+  }
+
+  free(conv->sent_message);
+  conv->sent_message = NULL;
+
+  string_p to_send = NULL;
+  if (otrng_failed(send_message(&to_send, message, recipient, client))) {
+    free(to_send);
+    return OTRNG_ERROR;
+  }
+
+  /* libotr may have nothing to send yet */
+  if (!to_send) {
+    *spans = NULL;
+    *num_spans = 0;
+    return OTRNG_SUCCESS;
+  }
+
+  if (mms <= 0) {
+    conv->sent_message = to_send;
+    conv->sent_span.data = to_send;
+    conv->sent_span.len = strlen(to_send);
+
+    *spans = &conv->sent_span;
+    *num_spans = 1;
+    return OTRNG_SUCCESS;
+  }
+
+  uint32_t our_tag = otrng_client_state_get_instance_tag(client->state);
+  uint32_t their_tag = conv->conn->their_instance_tag;
+
+  otrng_result ret = otrng_fragment_message_into(
+      conv->sent_fragments, num_spans, mms, our_tag, their_tag, to_send);
+  free(to_send);
+
+  if (otrng_failed(ret)) {
+    return OTRNG_ERROR;
+  }
+
+  *spans = conv->sent_fragments->spans;
+  return OTRNG_SUCCESS;
+}
+
+API otrng_result otrng_client_send_stream_start(
+    otrng_send_stream_s *stream, size_t message_len, int mms,
+    otrng_send_stream_emit_fn emit, void *ctx, const char *recipient,
+    otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+  conv = get_or_create_conversation_with(recipient, client);
+  if (!conv) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_send_stream_start(stream, message_len, NULL, 0, mms, emit, ctx,
+                                 conv->conn);
+}
+
+API otrng_result otrng_client_send_stream_write(otrng_send_stream_s *stream,
+                                                const uint8_t *message,
+                                                size_t len) {
+  return otrng_send_stream_write(stream, message, len);
+}
+
+API otrng_result otrng_client_send_stream_finish(otrng_send_stream_s *stream) {
+  otrng_result ret = otrng_send_stream_finish(stream);
+  otrng_send_stream_destroy(stream);
+
+  return ret;
+}
+
+API void otrng_client_send_stream_abort(otrng_send_stream_s *stream) {
+  otrng_send_stream_destroy(stream);
+}
+
 API otrng_result otrng_client_smp_start(char **tosend, const char *recipient,
                                         const unsigned char *question,
                                         const size_t q_len,
@@ -352,6 +453,125 @@ API otrng_result otrng_client_receive(char **newmessage, char **todisplay,
   return result;
 }
 
+API void otrng_client_result_init(otrng_client_result_s *result) {
+  result->to_send = NULL;
+  result->to_display = NULL;
+  result->tlvs = NULL;
+  result->should_ignore = otrng_false;
+
+  result->to_send_buffer = NULL;
+  result->to_send_capacity = 0;
+  result->to_display_buffer = NULL;
+  result->to_display_capacity = 0;
+}
+
+API void otrng_client_result_destroy(otrng_client_result_s *result) {
+  otrng_tlv_list_free(result->tlvs);
+  free(result->to_send_buffer);
+  free(result->to_display_buffer);
+
+  otrng_client_result_init(result);
+}
+
+tstatic void client_result_reset(otrng_client_result_s *result) {
+  result->to_send = NULL;
+  result->to_display = NULL;
+  otrng_tlv_list_free(result->tlvs);
+  result->tlvs = NULL;
+  result->should_ignore = otrng_false;
+}
+
+tstatic otrng_result copy_into_buffer(const char **dst, char **buffer,
+                                      size_t *capacity, const char *src) {
+  if (!src) {
+    return OTRNG_SUCCESS;
+  }
+
+  size_t len = strlen(src) + 1;
+  if (len > *capacity) {
+    char *grown = realloc(*buffer, len);
+    if (!grown) {
+      return OTRNG_ERROR;
+    }
+
+    *buffer = grown;
+    *capacity = len;
+  }
+
+  memcpy(*buffer, src, len);
+  *dst = *buffer;
+
+  return OTRNG_SUCCESS;
+}
+
+API otrng_result otrng_client_send_into(otrng_client_result_s *result,
+                                        const char *message,
+                                        const char *recipient,
+                                        otrng_client_s *client) {
+  client_result_reset(result);
+
+  char *to_send = NULL;
+  if (otrng_failed(send_message(&to_send, message, recipient, client))) {
+    free(to_send);
+    return OTRNG_ERROR;
+  }
+
+  otrng_result ret = copy_into_buffer(&result->to_send, &result->to_send_buffer,
+                                      &result->to_send_capacity, to_send);
+  free(to_send);
+
+  return ret;
+}
+
+API otrng_result otrng_client_receive_into(otrng_client_result_s *result,
+                                           const char *message,
+                                           const char *recipient,
+                                           otrng_client_s *client) {
+  otrng_conversation_s *conv = NULL;
+
+  client_result_reset(result);
+
+  conv = get_or_create_conversation_with(recipient, client);
+  if (!conv) {
+    result->should_ignore = otrng_true;
+    return OTRNG_SUCCESS;
+  }
+
+  otrng_response_p response;
+  otrng_response_init(response);
+
+  otrng_warning warn = OTRNG_WARN_NONE;
+  otrng_result ret =
+      otrng_receive_message(response, &warn, message, conv->conn);
+
+  if (warn == OTRNG_WARN_RECEIVED_NOT_VALID) {
+    otrng_response_destroy(response);
+    return OTRNG_ERROR;
+  }
+
+  if (otrng_failed(copy_into_buffer(&result->to_send, &result->to_send_buffer,
+                                    &result->to_send_capacity,
+                                    response->to_send)) ||
+      otrng_failed(copy_into_buffer(
+          &result->to_display, &result->to_display_buffer,
+          &result->to_display_capacity, response->to_display))) {
+    otrng_response_destroy(response);
+    return OTRNG_ERROR;
+  }
+
+  result->tlvs = response->tlvs;
+  response->tlvs = NULL;
+
+  otrng_response_destroy(response);
+
+  /* As otrng_client_receive, a message to display is a success */
+  if (result->to_display) {
+    return OTRNG_SUCCESS;
+  }
+
+  return ret;
+}
+
 API char *otrng_client_query_message(const char *recipient, const char *message,
                                      otrng_client_s *client) {
   otrng_conversation_s *conv = NULL;
@@ -398,6 +618,21 @@ API otrng_result otrng_client_disconnect(char **newmsg, const char *recipient,
   return OTRNG_SUCCESS;
 }
 
+API otrng_result
+otrng_client_flush_injected_messages(otrng_message_to_send_s *batch,
+                                     const char *recipient,
+                                     otrng_client_s *client) {
+  const otrng_conversation_s *conv =
+      get_conversation_with(recipient, client->conversations);
+  if (!conv || !conv->conn->v3_conn) {
+    batch->pieces = NULL;
+    batch->total = 0;
+    return OTRNG_SUCCESS;
+  }
+
+  return otrng_v3_flush_injected_messages(batch, conv->conn->v3_conn);
+}
+
 // TODO: @client this depends on how is going to be handled: as a different
 // event or inside process_conv_updated?
 /* expiration time should be set on seconds */
@@ -444,6 +679,163 @@ API otrng_result otrng_client_expire_fragments(int expiration_time,
   return OTRNG_SUCCESS;
 }
 
+API void otrng_client_account_and_protocol_changed(otrng_client_s *client) {
+  const list_element_s *el = NULL;
+  otrng_conversation_s *conv = NULL;
+
+  /* The instance tag is looked up by account and protocol */
+  otrng_client_state_forget_instance_tag(client->state);
+
+  for (el = client->conversations; el; el = el->next) {
+    conv = el->data;
+    if (conv->conn->v3_conn) {
+      otrng_v3_conn_forget_account_and_protocol(conv->conn->v3_conn);
+    }
+  }
+}
+
+API void
+otrng_conversation_get_stored_keys_stats(otrng_stored_keys_stats_s *stats,
+                                         otrng_conversation_s *conv) {
+  otrng_key_manager_stored_keys_stats(stats, conv->conn->keys);
+}
+
+API void otrng_client_get_stored_keys_stats(otrng_stored_keys_stats_s *stats,
+                                            otrng_client_s *client) {
+  const list_element_s *el = NULL;
+  otrng_stored_keys_stats_s conv_stats[1];
+
+  memset(stats, 0, sizeof(otrng_stored_keys_stats_s));
+  for (el = client->conversations; el; el = el->next) {
+    otrng_conversation_get_stored_keys_stats(conv_stats, el->data);
+
+    stats->skipped_keys += conv_stats->skipped_keys;
+    stats->checkpoints += conv_stats->checkpoints;
+    stats->old_mac_keys += conv_stats->old_mac_keys;
+    stats->bytes += conv_stats->bytes;
+    stats->evicted_keys += conv_stats->evicted_keys;
+  }
+}
+
+API void otrng_conversation_get_arena_stats(otrng_arena_stats_s *stats,
+                                            otrng_conversation_s *conv) {
+  otrng_arena_get_stats(stats, conv->conn->scratch);
+}
+
+API void otrng_client_get_arena_stats(otrng_arena_stats_s *stats,
+                                      otrng_client_s *client) {
+  const list_element_s *el = NULL;
+  otrng_arena_stats_s conv_stats[1];
+
+  memset(stats, 0, sizeof(otrng_arena_stats_s));
+  for (el = client->conversations; el; el = el->next) {
+    otrng_conversation_get_arena_stats(conv_stats, el->data);
+
+    stats->allocations += conv_stats->allocations;
+    stats->heap_allocations += conv_stats->heap_allocations;
+    stats->resets += conv_stats->resets;
+    stats->bytes += conv_stats->bytes;
+  }
+}
+
+/* A conversation's key manager, keyed by the age of its oldest stored key */
+typedef struct oldest_stored_key_s {
+  time_t stored_at;
+  key_manager_s *keys;
+} oldest_stored_key_s;
+
+/* Moves the entry at position n down the min-heap until it is in order */
+tstatic void oldest_stored_keys_sift_down(oldest_stored_key_s *heap,
+                                          size_t len, size_t n) {
+  for (;;) {
+    size_t smallest = n;
+    size_t left = 2 * n + 1;
+    size_t right = left + 1;
+
+    if (left < len && heap[left].stored_at < heap[smallest].stored_at) {
+      smallest = left;
+    }
+
+    if (right < len && heap[right].stored_at < heap[smallest].stored_at) {
+      smallest = right;
+    }
+
+    if (smallest == n) {
+      return;
+    }
+
+    oldest_stored_key_s tmp = heap[n];
+    heap[n] = heap[smallest];
+    heap[smallest] = tmp;
+    n = smallest;
+  }
+}
+
+/* Drops the oldest stored keys of the client, across all its conversations,
+ * until they fit in max_bytes. */
+tstatic void evict_oldest_stored_keys(otrng_client_s *client, size_t bytes,
+                                      size_t max_bytes) {
+  const list_element_s *el = NULL;
+  size_t len = 0;
+
+  oldest_stored_key_s *heap = malloc(
+      otrng_list_len(client->conversations) * sizeof(oldest_stored_key_s));
+  if (!heap) {
+    return;
+  }
+
+  for (el = client->conversations; el; el = el->next) {
+    const otrng_conversation_s *conv = el->data;
+
+    if (otrng_key_manager_oldest_key(&heap[len].stored_at, conv->conn->keys)) {
+      heap[len].keys = conv->conn->keys;
+      len++;
+    }
+  }
+
+  for (size_t n = len / 2; n > 0; n--) {
+    oldest_stored_keys_sift_down(heap, len, n - 1);
+  }
+
+  while (bytes > max_bytes && len > 0) {
+    bytes -= otrng_key_manager_evict_oldest_key(heap[0].keys);
+
+    if (!otrng_key_manager_oldest_key(&heap[0].stored_at, heap[0].keys)) {
+      heap[0] = heap[--len];
+    }
+
+    oldest_stored_keys_sift_down(heap, len, 0);
+  }
+
+  free(heap);
+}
+
+API void otrng_client_expire_stored_keys(otrng_client_s *client) {
+  const otrng_client_state_s *state = client->state;
+  const list_element_s *el = NULL;
+  otrng_stored_keys_stats_s stats[1];
+  size_t bytes = 0;
+  time_t now;
+
+  now = time(NULL);
+  for (el = client->conversations; el; el = el->next) {
+    const otrng_conversation_s *conv = el->data;
+
+    otrng_key_manager_expire_stored_keys(conv->conn->keys, now,
+                                         state->stored_keys_max_age,
+                                         state->stored_keys_max_bytes);
+    otrng_key_manager_stored_keys_stats(stats, conv->conn->keys);
+    bytes += stats->bytes;
+  }
+
+  if (!state->stored_keys_client_max_bytes ||
+      bytes <= state->stored_keys_client_max_bytes) {
+    return;
+  }
+
+  evict_oldest_stored_keys(client, bytes, state->stored_keys_client_max_bytes);
+}
+
 API otrng_result otrng_client_get_our_fingerprint(
     otrng_fingerprint_p fp, const otrng_client_s *client) {
   if (!client->state->keypair) {
@@ -482,6 +874,8 @@ otrng_client_get_prekey_client(const char *server_identity,
   free(account);
 
   client->prekey_client->callbacks = callbacks;
+  client->prekey_client->ser_client_profile =
+      otrng_client_state_get_serialized_client_profile(client->state);
 
   return client->prekey_client;
 }
@@ -38,8 +38,37 @@ typedef struct otrng_conversation_s {
 
   char *recipient;
   otrng_s *conn;
+
+  /* What otrng_client_send_spans last returned */
+  char *sent_message;
+  otrng_span_s sent_span;
+  otrng_fragment_buffer_p sent_fragments;
 } otrng_conversation_s, otrng_conversation_p[1];
 
+/**
+ * @brief The result of sending or receiving a message, owned by the caller
+ *        and reused between calls.
+ *
+ *  [to_send]     The message to send, or NULL. It points into the result.
+ *  [to_display]  The message to display, or NULL. It points into the result.
+ *  [tlvs]        The received TLVs. They are freed by the next call.
+ *  [should_ignore] Whether the received message should be ignored.
+ *
+ * The buffers are kept and only grow, so once they are large enough no
+ * memory is allocated for them.
+ **/
+typedef struct otrng_client_result_s {
+  const char *to_send;
+  const char *to_display;
+  tlv_list_s *tlvs;
+  otrng_bool should_ignore;
+
+  char *to_send_buffer;
+  size_t to_send_capacity;
+  char *to_display_buffer;
+  size_t to_display_capacity;
+} otrng_client_result_s, otrng_client_result_p[1];
+
 /* A client handle messages from/to a sender to/from multiple recipients. */
 typedef struct otrng_client_s {
   otrng_client_state_s *state;
@@ -63,6 +92,69 @@ API otrng_result otrng_client_send_non_interactive_auth(
     char **newmessage, const prekey_ensemble_s *ensemble, const char *recipient,
     otrng_client_s *client);
 
+/**
+ * @brief As otrng_client_send, but the message is given back as spans over
+ *        buffers owned by the conversation, ready to be written with writev
+ *        or sendmmsg.
+ *
+ * @param [spans]       The encoded message, or each of its fragments.
+ * @param [num_spans]   The number of spans, which is 0 when there is nothing
+ *                      to send.
+ * @param [message]     The message to send.
+ * @param [mms]         The maximum size of a fragment, or 0 not to fragment.
+ * @param [recipient]   The recipient.
+ * @param [client]      The client.
+ *
+ * @warning The spans are only valid until the next call to this function
+ *          for the same recipient.
+ */
+API otrng_result otrng_client_send_spans(const otrng_span_s **spans,
+                                         int *num_spans, const char *message,
+                                         int mms, const char *recipient,
+                                         otrng_client_s *client);
+
+/**
+ * @brief Starts sending a large message to a recipient a part at a time, so
+ *        that neither it nor its encoded form is ever held whole in memory.
+ *
+ * The message is written with otrng_client_send_stream_write, and sent with
+ * otrng_client_send_stream_finish. The encoded message, or each of its
+ * fragments, is given to [emit] as it is ready.
+ *
+ * @param [stream]       The stream, owned by the caller.
+ * @param [message_len]  The length of the message.
+ * @param [mms]          The maximum size of a fragment, or 0 not to
+ *                       fragment.
+ * @param [emit]         Where the output goes.
+ * @param [ctx]          Given to emit.
+ * @param [recipient]    The recipient.
+ * @param [client]       The client.
+ *
+ * @warning No other message can be sent to the recipient until the stream
+ *          is finished or aborted.
+ */
+API otrng_result otrng_client_send_stream_start(
+    otrng_send_stream_s *stream, size_t message_len, int mms,
+    otrng_send_stream_emit_fn emit, void *ctx, const char *recipient,
+    otrng_client_s *client);
+
+/**
+ * @brief Writes the next part of the message. It must not contain a NUL.
+ */
+API otrng_result otrng_client_send_stream_write(otrng_send_stream_s *stream,
+                                                const uint8_t *message,
+                                                size_t len);
+
+/**
+ * @brief Sends what is left of the message, and releases the stream.
+ */
+API otrng_result otrng_client_send_stream_finish(otrng_send_stream_s *stream);
+
+/**
+ * @brief Releases a stream that will not be finished.
+ */
+API void otrng_client_send_stream_abort(otrng_send_stream_s *stream);
+
 API otrng_result otrng_client_send_fragment(
     otrng_message_to_send_s **newmessage, const char *message, int mms,
     const char *recipient, otrng_client_s *client);
@@ -85,9 +177,48 @@ API otrng_result otrng_client_receive(char **newmessage, char **todisplay,
                                       otrng_client_s *client,
                                       otrng_bool *should_ignore);
 
+API void otrng_client_result_init(otrng_client_result_s *result);
+
+API void otrng_client_result_destroy(otrng_client_result_s *result);
+
+/**
+ * @brief As otrng_client_send, but the message is written into [result].
+ **/
+API otrng_result otrng_client_send_into(otrng_client_result_s *result,
+                                        const char *message,
+                                        const char *recipient,
+                                        otrng_client_s *client);
+
+/**
+ * @brief As otrng_client_receive, but what comes of the message is written
+ *        into [result], along with the received TLVs.
+ **/
+API otrng_result otrng_client_receive_into(otrng_client_result_s *result,
+                                           const char *message,
+                                           const char *recipient,
+                                           otrng_client_s *client);
+
 API otrng_result otrng_client_disconnect(char **newmsg, const char *recipient,
                                          otrng_client_s *client);
 
+/**
+ * @brief Takes the OTRv3 messages still waiting to be sent to a recipient.
+ *
+ *  @params
+ *  [batch] An empty batch, that receives the messages, oldest first.
+ *  [recipient] The recipient.
+ *  [client] The otrng client instance.
+ *
+ * @details libotr may produce more than one message while handling a single
+ *          call, but the functions of this client only return the last one.
+ *          The others must be flushed and sent before the next call, which
+ *          drops them.
+ **/
+API otrng_result
+otrng_client_flush_injected_messages(otrng_message_to_send_s *batch,
+                                     const char *recipient,
+                                     otrng_client_s *client);
+
 /* tstatic int otrng_encrypted_conversation_expire(char **newmsg, const char
  * *recipient, */
 /*                                        int expiration_time, */
@@ -97,6 +228,17 @@ API otrng_conversation_s *otrng_client_get_conversation(int force_create,
                                                         const char *recipient,
                                                         otrng_client_s *client);
 
+/**
+ * @brief Prepares, ahead of time, the parts of a DAKE with recipient that do
+ *        not depend on them. See otrng_prepare_dake.
+ *
+ *  @params
+ *  [recipient] The recipient.
+ *  [client] The otrng client instance.
+ **/
+API otrng_result otrng_client_prepare_dake(const char *recipient,
+                                          otrng_client_s *client);
+
 API otrng_bool otrng_conversation_is_encrypted(otrng_conversation_s *conv);
 
 API otrng_bool otrng_conversation_is_finished(otrng_conversation_s *conv);
@@ -120,6 +262,71 @@ API otrng_result otrng_expire_encrypted_session(char **newmsg,
 API otrng_result otrng_client_expire_fragments(int expiration_time,
                                                otrng_client_s *client);
 
+/**
+ * @brief Drops the stored message and MAC keys that are over the limits set
+ *        with otrng_client_state_set_stored_keys_limits.
+ *
+ *  @params
+ *  [client] The otrng client instance.
+ *
+ * @details Meant to be called periodically, as otrng_client_expire_fragments.
+ **/
+API void otrng_client_expire_stored_keys(otrng_client_s *client);
+
+/**
+ * @brief Tells the client that the account or protocol name returned by the
+ *        get_account_and_protocol callback has changed.
+ *
+ *  @params
+ *  [client] The otrng client instance.
+ *
+ * @details The OTRv3 conversations and the instance tag keep the names they
+ *          were given, and ask for them again only after this is called.
+ **/
+API void otrng_client_account_and_protocol_changed(otrng_client_s *client);
+
+/**
+ * @brief Counts the stored message and MAC keys of a conversation.
+ *
+ *  @params
+ *  [stats] The counters.
+ *  [conv] The conversation.
+ **/
+API void
+otrng_conversation_get_stored_keys_stats(otrng_stored_keys_stats_s *stats,
+                                         otrng_conversation_s *conv);
+
+/**
+ * @brief Counts the stored message and MAC keys of every conversation.
+ *
+ *  @params
+ *  [stats] The counters, summed over the conversations.
+ *  [client] The otrng client instance.
+ **/
+API void otrng_client_get_stored_keys_stats(otrng_stored_keys_stats_s *stats,
+                                            otrng_client_s *client);
+
+/**
+ * @brief Counts what the scratch arena of a conversation served while
+ *        handling its messages, and the memory it holds.
+ *
+ *  @params
+ *  [stats] The counters.
+ *  [conv] The conversation.
+ **/
+API void otrng_conversation_get_arena_stats(otrng_arena_stats_s *stats,
+                                            otrng_conversation_s *conv);
+
+/**
+ * @brief Counts what the scratch arenas of every conversation served.
+ *
+ *  @params
+ *  [stats] The counters, summed over the conversations.
+ *  [client] The otrng client instance.
+ **/
+API void otrng_client_get_arena_stats(otrng_arena_stats_s *stats,
+                                      otrng_client_s *client);
+
 API otrng_result otrng_client_get_our_fingerprint(otrng_fingerprint_p fp,
                                                   const otrng_client_s *client);
 
@@ -41,6 +41,7 @@ static client_profile_s *client_profile_init(client_profile_s *profile,
   profile->dsa_key = NULL;
   profile->dsa_key_len = 0;
   profile->transitional_signature = NULL;
+  profile->borrowed = otrng_false;
 
   return profile;
 }
@@ -128,11 +129,15 @@ INTERNAL void otrng_client_profile_destroy(client_profile_s *profile) {
   free(profile->versions);
   profile->versions = NULL;
 
-  free(profile->dsa_key);
-  profile->dsa_key = NULL;
+  if (!profile->borrowed) {
+    free(profile->dsa_key);
+    free(profile->transitional_signature);
+  }
 
-  free(profile->transitional_signature);
+  profile->dsa_key = NULL;
+  profile->dsa_key_len = 0;
   profile->transitional_signature = NULL;
+  profile->borrowed = otrng_false;
 }
 
 INTERNAL void otrng_client_profile_free(client_profile_s *profile) {
@@ -302,13 +307,19 @@ static otrng_result deserialize_dsa_key_field(client_profile_s *target,
     w += read + mpi->len;
   }
 
-  target->dsa_key = malloc(w);
-  if (!target->dsa_key) {
-    return OTRNG_ERROR;
+  if (target->borrowed) {
+    /* points to original buffer without copying */
+    target->dsa_key = (uint8_t *)buffer;
+  } else {
+    target->dsa_key = malloc(w);
+    if (!target->dsa_key) {
+      return OTRNG_ERROR;
+    }
+
+    memcpy(target->dsa_key, buffer, w);
   }
 
   target->dsa_key_len = w;
-  memcpy(target->dsa_key, buffer, w);
 
   if (nread) {
     *nread = w;
@@ -347,15 +358,14 @@ tstatic otrng_result deserialize_field(client_profile_s *target,
     break;
   case 0x04: // Versions
   {
-    uint8_t *versions = NULL;
+    const uint8_t *versions = NULL;
     size_t versions_len = 0;
-    if (!otrng_deserialize_data(&versions, &versions_len, buffer + w,
-                                buflen - w, &read)) {
+    if (!otrng_deserialize_data_no_copy(&versions, &versions_len, buffer + w,
+                                        buflen - w, &read)) {
       return OTRNG_ERROR;
     }
 
-    target->versions = otrng_strndup((char *)versions, versions_len);
-    free(versions);
+    target->versions = otrng_strndup((const char *)versions, versions_len);
   } break;
   case 0x05: // Expiration
     // TODO: Double check if the format is the same
@@ -373,6 +383,17 @@ tstatic otrng_result deserialize_field(client_profile_s *target,
     // ???
     break;
   case 0x08: // Transitional Signature
+    if (target->borrowed) {
+      if (buflen - w < OTRv3_DSA_SIG_BYTES) {
+        return OTRNG_ERROR;
+      }
+
+      /* points to original buffer without copying */
+      target->transitional_signature = (uint8_t *)buffer + w;
+      read = OTRv3_DSA_SIG_BYTES;
+      break;
+    }
+
     target->transitional_signature = malloc(OTRv3_DSA_SIG_BYTES);
     if (!target->transitional_signature) {
       return OTRNG_ERROR;
@@ -400,10 +421,10 @@ tstatic otrng_result deserialize_field(client_profile_s *target,
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_client_profile_deserialize(client_profile_s *target,
-                                                       const uint8_t *buffer,
-                                                       size_t buflen,
-                                                       size_t *nread) {
+tstatic otrng_result client_profile_deserialize(client_profile_s *target,
+                                                const uint8_t *buffer,
+                                                size_t buflen, size_t *nread,
+                                                otrng_bool borrow) {
   size_t read = 0;
   int w = 0;
 
@@ -413,6 +434,7 @@ INTERNAL otrng_result otrng_client_profile_deserialize(client_profile_s *target,
 
   // So if there are fields not present they do not point to invalid memory
   client_profile_init(target, NULL);
+  target->borrowed = borrow;
 
   uint32_t num_fields = 0;
   if (!otrng_deserialize_uint32(&num_fields, buffer + w, buflen - w, &read)) {
@@ -446,6 +468,19 @@ INTERNAL otrng_result otrng_client_profile_deserialize(client_profile_s *target,
   return OTRNG_SUCCESS;
 }
 
+INTERNAL otrng_result otrng_client_profile_deserialize(client_profile_s *target,
+                                                       const uint8_t *buffer,
+                                                       size_t buflen,
+                                                       size_t *nread) {
+  return client_profile_deserialize(target, buffer, buflen, nread, otrng_false);
+}
+
+INTERNAL otrng_result otrng_client_profile_deserialize_no_copy(
+    client_profile_s *target, const uint8_t *buffer, size_t buflen,
+    size_t *nread) {
+  return client_profile_deserialize(target, buffer, buflen, nread, otrng_true);
+}
+
 tstatic otrng_result client_profile_sign(client_profile_s *profile,
                                          const otrng_keypair_s *keypair) {
   uint8_t *body = NULL;
@@ -485,6 +520,24 @@ client_profile_verify_signature(const client_profile_s *profile) {
   return valid;
 }
 
+INTERNAL otrng_result otrng_client_profile_get_serialized(
+    const uint8_t **dst, size_t *dst_len, uint8_t **owned,
+    const client_profile_s *profile, const otrng_serialized_profile_s *ser) {
+  *owned = NULL;
+  if (ser && ser->data) {
+    *dst = ser->data;
+    *dst_len = ser->len;
+    return OTRNG_SUCCESS;
+  }
+
+  if (!otrng_client_profile_asprintf(owned, dst_len, profile)) {
+    return OTRNG_ERROR;
+  }
+
+  *dst = *owned;
+  return OTRNG_SUCCESS;
+}
+
 INTERNAL client_profile_s *
 otrng_client_profile_build(uint32_t instance_tag, const char *versions,
                            const otrng_keypair_s *keypair) {
@@ -27,6 +27,7 @@
 
 #include "keys.h"
 #include "mpi.h"
+#include "serialize.h"
 #include "shared.h"
 #include "str.h"
 
@@ -60,6 +61,10 @@ typedef struct client_profile_s {
   uint8_t *transitional_signature;
 
   eddsa_signature_p signature;
+
+  /* dsa_key and transitional_signature point into the buffer the profile was
+   * deserialized from, and are not freed with it */
+  otrng_bool borrowed;
 } client_profile_s, client_profile_p[1];
 
 INTERNAL void otrng_client_profile_copy(client_profile_s *dst,
@@ -74,9 +79,33 @@ INTERNAL otrng_result otrng_client_profile_deserialize(client_profile_s *target,
                                                        size_t buflen,
                                                        size_t *nread);
 
+/**
+ * @brief As otrng_client_profile_deserialize, but the DSA key and the
+ *        transitional signature are not copied out of buffer, which must
+ *        outlive the profile. Use otrng_client_profile_copy to keep it.
+ */
+INTERNAL otrng_result otrng_client_profile_deserialize_no_copy(
+    client_profile_s *target, const uint8_t *buffer, size_t buflen,
+    size_t *nread);
+
 INTERNAL otrng_result otrng_client_profile_asprintf(
     uint8_t **dst, size_t *nbytes, const client_profile_s *profile);
 
+/**
+ * @brief Get a profile in its serialized form, from ser when it holds it or
+ *        else by serializing the profile.
+ *
+ * @param [dst]       The serialized profile.
+ * @param [dst_len]   Its length.
+ * @param [owned]     Set to the new serialization, to be freed by the
+ *                    caller, or to NULL.
+ * @param [profile]   The profile.
+ * @param [ser]       Optional. The profile, already serialized.
+ */
+INTERNAL otrng_result otrng_client_profile_get_serialized(
+    const uint8_t **dst, size_t *dst_len, uint8_t **owned,
+    const client_profile_s *profile, const otrng_serialized_profile_s *ser);
+
 INTERNAL client_profile_s *
 otrng_client_profile_build(uint32_t instance_tag, const char *versions,
                            const otrng_keypair_s *keypair);
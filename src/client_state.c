@@ -68,12 +68,19 @@ INTERNAL otrng_client_state_s *otrng_client_state_new(const void *client_id) {
   client_state->our_prekeys = NULL;
   client_state->client_profile = NULL;
   client_state->prekey_profile = NULL;
+  otrng_serialized_profile_init(client_state->ser_client_profile);
+  otrng_serialized_profile_init(client_state->ser_prekey_profile);
   client_state->shared_prekey_pair = NULL;
   client_state->max_stored_msg_keys = 1000;
+  client_state->skipped_keys_checkpoint_interval = 0;
+  client_state->stored_keys_max_age = 0;
+  client_state->stored_keys_max_bytes = 0;
+  client_state->stored_keys_client_max_bytes = 0;
   client_state->max_published_prekey_msg = 100;
   client_state->minimum_stored_prekey_msg = 20;
   client_state->should_heartbeat = should_heartbeat;
   client_state->padding = 0;
+  client_state->instance_tag = 0;
 
   return client_state;
 }
@@ -83,6 +90,8 @@ INTERNAL void otrng_client_state_free(otrng_client_state_s *client_state) {
   otrng_list_free(client_state->our_prekeys, stored_prekeys_free_from_list);
   otrng_client_profile_free(client_state->client_profile);
   otrng_prekey_profile_free(client_state->prekey_profile);
+  otrng_serialized_profile_destroy(client_state->ser_client_profile);
+  otrng_serialized_profile_destroy(client_state->ser_prekey_profile);
   otrng_shared_prekey_pair_free(client_state->shared_prekey_pair);
 
   free(client_state);
@@ -197,6 +206,51 @@ API otrng_result otrng_client_state_add_client_profile(
   return OTRNG_SUCCESS;
 }
 
+API otrng_result otrng_client_state_replace_client_profile(
+    otrng_client_state_s *client_state, const client_profile_s *profile) {
+  if (!client_state) {
+    return OTRNG_ERROR;
+  }
+
+  if (profile == client_state->client_profile) {
+    return OTRNG_SUCCESS;
+  }
+
+  otrng_serialized_profile_destroy(client_state->ser_client_profile);
+
+  if (!client_state->client_profile) {
+    return otrng_client_state_add_client_profile(client_state, profile);
+  }
+
+  /* Replaced in place: the prekey client holds on to this profile */
+  otrng_client_profile_destroy(client_state->client_profile);
+  otrng_client_profile_copy(client_state->client_profile, profile);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_serialized_profile_s *
+otrng_client_state_get_serialized_client_profile(
+    otrng_client_state_s *client_state) {
+  otrng_serialized_profile_s *ser = client_state->ser_client_profile;
+  if (ser->data) {
+    return ser;
+  }
+
+  const client_profile_s *profile =
+      otrng_client_state_get_client_profile(client_state);
+  if (!profile) {
+    return NULL;
+  }
+
+  if (!otrng_client_profile_asprintf(&ser->data, &ser->len, profile)) {
+    otrng_serialized_profile_init(ser);
+    return NULL;
+  }
+
+  return ser;
+}
+
 INTERNAL otrng_result otrng_client_state_add_shared_prekey_v4(
     otrng_client_state_s *client_state,
     const uint8_t sym[ED448_PRIVATE_BYTES]) {
@@ -282,6 +336,51 @@ API otrng_result otrng_client_state_add_prekey_profile(
   return OTRNG_SUCCESS;
 }
 
+API otrng_result otrng_client_state_replace_prekey_profile(
+    otrng_client_state_s *client_state, const otrng_prekey_profile_s *profile) {
+  if (!client_state) {
+    return OTRNG_ERROR;
+  }
+
+  if (profile == client_state->prekey_profile) {
+    return OTRNG_SUCCESS;
+  }
+
+  otrng_serialized_profile_destroy(client_state->ser_prekey_profile);
+
+  if (!client_state->prekey_profile) {
+    return otrng_client_state_add_prekey_profile(client_state, profile);
+  }
+
+  /* Replaced in place: the prekey client holds on to this profile */
+  otrng_prekey_profile_destroy(client_state->prekey_profile);
+  otrng_prekey_profile_copy(client_state->prekey_profile, profile);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_serialized_profile_s *
+otrng_client_state_get_serialized_prekey_profile(
+    otrng_client_state_s *client_state) {
+  otrng_serialized_profile_s *ser = client_state->ser_prekey_profile;
+  if (ser->data) {
+    return ser;
+  }
+
+  const otrng_prekey_profile_s *profile =
+      otrng_client_state_get_prekey_profile(client_state);
+  if (!profile) {
+    return NULL;
+  }
+
+  if (!otrng_prekey_profile_asprint(&ser->data, &ser->len, profile)) {
+    otrng_serialized_profile_init(ser);
+    return NULL;
+  }
+
+  return ser;
+}
+
 tstatic OtrlInsTag *otrng_instance_tag_new(const char *protocol,
                                            const char *account,
                                            unsigned int instag) {
@@ -348,15 +447,21 @@ INTERNAL otrng_result otrng_client_state_add_instance_tag(
   }
 
   otrl_userstate_instance_tag_add(client_state->user_state, p);
+  client_state->instance_tag = instag;
+
   return OTRNG_SUCCESS;
 }
 
 INTERNAL unsigned int
-otrng_client_state_get_instance_tag(const otrng_client_state_s *client_state) {
+otrng_client_state_get_instance_tag(otrng_client_state_s *client_state) {
   if (!client_state->user_state) {
     return (unsigned int)0;
   }
 
+  if (client_state->instance_tag) {
+    return client_state->instance_tag;
+  }
+
   // TODO: We could use a "get storage key" callback and use it as
   // account_name plus an arbitrary "libotrng-storage" protocol.
   char *account_name = NULL;
@@ -381,7 +486,14 @@ otrng_client_state_get_instance_tag(const otrng_client_state_s *client_state) {
     return (unsigned int)0;
   }
 
-  return instag->instag;
+  client_state->instance_tag = instag->instag;
+
+  return client_state->instance_tag;
+}
+
+INTERNAL void
+otrng_client_state_forget_instance_tag(otrng_client_state_s *client_state) {
+  client_state->instance_tag = 0;
 }
 
 tstatic list_element_s *get_stored_prekey_node_by_id(uint32_t id,
@@ -410,7 +522,12 @@ INTERNAL void store_my_prekey_message(uint32_t id, uint32_t instance_tag,
     return;
   }
 
-  otrng_stored_prekeys_s *s = malloc(sizeof(otrng_stored_prekeys_s));
+  otrng_stored_prekeys_s *s =
+      otrng_secure_alloc(sizeof(otrng_stored_prekeys_s));
+  if (!s) {
+    return;
+  }
+
   s->id = id;
   s->sender_instance_tag = instance_tag;
 
@@ -421,7 +538,13 @@ INTERNAL void store_my_prekey_message(uint32_t id, uint32_t instance_tag,
   s->our_dh->priv = otrng_dh_mpi_copy(dh_pair->priv);
   s->our_dh->pub = otrng_dh_mpi_copy(dh_pair->pub);
 
-  client_state->our_prekeys = otrng_list_add(s, client_state->our_prekeys);
+  list_element_s *our_prekeys = otrng_list_add(s, client_state->our_prekeys);
+  if (!our_prekeys) {
+    otrng_stored_prekeys_free(s);
+    return;
+  }
+
+  client_state->our_prekeys = our_prekeys;
 }
 
 INTERNAL void
@@ -460,6 +583,19 @@ otrng_client_state_set_max_stored_msg_keys(unsigned int max_stored_msg_keys,
   client_state->max_stored_msg_keys = max_stored_msg_keys;
 }
 
+API void otrng_client_state_set_skipped_keys_checkpoint_interval(
+    unsigned int interval, otrng_client_state_s *client_state) {
+  client_state->skipped_keys_checkpoint_interval = interval;
+}
+
+API void otrng_client_state_set_stored_keys_limits(
+    unsigned int max_age, size_t max_bytes, size_t client_max_bytes,
+    otrng_client_state_s *client_state) {
+  client_state->stored_keys_max_age = max_age;
+  client_state->stored_keys_max_bytes = max_bytes;
+  client_state->stored_keys_client_max_bytes = client_max_bytes;
+}
+
 API void otrng_client_state_set_max_published_prekey_msg(
     unsigned int max_published_prekey_msg, otrng_client_state_s *client_state) {
   client_state->max_published_prekey_msg = max_published_prekey_msg;
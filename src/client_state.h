@@ -24,11 +24,13 @@
 #include <gcrypt.h>
 #include <libotr/userstate.h>
 
+#include "alloc.h"
 #include "client_callbacks.h"
 #include "client_profile.h"
 #include "keys.h"
 #include "list.h"
 #include "prekey_profile.h"
+#include "serialize.h"
 #include "shared.h"
 
 typedef struct {
@@ -54,20 +56,33 @@ typedef struct otrng_client_state_s {
   // TODO: @client One or many?
   client_profile_s *client_profile;
   otrng_prekey_profile_s *prekey_profile;
+  /* The profiles above, serialized. They are built on first use, and
+   * dropped when the profile is replaced. */
+  otrng_serialized_profile_p ser_client_profile;
+  otrng_serialized_profile_p ser_prekey_profile;
   list_element_s *our_prekeys; // otrng_stored_prekeys_s
 
   /* @secret: this should be deleted once the prekey profile expires */
   otrng_shared_prekey_pair_s *shared_prekey_pair;
 
   unsigned int max_stored_msg_keys;
+  unsigned int skipped_keys_checkpoint_interval;
+  /* Limits applied to stored keys by otrng_client_expire_stored_keys. 0
+   * means no limit. */
+  unsigned int stored_keys_max_age;
+  size_t stored_keys_max_bytes;
+  size_t stored_keys_client_max_bytes;
   unsigned int max_published_prekey_msg;
   unsigned int minimum_stored_prekey_msg;
   otrng_bool (*should_heartbeat)(int last_sent);
   size_t padding;
 
+  /* Our instance tag, as found in the v3 user state. 0 until it is first
+   * looked up, and again whenever the instance tags in the user state may
+   * have changed. */
+  uint32_t instance_tag;
+
   // OtrlPrivKey *privkeyv3; // ???
-  // otrng_instag_s *instag; // TODO: @client Store the instance tag here rather
-  // than use v3 User State as a store for instance tags
 } otrng_client_state_s, otrng_client_state_p[1];
 
 // TODO: move
@@ -79,7 +94,7 @@ static inline void otrng_stored_prekeys_free(otrng_stored_prekeys_s *s) {
   otrng_ecdh_keypair_destroy(s->our_ecdh);
   otrng_dh_keypair_destroy(s->our_dh);
 
-  free(s);
+  otrng_secure_free(s, sizeof(otrng_stored_prekeys_s));
 }
 
 static inline void stored_prekeys_free_from_list(void *p) {
@@ -101,7 +116,14 @@ INTERNAL const otrng_stored_prekeys_s *
 get_my_prekeys_by_id(uint32_t id, const otrng_client_state_s *client_state);
 
 INTERNAL unsigned int
-otrng_client_state_get_instance_tag(const otrng_client_state_s *client_state);
+otrng_client_state_get_instance_tag(otrng_client_state_s *client_state);
+
+/**
+ * @brief Forget the cached instance tag, so it is looked up in the user state
+ *        again. To be called after the instance tags there are changed.
+ */
+INTERNAL void
+otrng_client_state_forget_instance_tag(otrng_client_state_s *client_state);
 
 INTERNAL otrng_result otrng_client_state_add_instance_tag(
     otrng_client_state_s *client_state, unsigned int instag);
@@ -122,12 +144,54 @@ otrng_client_state_get_client_profile(otrng_client_state_s *client_state);
 API otrng_result otrng_client_state_add_client_profile(
     otrng_client_state_s *client_state, const client_profile_s *profile);
 
+/**
+ * @brief Replace our client profile, for example when it is about to expire.
+ *
+ * @param [client_state]   The client state.
+ * @param [profile]        The new profile. It is copied over the current
+ *                         one, which the prekey client may hold.
+ */
+API otrng_result otrng_client_state_replace_client_profile(
+    otrng_client_state_s *client_state, const client_profile_s *profile);
+
+/**
+ * @brief Get our client profile in its serialized form.
+ *
+ * @param [client_state]   The client state.
+ *
+ * @return The serialized profile, owned by the client state, or NULL.
+ */
+INTERNAL otrng_serialized_profile_s *
+otrng_client_state_get_serialized_client_profile(
+    otrng_client_state_s *client_state);
+
 API const otrng_prekey_profile_s *
 otrng_client_state_get_prekey_profile(otrng_client_state_s *client_state);
 
 API otrng_result otrng_client_state_add_prekey_profile(
     otrng_client_state_s *client_state, const otrng_prekey_profile_s *profile);
 
+/**
+ * @brief Replace our prekey profile, for example when it is about to expire.
+ *
+ * @param [client_state]   The client state.
+ * @param [profile]        The new profile. It is copied over the current
+ *                         one, which the prekey client may hold.
+ */
+API otrng_result otrng_client_state_replace_prekey_profile(
+    otrng_client_state_s *client_state, const otrng_prekey_profile_s *profile);
+
+/**
+ * @brief Get our prekey profile in its serialized form.
+ *
+ * @param [client_state]   The client state.
+ *
+ * @return The serialized profile, owned by the client state, or NULL.
+ */
+INTERNAL otrng_serialized_profile_s *
+otrng_client_state_get_serialized_prekey_profile(
+    otrng_client_state_s *client_state);
+
 // TODO: @client Read/Write prekey_profiles from/to a file.
 
 INTERNAL OtrlPrivKey *
@@ -150,6 +214,36 @@ API void
 otrng_client_state_set_max_stored_msg_keys(unsigned int max_stored_msg_keys,
                                            otrng_client_state_s *client_state);
 
+/**
+ * @brief Derive skipped message keys only when their message arrives.
+ *
+ * Instead of the keys of every skipped message, one chain key is stored for
+ * every interval skipped messages. 0, the default, stores every key. It
+ * applies to conversations started afterwards.
+ *
+ * @param [interval]       The number of messages covered by a chain key.
+ * @param [client_state]   The client state.
+ */
+API void otrng_client_state_set_skipped_keys_checkpoint_interval(
+    unsigned int interval, otrng_client_state_s *client_state);
+
+/**
+ * @brief Bound the keys kept for late messages and for revealing.
+ *
+ * The limits are enforced when otrng_client_expire_stored_keys runs. Keys
+ * over them are dropped oldest first: late messages that needed them can
+ * not be read, and old MAC keys are not revealed. 0 means no limit, which
+ * is the default.
+ *
+ * @param [max_age]            The age limit, in seconds.
+ * @param [max_bytes]          The memory limit for each conversation.
+ * @param [client_max_bytes]   The memory limit for all conversations.
+ * @param [client_state]       The client state.
+ */
+API void otrng_client_state_set_stored_keys_limits(
+    unsigned int max_age, size_t max_bytes, size_t client_max_bytes,
+    otrng_client_state_s *client_state);
+
 API void otrng_client_state_set_max_published_prekey_msg(
     unsigned int max_published_prekey_msg, otrng_client_state_s *client_state);
 
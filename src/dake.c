@@ -75,18 +75,22 @@ otrng_dake_identity_message_free(dake_identity_message_s *identity_message) {
 
 INTERNAL otrng_result otrng_dake_identity_message_asprintf(
     uint8_t **dst, size_t *nbytes,
-    const dake_identity_message_s *identity_message) {
+    const dake_identity_message_s *identity_message,
+    const otrng_serialized_profile_s *ser_profile) {
   size_t profile_len = 0;
-  uint8_t *profile = NULL;
-  if (!otrng_client_profile_asprintf(&profile, &profile_len,
-                                     identity_message->profile)) {
+  const uint8_t *profile = NULL;
+  uint8_t *owned_profile = NULL;
+  if (!otrng_client_profile_get_serialized(&profile, &profile_len,
+                                           &owned_profile,
+                                           identity_message->profile,
+                                           ser_profile)) {
     return OTRNG_ERROR;
   }
 
   size_t s = IDENTITY_MAX_BYTES + profile_len;
   uint8_t *buff = malloc(s);
   if (!buff) {
-    free(profile);
+    free(owned_profile);
     return OTRNG_ERROR;
   }
 
@@ -100,7 +104,7 @@ INTERNAL otrng_result otrng_dake_identity_message_asprintf(
   cursor += otrng_serialize_bytes_array(cursor, profile, profile_len);
   cursor += otrng_serialize_ec_point(cursor, identity_message->Y);
 
-  free(profile);
+  free(owned_profile);
 
   size_t len = 0;
   if (!otrng_serialize_dh_public_key(cursor, (s - (cursor - buff)), &len,
@@ -123,8 +127,21 @@ INTERNAL otrng_result otrng_dake_identity_message_asprintf(
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_dake_identity_message_deserialize(
-    dake_identity_message_s *dst, const uint8_t *src, size_t src_len) {
+tstatic otrng_result deserialize_profile(client_profile_s *dst,
+                                         const uint8_t *buffer, size_t buflen,
+                                         size_t *nread, otrng_bool borrow) {
+  if (borrow) {
+    return otrng_client_profile_deserialize_no_copy(dst, buffer, buflen,
+                                                    nread);
+  }
+
+  return otrng_client_profile_deserialize(dst, buffer, buflen, nread);
+}
+
+tstatic otrng_result identity_message_deserialize(dake_identity_message_s *dst,
+                                                  const uint8_t *src,
+                                                  size_t src_len,
+                                                  otrng_bool borrow) {
   const uint8_t *cursor = src;
   int64_t len = src_len;
   size_t read = 0;
@@ -169,7 +186,7 @@ INTERNAL otrng_result otrng_dake_identity_message_deserialize(
   cursor += read;
   len -= read;
 
-  if (!otrng_client_profile_deserialize(dst->profile, cursor, len, &read)) {
+  if (!deserialize_profile(dst->profile, cursor, len, &read, borrow)) {
     return OTRNG_ERROR;
   }
 
@@ -186,6 +203,16 @@ INTERNAL otrng_result otrng_dake_identity_message_deserialize(
   return otrng_deserialize_dh_mpi_otr(&dst->B, cursor, len, &read);
 }
 
+INTERNAL otrng_result otrng_dake_identity_message_deserialize(
+    dake_identity_message_s *dst, const uint8_t *src, size_t src_len) {
+  return identity_message_deserialize(dst, src, src_len, otrng_false);
+}
+
+INTERNAL otrng_result otrng_dake_identity_message_deserialize_no_copy(
+    dake_identity_message_s *dst, const uint8_t *src, size_t src_len) {
+  return identity_message_deserialize(dst, src, src_len, otrng_true);
+}
+
 INTERNAL void otrng_dake_auth_r_destroy(dake_auth_r_s *auth_r) {
   otrng_dh_mpi_release(auth_r->A);
   auth_r->A = NULL;
@@ -194,13 +221,17 @@ INTERNAL void otrng_dake_auth_r_destroy(dake_auth_r_s *auth_r) {
   otrng_ring_sig_destroy(auth_r->sigma);
 }
 
-INTERNAL otrng_result otrng_dake_auth_r_asprintf(uint8_t **dst, size_t *nbytes,
-                                                 const dake_auth_r_s *auth_r) {
+INTERNAL otrng_result
+otrng_dake_auth_r_asprintf(uint8_t **dst, size_t *nbytes,
+                           const dake_auth_r_s *auth_r,
+                           const otrng_serialized_profile_s *ser_profile) {
   size_t our_profile_len = 0;
-  uint8_t *our_profile = NULL;
+  const uint8_t *our_profile = NULL;
+  uint8_t *owned_profile = NULL;
 
-  if (!otrng_client_profile_asprintf(&our_profile, &our_profile_len,
-                                     auth_r->profile)) {
+  if (!otrng_client_profile_get_serialized(&our_profile, &our_profile_len,
+                                           &owned_profile, auth_r->profile,
+                                           ser_profile)) {
     return OTRNG_ERROR;
   }
 
@@ -208,7 +239,7 @@ INTERNAL otrng_result otrng_dake_auth_r_asprintf(uint8_t **dst, size_t *nbytes,
 
   uint8_t *buff = malloc(s);
   if (!buff) {
-    free(our_profile);
+    free(owned_profile);
     return OTRNG_ERROR;
   }
 
@@ -220,7 +251,7 @@ INTERNAL otrng_result otrng_dake_auth_r_asprintf(uint8_t **dst, size_t *nbytes,
   cursor += otrng_serialize_bytes_array(cursor, our_profile, our_profile_len);
   cursor += otrng_serialize_ec_point(cursor, auth_r->X);
 
-  free(our_profile);
+  free(owned_profile);
 
   size_t len = 0;
   if (!otrng_serialize_dh_public_key(cursor, (s - (cursor - buff)), &len,
@@ -245,9 +276,9 @@ INTERNAL otrng_result otrng_dake_auth_r_asprintf(uint8_t **dst, size_t *nbytes,
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_dake_auth_r_deserialize(dake_auth_r_s *dst,
-                                                    const uint8_t *buffer,
-                                                    size_t buflen) {
+tstatic otrng_result auth_r_deserialize(dake_auth_r_s *dst,
+                                        const uint8_t *buffer, size_t buflen,
+                                        otrng_bool borrow) {
   const uint8_t *cursor = buffer;
   int64_t len = buflen;
   size_t read = 0;
@@ -292,7 +323,7 @@ INTERNAL otrng_result otrng_dake_auth_r_deserialize(dake_auth_r_s *dst,
   cursor += read;
   len -= read;
 
-  if (!otrng_client_profile_deserialize(dst->profile, cursor, len, &read)) {
+  if (!deserialize_profile(dst->profile, cursor, len, &read, borrow)) {
     return OTRNG_ERROR;
   }
 
@@ -316,6 +347,17 @@ INTERNAL otrng_result otrng_dake_auth_r_deserialize(dake_auth_r_s *dst,
   return otrng_deserialize_ring_sig(dst->sigma, cursor, len, &read);
 }
 
+INTERNAL otrng_result otrng_dake_auth_r_deserialize(dake_auth_r_s *dst,
+                                                    const uint8_t *buffer,
+                                                    size_t buflen) {
+  return auth_r_deserialize(dst, buffer, buflen, otrng_false);
+}
+
+INTERNAL otrng_result otrng_dake_auth_r_deserialize_no_copy(
+    dake_auth_r_s *dst, const uint8_t *buffer, size_t buflen) {
+  return auth_r_deserialize(dst, buffer, buflen, otrng_true);
+}
+
 INTERNAL void otrng_dake_auth_i_destroy(dake_auth_i_s *auth_i) {
   otrng_ring_sig_destroy(auth_i->sigma);
 }
@@ -557,24 +599,27 @@ INTERNAL void otrng_dake_non_interactive_auth_message_destroy(
 
 INTERNAL otrng_result otrng_dake_non_interactive_auth_message_asprintf(
     uint8_t **dst, size_t *nbytes,
-    const dake_non_interactive_auth_message_s *non_interactive_auth) {
+    const dake_non_interactive_auth_message_s *non_interactive_auth,
+    const otrng_serialized_profile_s *ser_profile) {
 
   if (!dst) {
     return OTRNG_ERROR;
   }
 
   size_t our_profile_len = 0;
-  uint8_t *our_profile = NULL;
+  const uint8_t *our_profile = NULL;
+  uint8_t *owned_profile = NULL;
 
-  if (!otrng_client_profile_asprintf(&our_profile, &our_profile_len,
-                                     non_interactive_auth->profile)) {
+  if (!otrng_client_profile_get_serialized(
+          &our_profile, &our_profile_len, &owned_profile,
+          non_interactive_auth->profile, ser_profile)) {
     return OTRNG_ERROR;
   }
 
   size_t s = NON_INT_AUTH_MAX_BYTES + our_profile_len;
   uint8_t *buff = malloc(s);
   if (!buff) {
-    free(our_profile);
+    free(owned_profile);
     return OTRNG_ERROR;
   }
 
@@ -588,7 +633,7 @@ INTERNAL otrng_result otrng_dake_non_interactive_auth_message_asprintf(
   cursor += otrng_serialize_bytes_array(cursor, our_profile, our_profile_len);
   cursor += otrng_serialize_ec_point(cursor, non_interactive_auth->X);
 
-  free(our_profile);
+  free(owned_profile);
 
   size_t len = 0;
   if (!otrng_serialize_dh_public_key(cursor, (s - (cursor - buff)), &len,
@@ -615,9 +660,9 @@ INTERNAL otrng_result otrng_dake_non_interactive_auth_message_asprintf(
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_dake_non_interactive_auth_message_deserialize(
+tstatic otrng_result non_interactive_auth_message_deserialize(
     dake_non_interactive_auth_message_s *dst, const uint8_t *buffer,
-    size_t buflen) {
+    size_t buflen, otrng_bool borrow) {
   const uint8_t *cursor = buffer;
   int64_t len = buflen;
   size_t read = 0;
@@ -662,7 +707,7 @@ INTERNAL otrng_result otrng_dake_non_interactive_auth_message_deserialize(
   cursor += read;
   len -= read;
 
-  if (!otrng_client_profile_deserialize(dst->profile, cursor, len, &read)) {
+  if (!deserialize_profile(dst->profile, cursor, len, &read, borrow)) {
     return OTRNG_ERROR;
   }
 
@@ -700,6 +745,21 @@ INTERNAL otrng_result otrng_dake_non_interactive_auth_message_deserialize(
   return otrng_deserialize_bytes_array(dst->auth_mac, HASH_BYTES, cursor, len);
 }
 
+INTERNAL otrng_result otrng_dake_non_interactive_auth_message_deserialize(
+    dake_non_interactive_auth_message_s *dst, const uint8_t *buffer,
+    size_t buflen) {
+  return non_interactive_auth_message_deserialize(dst, buffer, buflen,
+                                                  otrng_false);
+}
+
+INTERNAL otrng_result
+otrng_dake_non_interactive_auth_message_deserialize_no_copy(
+    dake_non_interactive_auth_message_s *dst, const uint8_t *buffer,
+    size_t buflen) {
+  return non_interactive_auth_message_deserialize(dst, buffer, buflen,
+                                                  otrng_true);
+}
+
 INTERNAL otrng_bool otrng_valid_received_values(
     const uint32_t sender_instance_tag, const ec_point_p their_ecdh,
     const dh_mpi_p their_dh, const client_profile_s *profile) {
@@ -725,17 +785,58 @@ INTERNAL otrng_bool otrng_valid_received_values(
   (3 * HASH_BYTES + 2 * ED448_POINT_BYTES + 2 * DH_MPI_MAX_BYTES +             \
    ED448_SHARED_PREKEY_BYTES)
 
+/* KDF_1(usage || profile, 64) of a participant's profile. Our own is hashed
+ * from its cached serialization */
+tstatic otrng_result
+hash_participant_profile(uint8_t dst[HASH_BYTES], uint8_t usage,
+                         const otrng_dake_participant_data_s *participant) {
+  const otrng_serialized_profile_s *ser = participant->ser_client_profile;
+  if (ser && ser->data) {
+    otrng_serialized_profile_digest(dst, usage,
+                                    participant->ser_client_profile);
+    return OTRNG_SUCCESS;
+  }
+
+  uint8_t *ser_profile = NULL;
+  size_t ser_profile_len = 0;
+  if (!otrng_client_profile_asprintf(&ser_profile, &ser_profile_len,
+                                     participant->client_profile)) {
+    return OTRNG_ERROR;
+  }
+
+  shake_256_kdf1(dst, HASH_BYTES, usage, ser_profile, ser_profile_len);
+  free(ser_profile);
+
+  return OTRNG_SUCCESS;
+}
+
+/* The ephemeral keys of a participant, as written in the tag: the ones it
+ * comes with, or serialized in buff */
+tstatic const ephemeral_pub_ser_s *
+participant_ephemeral(ephemeral_pub_ser_s *buff,
+                      const otrng_dake_participant_data_s *participant) {
+  if (participant->ser_ephemeral) {
+    return participant->ser_ephemeral;
+  }
+
+  otrng_serialize_ec_point(buff->ecdh, &participant->ecdh);
+  if (!otrng_serialize_dh_public_key(buff->dh, sizeof(buff->dh), &buff->dh_len,
+                                     participant->dh)) {
+    return NULL;
+  }
+
+  return buff;
+}
+
 tstatic otrng_result build_rsign_tag(
     uint8_t *dst, size_t dstlen, size_t *written, uint8_t first_usage,
-    const client_profile_s *i_profile, const client_profile_s *r_profile,
-    const ec_point_p i_ecdh, const ec_point_p r_ecdh, const dh_mpi_p i_dh,
-    const dh_mpi_p r_dh, const uint8_t *ser_r_shared_prekey,
-    size_t ser_r_shared_prekey_len, const uint8_t *phi, size_t phi_len) {
-  uint8_t *ser_i_profile = NULL, *ser_r_profile = NULL;
-  size_t ser_i_profile_len, ser_r_profile_len = 0;
-  uint8_t ser_i_ecdh[ED448_POINT_BYTES], ser_r_ecdh[ED448_POINT_BYTES];
-  uint8_t ser_i_dh[DH_MPI_MAX_BYTES], ser_r_dh[DH_MPI_MAX_BYTES];
-  size_t ser_i_dh_len = 0, ser_r_dh_len = 0;
+    const otrng_dake_participant_data_s *initiator,
+    const otrng_dake_participant_data_s *responder,
+    const uint8_t *ser_r_shared_prekey, size_t ser_r_shared_prekey_len,
+    const uint8_t *phi, size_t phi_len) {
+  ephemeral_pub_ser_s i_buff, r_buff;
+  const ephemeral_pub_ser_s *i_ephemeral = NULL, *r_ephemeral = NULL;
+  otrng_result result = OTRNG_ERROR;
 
   uint8_t hash_ser_i_profile[HASH_BYTES];
   uint8_t hash_ser_r_profile[HASH_BYTES];
@@ -745,27 +846,14 @@ tstatic otrng_result build_rsign_tag(
     return OTRNG_ERROR;
   }
 
-  otrng_serialize_ec_point(ser_i_ecdh, i_ecdh);
-  otrng_serialize_ec_point(ser_r_ecdh, r_ecdh);
-
-  if (!otrng_serialize_dh_public_key(ser_i_dh, DH_MPI_MAX_BYTES, &ser_i_dh_len,
-                                     i_dh)) {
-    return OTRNG_ERROR;
-  }
-
-  if (!otrng_serialize_dh_public_key(ser_r_dh, DH_MPI_MAX_BYTES, &ser_r_dh_len,
-                                     r_dh)) {
-    return OTRNG_ERROR;
-  }
-
   do {
-    if (!otrng_client_profile_asprintf(&ser_i_profile, &ser_i_profile_len,
-                                       i_profile)) {
+    i_ephemeral = participant_ephemeral(&i_buff, initiator);
+    if (!i_ephemeral) {
       continue;
     }
 
-    if (!otrng_client_profile_asprintf(&ser_r_profile, &ser_r_profile_len,
-                                       r_profile)) {
+    r_ephemeral = participant_ephemeral(&r_buff, responder);
+    if (!r_ephemeral) {
       continue;
     }
 
@@ -773,10 +861,16 @@ tstatic otrng_result build_rsign_tag(
     uint8_t usage_alice_client_profile = first_usage + 1;
     uint8_t usage_phi = first_usage + 2;
 
-    shake_256_kdf1(hash_ser_i_profile, HASH_BYTES, usage_bob_client_profile,
-                   ser_i_profile, ser_i_profile_len);
-    shake_256_kdf1(hash_ser_r_profile, HASH_BYTES, usage_alice_client_profile,
-                   ser_r_profile, ser_r_profile_len);
+    if (!hash_participant_profile(hash_ser_i_profile,
+                                  usage_bob_client_profile, initiator)) {
+      continue;
+    }
+
+    if (!hash_participant_profile(hash_ser_r_profile,
+                                  usage_alice_client_profile, responder)) {
+      continue;
+    }
+
     shake_256_kdf1(hash_phi, HASH_BYTES, usage_phi, phi, phi_len);
 
     uint8_t *cursor = dst;
@@ -786,17 +880,17 @@ tstatic otrng_result build_rsign_tag(
     memcpy(cursor, hash_ser_r_profile, HASH_BYTES);
     cursor += HASH_BYTES;
 
-    memcpy(cursor, ser_i_ecdh, ED448_POINT_BYTES);
+    memcpy(cursor, i_ephemeral->ecdh, ED448_POINT_BYTES);
     cursor += ED448_POINT_BYTES;
 
-    memcpy(cursor, ser_r_ecdh, ED448_POINT_BYTES);
+    memcpy(cursor, r_ephemeral->ecdh, ED448_POINT_BYTES);
     cursor += ED448_POINT_BYTES;
 
-    memcpy(cursor, ser_i_dh, ser_i_dh_len);
-    cursor += ser_i_dh_len;
+    memcpy(cursor, i_ephemeral->dh, i_ephemeral->dh_len);
+    cursor += i_ephemeral->dh_len;
 
-    memcpy(cursor, ser_r_dh, ser_r_dh_len);
-    cursor += ser_r_dh_len;
+    memcpy(cursor, r_ephemeral->dh, r_ephemeral->dh_len);
+    cursor += r_ephemeral->dh_len;
 
     if (ser_r_shared_prekey) {
       memcpy(cursor, ser_r_shared_prekey, ser_r_shared_prekey_len);
@@ -809,17 +903,14 @@ tstatic otrng_result build_rsign_tag(
     if (written) {
       *written = cursor - dst;
     }
-  } while (0);
 
-  free(ser_i_profile);
-  free(ser_r_profile);
+    result = OTRNG_SUCCESS;
+  } while (0);
 
-  sodium_memzero(ser_i_ecdh, ED448_POINT_BYTES);
-  sodium_memzero(ser_r_ecdh, ED448_POINT_BYTES);
-  sodium_memzero(ser_i_dh, DH3072_MOD_LEN_BYTES);
-  sodium_memzero(ser_r_dh, DH3072_MOD_LEN_BYTES);
+  sodium_memzero(&i_buff, sizeof(ephemeral_pub_ser_s));
+  sodium_memzero(&r_buff, sizeof(ephemeral_pub_ser_s));
 
-  return OTRNG_SUCCESS;
+  return result;
 }
 
 INTERNAL otrng_result build_interactive_rsign_tag(
@@ -840,18 +931,14 @@ INTERNAL otrng_result build_interactive_rsign_tag(
     // t = 0x0 || KDF_1(0x05 || Bobs_Client_Profile, 64) || KDF_1(0x06 ||
     // Alices_Client_Profile, 64) || Y || X || B || A || KDF_1(0x07 || phi, 64)
     *buff = 0x0;
-    result = build_rsign_tag(
-        buff + 1, MAX_T_LENGTH, &written, 0x05, initiator->client_profile,
-        responder->client_profile, &initiator->ecdh, &responder->ecdh,
-        initiator->dh, responder->dh, NULL, 0, phi, phi_len);
+    result = build_rsign_tag(buff + 1, MAX_T_LENGTH, &written, 0x05,
+                             initiator, responder, NULL, 0, phi, phi_len);
   } else if (auth_tag_type == 'i') {
     // t = 0x1 || KDF_1(0x08 || Bobs_Client_Profile, 64) || KDF_1(0x09 ||
     // Alices_Client_Profile, 64) || Y || X || B || A || KDF_1(0x0A || phi, 64)
     *buff = 0x01;
-    result = build_rsign_tag(
-        buff + 1, MAX_T_LENGTH, &written, 0x08, initiator->client_profile,
-        responder->client_profile, &initiator->ecdh, &responder->ecdh,
-        initiator->dh, responder->dh, NULL, 0, phi, phi_len);
+    result = build_rsign_tag(buff + 1, MAX_T_LENGTH, &written, 0x08,
+                             initiator, responder, NULL, 0, phi, phi_len);
   }
 
   if (result == OTRNG_ERROR) {
@@ -884,10 +971,8 @@ build_non_interactive_rsign_tag(uint8_t **msg, size_t *msg_len,
   otrng_serialize_shared_prekey(ser_r_shared_prekey, r_shared_prekey);
 
   otrng_result result = build_rsign_tag(
-      *msg, MAX_T_LENGTH, msg_len, first_usage, initiator->client_profile,
-      responder->client_profile, &initiator->ecdh, &responder->ecdh,
-      initiator->dh, responder->dh, ser_r_shared_prekey,
-      ED448_SHARED_PREKEY_BYTES, phi, phi_len);
+      *msg, MAX_T_LENGTH, msg_len, first_usage, initiator, responder,
+      ser_r_shared_prekey, ED448_SHARED_PREKEY_BYTES, phi, phi_len);
 
   sodium_memzero(ser_r_shared_prekey, ED448_SHARED_PREKEY_BYTES);
 
@@ -28,6 +28,8 @@
 #include "constants.h"
 #include "dh.h"
 #include "ed448.h"
+#include "keys.h"
+#include "serialize.h"
 #include "shared.h"
 
 typedef struct dake_identity_message_s {
@@ -79,9 +81,22 @@ INTERNAL otrng_result otrng_dake_non_interactive_auth_message_deserialize(
     dake_non_interactive_auth_message_s *dst, const uint8_t *buffer,
     size_t buflen);
 
+/*
+ * As otrng_dake_non_interactive_auth_message_deserialize, but the profile
+ * borrows from buffer. See otrng_client_profile_deserialize_no_copy.
+ */
+INTERNAL otrng_result
+otrng_dake_non_interactive_auth_message_deserialize_no_copy(
+    dake_non_interactive_auth_message_s *dst, const uint8_t *buffer,
+    size_t buflen);
+
+/*
+ * @param ser_profile Optional. The profile of the message, already serialized.
+ */
 INTERNAL otrng_result otrng_dake_non_interactive_auth_message_asprintf(
     uint8_t **dst, size_t *nbytes,
-    const dake_non_interactive_auth_message_s *non_interactive_auth);
+    const dake_non_interactive_auth_message_s *non_interactive_auth,
+    const otrng_serialized_profile_s *ser_profile);
 
 INTERNAL void otrng_dake_non_interactive_auth_message_destroy(
     dake_non_interactive_auth_message_s *non_interactive_auth);
@@ -98,18 +113,41 @@ otrng_dake_identity_message_destroy(dake_identity_message_s *identity_message);
 INTERNAL otrng_result otrng_dake_identity_message_deserialize(
     dake_identity_message_s *dst, const uint8_t *src, size_t src_len);
 
+/*
+ * As otrng_dake_identity_message_deserialize, but the profile borrows from
+ * src. See otrng_client_profile_deserialize_no_copy.
+ */
+INTERNAL otrng_result otrng_dake_identity_message_deserialize_no_copy(
+    dake_identity_message_s *dst, const uint8_t *src, size_t src_len);
+
+/*
+ * @param ser_profile Optional. The profile of the message, already serialized.
+ */
 INTERNAL otrng_result otrng_dake_identity_message_asprintf(
     uint8_t **dst, size_t *nbytes,
-    const dake_identity_message_s *identity_message);
+    const dake_identity_message_s *identity_message,
+    const otrng_serialized_profile_s *ser_profile);
 
 INTERNAL void otrng_dake_auth_r_destroy(dake_auth_r_s *auth_r);
 
-INTERNAL otrng_result otrng_dake_auth_r_asprintf(uint8_t **dst, size_t *nbytes,
-                                                 const dake_auth_r_s *auth_r);
+/*
+ * @param ser_profile Optional. The profile of the message, already serialized.
+ */
+INTERNAL otrng_result
+otrng_dake_auth_r_asprintf(uint8_t **dst, size_t *nbytes,
+                           const dake_auth_r_s *auth_r,
+                           const otrng_serialized_profile_s *ser_profile);
 INTERNAL otrng_result otrng_dake_auth_r_deserialize(dake_auth_r_s *dst,
                                                     const uint8_t *buffer,
                                                     size_t buflen);
 
+/*
+ * As otrng_dake_auth_r_deserialize, but the profile borrows from buffer. See
+ * otrng_client_profile_deserialize_no_copy.
+ */
+INTERNAL otrng_result otrng_dake_auth_r_deserialize_no_copy(
+    dake_auth_r_s *dst, const uint8_t *buffer, size_t buflen);
+
 INTERNAL void otrng_dake_auth_i_destroy(dake_auth_i_s *auth_i);
 
 INTERNAL otrng_result otrng_dake_auth_i_asprintf(uint8_t **dst, size_t *nbytes,
@@ -146,6 +184,10 @@ typedef struct {
   const goldilocks_448_point_s ecdh;
   const dh_mpi_p dh;
   const uint16_t instance_tag;
+  /* Optional. The serialized forms of the values above, used instead of
+   * serializing them again */
+  otrng_serialized_profile_s *ser_client_profile;
+  const ephemeral_pub_ser_s *ser_ephemeral;
 } otrng_dake_participant_data_s;
 
 /*
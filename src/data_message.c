@@ -37,13 +37,14 @@ INTERNAL data_message_s *otrng_data_message_new() {
   ret->message_id = 0;
   ret->previous_chain_n = 0;
 
-  ret->dh = NULL;
+  memset(ret->dh, 0, sizeof(ret->dh));
   otrng_ec_bzero(ret->ecdh, ED448_POINT_BYTES);
 
   memset(ret->nonce, 0, sizeof(ret->nonce));
 
   ret->enc_msg = NULL;
   ret->enc_msg_len = 0;
+  ret->enc_msg_borrowed = otrng_false;
 
   memset(ret->mac, 0, sizeof(ret->mac));
 
@@ -54,14 +55,16 @@ tstatic void data_message_destroy(data_message_s *data_msg) {
   data_msg->flags = 0;
 
   otrng_ec_point_destroy(data_msg->ecdh);
-  otrng_dh_mpi_release(data_msg->dh);
-  data_msg->dh = NULL;
+  memset(data_msg->dh, 0, sizeof(data_msg->dh));
 
   sodium_memzero(data_msg->nonce, sizeof data_msg->nonce);
   data_msg->enc_msg_len = 0;
   // TODO: @freeing check if this free is always needed
-  free(data_msg->enc_msg);
+  if (!data_msg->enc_msg_borrowed) {
+    free(data_msg->enc_msg);
+  }
   data_msg->enc_msg = NULL;
+  data_msg->enc_msg_borrowed = otrng_false;
   sodium_memzero(data_msg->mac, sizeof data_msg->mac);
 }
 
@@ -74,14 +77,8 @@ INTERNAL void otrng_data_message_free(data_message_s *data_msg) {
   free(data_msg);
 }
 
-INTERNAL otrng_result otrng_data_message_body_asprintf(
-    uint8_t **body, size_t *bodylen, const data_message_s *data_msg) {
-  size_t s = DATA_MESSAGE_MAX_BYTES + data_msg->enc_msg_len;
-  uint8_t *dst = malloc(s);
-  if (!dst) {
-    return OTRNG_ERROR;
-  }
-
+INTERNAL size_t otrng_data_message_serialize_header(
+    uint8_t *dst, const data_message_s *data_msg) {
   uint8_t *cursor = dst;
   cursor += otrng_serialize_uint16(cursor, OTRNG_PROTOCOL_VERSION_4);
   cursor += otrng_serialize_uint8(cursor, DATA_MSG_TYPE);
@@ -93,16 +90,26 @@ INTERNAL otrng_result otrng_data_message_body_asprintf(
   cursor += otrng_serialize_uint32(cursor, data_msg->message_id);
   cursor += otrng_serialize_ec_point(cursor, data_msg->ecdh);
 
-  // TODO: @freeing @sanitizer This could be NULL. We need to test.
-  size_t len = 0;
-  if (!otrng_serialize_dh_public_key(cursor, (s - (cursor - dst)), &len,
-                                     data_msg->dh)) {
-    free(dst);
-    return OTRNG_ERROR;
-  }
-  cursor += len;
+  /* An absent DH key is serialized as an empty MPI */
+  size_t dh_len = otrng_dh_fixed_len(data_msg->dh);
+  cursor += otrng_serialize_data(
+      cursor, data_msg->dh + DH3072_MOD_LEN_BYTES - dh_len, dh_len);
   cursor += otrng_serialize_bytes_array(cursor, data_msg->nonce,
                                         DATA_MSG_NONCE_BYTES);
+
+  return cursor - dst;
+}
+
+INTERNAL otrng_result otrng_data_message_body_asprintf(
+    uint8_t **body, size_t *bodylen, const data_message_s *data_msg) {
+  size_t s = DATA_MESSAGE_MAX_BYTES + data_msg->enc_msg_len;
+  uint8_t *dst = malloc(s);
+  if (!dst) {
+    return OTRNG_ERROR;
+  }
+
+  uint8_t *cursor = dst;
+  cursor += otrng_data_message_serialize_header(cursor, data_msg);
   cursor +=
       otrng_serialize_data(cursor, data_msg->enc_msg, data_msg->enc_msg_len);
 
@@ -117,10 +124,10 @@ INTERNAL otrng_result otrng_data_message_body_asprintf(
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
-                                                     const uint8_t *buff,
-                                                     size_t bufflen,
-                                                     size_t *nread) {
+tstatic otrng_result data_message_deserialize(data_message_s *dst,
+                                              const uint8_t *buff,
+                                              size_t bufflen, size_t *nread,
+                                              otrng_bool borrow) {
   const uint8_t *cursor = buff;
   int64_t len = bufflen;
   size_t read = 0;
@@ -200,16 +207,24 @@ INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
   cursor += ED448_POINT_BYTES;
   len -= ED448_POINT_BYTES;
 
-  // TODO: @refactoring @sanitizer If the DH key is absent the MPI will have a
-  // zero length, per spec. We need to test what otrng_dh_mpi_deserialize does
-  // when b_mpi->data is NULL.
+  /* If the DH key is absent the MPI will have a zero length, per spec */
+  otrng_mpi_p dh_mpi; // no need to free, because nothing is copied now
+  if (!otrng_mpi_deserialize_no_copy(dh_mpi, cursor, len, &read)) {
+    return OTRNG_ERROR;
+  }
 
-  if (!otrng_deserialize_dh_mpi_otr(&dst->dh, cursor, len, &read)) {
+  if (dh_mpi->len > DH3072_MOD_LEN_BYTES) {
     return OTRNG_ERROR;
   }
 
-  cursor += read;
-  len -= read;
+  memset(dst->dh, 0, sizeof(dst->dh));
+  if (dh_mpi->len) {
+    memcpy(dst->dh + DH3072_MOD_LEN_BYTES - dh_mpi->len, dh_mpi->data,
+           dh_mpi->len);
+  }
+
+  cursor += read + dh_mpi->len;
+  len -= read + dh_mpi->len;
 
   if (!otrng_deserialize_bytes_array(dst->nonce, DATA_MSG_NONCE_BYTES, cursor,
                                      len)) {
@@ -219,8 +234,18 @@ INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
   cursor += DATA_MSG_NONCE_BYTES;
   len -= DATA_MSG_NONCE_BYTES;
 
-  if (!otrng_deserialize_data(&dst->enc_msg, &dst->enc_msg_len, cursor, len,
-                              &read)) {
+  if (borrow) {
+    const uint8_t *enc_msg = NULL;
+    if (!otrng_deserialize_data_no_copy(&enc_msg, &dst->enc_msg_len, cursor,
+                                        len, &read)) {
+      return OTRNG_ERROR;
+    }
+
+    /* points to original buffer without copying */
+    dst->enc_msg = (uint8_t *)enc_msg;
+    dst->enc_msg_borrowed = otrng_true;
+  } else if (!otrng_deserialize_data(&dst->enc_msg, &dst->enc_msg_len, cursor,
+                                     len, &read)) {
     return OTRNG_ERROR;
   }
 
@@ -231,6 +256,20 @@ INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
                                        cursor, len);
 }
 
+INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
+                                                     const uint8_t *buff,
+                                                     size_t bufflen,
+                                                     size_t *nread) {
+  return data_message_deserialize(dst, buff, bufflen, nread, otrng_false);
+}
+
+INTERNAL otrng_result otrng_data_message_deserialize_no_copy(
+    data_message_s *dst, const uint8_t *buff, size_t bufflen, size_t *nread) {
+  return data_message_deserialize(dst, buff, bufflen, nread, otrng_true);
+}
+
+static const uint8_t usage_data_msg_sections = 0x19;
+
 INTERNAL static otrng_result
 otrng_data_message_sections_hash(uint8_t *dst, size_t dstlen,
                                  const uint8_t *body, size_t bodylen) {
@@ -238,13 +277,17 @@ otrng_data_message_sections_hash(uint8_t *dst, size_t dstlen,
     return OTRNG_ERROR;
   }
 
-  static uint8_t usage_data_msg_sections = 0x19;
   // KDF_1(usage_data_msg_sections || data_message_sections, 64)
   shake_256_kdf1(dst, HASH_BYTES, usage_data_msg_sections, body, bodylen);
 
   return OTRNG_SUCCESS;
 }
 
+INTERNAL void
+otrng_data_message_sections_hash_init(goldilocks_shake256_ctx_p hash) {
+  hash_init_with_usage(hash, usage_data_msg_sections);
+}
+
 INTERNAL otrng_result otrng_data_message_authenticator(
     uint8_t *dst, size_t dstlen, const msg_mac_key_p mac_key,
     const uint8_t *body, size_t bodylen) {
@@ -265,8 +308,9 @@ INTERNAL otrng_result otrng_data_message_authenticator(
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_bool otrng_valid_data_message(msg_mac_key_p mac_key,
-                                             const data_message_s *data_msg) {
+tstatic otrng_bool valid_data_message(msg_mac_key_p mac_key,
+                                     const data_message_s *data_msg,
+                                     otrng_bool check_dh) {
   uint8_t *body = NULL;
   size_t bodylen = 0;
 
@@ -292,9 +336,19 @@ INTERNAL otrng_bool otrng_valid_data_message(msg_mac_key_p mac_key,
     return otrng_false;
   }
 
-  if (!data_msg->dh) {
+  if (!check_dh || !otrng_dh_fixed_len(data_msg->dh)) {
     return otrng_true;
   }
 
-  return otrng_dh_mpi_valid(data_msg->dh);
+  return otrng_dh_fixed_valid(data_msg->dh);
+}
+
+INTERNAL otrng_bool otrng_valid_data_message(msg_mac_key_p mac_key,
+                                             const data_message_s *data_msg) {
+  return valid_data_message(mac_key, data_msg, otrng_true);
+}
+
+INTERNAL otrng_bool otrng_valid_data_message_known_dh(
+    msg_mac_key_p mac_key, const data_message_s *data_msg) {
+  return valid_data_message(mac_key, data_msg, otrng_false);
 }
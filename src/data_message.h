@@ -40,10 +40,14 @@ typedef struct data_message_s {
   uint32_t ratchet_id;
   uint32_t message_id;
   ec_point_p ecdh;
-  dh_public_key_p dh;
+  /* Kept in its fixed-width form: it is only parsed into an MPI when a new DH
+   * ratchet needs it */
+  dh_public_key_fixed_p dh;
   uint8_t nonce[DATA_MSG_NONCE_BYTES];
   uint8_t *enc_msg;
   size_t enc_msg_len;
+  /* enc_msg points into the buffer the message was deserialized from */
+  otrng_bool enc_msg_borrowed;
   uint8_t mac[DATA_MSG_MAC_BYTES];
 } data_message_s, data_message_p[1];
 
@@ -51,6 +55,15 @@ INTERNAL data_message_s *otrng_data_message_new(void);
 
 INTERNAL void otrng_data_message_free(data_message_s *data_msg);
 
+/**
+ * @brief Serializes what comes before the encrypted message: everything up
+ *        to the nonce. dst must have room for DATA_MESSAGE_MAX_BYTES bytes.
+ *
+ * @return The number of bytes written.
+ */
+INTERNAL size_t otrng_data_message_serialize_header(
+    uint8_t *dst, const data_message_s *data_msg);
+
 INTERNAL otrng_result otrng_data_message_body_asprintf(
     uint8_t **body, size_t *bodylen, const data_message_s *data_msg);
 
@@ -59,6 +72,19 @@ INTERNAL otrng_result otrng_data_message_deserialize(data_message_s *dst,
                                                      size_t bufflen,
                                                      size_t *nread);
 
+/* As otrng_data_message_deserialize, but the encrypted message is not copied
+ * out of buff, which must outlive the message */
+INTERNAL otrng_result otrng_data_message_deserialize_no_copy(
+    data_message_s *dst, const uint8_t *buff, size_t bufflen, size_t *nread);
+
+/**
+ * @brief Starts the hash of the data message sections, for a message that is
+ *        serialized a piece at a time. The authenticator is computed from
+ *        the 64 bytes it gives with otrng_key_manager_calculate_authenticator.
+ */
+INTERNAL void
+otrng_data_message_sections_hash_init(goldilocks_shake256_ctx_p hash);
+
 INTERNAL otrng_result otrng_data_message_authenticator(
     uint8_t *dst, size_t dstlen, const msg_mac_key_p mac_key,
     const uint8_t *body, size_t bodylen);
@@ -66,8 +92,17 @@ INTERNAL otrng_result otrng_data_message_authenticator(
 INTERNAL otrng_bool otrng_valid_data_message(msg_mac_key_p mac_key,
                                              const data_message_s *data_msg);
 
+/* As otrng_valid_data_message, for a message whose DH key is the one already
+ * validated and held by the key manager */
+INTERNAL otrng_bool otrng_valid_data_message_known_dh(
+    msg_mac_key_p mac_key, const data_message_s *data_msg);
+
 #ifdef OTRNG_DATA_MESSAGE_PRIVATE
 tstatic void data_message_destroy(data_message_s *data_msg);
+
+tstatic otrng_bool valid_data_message(msg_mac_key_p mac_key,
+                                     const data_message_s *data_msg,
+                                     otrng_bool check_dh);
 #endif
 
 #endif
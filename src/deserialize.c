@@ -18,12 +18,12 @@
  *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <libotr/b64.h>
 #include <string.h>
 
 #define OTRNG_DESERIALIZE_PRIVATE
 
 #include "deserialize.h"
+#include "base64.h"
 #include "mpi.h"
 
 INTERNAL otrng_result otrng_deserialize_uint64(uint64_t *n,
@@ -90,9 +90,11 @@ INTERNAL otrng_result otrng_deserialize_uint8(uint8_t *n, const uint8_t *buffer,
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_deserialize_data(uint8_t **dst, size_t *dstlen,
-                                             const uint8_t *buffer,
-                                             size_t buflen, size_t *read) {
+INTERNAL otrng_result otrng_deserialize_data_no_copy(const uint8_t **dst,
+                                                     size_t *dstlen,
+                                                     const uint8_t *buffer,
+                                                     size_t buflen,
+                                                     size_t *read) {
   size_t r = 0;
   uint32_t s = 0;
 
@@ -118,18 +120,41 @@ INTERNAL otrng_result otrng_deserialize_data(uint8_t **dst, size_t *dstlen,
     return OTRNG_ERROR;
   }
 
+  /* points to original buffer without copying */
+  *dst = buffer + r;
+  if (read) {
+    *read += s;
+  }
+
+  if (dstlen) {
+    *dstlen = s;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_deserialize_data(uint8_t **dst, size_t *dstlen,
+                                             const uint8_t *buffer,
+                                             size_t buflen, size_t *read) {
+  const uint8_t *data = NULL;
+  size_t s = 0;
+
+  if (!otrng_deserialize_data_no_copy(&data, &s, buffer, buflen, read)) {
+    return OTRNG_ERROR;
+  }
+
+  if (!s) {
+    return OTRNG_SUCCESS;
+  }
+
   uint8_t *t = malloc(s);
   if (!t) {
     return OTRNG_ERROR;
   }
 
-  memcpy(t, buffer + r, s);
+  memcpy(t, data, s);
 
   *dst = t;
-  if (read) {
-    *read += s;
-  }
-
   if (dstlen) {
     *dstlen = s;
   }
@@ -314,7 +339,7 @@ INTERNAL otrng_result otrng_symmetric_key_deserialize(otrng_keypair_s *pair,
     return OTRNG_ERROR;
   }
 
-  size_t written = otrl_base64_decode(dec, buff, len);
+  size_t written = otrng_base64_decode_into(dec, buff, len);
 
   if (written == ED448_PRIVATE_BYTES) {
     otrng_keypair_generate(pair, dec);
@@ -45,6 +45,16 @@ INTERNAL otrng_result otrng_deserialize_data(uint8_t **dst, size_t *dst_len,
                                              const uint8_t *buffer,
                                              size_t buflen, size_t *read);
 
+/**
+ * @brief As otrng_deserialize_data, but dst points into buffer instead of to
+ *        a copy of the data.
+ */
+INTERNAL otrng_result otrng_deserialize_data_no_copy(const uint8_t **dst,
+                                                     size_t *dstlen,
+                                                     const uint8_t *buffer,
+                                                     size_t buflen,
+                                                     size_t *read);
+
 INTERNAL otrng_result otrng_deserialize_bytes_array(uint8_t *dst, size_t dstlen,
                                                     const uint8_t *buffer,
                                                     size_t buflen);
@@ -19,6 +19,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #define OTRNG_DH_PRIVATE
 
@@ -68,6 +69,7 @@ static const char *DH3072_MODULUS_SQ =
 static gcry_mpi_t DH3072_MODULUS = NULL;
 static gcry_mpi_t DH3072_MODULUS_Q = NULL;
 static gcry_mpi_t DH3072_MODULUS_MINUS_2 = NULL;
+static dh_public_key_fixed_p DH3072_MODULUS_MINUS_2_FIXED;
 static const char *DH3072_GENERATOR_S = "0x02";
 static gcry_mpi_t DH3072_GENERATOR = NULL;
 
@@ -91,6 +93,9 @@ INTERNAL void otrng_dh_init(void) {
 
   DH3072_MODULUS_MINUS_2 = gcry_mpi_new(DH3072_MOD_LEN_BITS);
   gcry_mpi_sub_ui(DH3072_MODULUS_MINUS_2, DH3072_MODULUS, 2);
+
+  otrng_dh_mpi_serialize_fixed(DH3072_MODULUS_MINUS_2_FIXED,
+                               DH3072_MODULUS_MINUS_2);
 }
 
 INTERNAL void otrng_dh_free(void) {
@@ -270,6 +275,72 @@ API otrng_bool otrng_dh_mpi_valid(dh_mpi_p mpi) {
   return otrng_true;
 }
 
+INTERNAL otrng_result otrng_dh_mpi_serialize_fixed(dh_public_key_fixed_p dst,
+                                                   const dh_mpi_p src) {
+  memset(dst, 0, DH3072_MOD_LEN_BYTES);
+
+  if (!src) {
+    return OTRNG_SUCCESS;
+  }
+
+  size_t len = 0;
+  if (gcry_mpi_print(GCRYMPI_FMT_USG, NULL, 0, &len, src)) {
+    return OTRNG_ERROR;
+  }
+
+  if (len > DH3072_MOD_LEN_BYTES) {
+    return OTRNG_ERROR;
+  }
+
+  if (gcry_mpi_print(GCRYMPI_FMT_USG, dst + DH3072_MOD_LEN_BYTES - len, len,
+                     NULL, src)) {
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL size_t otrng_dh_fixed_len(const dh_public_key_fixed_p src) {
+  size_t zeros = 0;
+  while (zeros < DH3072_MOD_LEN_BYTES && src[zeros] == 0) {
+    zeros++;
+  }
+
+  return DH3072_MOD_LEN_BYTES - zeros;
+}
+
+INTERNAL otrng_result otrng_dh_mpi_deserialize_fixed(
+    dh_mpi_p *dst, const dh_public_key_fixed_p src) {
+  size_t len = otrng_dh_fixed_len(src);
+  if (!len) {
+    *dst = NULL;
+    return OTRNG_SUCCESS;
+  }
+
+  if (gcry_mpi_scan(dst, GCRYMPI_FMT_USG, src + DH3072_MOD_LEN_BYTES - len,
+                    len, NULL)) {
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_bool otrng_dh_fixed_valid(const dh_public_key_fixed_p src) {
+  size_t len = otrng_dh_fixed_len(src);
+
+  /* >= 2 */
+  if (len == 0 || (len == 1 && src[DH3072_MOD_LEN_BYTES - 1] < 2)) {
+    return otrng_false;
+  }
+
+  /* <= dh_p - 2: both values are big-endian and have the same width */
+  if (memcmp(src, DH3072_MODULUS_MINUS_2_FIXED, DH3072_MOD_LEN_BYTES) > 0) {
+    return otrng_false;
+  }
+
+  return otrng_true;
+}
+
 INTERNAL dh_mpi_p otrng_dh_mpi_copy(const dh_mpi_p src) {
   return gcry_mpi_copy(src);
 }
@@ -38,6 +38,10 @@ typedef gcry_mpi_t dh_mpi_p;
 typedef dh_mpi_p dh_private_key_p, dh_public_key_p;
 typedef uint8_t dh_shared_secret_p[DH3072_MOD_LEN_BYTES];
 
+/* A DH public key as a big-endian value, left-padded with zeros to the size of
+ * the modulus. An all-zero value stands for an absent key. */
+typedef uint8_t dh_public_key_fixed_p[DH3072_MOD_LEN_BYTES];
+
 typedef struct dh_keypair_s {
   dh_public_key_p pub;
   dh_private_key_p priv;
@@ -79,6 +83,24 @@ INTERNAL otrng_result otrng_dh_mpi_deserialize(dh_mpi_p *dst,
 
 INTERNAL otrng_bool otrng_dh_mpi_valid(dh_mpi_p mpi);
 
+INTERNAL otrng_result otrng_dh_mpi_serialize_fixed(dh_public_key_fixed_p dst,
+                                                   const dh_mpi_p src);
+
+/**
+ * @brief Parses a fixed-width DH public key into an MPI.
+ *
+ * @param [dst] The MPI. It is set to NULL if the key is absent.
+ * @param [src] The fixed-width key.
+ */
+INTERNAL otrng_result otrng_dh_mpi_deserialize_fixed(
+    dh_mpi_p *dst, const dh_public_key_fixed_p src);
+
+/* Number of significant bytes: the length of the key in an OTR MPI */
+INTERNAL size_t otrng_dh_fixed_len(const dh_public_key_fixed_p src);
+
+/* Same range check as otrng_dh_mpi_valid, without creating an MPI */
+INTERNAL otrng_bool otrng_dh_fixed_valid(const dh_public_key_fixed_p src);
+
 INTERNAL dh_mpi_p otrng_dh_mpi_copy(const dh_mpi_p src);
 
 INTERNAL void otrng_dh_mpi_release(dh_mpi_p mpi);
@@ -29,9 +29,6 @@
 #include "fragment.h"
 #include "list.h"
 
-// Example:
-//?OTR|00000000|00000001|00000002,00001,00002,one ,
-#define FRAGMENT_FORMAT "?OTR|%08x|%08x|%08x,%05hu,%05hu,%.*s,"
 #define UNFRAGMENT_FORMAT "?OTR|%08x|%08x|%08x,%05hu,%05hu,%n%*[^,],%n"
 
 API otrng_message_to_send_s *otrng_message_new() {
@@ -66,6 +63,21 @@ tstatic void initialize_fragment_context(fragment_context_s *context) {
   context->last_fragment_received_at = 0;
   context->total_message_len = 0;
   context->fragments = NULL;
+
+  context->buffer = NULL;
+  context->buffer_len = 0;
+  context->buffer_capacity = 0;
+  context->received = NULL;
+  context->next = 0;
+  context->pending = NULL;
+  context->pending_len = NULL;
+  context->received_bytes = 0;
+
+  context->encoded = otrng_false;
+  context->decoded = otrng_false;
+  context->scanned = 0;
+  context->decoded_len = 0;
+  otrng_base64_decoder_init(context->decoder);
 }
 
 tstatic void free_fragments_in_context(fragment_context_s *context) {
@@ -79,8 +91,27 @@ tstatic void free_fragments_in_context(fragment_context_s *context) {
   }
 }
 
+tstatic void free_buffer_in_context(fragment_context_s *context) {
+  free(context->buffer);
+  context->buffer = NULL;
+  free(context->received);
+  context->received = NULL;
+
+  if (context->pending) {
+    for (unsigned int i = 0; i < context->total; i++) {
+      free(context->pending[i]);
+    }
+  }
+
+  free(context->pending);
+  context->pending = NULL;
+  free(context->pending_len);
+  context->pending_len = NULL;
+}
+
 tstatic void reset_fragment_context(fragment_context_s *context) {
   free_fragments_in_context(context);
+  free_buffer_in_context(context);
   initialize_fragment_context(context);
 }
 
@@ -96,6 +127,7 @@ INTERNAL /*@null@*/ fragment_context_s *otrng_fragment_context_new(void) {
 
 INTERNAL void otrng_fragment_context_free(fragment_context_s *context) {
   free_fragments_in_context(context);
+  free_buffer_in_context(context);
   free(context->fragments);
   free(context);
 }
@@ -181,8 +213,96 @@ INTERNAL otrng_result otrng_fragment_message(int max_size,
   return OTRNG_SUCCESS;
 }
 
-tstatic otrng_bool is_fragment(const string_p message) {
-  if (message != NULL && strstr(message, "?OTR|") == message) {
+INTERNAL void otrng_fragment_buffer_init(otrng_fragment_buffer_s *buffer) {
+  buffer->data = NULL;
+  buffer->capacity = 0;
+  buffer->spans = NULL;
+  buffer->spans_capacity = 0;
+}
+
+INTERNAL void otrng_fragment_buffer_destroy(otrng_fragment_buffer_s *buffer) {
+  free(buffer->data);
+  free(buffer->spans);
+  otrng_fragment_buffer_init(buffer);
+}
+
+tstatic otrng_result reserve_fragment_buffer(otrng_fragment_buffer_s *buffer,
+                                             size_t len, int total) {
+  if (len > buffer->capacity) {
+    char *data = realloc(buffer->data, len);
+    if (!data) {
+      return OTRNG_ERROR;
+    }
+
+    buffer->data = data;
+    buffer->capacity = len;
+  }
+
+  if (total > buffer->spans_capacity) {
+    otrng_span_s *spans = realloc(buffer->spans, total * sizeof(otrng_span_s));
+    if (!spans) {
+      return OTRNG_ERROR;
+    }
+
+    buffer->spans = spans;
+    buffer->spans_capacity = total;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_fragment_message_into(
+    otrng_fragment_buffer_s *buffer, int *total, int max_size,
+    uint32_t our_instance, uint32_t their_instance, const string_p message) {
+  if (max_size <= FRAGMENT_HEADER_LEN) {
+    return OTRNG_ERROR;
+  }
+
+  if (!message) {
+    *total = 0;
+    return OTRNG_SUCCESS;
+  }
+
+  size_t message_len = strlen(message);
+  size_t limit = max_size - FRAGMENT_HEADER_LEN;
+  size_t num = message_len ? ((message_len - 1) / limit) + 1 : 1;
+  if (num > 65535) {
+    return OTRNG_ERROR;
+  }
+
+  /* The last snprintf also writes a NUL */
+  size_t len = num * FRAGMENT_HEADER_LEN + message_len + 1;
+  if (otrng_failed(reserve_fragment_buffer(buffer, len, num))) {
+    return OTRNG_ERROR;
+  }
+
+  uint32_t identifier;
+  gcry_randomize(&identifier, sizeof(identifier), GCRY_STRONG_RANDOM);
+
+  char *cursor = buffer->data;
+  for (size_t i = 0; i < num; i++) {
+    size_t piece_len = message_len < limit ? message_len : limit;
+    size_t fragment_len = FRAGMENT_HEADER_LEN + piece_len;
+
+    snprintf(cursor, fragment_len + 1, FRAGMENT_FORMAT, identifier,
+             our_instance, their_instance, (unsigned short)(i + 1),
+             (unsigned short)num, (int)piece_len, message);
+
+    buffer->spans[i].data = cursor;
+    buffer->spans[i].len = fragment_len;
+
+    cursor += fragment_len;
+    message += piece_len;
+    message_len -= piece_len;
+  }
+
+  *total = num;
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_bool otrng_is_fragment(const string_p message) {
+  if (message != NULL && strncmp(message, "?OTR|", 5) == 0) {
     return otrng_true;
   }
 
@@ -233,6 +353,32 @@ tstatic otrng_result copy_fragment_to_context(fragment_context_s *context,
   return OTRNG_SUCCESS;
 }
 
+tstatic fragment_context_s *get_fragment_context(list_element_s **contexts,
+                                                 uint32_t identifier) {
+  for (list_element_s *current = *contexts; current; current = current->next) {
+    fragment_context_s *context = current->data;
+    if (context && context->identifier == identifier) {
+      return context;
+    }
+  }
+
+  fragment_context_s *context = otrng_fragment_context_new();
+  if (!context) {
+    return NULL;
+  }
+
+  context->identifier = identifier;
+
+  list_element_s *added = otrng_list_add(context, *contexts);
+  if (!added) {
+    otrng_fragment_context_free(context);
+    return NULL;
+  }
+
+  *contexts = added;
+  return context;
+}
+
 INTERNAL otrng_result otrng_unfragment_message(char **unfrag_message,
                                                list_element_s **contexts,
                                                const string_p message,
@@ -243,7 +389,7 @@ INTERNAL otrng_result otrng_unfragment_message(char **unfrag_message,
     return OTRNG_ERROR;
   }
 
-  if (!is_fragment(message)) {
+  if (!otrng_is_fragment(message)) {
     *unfrag_message = otrng_strdup(message);
     return OTRNG_SUCCESS;
   }
@@ -263,23 +409,10 @@ INTERNAL otrng_result otrng_unfragment_message(char **unfrag_message,
     return OTRNG_ERROR;
   }
 
-  fragment_context_s *context = NULL;
-  for (list_element_s *current = *contexts; current; current = current->next) {
-    if (!current->data) {
-      continue;
-    }
-
-    fragment_context_s *ctx = current->data;
-    if (ctx->identifier == fragment_identifier) {
-      context = ctx;
-      break;
-    }
-  }
-
+  fragment_context_s *context =
+      get_fragment_context(contexts, fragment_identifier);
   if (!context) {
-    context = otrng_fragment_context_new();
-    context->identifier = fragment_identifier;
-    *contexts = otrng_list_add(context, *contexts);
+    return OTRNG_ERROR;
   }
 
   if (i == 0 || t == 0 || i > t) {
@@ -326,6 +459,252 @@ INTERNAL otrng_result otrng_unfragment_message(char **unfrag_message,
   return OTRNG_SUCCESS;
 }
 
+tstatic otrng_result initialize_received(fragment_context_s *context) {
+  context->received = malloc(context->total);
+  if (!context->received) {
+    return OTRNG_ERROR;
+  }
+
+  memset(context->received, 0, context->total);
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result append_piece(fragment_context_s *context,
+                                  const char *piece, size_t piece_len) {
+  /* And a NUL, if the message is not encoded */
+  size_t needed = context->buffer_len + piece_len + 1;
+
+  if (needed > context->buffer_capacity) {
+    /* Fragments are usually the same size, so the first one tells how long
+     * the message is */
+    size_t capacity = OTRNG_FRAGMENT_MAX_MESSAGE_BYTES + 1;
+    if (context->buffer_capacity) {
+      capacity = 2 * context->buffer_capacity;
+    } else if (piece_len <= OTRNG_FRAGMENT_MAX_MESSAGE_BYTES / context->total) {
+      capacity = context->total * piece_len + 1;
+    }
+
+    if (capacity > OTRNG_FRAGMENT_MAX_MESSAGE_BYTES + 1) {
+      capacity = OTRNG_FRAGMENT_MAX_MESSAGE_BYTES + 1;
+    }
+
+    if (capacity < needed) {
+      capacity = needed;
+    }
+
+    char *buffer = realloc(context->buffer, capacity);
+    if (!buffer) {
+      return OTRNG_ERROR;
+    }
+
+    context->buffer = buffer;
+    context->buffer_capacity = capacity;
+  }
+
+  memcpy(context->buffer + context->buffer_len, piece, piece_len);
+  context->buffer_len += piece_len;
+  context->next++;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result hold_piece(fragment_context_s *context, unsigned short i,
+                                const char *piece, size_t piece_len) {
+  if (!context->pending) {
+    context->pending = malloc(context->total * sizeof(char *));
+    context->pending_len = malloc(context->total * sizeof(size_t));
+    if (!context->pending || !context->pending_len) {
+      free(context->pending);
+      context->pending = NULL;
+      free(context->pending_len);
+      context->pending_len = NULL;
+      return OTRNG_ERROR;
+    }
+
+    memset(context->pending, 0, context->total * sizeof(char *));
+  }
+
+  context->pending[i - 1] = malloc(piece_len + 1);
+  if (!context->pending[i - 1]) {
+    return OTRNG_ERROR;
+  }
+
+  memcpy(context->pending[i - 1], piece, piece_len);
+  context->pending_len[i - 1] = piece_len;
+
+  return OTRNG_SUCCESS;
+}
+
+/* Appends the fragments that were waiting for the ones before them */
+tstatic otrng_result append_pending_pieces(fragment_context_s *context) {
+  while (context->pending && context->next < context->total &&
+         context->pending[context->next]) {
+    unsigned int j = context->next;
+    if (otrng_failed(append_piece(context, context->pending[j],
+                                  context->pending_len[j]))) {
+      return OTRNG_ERROR;
+    }
+
+    free(context->pending[j]);
+    context->pending[j] = NULL;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+/* Decodes, in place, what arrived of the payload since the last time */
+tstatic void decode_received_payload(fragment_context_s *context) {
+  size_t received_len = context->buffer_len;
+
+  if (context->scanned == 0) {
+    if (received_len < 5) {
+      return;
+    }
+
+    context->encoded = memcmp(context->buffer, "?OTR:", 5) == 0;
+    context->scanned = 5;
+  }
+
+  if (!context->encoded || context->decoded) {
+    return;
+  }
+
+  const char *src = context->buffer + context->scanned;
+  size_t len = received_len - context->scanned;
+  const char *end = memchr(src, '.', len);
+  if (end) {
+    len = end - src;
+  }
+
+  /* The output never catches up with the input: it starts 5 characters
+   * behind, and every 4 characters become at most 3 bytes */
+  uint8_t *dst = (uint8_t *)context->buffer + context->decoded_len;
+  context->decoded_len +=
+      otrng_base64_decoder_update(context->decoder, dst, src, len);
+  context->scanned += len;
+
+  if (end) {
+    dst = (uint8_t *)context->buffer + context->decoded_len;
+    context->decoded_len += otrng_base64_decoder_final(context->decoder, dst);
+    context->decoded = otrng_true;
+  }
+}
+
+INTERNAL otrng_result otrng_unfragment_and_decode_message(
+    uint8_t **dst, size_t *dst_len, otrng_bool *encoded,
+    list_element_s **contexts, const string_p message,
+    const int our_instance_tag) {
+  *dst = NULL;
+  *dst_len = 0;
+  *encoded = otrng_false;
+
+  if (!contexts || !otrng_is_fragment(message)) {
+    return OTRNG_ERROR;
+  }
+
+  int start = 0, end = 0;
+  uint32_t fragment_identifier, sender_tag, receiver_tag;
+  uint16_t i, t;
+
+  sscanf(message, UNFRAGMENT_FORMAT, &fragment_identifier, &sender_tag,
+         &receiver_tag, &i, &t, &start, &end);
+
+  if (our_instance_tag != receiver_tag && 0 != receiver_tag) {
+    return OTRNG_SUCCESS;
+  }
+
+  if (end <= start) {
+    return OTRNG_ERROR;
+  }
+
+  fragment_context_s *context =
+      get_fragment_context(contexts, fragment_identifier);
+  if (!context) {
+    return OTRNG_ERROR;
+  }
+
+  if (i == 0 || t == 0 || i > t) {
+    reset_fragment_context(context);
+    return OTRNG_SUCCESS;
+  }
+
+  /* Started by otrng_unfragment_message */
+  if (context->fragments) {
+    return OTRNG_ERROR;
+  }
+
+  if (context->total != 0 && context->total != t) {
+    return OTRNG_ERROR;
+  }
+
+  context->total = t;
+
+  if (context->received == NULL) {
+    if (otrng_failed(initialize_received(context))) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  if (context->received[i - 1]) {
+    return OTRNG_ERROR;
+  }
+
+  const char *piece = message + start;
+  size_t piece_len = end - start - 1;
+
+  if (piece_len > OTRNG_FRAGMENT_MAX_MESSAGE_BYTES - context->received_bytes) {
+    reset_fragment_context(context);
+    return OTRNG_ERROR;
+  }
+
+  if (i - 1 == context->next) {
+    if (otrng_failed(append_piece(context, piece, piece_len)) ||
+        otrng_failed(append_pending_pieces(context))) {
+      return OTRNG_ERROR;
+    }
+  } else if (otrng_failed(hold_piece(context, i, piece, piece_len))) {
+    return OTRNG_ERROR;
+  }
+
+  context->received_bytes += piece_len;
+  context->received[i - 1] = 1;
+  context->count++;
+  context->last_fragment_received_at = time(NULL);
+
+  if (context->buffer) {
+    decode_received_payload(context);
+  }
+
+  if (context->count < t) {
+    return OTRNG_SUCCESS;
+  }
+
+  otrng_result result = OTRNG_SUCCESS;
+
+  /* An encoded message without its terminating '.' */
+  if (context->encoded && !context->decoded) {
+    result = OTRNG_ERROR;
+  } else {
+    *encoded = context->encoded;
+    if (context->encoded) {
+      *dst_len = context->decoded_len;
+    } else {
+      context->buffer[context->buffer_len] = '\0';
+      *dst_len = context->buffer_len;
+    }
+
+    *dst = (uint8_t *)context->buffer;
+    context->buffer = NULL;
+  }
+
+  list_element_s *to_remove = otrng_list_get_by_value(context, *contexts);
+  *contexts = otrng_list_remove_element(to_remove, *contexts);
+  otrng_fragment_context_free(context);
+  otrng_list_free_nodes(to_remove);
+
+  return result;
+}
+
 INTERNAL otrng_result otrng_expire_fragments(time_t now,
                                              uint32_t expiration_time,
                                              list_element_s **contexts) {
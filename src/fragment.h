@@ -21,6 +21,7 @@
 #ifndef OTRNG_FRAGMENT_H
 #define OTRNG_FRAGMENT_H
 
+#include "base64.h"
 #include "error.h"
 #include "list.h"
 #include "shared.h"
@@ -30,17 +31,62 @@
  * index,total,,*/
 #define FRAGMENT_HEADER_LEN 45
 
+// Example:
+//?OTR|00000000|00000001|00000002,00001,00002,one ,
+#define FRAGMENT_FORMAT "?OTR|%08x|%08x|%08x,%05hu,%05hu,%.*s,"
+
+/* The longest message otrng_unfragment_and_decode_message puts back
+ * together. The fragments may have any length, and the message is dropped
+ * as soon as those received add up to more. */
+#define OTRNG_FRAGMENT_MAX_MESSAGE_BYTES (4 * 1024 * 1024)
+
 typedef struct otrng_message_to_send_s {
   string_p *pieces;
   int total;
 } otrng_message_to_send_s, otrng_message_to_send_p[1];
 
+/* A part of a buffer owned by the library */
+typedef struct otrng_span_s {
+  const char *data;
+  size_t len;
+} otrng_span_s;
+
+/* The fragments of a message, written one after the other in a buffer that
+ * is kept between messages. spans[i] is the i-th fragment, without a NUL. */
+typedef struct otrng_fragment_buffer_s {
+  char *data;
+  size_t capacity;
+
+  otrng_span_s *spans;
+  int spans_capacity;
+} otrng_fragment_buffer_s, otrng_fragment_buffer_p[1];
+
 typedef struct fragment_context_s {
   uint32_t identifier;
   unsigned int total, count;
   size_t total_message_len;
   time_t last_fragment_received_at;
   string_p *fragments;
+
+  /* Used by otrng_unfragment_and_decode_message. The fragments are appended
+   * to buffer in order, and the first next of them are there. One that
+   * arrives before the fragments ahead of it waits in pending. As soon as it
+   * is in buffer, the payload of an encoded message is decoded in place, to
+   * the start of buffer. */
+  char *buffer;
+  size_t buffer_len;
+  size_t buffer_capacity;
+  uint8_t *received;
+  unsigned int next;
+  char **pending;
+  size_t *pending_len;
+  size_t received_bytes;
+
+  otrng_bool encoded;
+  otrng_bool decoded;
+  size_t scanned;
+  size_t decoded_len;
+  otrng_base64_decoder_p decoder;
 } fragment_context_s, fragment_context_p[1];
 
 API otrng_message_to_send_s *otrng_message_new(void);
@@ -57,11 +103,49 @@ INTERNAL otrng_result otrng_fragment_message(int max_size,
                                              int their_instance,
                                              const string_p message);
 
+INTERNAL void otrng_fragment_buffer_init(otrng_fragment_buffer_s *buffer);
+
+INTERNAL void otrng_fragment_buffer_destroy(otrng_fragment_buffer_s *buffer);
+
+/**
+ * @brief Fragments a message as otrng_fragment_message does, into [buffer].
+ *
+ * The fragments stay valid until the buffer is used again.
+ *
+ * @param [total]  The number of fragments, which are buffer->spans[0..total).
+ *                 It is 0 when there is no message.
+ */
+INTERNAL otrng_result otrng_fragment_message_into(
+    otrng_fragment_buffer_s *buffer, int *total, int max_size,
+    uint32_t our_instance, uint32_t their_instance, const string_p message);
+
+INTERNAL otrng_bool otrng_is_fragment(const string_p message);
+
 INTERNAL otrng_result otrng_unfragment_message(char **unfrag_message,
                                                list_element_s **contexts,
                                                const string_p message,
                                                const int our_instance_tag);
 
+/**
+ * @brief Reassembles a fragmented message as otrng_unfragment_message does,
+ *        but without keeping each fragment apart: the fragments are copied to
+ *        their place in a buffer sized from their number and length, and an
+ *        encoded message is decoded as its fragments arrive.
+ *
+ * Every fragment of a message but the last must have the same length, as
+ * otrng_fragment_message makes them.
+ *
+ * @param [dst]       NULL until the last fragment arrives. Then the decoded
+ *                    payload of an encoded message, or else the
+ *                    NUL-terminated message. To be freed by the caller.
+ * @param [dst_len]   The length of dst.
+ * @param [encoded]   If the message was an encoded message.
+ */
+INTERNAL otrng_result otrng_unfragment_and_decode_message(
+    uint8_t **dst, size_t *dst_len, otrng_bool *encoded,
+    list_element_s **contexts, const string_p message,
+    const int our_instance_tag);
+
 INTERNAL otrng_result otrng_expire_fragments(time_t now,
                                              uint32_t expiration_time,
                                              list_element_s **contexts);
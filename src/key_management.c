@@ -25,6 +25,7 @@
 
 #define OTRNG_KEY_MANAGEMENT_PRIVATE
 
+#include "alloc.h"
 #include "key_management.h"
 #include "random.h"
 #include "serialize.h"
@@ -62,9 +63,17 @@ INTERNAL void otrng_key_manager_init(key_manager_s *manager) {
   otrng_ec_bzero(manager->our_ecdh->pub, ED448_POINT_BYTES);
   manager->our_dh->pub = NULL;
   manager->our_dh->priv = NULL;
+  otrng_key_manager_our_dh_changed(manager);
+
+  otrng_ec_bzero(manager->next_ecdh->pub, ED448_POINT_BYTES);
+  manager->next_dh->pub = NULL;
+  manager->next_dh->priv = NULL;
+  memset(&manager->next_pub, 0, sizeof(ephemeral_pub_ser_s));
+  manager->next_keys_ready = otrng_false;
 
   otrng_ec_bzero(manager->their_ecdh, ED448_POINT_BYTES);
   manager->their_dh = NULL;
+  otrng_key_manager_their_dh_changed(manager);
 
   otrng_ec_bzero(manager->their_shared_prekey, ED448_POINT_BYTES);
   otrng_ec_bzero(manager->our_shared_prekey, ED448_POINT_BYTES);
@@ -86,10 +95,15 @@ INTERNAL void otrng_key_manager_init(key_manager_s *manager) {
 
   manager->skipped_keys = NULL;
   manager->old_mac_keys = NULL;
+
+  manager->checkpoint_interval = 0;
+  manager->checkpoints = NULL;
+
+  manager->evicted_keys = 0;
 }
 
 INTERNAL key_manager_s *otrng_key_manager_new(void) {
-  key_manager_s *manager = malloc(sizeof(key_manager_s));
+  key_manager_s *manager = otrng_secure_alloc(sizeof(key_manager_s));
   if (!manager) {
     return NULL;
   }
@@ -98,14 +112,30 @@ INTERNAL key_manager_s *otrng_key_manager_new(void) {
   return manager;
 }
 
+tstatic void forget_prepared_keys(key_manager_s *manager) {
+  otrng_ecdh_keypair_destroy(manager->next_ecdh);
+  otrng_dh_keypair_destroy(manager->next_dh);
+  memset(&manager->next_pub, 0, sizeof(ephemeral_pub_ser_s));
+  manager->next_keys_ready = otrng_false;
+}
+
+tstatic void chain_checkpoint_free(void *data) {
+  chain_checkpoint_s *checkpoint = data;
+  sodium_memzero(checkpoint, sizeof(chain_checkpoint_s));
+  otrng_secure_free(checkpoint, sizeof(chain_checkpoint_s));
+}
+
 INTERNAL void otrng_key_manager_destroy(key_manager_s *manager) {
   otrng_ecdh_keypair_destroy(manager->our_ecdh);
   otrng_dh_keypair_destroy(manager->our_dh);
+  otrng_key_manager_our_dh_changed(manager);
+  forget_prepared_keys(manager);
 
   otrng_ec_point_destroy(manager->their_ecdh);
 
   gcry_mpi_release(manager->their_dh);
   manager->their_dh = NULL;
+  otrng_key_manager_their_dh_changed(manager);
 
   manager->i = 0;
   manager->j = 0;
@@ -127,11 +157,14 @@ INTERNAL void otrng_key_manager_destroy(key_manager_s *manager) {
 
   otrng_list_free_full(manager->old_mac_keys);
   manager->old_mac_keys = NULL;
+
+  otrng_list_free(manager->checkpoints, chain_checkpoint_free);
+  manager->checkpoints = NULL;
 }
 
 INTERNAL void otrng_key_manager_free(key_manager_s *manager) {
   otrng_key_manager_destroy(manager);
-  free(manager);
+  otrng_secure_free(manager, sizeof(key_manager_s));
 }
 
 INTERNAL void otrng_key_manager_wipe_shared_prekeys(key_manager_s *manager) {
@@ -142,7 +175,8 @@ INTERNAL void otrng_key_manager_wipe_shared_prekeys(key_manager_s *manager) {
 
 INTERNAL receiving_ratchet_s *
 otrng_receiving_ratchet_new(key_manager_s *manager) {
-  receiving_ratchet_s *ratchet = malloc(sizeof(receiving_ratchet_s));
+  receiving_ratchet_s *ratchet =
+      otrng_secure_alloc(sizeof(receiving_ratchet_s));
   if (!ratchet) {
     return NULL;
   }
@@ -152,6 +186,8 @@ otrng_receiving_ratchet_new(key_manager_s *manager) {
 
   otrng_ec_bzero(ratchet->their_ecdh, ED448_POINT_BYTES);
   ratchet->their_dh = NULL;
+  memset(ratchet->their_dh_fixed, 0, sizeof(dh_public_key_fixed_p));
+  ratchet->their_dh_unchanged = otrng_false;
 
   memset(ratchet->brace_key, 0, sizeof(brace_key_p));
 
@@ -168,6 +204,12 @@ otrng_receiving_ratchet_new(key_manager_s *manager) {
          sizeof(extra_symmetric_key_p));
 
   ratchet->skipped_keys = manager->skipped_keys;
+  ratchet->checkpoints = manager->checkpoints;
+  ratchet->checkpoint_interval = manager->checkpoint_interval;
+  ratchet->used_checkpoint = NULL;
+  memset(ratchet->moved_checkpoint, 0, sizeof(chain_checkpoint_p));
+  ratchet->new_checkpoints = NULL;
+  ratchet->new_skipped_keys = NULL;
 
   return ratchet;
 }
@@ -179,6 +221,7 @@ tstatic void otrng_key_manager_set_their_keys(ec_point_p their_ecdh,
   otrng_ec_point_copy(manager->their_ecdh, their_ecdh);
   otrng_dh_mpi_release(manager->their_dh);
   manager->their_dh = otrng_dh_mpi_copy(their_dh);
+  otrng_key_manager_their_dh_changed(manager);
 }
 
 INTERNAL void otrng_receiving_ratchet_copy(key_manager_s *dst,
@@ -188,7 +231,15 @@ INTERNAL void otrng_receiving_ratchet_copy(key_manager_s *dst,
   }
   otrng_ec_scalar_copy(dst->our_ecdh->priv, src->our_ecdh_priv);
 
-  otrng_key_manager_set_their_keys(src->their_ecdh, src->their_dh, dst);
+  if (src->their_dh_unchanged) {
+    otrng_ec_point_destroy(dst->their_ecdh);
+    otrng_ec_point_copy(dst->their_ecdh, src->their_ecdh);
+  } else {
+    otrng_key_manager_set_their_keys(src->their_ecdh, src->their_dh, dst);
+    memcpy(dst->their_dh_fixed, src->their_dh_fixed,
+           sizeof(dh_public_key_fixed_p));
+    dst->their_dh_cached = otrng_true;
+  }
 
   memcpy(dst->brace_key, src->brace_key, sizeof(brace_key_p));
   memcpy(dst->shared_secret, src->shared_secret, sizeof(shared_secret_p));
@@ -205,6 +256,70 @@ INTERNAL void otrng_receiving_ratchet_copy(key_manager_s *dst,
          sizeof(extra_symmetric_key_p));
 
   dst->skipped_keys = src->skipped_keys;
+  apply_checkpoint_changes(dst, src);
+}
+
+/* Appends the list [tail] to the list [head] */
+tstatic list_element_s *list_join(list_element_s *head, list_element_s *tail) {
+  list_element_s *last = otrng_list_get_last(head);
+  if (!last) {
+    return tail;
+  }
+
+  last->next = tail;
+  return head;
+}
+
+tstatic time_t skipped_keys_stored_at(const void *data) {
+  return ((const skipped_keys_s *)data)->stored_at;
+}
+
+/* Merges two lists that are each in the order their entries were stored */
+tstatic list_element_s *merge_by_age(list_element_s *one, list_element_s *two,
+                                     time_t (*stored_at)(const void *data)) {
+  list_element_s *head = NULL;
+  list_element_s **tail = &head;
+
+  while (one && two) {
+    list_element_s **older =
+        stored_at(two->data) < stored_at(one->data) ? &two : &one;
+    *tail = *older;
+    tail = &(*older)->next;
+    *older = (*older)->next;
+  }
+
+  *tail = one ? one : two;
+  return head;
+}
+
+tstatic void apply_checkpoint_changes(key_manager_s *manager,
+                                      receiving_ratchet_s *ratchet) {
+  if (ratchet->used_checkpoint) {
+    list_element_s *used = otrng_list_get_by_value(ratchet->used_checkpoint,
+                                                   manager->checkpoints);
+    chain_checkpoint_s *moved = ratchet->moved_checkpoint;
+
+    if (used && moved->j == moved->until) {
+      manager->checkpoints =
+          otrng_list_remove_element(used, manager->checkpoints);
+      otrng_list_free(used, chain_checkpoint_free);
+    } else if (used) {
+      memcpy(used->data, moved, sizeof(chain_checkpoint_s));
+    }
+
+    ratchet->used_checkpoint = NULL;
+    sodium_memzero(moved, sizeof(chain_checkpoint_s));
+  }
+
+  manager->checkpoints =
+      list_join(manager->checkpoints, ratchet->new_checkpoints);
+  ratchet->new_checkpoints = NULL;
+
+  /* Keys derived from a checkpoint carry its time, which may be older than
+   * the last stored keys */
+  manager->skipped_keys = merge_by_age(
+      manager->skipped_keys, ratchet->new_skipped_keys, skipped_keys_stored_at);
+  ratchet->new_skipped_keys = NULL;
 }
 
 INTERNAL void otrng_receiving_ratchet_destroy(receiving_ratchet_s *ratchet) {
@@ -232,18 +347,43 @@ INTERNAL void otrng_receiving_ratchet_destroy(receiving_ratchet_s *ratchet) {
   sodium_memzero(ratchet->extra_symmetric_key, sizeof(extra_symmetric_key_p));
 
   ratchet->skipped_keys = NULL;
+  ratchet->checkpoints = NULL;
 
-  free(ratchet);
+  /* What was not applied belongs to a message that was not authenticated */
+  ratchet->used_checkpoint = NULL;
+  otrng_list_free(ratchet->new_checkpoints, chain_checkpoint_free);
+  ratchet->new_checkpoints = NULL;
+  otrng_list_free_full(ratchet->new_skipped_keys);
+  ratchet->new_skipped_keys = NULL;
+
+  otrng_secure_free(ratchet, sizeof(receiving_ratchet_s));
   ratchet = NULL;
 }
 
-INTERNAL void otrng_key_manager_set_their_tmp_keys(
-    ec_point_p their_ecdh, dh_public_key_p their_dh,
-    receiving_ratchet_s *tmp_receiving_ratchet) {
+INTERNAL otrng_result otrng_key_manager_set_their_tmp_keys(
+    ec_point_p their_ecdh, const dh_public_key_fixed_p their_dh,
+    key_manager_s *manager, receiving_ratchet_s *tmp_receiving_ratchet) {
   otrng_ec_point_destroy(tmp_receiving_ratchet->their_ecdh);
   otrng_ec_point_copy(tmp_receiving_ratchet->their_ecdh, their_ecdh);
   otrng_dh_mpi_release(tmp_receiving_ratchet->their_dh);
-  tmp_receiving_ratchet->their_dh = otrng_dh_mpi_copy(their_dh);
+  tmp_receiving_ratchet->their_dh = NULL;
+
+  memcpy(tmp_receiving_ratchet->their_dh_fixed, their_dh,
+         sizeof(dh_public_key_fixed_p));
+
+  /* Their DH key only changes every third ratchet: most messages carry the
+   * one we already hold */
+  if (manager->their_dh_cached &&
+      memcmp(manager->their_dh_fixed, their_dh,
+             sizeof(dh_public_key_fixed_p)) == 0) {
+    tmp_receiving_ratchet->their_dh_unchanged = otrng_true;
+    return OTRNG_SUCCESS;
+  }
+
+  tmp_receiving_ratchet->their_dh_unchanged = otrng_false;
+
+  return otrng_dh_mpi_deserialize_fixed(&tmp_receiving_ratchet->their_dh,
+                                        their_dh);
 }
 
 INTERNAL void otrng_key_manager_set_their_ecdh(const ec_point_p their_ecdh,
@@ -255,6 +395,26 @@ INTERNAL void otrng_key_manager_set_their_dh(const dh_public_key_p their_dh,
                                              key_manager_s *manager) {
   otrng_dh_mpi_release(manager->their_dh);
   manager->their_dh = otrng_dh_mpi_copy(their_dh);
+  otrng_key_manager_their_dh_changed(manager);
+}
+
+/* Moves the prepared keys in place of our current ones */
+tstatic void use_prepared_keys(key_manager_s *manager) {
+  otrng_ecdh_keypair_destroy(manager->our_ecdh);
+  otrng_dh_keypair_destroy(manager->our_dh);
+  otrng_key_manager_our_dh_changed(manager);
+
+  memcpy(manager->our_ecdh, manager->next_ecdh, sizeof(ecdh_keypair_s));
+  manager->our_dh->pub = manager->next_dh->pub;
+  manager->our_dh->priv = manager->next_dh->priv;
+  memcpy(&manager->our_pub, &manager->next_pub, sizeof(ephemeral_pub_ser_s));
+  manager->our_pub_cached = otrng_true;
+
+  sodium_memzero(manager->next_ecdh, sizeof(ecdh_keypair_s));
+  manager->next_dh->pub = NULL;
+  manager->next_dh->priv = NULL;
+  memset(&manager->next_pub, 0, sizeof(ephemeral_pub_ser_s));
+  manager->next_keys_ready = otrng_false;
 }
 
 INTERNAL otrng_result
@@ -262,10 +422,11 @@ otrng_key_manager_generate_ephemeral_keys(key_manager_s *manager) {
   time_t now;
   uint8_t sym[ED448_PRIVATE_BYTES];
 
+  now = time(NULL);
   random_bytes(sym, ED448_PRIVATE_BYTES);
 
-  now = time(NULL);
   otrng_ecdh_keypair_destroy(manager->our_ecdh);
+  manager->our_pub_cached = otrng_false;
   /* @secret the ecdh keypair will last
      1. for the first generation: until the ratchet is initialized
      2. when receiving a new dh ratchet
@@ -277,6 +438,7 @@ otrng_key_manager_generate_ephemeral_keys(key_manager_s *manager) {
 
   if (manager->i % 3 == 0) {
     otrng_dh_keypair_destroy(manager->our_dh);
+    otrng_key_manager_our_dh_changed(manager);
 
     /* @secret the dh keypair will last
        1. for the first generation: until the ratchet is initialized
@@ -290,6 +452,120 @@ otrng_key_manager_generate_ephemeral_keys(key_manager_s *manager) {
   return OTRNG_SUCCESS;
 }
 
+INTERNAL otrng_result
+otrng_key_manager_generate_dake_keys(key_manager_s *manager) {
+  if (!manager->next_keys_ready) {
+    return otrng_key_manager_generate_ephemeral_keys(manager);
+  }
+
+  use_prepared_keys(manager);
+  manager->last_generated = time(NULL);
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result
+otrng_key_manager_prepare_ephemeral_keys(key_manager_s *manager) {
+  if (manager->next_keys_ready) {
+    return OTRNG_SUCCESS;
+  }
+
+  /* @secret the prepared keys last until they are used, or the key manager
+     is destroyed */
+  if (!otrng_generate_ephemeral_keys(manager->next_ecdh, manager->next_dh) ||
+      !otrng_ephemeral_pub_serialize(&manager->next_pub, manager->next_ecdh,
+                                     manager->next_dh)) {
+    forget_prepared_keys(manager);
+    return OTRNG_ERROR;
+  }
+
+  manager->next_keys_ready = otrng_true;
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL const ephemeral_pub_ser_s *
+otrng_key_manager_get_our_pub(const key_manager_s *manager) {
+  if (!manager->our_pub_cached) {
+    return NULL;
+  }
+
+  return &manager->our_pub;
+}
+
+INTERNAL const uint8_t *
+otrng_key_manager_get_our_dh_fixed(key_manager_s *manager) {
+  if (!manager->our_dh_pub_cached) {
+    if (!otrng_dh_mpi_serialize_fixed(manager->our_dh_pub_fixed,
+                                      manager->our_dh->pub)) {
+      return NULL;
+    }
+
+    manager->our_dh_pub_cached = otrng_true;
+  }
+
+  return manager->our_dh_pub_fixed;
+}
+
+tstatic void forget_dh_shared_secret(key_manager_s *manager) {
+  sodium_memzero(manager->k_dh, sizeof(manager->k_dh));
+  manager->k_dh_len = 0;
+  memset(manager->k_dh_their, 0, sizeof(manager->k_dh_their));
+  manager->k_dh_cached = otrng_false;
+}
+
+INTERNAL void otrng_key_manager_our_dh_changed(key_manager_s *manager) {
+  memset(manager->our_dh_pub_fixed, 0, sizeof(manager->our_dh_pub_fixed));
+  manager->our_dh_pub_cached = otrng_false;
+  memset(&manager->our_pub, 0, sizeof(ephemeral_pub_ser_s));
+  manager->our_pub_cached = otrng_false;
+  forget_dh_shared_secret(manager);
+}
+
+INTERNAL void otrng_key_manager_their_dh_changed(key_manager_s *manager) {
+  memset(manager->their_dh_fixed, 0, sizeof(manager->their_dh_fixed));
+  manager->their_dh_cached = otrng_false;
+  forget_dh_shared_secret(manager);
+}
+
+/* Computes the DH shared secret between our_dh and their_dh, reusing the
+ * last one when their_dh has not changed */
+tstatic otrng_result dh_shared_secret_memoized(
+    dh_shared_secret_p k_dh, size_t *k_dh_len, key_manager_s *manager,
+    const dh_public_key_p their_dh,
+    const dh_public_key_fixed_p their_dh_fixed) {
+  if (manager->k_dh_cached &&
+      memcmp(manager->k_dh_their, their_dh_fixed,
+             sizeof(dh_public_key_fixed_p)) == 0) {
+    memcpy(k_dh, manager->k_dh, manager->k_dh_len);
+    *k_dh_len = manager->k_dh_len;
+    return OTRNG_SUCCESS;
+  }
+
+  if (!otrng_dh_shared_secret(k_dh, k_dh_len, manager->our_dh->priv,
+                              their_dh)) {
+    return OTRNG_ERROR;
+  }
+
+  memcpy(manager->k_dh, k_dh, *k_dh_len);
+  manager->k_dh_len = *k_dh_len;
+  memcpy(manager->k_dh_their, their_dh_fixed, sizeof(dh_public_key_fixed_p));
+  manager->k_dh_cached = otrng_true;
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic const uint8_t *get_their_dh_fixed(key_manager_s *manager) {
+  if (!manager->their_dh_cached) {
+    if (!otrng_dh_mpi_serialize_fixed(manager->their_dh_fixed,
+                                      manager->their_dh)) {
+      return NULL;
+    }
+
+    manager->their_dh_cached = otrng_true;
+  }
+
+  return manager->their_dh_fixed;
+}
+
 INTERNAL void otrng_key_manager_calculate_tmp_key(uint8_t *tmp_key,
                                                   k_ecdh_p k_ecdh,
                                                   brace_key_p brace_key,
@@ -357,6 +633,7 @@ tstatic otrng_result generate_first_ephemeral_keys(key_manager_s *manager,
     goldilocks_bzero(random_buff, ED448_PRIVATE_BYTES);
 
     otrng_dh_keypair_destroy(manager->our_dh);
+    otrng_key_manager_our_dh_changed(manager);
     /* @secret this will be deleted once sent a new data message in a new
      * ratchet */
     if (!otrng_dh_keypair_generate_from_shared_secret(
@@ -386,6 +663,7 @@ tstatic otrng_result generate_first_ephemeral_keys(key_manager_s *manager,
     }
 
     manager->their_dh = tmp_their_dh->pub;
+    otrng_key_manager_their_dh_changed(manager);
   }
   return OTRNG_SUCCESS;
 }
@@ -402,8 +680,10 @@ tstatic otrng_result calculate_brace_key(
   assert(action == 's' || action == 'r');
   if (action == 's') {
     if (manager->i % 3 == 0) {
-      if (!otrng_dh_shared_secret(k_dh, &k_dh_len, manager->our_dh->priv,
-                                  manager->their_dh)) {
+      const uint8_t *their_dh_fixed = get_their_dh_fixed(manager);
+      if (!their_dh_fixed ||
+          !dh_shared_secret_memoized(k_dh, &k_dh_len, manager,
+                                     manager->their_dh, their_dh_fixed)) {
         return OTRNG_ERROR;
       }
       shake_256_kdf1(manager->brace_key, BRACE_KEY_BYTES, usage_third_brace_key,
@@ -415,8 +695,13 @@ tstatic otrng_result calculate_brace_key(
   } else if (action == 'r') {
     if (manager->i % 3 == 0) {
       // TODO: should take tmp too
-      if (!otrng_dh_shared_secret(k_dh, &k_dh_len, manager->our_dh->priv,
-                                  tmp_receiving_ratchet->their_dh)) {
+      dh_public_key_p their_dh = tmp_receiving_ratchet->their_dh;
+      if (tmp_receiving_ratchet->their_dh_unchanged) {
+        their_dh = manager->their_dh;
+      }
+
+      if (!dh_shared_secret_memoized(k_dh, &k_dh_len, manager, their_dh,
+                                     tmp_receiving_ratchet->their_dh_fixed)) {
         return OTRNG_ERROR;
       }
       shake_256_kdf1(tmp_receiving_ratchet->brace_key, BRACE_KEY_BYTES,
@@ -475,6 +760,7 @@ INTERNAL otrng_result otrng_key_manager_generate_shared_secret(
     }
 
     otrng_dh_priv_key_destroy(manager->our_dh);
+    forget_dh_shared_secret(manager);
 
     calculate_shared_secret(manager, NULL, k_ecdh, 's');
 
@@ -620,6 +906,7 @@ tstatic otrng_result rotate_keys(key_manager_s *manager,
     // TODO: this should destroy the tmp data
     if (tmp_receiving_ratchet->i % 3 == 0) {
       otrng_dh_priv_key_destroy(manager->our_dh);
+      forget_dh_shared_secret(manager);
     }
 
     tmp_receiving_ratchet->pn = tmp_receiving_ratchet->j;
@@ -787,6 +1074,191 @@ tstatic void calculate_extra_key(key_manager_s *manager,
 //  manager->skipped_keys = NULL;
 //}
 
+tstatic void chain_kdf_init(chain_kdf_s *kdf) {
+  uint8_t magic[1] = {0xFF};
+
+  hash_init_with_usage(kdf->enc, usage_message_key);
+
+  hash_init_with_usage(kdf->extra, usage_extra_symm_key);
+  hash_update(kdf->extra, magic, 1);
+
+  hash_init_with_usage(kdf->next, usage_next_chain_key);
+}
+
+tstatic void chain_kdf_destroy(chain_kdf_s *kdf) {
+  hash_destroy(kdf->enc);
+  hash_destroy(kdf->extra);
+  hash_destroy(kdf->next);
+}
+
+tstatic void chain_kdf_step(msg_enc_key_p enc_key,
+                            extra_symmetric_key_p extra_key,
+                            receiving_chain_key_p chain_key,
+                            const chain_kdf_s *kdf) {
+  goldilocks_shake256_ctx_p hd;
+
+  /* MKenc = KDF_1(usage_message_key || chain_key, 32) */
+  memcpy(hd, kdf->enc, sizeof(goldilocks_shake256_ctx_p));
+  hash_update(hd, chain_key, sizeof(receiving_chain_key_p));
+  hash_final(hd, enc_key, sizeof(msg_enc_key_p));
+
+  /* extra_symm_key = KDF_1(usage_extra_symm_key || 0xFF || chain_key, 32) */
+  memcpy(hd, kdf->extra, sizeof(goldilocks_shake256_ctx_p));
+  hash_update(hd, chain_key, sizeof(receiving_chain_key_p));
+  hash_final(hd, extra_key, sizeof(extra_symmetric_key_p));
+
+  hash_destroy(hd);
+
+  chain_kdf_next(chain_key, kdf);
+}
+
+tstatic void chain_kdf_next(receiving_chain_key_p chain_key,
+                            const chain_kdf_s *kdf) {
+  goldilocks_shake256_ctx_p hd;
+
+  /* chain_key = KDF_1(usage_next_chain_key || chain_key, 64) */
+  memcpy(hd, kdf->next, sizeof(goldilocks_shake256_ctx_p));
+  hash_update(hd, chain_key, sizeof(receiving_chain_key_p));
+  hash_final(hd, chain_key, sizeof(receiving_chain_key_p));
+
+  hash_destroy(hd);
+}
+
+/* Keeps one chain key for every checkpoint_interval messages up to until,
+ * instead of the keys of every message. Only the chain itself is stepped. */
+tstatic otrng_result
+store_chain_checkpoints(receiving_ratchet_s *tmp_receiving_ratchet,
+                        unsigned int ratchet_id, const int until) {
+  chain_kdf_s kdf[1];
+  chain_kdf_init(kdf);
+  time_t now = time(NULL);
+
+  while (tmp_receiving_ratchet->k < until) {
+    chain_checkpoint_s *checkpoint =
+        otrng_secure_alloc(sizeof(chain_checkpoint_s));
+    if (!checkpoint) {
+      chain_kdf_destroy(kdf);
+      return OTRNG_ERROR;
+    }
+
+    checkpoint->i = ratchet_id;
+    checkpoint->j = tmp_receiving_ratchet->k;
+    checkpoint->until =
+        tmp_receiving_ratchet->k + tmp_receiving_ratchet->checkpoint_interval;
+    if (checkpoint->until > until) {
+      checkpoint->until = until;
+    }
+
+    memcpy(checkpoint->chain_key, tmp_receiving_ratchet->chain_r,
+           sizeof(receiving_chain_key_p));
+    checkpoint->stored_at = now;
+
+    /*
+       @secret: should be deleted when:
+       1. session expired
+       2. every key it covers is retrieved
+    */
+    list_element_s *checkpoints =
+        otrng_list_add(checkpoint, tmp_receiving_ratchet->new_checkpoints);
+    if (!checkpoints) {
+      chain_checkpoint_free(checkpoint);
+      chain_kdf_destroy(kdf);
+      return OTRNG_ERROR;
+    }
+    tmp_receiving_ratchet->new_checkpoints = checkpoints;
+
+    while (tmp_receiving_ratchet->k < checkpoint->until) {
+      chain_kdf_next(tmp_receiving_ratchet->chain_r, kdf);
+      tmp_receiving_ratchet->k++;
+    }
+  }
+
+  chain_kdf_destroy(kdf);
+  return OTRNG_SUCCESS;
+}
+
+/* Moves a checkpoint one message forward, keeping the keys of that message
+ * as skipped keys */
+tstatic otrng_result checkpoint_to_skipped_keys(list_element_s **skipped_keys,
+                                                chain_checkpoint_s *checkpoint,
+                                                const chain_kdf_s *kdf) {
+  skipped_keys_s *skipped = malloc(sizeof(skipped_keys_s));
+  if (!skipped) {
+    return OTRNG_ERROR;
+  }
+
+  skipped->i = checkpoint->i;
+  skipped->j = checkpoint->j;
+  skipped->stored_at = checkpoint->stored_at;
+  chain_kdf_step(skipped->enc_key, skipped->extra_symmetric_key,
+                 checkpoint->chain_key, kdf);
+
+  list_element_s *added = otrng_list_add(skipped, *skipped_keys);
+  if (!added) {
+    sodium_memzero(skipped, sizeof(skipped_keys_s));
+    free(skipped);
+    return OTRNG_ERROR;
+  }
+
+  *skipped_keys = added;
+  checkpoint->j++;
+
+  return OTRNG_SUCCESS;
+}
+
+/* Derives the keys of a skipped message from the checkpoint covering it.
+ * The checkpoint then moves past it, so that those keys cannot be derived
+ * again: the keys of the messages it passes over are kept as skipped keys.
+ * Only a copy of the checkpoint is moved, until the message is
+ * authenticated. */
+tstatic otrng_result
+get_keys_from_checkpoint(msg_enc_key_p enc_key, int ratchet_id,
+                         int message_id,
+                         receiving_ratchet_s *tmp_receiving_ratchet) {
+  if (tmp_receiving_ratchet->used_checkpoint || message_id < 0) {
+    return OTRNG_ERROR;
+  }
+
+  list_element_s *current = tmp_receiving_ratchet->checkpoints;
+  chain_checkpoint_s *found = NULL;
+  for (; current; current = current->next) {
+    chain_checkpoint_s *candidate = current->data;
+    if (candidate->i == ratchet_id && candidate->j <= message_id &&
+        message_id < candidate->until) {
+      found = candidate;
+      break;
+    }
+  }
+
+  if (!found) {
+    return OTRNG_ERROR;
+  }
+
+  chain_checkpoint_s *checkpoint = tmp_receiving_ratchet->moved_checkpoint;
+  memcpy(checkpoint, found, sizeof(chain_checkpoint_s));
+
+  chain_kdf_s kdf[1];
+  chain_kdf_init(kdf);
+
+  while (checkpoint->j < message_id) {
+    if (!checkpoint_to_skipped_keys(&tmp_receiving_ratchet->new_skipped_keys,
+                                    checkpoint, kdf)) {
+      chain_kdf_destroy(kdf);
+      sodium_memzero(checkpoint, sizeof(chain_checkpoint_s));
+      return OTRNG_ERROR;
+    }
+  }
+
+  chain_kdf_step(enc_key, tmp_receiving_ratchet->extra_symmetric_key,
+                 checkpoint->chain_key, kdf);
+  checkpoint->j++;
+  chain_kdf_destroy(kdf);
+
+  tmp_receiving_ratchet->used_checkpoint = found;
+
+  return OTRNG_SUCCESS;
+}
+
 tstatic otrng_result store_enc_keys(msg_enc_key_p enc_key,
                                     receiving_ratchet_s *tmp_receiving_ratchet,
                                     const int until, const int max_skip,
@@ -803,33 +1275,32 @@ tstatic otrng_result store_enc_keys(msg_enc_key_p enc_key,
   uint8_t zero_buff[CHAIN_KEY_BYTES] = {0};
   if (!(memcmp(tmp_receiving_ratchet->chain_r, zero_buff,
                sizeof(receiving_chain_key_p)) == 0)) {
-    while (tmp_receiving_ratchet->k < until) {
-      shake_256_kdf1(enc_key, sizeof(msg_enc_key_p), usage_message_key,
-                     tmp_receiving_ratchet->chain_r,
-                     sizeof(receiving_chain_key_p));
-
-      goldilocks_shake256_ctx_p hd;
-      uint8_t extra_key[EXTRA_SYMMETRIC_KEY_BYTES];
-      uint8_t magic[1] = {0xFF};
-
-      hash_init_with_usage(hd, usage_extra_symm_key);
-      hash_update(hd, magic, 1);
-
-      hash_update(hd, tmp_receiving_ratchet->chain_r,
-                  sizeof(receiving_chain_key_p));
-      hash_final(hd, extra_key, sizeof(extra_symmetric_key_p));
-      hash_destroy(hd);
+    if (tmp_receiving_ratchet->checkpoint_interval) {
+      assert(ratchet_type == 'd' || ratchet_type == 'c');
+      /* ratchet_id - 1 for the dh ratchet */
+      unsigned int ratchet_id = ratchet_type == 'd'
+                                    ? tmp_receiving_ratchet->i - 1
+                                    : tmp_receiving_ratchet->i;
+      return store_chain_checkpoints(tmp_receiving_ratchet, ratchet_id, until);
+    }
 
-      shake_256_kdf1(tmp_receiving_ratchet->chain_r,
-                     sizeof(receiving_chain_key_p), usage_next_chain_key,
-                     tmp_receiving_ratchet->chain_r,
-                     sizeof(receiving_chain_key_p));
+    /* Every position of the chain goes through the same three KDFs: their
+     * prefixes are absorbed once for the whole run */
+    chain_kdf_s kdf[1];
+    chain_kdf_init(kdf);
+    time_t now = time(NULL);
 
+    while (tmp_receiving_ratchet->k < until) {
+      /* Allocated first, so a failure leaves the chain where it was */
       skipped_keys_s *skipped_msg_enc_key = malloc(sizeof(skipped_keys_s));
       if (!skipped_msg_enc_key) {
+        chain_kdf_destroy(kdf);
         return OTRNG_ERROR;
       }
 
+      extra_symmetric_key_p extra_key;
+      chain_kdf_step(enc_key, extra_key, tmp_receiving_ratchet->chain_r, kdf);
+
       assert(ratchet_type == 'd' || ratchet_type == 'c');
       if (ratchet_type == 'd') {
         skipped_msg_enc_key->i = tmp_receiving_ratchet->i -
@@ -839,10 +1310,12 @@ tstatic otrng_result store_enc_keys(msg_enc_key_p enc_key,
       }
 
       skipped_msg_enc_key->j = tmp_receiving_ratchet->k;
+      skipped_msg_enc_key->stored_at = now;
 
       memcpy(skipped_msg_enc_key->extra_symmetric_key, extra_key,
              sizeof(extra_symmetric_key_p));
       memcpy(skipped_msg_enc_key->enc_key, enc_key, sizeof(msg_enc_key_p));
+      sodium_memzero(extra_key, sizeof(extra_symmetric_key_p));
 
       /*
          @secret: should be deleted when:
@@ -854,6 +1327,8 @@ tstatic otrng_result store_enc_keys(msg_enc_key_p enc_key,
       sodium_memzero(enc_key, sizeof(msg_enc_key_p));
       tmp_receiving_ratchet->k++;
     }
+
+    chain_kdf_destroy(kdf);
   }
 
   return OTRNG_SUCCESS;
@@ -888,6 +1363,13 @@ INTERNAL otrng_result otrng_key_get_skipped_keys(
     current = current->next;
   }
 
+  if (get_keys_from_checkpoint(enc_key, ratchet_id, message_id,
+                               tmp_receiving_ratchet)) {
+    shake_256_kdf1(mac_key, MAC_KEY_BYTES, usage_mac_key, enc_key,
+                   ENC_KEY_BYTES);
+    return OTRNG_SUCCESS;
+  }
+
   /* This is not an actual error, it is just that the key we need was not
   skipped */
   return OTRNG_ERROR;
@@ -950,49 +1432,225 @@ INTERNAL otrng_result otrng_key_manager_derive_dh_ratchet_keys(
 
 INTERNAL otrng_result otrng_store_old_mac_keys(key_manager_s *manager,
                                                msg_mac_key_p mac_key) {
-  uint8_t *to_store_mac = malloc(MAC_KEY_BYTES);
+  old_mac_key_s *to_store_mac = malloc(sizeof(old_mac_key_s));
   if (!to_store_mac) {
     return OTRNG_ERROR;
   }
 
-  memcpy(to_store_mac, mac_key, sizeof(msg_mac_key_p));
+  memcpy(to_store_mac->mac_key, mac_key, sizeof(msg_mac_key_p));
+  to_store_mac->stored_at = time(NULL);
   manager->old_mac_keys = otrng_list_add(to_store_mac, manager->old_mac_keys);
 
   return OTRNG_SUCCESS;
 }
 
-INTERNAL uint8_t *otrng_reveal_mac_keys_on_tlv(key_manager_s *manager) {
+INTERNAL uint8_t *otrng_reveal_mac_keys_on_tlv(size_t *len,
+                                               key_manager_s *manager) {
   size_t num_stored_keys = otrng_list_len(manager->skipped_keys);
-  size_t serlen = num_stored_keys * MAC_KEY_BYTES;
-  uint8_t *ser_mac_keys;
+  list_element_s *current = manager->checkpoints;
+  for (; current; current = current->next) {
+    const chain_checkpoint_s *checkpoint = current->data;
+    num_stored_keys += checkpoint->until - checkpoint->j;
+  }
 
-  if (serlen != 0) {
-    ser_mac_keys = malloc(serlen);
-    if (!ser_mac_keys) {
-      return NULL;
-    }
+  *len = num_stored_keys * MAC_KEY_BYTES;
+  if (*len == 0) {
+    return NULL;
+  }
 
-    msg_mac_key_p mac_key;
-    msg_enc_key_p enc_key;
+  uint8_t *ser_mac_keys = malloc(*len);
+  if (!ser_mac_keys) {
+    return NULL;
+  }
 
-    memset(enc_key, 0, sizeof(msg_enc_key_p));
-    memset(mac_key, 0, sizeof(msg_mac_key_p));
+  uint8_t *cursor = ser_mac_keys;
+  for (current = manager->skipped_keys; current; current = current->next) {
+    const skipped_keys_s *skipped_keys = current->data;
+    shake_256_kdf1(cursor, MAC_KEY_BYTES, usage_mac_key, skipped_keys->enc_key,
+                   sizeof(msg_enc_key_p));
+    cursor += MAC_KEY_BYTES;
+  }
+  otrng_list_free_full(manager->skipped_keys);
+  manager->skipped_keys = NULL;
 
-    for (int i = 0; i < num_stored_keys; i++) {
-      list_element_s *last = otrng_list_get_last(manager->skipped_keys);
-      skipped_keys_s *skipped_keys = last->data;
-      memcpy(enc_key, skipped_keys->enc_key, sizeof(msg_enc_key_p));
-      shake_256_kdf1(mac_key, sizeof(msg_mac_key_p), usage_mac_key, enc_key,
+  /* Only the chain key of a checkpoint is held while its keys are derived */
+  chain_kdf_s kdf[1];
+  chain_kdf_init(kdf);
+  msg_enc_key_p enc_key;
+  extra_symmetric_key_p extra_key;
+
+  for (current = manager->checkpoints; current; current = current->next) {
+    chain_checkpoint_s *checkpoint = current->data;
+    while (checkpoint->j < checkpoint->until) {
+      chain_kdf_step(enc_key, extra_key, checkpoint->chain_key, kdf);
+      shake_256_kdf1(cursor, MAC_KEY_BYTES, usage_mac_key, enc_key,
                      sizeof(msg_enc_key_p));
-      memcpy(ser_mac_keys + i * MAC_KEY_BYTES, mac_key, MAC_KEY_BYTES);
-      manager->skipped_keys =
-          otrng_list_remove_element(last, manager->skipped_keys);
-      otrng_list_free_full(last);
+      cursor += MAC_KEY_BYTES;
+      checkpoint->j++;
     }
-    otrng_list_free_nodes(manager->skipped_keys);
+  }
+  otrng_list_free(manager->checkpoints, chain_checkpoint_free);
+  manager->checkpoints = NULL;
 
-    return ser_mac_keys;
+  chain_kdf_destroy(kdf);
+  sodium_memzero(enc_key, sizeof(msg_enc_key_p));
+  sodium_memzero(extra_key, sizeof(extra_symmetric_key_p));
+
+  return ser_mac_keys;
+}
+
+/* the lists of keys kept for later, as seen by the eviction */
+typedef struct stored_key_list_s {
+  list_element_s **list;
+  size_t entry_bytes;
+  time_t (*stored_at)(const void *data);
+  void (*free)(void *data);
+} stored_key_list_s;
+
+#define STORED_KEY_LISTS 3
+
+#define SKIPPED_KEY_ENTRY_BYTES                                                \
+  (sizeof(list_element_s) + sizeof(skipped_keys_s))
+#define CHECKPOINT_ENTRY_BYTES                                                 \
+  (sizeof(list_element_s) + sizeof(chain_checkpoint_s))
+#define OLD_MAC_KEY_ENTRY_BYTES (sizeof(list_element_s) + sizeof(old_mac_key_s))
+
+tstatic time_t chain_checkpoint_stored_at(const void *data) {
+  return ((const chain_checkpoint_s *)data)->stored_at;
+}
+
+tstatic time_t old_mac_key_stored_at(const void *data) {
+  return ((const old_mac_key_s *)data)->stored_at;
+}
+
+tstatic void skipped_keys_free(void *data) {
+  sodium_memzero(data, sizeof(skipped_keys_s));
+  free(data);
+}
+
+tstatic void old_mac_key_free(void *data) {
+  sodium_memzero(data, sizeof(old_mac_key_s));
+  free(data);
+}
+
+tstatic void get_stored_key_lists(stored_key_list_s lists[STORED_KEY_LISTS],
+                                  key_manager_s *manager) {
+  lists[0].list = &manager->skipped_keys;
+  lists[0].entry_bytes = SKIPPED_KEY_ENTRY_BYTES;
+  lists[0].stored_at = skipped_keys_stored_at;
+  lists[0].free = skipped_keys_free;
+
+  lists[1].list = &manager->checkpoints;
+  lists[1].entry_bytes = CHECKPOINT_ENTRY_BYTES;
+  lists[1].stored_at = chain_checkpoint_stored_at;
+  lists[1].free = chain_checkpoint_free;
+
+  lists[2].list = &manager->old_mac_keys;
+  lists[2].entry_bytes = OLD_MAC_KEY_ENTRY_BYTES;
+  lists[2].stored_at = old_mac_key_stored_at;
+  lists[2].free = old_mac_key_free;
+}
+
+/* Drops the first, and so oldest, entry of a list */
+tstatic void evict_stored_key(const stored_key_list_s *from,
+                              key_manager_s *manager) {
+  list_element_s *first = *from->list;
+  *from->list = first->next;
+  first->next = NULL;
+
+  otrng_list_free(first, from->free);
+  manager->evicted_keys++;
+}
+
+/* Every list is in the order its keys were stored, so the oldest key is the
+ * first of one of them */
+tstatic const stored_key_list_s *
+find_oldest_stored_key(const stored_key_list_s lists[STORED_KEY_LISTS]) {
+  const stored_key_list_s *from = NULL;
+  time_t oldest_at = 0;
+
+  for (int n = 0; n < STORED_KEY_LISTS; n++) {
+    const list_element_s *first = *lists[n].list;
+    if (!first) {
+      continue;
+    }
+
+    time_t stored_at = lists[n].stored_at(first->data);
+    if (!from || stored_at < oldest_at) {
+      from = &lists[n];
+      oldest_at = stored_at;
+    }
+  }
+
+  return from;
+}
+
+INTERNAL void otrng_key_manager_stored_keys_stats(
+    otrng_stored_keys_stats_s *stats, key_manager_s *manager) {
+  stats->skipped_keys = otrng_list_len(manager->skipped_keys);
+  stats->checkpoints = otrng_list_len(manager->checkpoints);
+  stats->old_mac_keys = otrng_list_len(manager->old_mac_keys);
+  stats->bytes = stats->skipped_keys * SKIPPED_KEY_ENTRY_BYTES +
+                 stats->checkpoints * CHECKPOINT_ENTRY_BYTES +
+                 stats->old_mac_keys * OLD_MAC_KEY_ENTRY_BYTES;
+  stats->evicted_keys = manager->evicted_keys;
+}
+
+INTERNAL otrng_bool otrng_key_manager_oldest_key(time_t *stored_at,
+                                                 key_manager_s *manager) {
+  stored_key_list_s lists[STORED_KEY_LISTS];
+  get_stored_key_lists(lists, manager);
+
+  const stored_key_list_s *from = find_oldest_stored_key(lists);
+  if (!from) {
+    return otrng_false;
+  }
+
+  *stored_at = from->stored_at((*from->list)->data);
+  return otrng_true;
+}
+
+INTERNAL size_t otrng_key_manager_evict_oldest_key(key_manager_s *manager) {
+  stored_key_list_s lists[STORED_KEY_LISTS];
+  get_stored_key_lists(lists, manager);
+
+  const stored_key_list_s *from = find_oldest_stored_key(lists);
+  if (!from) {
+    return 0;
+  }
+
+  evict_stored_key(from, manager);
+  return from->entry_bytes;
+}
+
+INTERNAL size_t otrng_key_manager_expire_stored_keys(key_manager_s *manager,
+                                                     time_t now,
+                                                     unsigned int max_age,
+                                                     size_t max_bytes) {
+  unsigned int evicted_before = manager->evicted_keys;
+  stored_key_list_s lists[STORED_KEY_LISTS];
+  get_stored_key_lists(lists, manager);
+
+  /* Only the keys that are too old are visited */
+  if (max_age) {
+    for (int n = 0; n < STORED_KEY_LISTS; n++) {
+      while (*lists[n].list &&
+             difftime(now, lists[n].stored_at((*lists[n].list)->data)) >
+                 max_age) {
+        evict_stored_key(&lists[n], manager);
+      }
+    }
+  }
+
+  if (max_bytes) {
+    otrng_stored_keys_stats_s stats[1];
+    otrng_key_manager_stored_keys_stats(stats, manager);
+
+    size_t bytes = stats->bytes;
+    while (bytes > max_bytes) {
+      bytes -= otrng_key_manager_evict_oldest_key(manager);
+    }
   }
 
-  return NULL;
+  return manager->evicted_keys - evicted_before;
 }
@@ -26,6 +26,7 @@
 #include "ed448.h"
 #include "keys.h"
 #include "list.h"
+#include "shake.h"
 #include "shared.h"
 #include "warn.h"
 
@@ -54,8 +55,33 @@ typedef struct skipped_keys_s {
   unsigned int j; /* Counter of the sending messages */
   extra_symmetric_key_p extra_symmetric_key;
   msg_enc_key_p enc_key;
+  time_t stored_at;
 } skipped_keys_s, skipped_keys_p[1];
 
+/* a MAC key waiting to be revealed */
+typedef struct old_mac_key_s {
+  msg_mac_key_p mac_key;
+  time_t stored_at;
+} old_mac_key_s;
+
+/* a receiving chain key kept in place of the message keys it can derive:
+ * those for message ids j up to (but not including) until, in ratchet i */
+typedef struct chain_checkpoint_s {
+  unsigned int i;
+  unsigned int j;
+  unsigned int until;
+  receiving_chain_key_p chain_key;
+  time_t stored_at;
+} chain_checkpoint_s, chain_checkpoint_p[1];
+
+/* the sponges every step of a receiving chain starts from, with the usage
+ * (and, for the extra key, the 0xFF marker) already absorbed */
+typedef struct chain_kdf_s {
+  goldilocks_shake256_ctx_p enc;
+  goldilocks_shake256_ctx_p extra;
+  goldilocks_shake256_ctx_p next;
+} chain_kdf_s;
+
 /* a temporary structure used to hold the values of the receiving ratchet */
 typedef struct receiving_ratchet_s {
   ec_scalar_p our_ecdh_priv;
@@ -63,6 +89,10 @@ typedef struct receiving_ratchet_s {
 
   ec_point_p their_ecdh;
   dh_public_key_p their_dh;
+  dh_public_key_fixed_p their_dh_fixed;
+  /* Set when their_dh is the key the manager already holds. their_dh is not
+   * parsed in that case. */
+  otrng_bool their_dh_unchanged;
 
   brace_key_p brace_key;
   shared_secret_p shared_secret;
@@ -77,6 +107,22 @@ typedef struct receiving_ratchet_s {
   extra_symmetric_key_p extra_symmetric_key;
 
   list_element_s *skipped_keys;
+
+  /* The manager's checkpoints. They are only read: what a message changes
+   * is kept below, and only applied by otrng_receiving_ratchet_copy once the
+   * message is authenticated. */
+  list_element_s *checkpoints;
+  unsigned int checkpoint_interval;
+
+  /* The checkpoint a skipped message was derived from, and where it is left
+   * after that message */
+  chain_checkpoint_s *used_checkpoint;
+  chain_checkpoint_p moved_checkpoint;
+
+  /* The checkpoints stored for this message, and the keys of the messages
+   * moved_checkpoint passed over */
+  list_element_s *new_checkpoints;
+  list_element_s *new_skipped_keys;
 } receiving_ratchet_s, receiving_ratchet_p[1];
 
 /* represents the different values needed for key management */
@@ -88,6 +134,36 @@ typedef struct key_manager_s {
   ec_point_p their_ecdh;
   dh_public_key_p their_dh;
 
+  /* Fixed-width form of our_dh->pub, as sent in every data message. It is
+   * valid while our_dh_pub_cached is set. */
+  dh_public_key_fixed_p our_dh_pub_fixed;
+  otrng_bool our_dh_pub_cached;
+
+  /* our_ecdh and our_dh as written in the DAKE, valid while our_pub_cached is
+   * set. Only keys that were prepared ahead come with it. */
+  ephemeral_pub_ser_s our_pub;
+  otrng_bool our_pub_cached;
+
+  /* @secret Ephemeral keys generated ahead of time, by
+   * otrng_key_manager_prepare_ephemeral_keys. They are used, instead of new
+   * ones, the next time ephemeral keys are generated. */
+  ecdh_keypair_p next_ecdh;
+  dh_keypair_p next_dh;
+  ephemeral_pub_ser_s next_pub;
+  otrng_bool next_keys_ready;
+
+  /* Fixed-width form of their_dh, valid while their_dh_cached is set. It is
+   * used to recognize an unchanged key in incoming data messages. */
+  dh_public_key_fixed_p their_dh_fixed;
+  otrng_bool their_dh_cached;
+
+  /* @secret The last DH shared secret, for our_dh and the key in k_dh_their.
+   * It is wiped as soon as either key changes. */
+  dh_shared_secret_p k_dh;
+  size_t k_dh_len;
+  dh_public_key_fixed_p k_dh_their;
+  otrng_bool k_dh_cached;
+
   // TODO: @refactoring REMOVE THIS
   // or turn it into a pair and store both this and the long term keypair on
   // this key manager.
@@ -113,9 +189,28 @@ typedef struct key_manager_s {
   list_element_s *skipped_keys;
   list_element_s *old_mac_keys;
 
+  /* When not 0, skipped message keys are not derived up front: one chain
+   * key is kept for every checkpoint_interval skipped messages, and their
+   * keys are derived when they arrive. */
+  unsigned int checkpoint_interval;
+  list_element_s *checkpoints; /* chain_checkpoint_s */
+
+  /* The number of stored keys dropped by otrng_key_manager_expire_stored_keys
+   * and otrng_key_manager_evict_oldest_key */
+  unsigned int evicted_keys;
+
   time_t last_generated;
 } key_manager_s, key_manager_p[1];
 
+/* what a key manager holds for late messages and for revealing */
+typedef struct otrng_stored_keys_stats_s {
+  size_t skipped_keys;
+  size_t checkpoints;
+  size_t old_mac_keys;
+  size_t bytes;        /* memory taken by the three lists */
+  size_t evicted_keys; /* entries dropped by the limits, so far */
+} otrng_stored_keys_stats_s, otrng_stored_keys_stats_p[1];
+
 /*
  * @brief Creates a new key manager.
  *
@@ -183,13 +278,18 @@ INTERNAL void otrng_receiving_ratchet_destroy(receiving_ratchet_s *ratchet);
 /**
  * @brief Securely replace their ecdh and their dh keys.
  *
+ * If their_dh is the key the manager already holds, it is neither parsed nor
+ * validated again.
+ *
  * @param [their_ecdh]               The new their_ecdh key.
- * @param [their_dh]                 The new their_dh key.
+ * @param [their_dh]                 The new their_dh key, in its fixed-width
+ *                                   form.
+ * @param [manager]                  The key manager.
  * @param [tmp_receiving_ratchet]    The receiving ratchet.
  */
-INTERNAL void otrng_key_manager_set_their_tmp_keys(
-    ec_point_p their_ecdh, dh_public_key_p their_dh,
-    receiving_ratchet_s *tmp_receiving_ratchet);
+INTERNAL otrng_result otrng_key_manager_set_their_tmp_keys(
+    ec_point_p their_ecdh, const dh_public_key_fixed_p their_dh,
+    key_manager_s *manager, receiving_ratchet_s *tmp_receiving_ratchet);
 
 /**
  * @brief Securely replace their ecdh keys.
@@ -217,6 +317,64 @@ INTERNAL void otrng_key_manager_set_their_dh(const dh_public_key_p their_dh,
 INTERNAL otrng_result
 otrng_key_manager_generate_ephemeral_keys(key_manager_s *manager);
 
+/**
+ * @brief Generate the ephemeral ecdh and dh keys sent in the DAKE.
+ *
+ * Uses the keys prepared ahead, if there are any.
+ *
+ * @param [manager]   The key manager.
+ */
+INTERNAL otrng_result
+otrng_key_manager_generate_dake_keys(key_manager_s *manager);
+
+/**
+ * @brief Generate the next ephemeral ecdh and dh keys, and serialize them,
+ *        ahead of the time they are needed.
+ *
+ * Does nothing if they are already prepared.
+ *
+ * @param [manager]   The key manager.
+ */
+INTERNAL otrng_result
+otrng_key_manager_prepare_ephemeral_keys(key_manager_s *manager);
+
+/**
+ * @brief Get our current ephemeral public keys as written in the DAKE, if
+ *        they were prepared ahead.
+ *
+ * @param [manager]   The key manager.
+ *
+ * @return The serialized keys, or NULL.
+ */
+INTERNAL const ephemeral_pub_ser_s *
+otrng_key_manager_get_our_pub(const key_manager_s *manager);
+
+/**
+ * @brief Get our current dh public key in its fixed-width form.
+ *
+ * The value is cached until our dh keypair changes.
+ *
+ * @param [manager]   The key manager.
+ */
+INTERNAL const uint8_t *
+otrng_key_manager_get_our_dh_fixed(key_manager_s *manager);
+
+/**
+ * @brief Forget the cached form of our dh public key. Must be called
+ *        whenever our_dh is replaced outside of the key manager.
+ *
+ * @param [manager]   The key manager.
+ */
+INTERNAL void otrng_key_manager_our_dh_changed(key_manager_s *manager);
+
+/**
+ * @brief Forget the cached forms of their dh public key. Must be called
+ *        whenever their_dh is replaced outside of the key manager.
+ *
+ * @param [manager]   The key manager.
+ */
+INTERNAL void otrng_key_manager_their_dh_changed(key_manager_s *manager);
+
 /**
  * @brief Generate the temporary key to be used by the non-interactive DAKE.
  *
@@ -328,10 +486,110 @@ INTERNAL otrng_result otrng_key_manager_derive_dh_ratchet_keys(
 INTERNAL otrng_result otrng_store_old_mac_keys(key_manager_s *manager,
                                                msg_mac_key_p mac_key);
 
-INTERNAL uint8_t *otrng_reveal_mac_keys_on_tlv(key_manager_s *manager);
+/**
+ * @brief Serialize the MAC keys of every skipped message, and drop the keys
+ *        kept for them. The MAC keys of the messages a chain checkpoint
+ *        covers are derived one at a time, straight into the result.
+ *
+ * @param [len]       The length of the result.
+ * @param [manager]   The key manager.
+ *
+ * @return The MAC keys, or NULL if there are none or if something goes
+ *         wrong, which [len] being 0 or not tells apart.
+ */
+INTERNAL uint8_t *otrng_reveal_mac_keys_on_tlv(size_t *len,
+                                               key_manager_s *manager);
+
+/**
+ * @brief Count the keys kept for late messages and for revealing.
+ *
+ * @param [stats]     The counters.
+ * @param [manager]   The key manager.
+ */
+INTERNAL void
+otrng_key_manager_stored_keys_stats(otrng_stored_keys_stats_s *stats,
+                                    key_manager_s *manager);
+
+/**
+ * @brief Drop the stored keys older than max_age and then, oldest first,
+ *        those over max_bytes. Old MAC keys dropped this way are never
+ *        revealed.
+ *
+ * @param [manager]     The key manager.
+ * @param [now]         The current time.
+ * @param [max_age]     The age limit, in seconds. 0 for no limit.
+ * @param [max_bytes]   The memory limit. 0 for no limit.
+ *
+ * @return The number of entries dropped.
+ */
+INTERNAL size_t otrng_key_manager_expire_stored_keys(key_manager_s *manager,
+                                                     time_t now,
+                                                     unsigned int max_age,
+                                                     size_t max_bytes);
+
+/**
+ * @brief Find when the oldest stored key was stored.
+ *
+ * @return otrng_false if there are no stored keys.
+ */
+INTERNAL otrng_bool otrng_key_manager_oldest_key(time_t *stored_at,
+                                                 key_manager_s *manager);
+
+/**
+ * @brief Drop the oldest stored key.
+ *
+ * @return The memory released, 0 if there was nothing to drop.
+ */
+INTERNAL size_t otrng_key_manager_evict_oldest_key(key_manager_s *manager);
 
 #ifdef OTRNG_KEY_MANAGEMENT_PRIVATE
 
+/**
+ * @brief Apply to the key manager what a receiving ratchet changed in the
+ *        chain checkpoints.
+ *
+ * @param [manager]   The key manager.
+ * @param [ratchet]   The receiving ratchet. It no longer holds those changes.
+ */
+tstatic void apply_checkpoint_changes(key_manager_s *manager,
+                                      receiving_ratchet_s *ratchet);
+
+tstatic void chain_kdf_init(chain_kdf_s *kdf);
+
+tstatic void chain_kdf_destroy(chain_kdf_s *kdf);
+
+tstatic void chain_kdf_next(receiving_chain_key_p chain_key,
+                            const chain_kdf_s *kdf);
+
+/**
+ * @brief Derive the message keys for the current position of a receiving
+ *        chain, and move the chain forward.
+ *
+ * @param [enc_key]     The message encryption key.
+ * @param [extra_key]   The extra symmetric key.
+ * @param [chain_key]   The chain key. It is replaced by the next one.
+ * @param [kdf]         The prepared sponges.
+ */
+tstatic void chain_kdf_step(msg_enc_key_p enc_key,
+                            extra_symmetric_key_p extra_key,
+                            receiving_chain_key_p chain_key,
+                            const chain_kdf_s *kdf);
+
+/**
+ * @brief Compute the DH shared secret between our_dh and their_dh, reusing
+ *        the last one computed if their_dh has not changed since.
+ *
+ * @param [k_dh]             The shared secret.
+ * @param [k_dh_len]         The length of the shared secret.
+ * @param [manager]          The key manager.
+ * @param [their_dh]         Their dh public key.
+ * @param [their_dh_fixed]   Their dh public key, in its fixed-width form.
+ */
+tstatic otrng_result dh_shared_secret_memoized(
+    dh_shared_secret_p k_dh, size_t *k_dh_len, key_manager_s *manager,
+    const dh_public_key_p their_dh,
+    const dh_public_key_fixed_p their_dh_fixed);
+
 /**
  * @brief Calculate the brace key.
  *
@@ -19,17 +19,19 @@
  */
 
 #include <assert.h>
-#include <libotr/b64.h>
 #include <stdlib.h>
 
 #define OTRNG_KEYS_PRIVATE
 
+#include "alloc.h"
+#include "base64.h"
 #include "keys.h"
 #include "random.h"
+#include "serialize.h"
 #include "shake.h"
 
 INTERNAL otrng_keypair_s *otrng_keypair_new(void) {
-  otrng_keypair_s *ret = malloc(sizeof(otrng_keypair_s));
+  otrng_keypair_s *ret = otrng_secure_alloc(sizeof(otrng_keypair_s));
   if (!ret) {
     return NULL;
   }
@@ -64,7 +66,7 @@ INTERNAL void otrng_keypair_free(otrng_keypair_s *keypair) {
   }
 
   keypair_destroy(keypair);
-  free(keypair);
+  otrng_secure_free(keypair, sizeof(otrng_keypair_s));
 }
 
 INTERNAL otrng_result otrng_symmetric_key_serialize(
@@ -74,12 +76,13 @@ INTERNAL otrng_result otrng_symmetric_key_serialize(
     return OTRNG_ERROR;
   }
 
-  *written = otrl_base64_encode(*buffer, sym, ED448_PRIVATE_BYTES);
+  *written = otrng_base64_encode_into(*buffer, sym, ED448_PRIVATE_BYTES);
   return OTRNG_SUCCESS;
 }
 
 INTERNAL otrng_shared_prekey_pair_s *otrng_shared_prekey_pair_new(void) {
-  otrng_shared_prekey_pair_s *ret = malloc(sizeof(otrng_shared_prekey_pair_s));
+  otrng_shared_prekey_pair_s *ret =
+      otrng_secure_alloc(sizeof(otrng_shared_prekey_pair_s));
   if (!ret) {
     return NULL;
   }
@@ -114,6 +117,14 @@ INTERNAL otrng_result otrng_generate_ephemeral_keys(ecdh_keypair_p ecdh,
   return otrng_dh_keypair_generate(dh);
 }
 
+INTERNAL otrng_result otrng_ephemeral_pub_serialize(ephemeral_pub_ser_s *dst,
+                                                    const ecdh_keypair_s *ecdh,
+                                                    const dh_keypair_s *dh) {
+  otrng_serialize_ec_point(dst->ecdh, ecdh->pub);
+  return otrng_serialize_dh_public_key(dst->dh, sizeof(dst->dh), &dst->dh_len,
+                                       dh->pub);
+}
+
 tstatic void
 shared_prekey_pair_destroy(otrng_shared_prekey_pair_s *prekey_pair) {
   goldilocks_bzero(prekey_pair->sym, ED448_PRIVATE_BYTES);
@@ -128,7 +139,7 @@ otrng_shared_prekey_pair_free(otrng_shared_prekey_pair_s *prekey_pair) {
   }
 
   shared_prekey_pair_destroy(prekey_pair);
-  free(prekey_pair);
+  otrng_secure_free(prekey_pair, sizeof(otrng_shared_prekey_pair_s));
 }
 
 INTERNAL uint8_t *otrng_derive_key_from_extra_symm_key(
@@ -77,6 +77,24 @@ otrng_shared_prekey_pair_free(otrng_shared_prekey_pair_s *prekey_pair);
 INTERNAL otrng_result otrng_generate_ephemeral_keys(ecdh_keypair_p ecdh,
                                                     dh_keypair_p dh);
 
+/* the public parts of an ECDH and a DH keypair, as written in the DAKE */
+typedef struct ephemeral_pub_ser_s {
+  uint8_t ecdh[ED448_POINT_BYTES];
+  uint8_t dh[DH_MPI_MAX_BYTES];
+  size_t dh_len;
+} ephemeral_pub_ser_s;
+
+/**
+ * @brief Serialize the public parts of an ECDH and a DH keypair.
+ *
+ * @param [dst]    The serialized keys.
+ * @param [ecdh]   The ECDH keypair.
+ * @param [dh]     The DH keypair.
+ */
+INTERNAL otrng_result otrng_ephemeral_pub_serialize(ephemeral_pub_ser_s *dst,
+                                                    const ecdh_keypair_s *ecdh,
+                                                    const dh_keypair_s *dh);
+
 /**
  * @brief Derive keys from the extra symmetric key.
  *
@@ -387,6 +387,12 @@ API otrng_result otrng_user_state_instance_tags_read_FILEp(
     otrng_user_state_s *state, FILE *instag) {
   // We use v3 user_state also for v4 instance tags, for now. */
   gcry_error_t res = otrl_instag_read_FILEp(state->user_state_v3, instag);
+
+  for (list_element_s *current = state->states; current;
+       current = current->next) {
+    otrng_client_state_forget_instance_tag(current->data);
+  }
+
   if (res) {
     return OTRNG_ERROR;
   }
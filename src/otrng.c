@@ -20,7 +20,6 @@
 
 #include "otrng.h"
 
-#include <libotr/b64.h>
 #include <libotr/mem.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +28,7 @@
 
 #define OTRNG_OTRNG_PRIVATE
 
+#include "base64.h"
 #include "constants.h"
 #include "dake.h"
 #include "data_message.h"
@@ -187,6 +187,9 @@ INTERNAL otrng_s *otrng_new(otrng_client_state_s *state,
   otr->their_prekey_profile = NULL;
 
   otr->keys = otrng_key_manager_new();
+  if (otr->keys) {
+    otr->keys->checkpoint_interval = state->skipped_keys_checkpoint_interval;
+  }
   otrng_smp_protocol_init(otr->smp);
 
   otr->pending_fragments = NULL;
@@ -199,6 +202,9 @@ INTERNAL otrng_s *otrng_new(otrng_client_state_s *state,
   otr->sending_init_msg = NULL;
   otr->receiving_init_msg = NULL;
 
+  otrng_arena_init(otr->scratch, OTRNG_ARENA_BLOCK_SIZE);
+  otrng_tlv_writer_init(otr->tlv_writer);
+
   return otr;
 }
 
@@ -238,6 +244,9 @@ INTERNAL void otrng_destroy(/*@only@ */ otrng_s *otr) {
   // TODO: @freeing should we free this after being used by phi?;
   free(otr->receiving_init_msg);
   otr->receiving_init_msg = NULL;
+
+  otrng_arena_destroy(otr->scratch);
+  otrng_tlv_writer_destroy(otr->tlv_writer);
 }
 
 INTERNAL void otrng_free(/*@only@ */ otrng_s *otr) {
@@ -328,10 +337,6 @@ API otrng_result otrng_build_whitespace_tag(string_p *whitespace_tag,
   return OTRNG_SUCCESS;
 }
 
-tstatic otrng_bool message_contains_tag(const string_p message) {
-  return strstr(message, tag_base) != NULL;
-}
-
 tstatic void set_to_display(otrng_response_s *response,
                             const string_p message) {
   size_t msg_len = strlen(message);
@@ -340,6 +345,7 @@ tstatic void set_to_display(otrng_response_s *response,
 
 tstatic otrng_result message_to_display_without_tag(otrng_response_s *response,
                                                     const string_p message,
+                                                    const char *found_at,
                                                     size_t msg_len) {
   // TODO: What if there is more than one VERSION TAG?
   size_t tag_length = WHITESPACE_TAG_BASE_BYTES + WHITESPACE_TAG_VERSION_BYTES;
@@ -349,7 +355,6 @@ tstatic otrng_result message_to_display_without_tag(otrng_response_s *response,
     return OTRNG_ERROR;
   }
 
-  char *found_at = strstr(message, tag_base);
   if (!found_at) {
     return OTRNG_ERROR;
   }
@@ -375,25 +380,18 @@ tstatic otrng_result message_to_display_without_tag(otrng_response_s *response,
 }
 
 tstatic void set_running_version_from_tag(otrng_s *otr,
-                                          const string_p message) {
-  if (allow_version(otr, OTRNG_ALLOW_V4) && strstr(message, tag_version_v4)) {
+                                          const otrng_message_info_s *info) {
+  if (allow_version(otr, OTRNG_ALLOW_V4) && info->tag_v4) {
     otr->running_version = OTRNG_PROTOCOL_VERSION_4;
     return;
   }
 
-  if (allow_version(otr, OTRNG_ALLOW_V3) && strstr(message, tag_version_v3)) {
+  if (allow_version(otr, OTRNG_ALLOW_V3) && info->tag_v3) {
     otr->running_version = OTRNG_PROTOCOL_VERSION_3;
     return;
   }
 }
 
-tstatic otrng_bool message_is_query(const string_p message) {
-  if (strstr(message, query_header) != NULL) {
-    return otrng_true;
-  }
-  return otrng_false;
-}
-
 tstatic void set_running_version_from_query_msg(otrng_s *otr,
                                                 const string_p message) {
   if (allow_version(otr, OTRNG_ALLOW_V4) && strstr(message, "4")) {
@@ -403,32 +401,33 @@ tstatic void set_running_version_from_query_msg(otrng_s *otr,
   }
 }
 
-tstatic otrng_bool message_is_otr_encoded(const string_p message) {
-  if (strstr(message, otr_header) != NULL) {
-    return otrng_true;
-  }
-  return otrng_false;
-}
-
-tstatic otrng_bool message_is_otr_error(const string_p message) {
-  if (strncmp(message, otr_error_header, strlen(otr_error_header)) == 0) {
-    return otrng_true;
-  }
-  return otrng_false;
-}
-
 INTERNAL otrng_response_s *otrng_response_new(void) {
   otrng_response_s *response = malloc(sizeof(otrng_response_s));
   if (!response) {
     return NULL;
   }
 
+  otrng_response_init(response);
+
+  return response;
+}
+
+INTERNAL void otrng_response_init(otrng_response_s *response) {
   response->to_display = NULL;
   response->to_send = NULL;
   response->warning = OTRNG_WARN_NONE;
   response->tlvs = NULL;
+}
 
-  return response;
+INTERNAL void otrng_response_destroy(otrng_response_s *response) {
+  free(response->to_display);
+  response->to_display = NULL;
+
+  free(response->to_send);
+  response->to_send = NULL;
+
+  otrng_tlv_list_free(response->tlvs);
+  response->tlvs = NULL;
 }
 
 INTERNAL void otrng_response_free(otrng_response_s *response) {
@@ -436,15 +435,7 @@ INTERNAL void otrng_response_free(otrng_response_s *response) {
     return;
   }
 
-  if (response->to_display) {
-    free(response->to_display);
-  }
-
-  if (response->to_send) {
-    free(response->to_send);
-  }
-
-  otrng_tlv_list_free(response->tlvs);
+  otrng_response_destroy(response);
 
   free(response);
 }
@@ -460,15 +451,16 @@ tstatic void receive_plaintext(otrng_response_s *response,
 }
 
 tstatic otrng_result serialize_and_encode_identity_message(
-    string_p *dst, const dake_identity_message_s *m) {
+    string_p *dst, const dake_identity_message_s *m,
+    const otrng_serialized_profile_s *ser_profile) {
   uint8_t *buff = NULL;
   size_t len = 0;
 
-  if (!otrng_dake_identity_message_asprintf(&buff, &len, m)) {
+  if (!otrng_dake_identity_message_asprintf(&buff, &len, m, ser_profile)) {
     return OTRNG_ERROR;
   }
 
-  *dst = otrl_base64_otr_encode(buff, len);
+  *dst = otrng_base64_otr_encode(buff, len);
 
   free(buff);
   return OTRNG_SUCCESS;
@@ -489,15 +481,15 @@ tstatic otrng_result reply_with_identity_msg(otrng_response_s *response,
   otrng_ec_point_copy(m->Y, our_ecdh(otr));
   m->B = otrng_dh_mpi_copy(our_dh(otr));
 
-  otrng_result result =
-      serialize_and_encode_identity_message(&response->to_send, m);
+  otrng_result result = serialize_and_encode_identity_message(
+      &response->to_send, m, get_my_serialized_client_profile(otr));
   otrng_dake_identity_message_free(m);
 
   return result;
 }
 
 tstatic otrng_result start_dake(otrng_response_s *response, otrng_s *otr) {
-  if (otrng_key_manager_generate_ephemeral_keys(otr->keys) == OTRNG_ERROR) {
+  if (otrng_key_manager_generate_dake_keys(otr->keys) == OTRNG_ERROR) {
     return OTRNG_ERROR;
   }
 
@@ -511,15 +503,24 @@ tstatic otrng_result start_dake(otrng_response_s *response, otrng_s *otr) {
   return OTRNG_SUCCESS;
 }
 
+API otrng_result otrng_prepare_dake(otrng_s *otr) {
+  if (!get_my_serialized_client_profile(otr)) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_key_manager_prepare_ephemeral_keys(otr->keys);
+}
+
 tstatic otrng_result receive_tagged_plaintext(otrng_response_s *response,
                                               const string_p message,
+                                              const otrng_message_info_s *info,
                                               otrng_s *otr) {
-  set_running_version_from_tag(otr, message);
+  set_running_version_from_tag(otr, info);
 
   switch (otr->running_version) {
   case OTRNG_PROTOCOL_VERSION_4:
-    if (message_to_display_without_tag(response, message, strlen(message)) ==
-        OTRNG_ERROR) {
+    if (message_to_display_without_tag(response, message, info->tag,
+                                       strlen(message)) == OTRNG_ERROR) {
       return OTRNG_ERROR;
     }
 
@@ -563,16 +564,17 @@ tstatic otrng_result receive_query_message(otrng_response_s *response,
   return OTRNG_ERROR;
 }
 
-tstatic otrng_result serialize_and_encode_auth_r(string_p *dst,
-                                                 const dake_auth_r_s *m) {
+tstatic otrng_result
+serialize_and_encode_auth_r(string_p *dst, const dake_auth_r_s *m,
+                            const otrng_serialized_profile_s *ser_profile) {
   uint8_t *buff = NULL;
   size_t len = 0;
 
-  if (!otrng_dake_auth_r_asprintf(&buff, &len, m)) {
+  if (!otrng_dake_auth_r_asprintf(&buff, &len, m, ser_profile)) {
     return OTRNG_ERROR;
   }
 
-  *dst = otrl_base64_otr_encode(buff, len);
+  *dst = otrng_base64_otr_encode(buff, len);
 
   free(buff);
   return OTRNG_SUCCESS;
@@ -638,6 +640,10 @@ static otrng_result generate_phi_sending(uint8_t **dst, size_t *dst_len,
 static otrng_result generate_sending_rsig_tag(uint8_t **dst, size_t *dst_len,
                                               const char auth_tag_type,
                                               otrng_s *otr) {
+  const client_profile_s *our_profile = get_my_client_profile(otr);
+  otrng_serialized_profile_s *ser_our_profile =
+      get_my_serialized_client_profile(otr);
+
   const otrng_dake_participant_data_s initiator = {
       .client_profile = otr->their_client_profile,
       .ecdh = *(otr->keys->their_ecdh),
@@ -645,9 +651,11 @@ static otrng_result generate_sending_rsig_tag(uint8_t **dst, size_t *dst_len,
   };
 
   const otrng_dake_participant_data_s responder = {
-      .client_profile = get_my_client_profile(otr),
+      .client_profile = our_profile,
       .ecdh = *(otr->keys->our_ecdh->pub),
       .dh = our_dh(otr),
+      .ser_client_profile = ser_our_profile,
+      .ser_ephemeral = otrng_key_manager_get_our_pub(otr->keys),
   };
 
   uint8_t *phi = NULL;
@@ -666,10 +674,16 @@ static otrng_result generate_sending_rsig_tag(uint8_t **dst, size_t *dst_len,
 static otrng_result generate_receiving_rsig_tag(
     uint8_t **dst, size_t *dst_len, const char auth_tag_type,
     const otrng_dake_participant_data_s *responder, otrng_s *otr) {
+  const client_profile_s *our_profile = get_my_client_profile(otr);
+  otrng_serialized_profile_s *ser_our_profile =
+      get_my_serialized_client_profile(otr);
+
   const otrng_dake_participant_data_s initiator = {
-      .client_profile = get_my_client_profile(otr),
+      .client_profile = our_profile,
       .ecdh = *(otr->keys->our_ecdh->pub),
       .dh = our_dh(otr),
+      .ser_client_profile = ser_our_profile,
+      .ser_ephemeral = otrng_key_manager_get_our_pub(otr->keys),
   };
 
   uint8_t *phi = NULL;
@@ -712,7 +726,8 @@ tstatic otrng_result reply_with_auth_r_msg(string_p *dst, otrng_s *otr) {
       t, t_len);
   free(t);
 
-  otrng_result result = serialize_and_encode_auth_r(dst, msg);
+  otrng_result result = serialize_and_encode_auth_r(
+      dst, msg, get_my_serialized_client_profile(otr));
   otrng_dake_auth_r_destroy(msg);
 
   return result;
@@ -781,15 +796,17 @@ tstatic otrng_result generate_tmp_key_r(uint8_t *dst, otrng_s *otr) {
 }
 
 tstatic otrng_result serialize_and_encode_non_interactive_auth(
-    string_p *dst, const dake_non_interactive_auth_message_s *m) {
+    string_p *dst, const dake_non_interactive_auth_message_s *m,
+    const otrng_serialized_profile_s *ser_profile) {
   uint8_t *buff = NULL;
   size_t len = 0;
 
-  if (!otrng_dake_non_interactive_auth_message_asprintf(&buff, &len, m)) {
+  if (!otrng_dake_non_interactive_auth_message_asprintf(&buff, &len, m,
+                                                        ser_profile)) {
     return OTRNG_ERROR;
   }
 
-  *dst = otrl_base64_otr_encode(buff, len);
+  *dst = otrng_base64_otr_encode(buff, len);
 
   free(buff);
   return OTRNG_SUCCESS;
@@ -834,6 +851,7 @@ tstatic otrng_result build_non_interactive_auth_message(
       .client_profile = get_my_client_profile(otr),
       .ecdh = *(otr->keys->our_ecdh->pub),
       .dh = our_dh(otr),
+      .ser_client_profile = get_my_serialized_client_profile(otr),
   };
 
   uint8_t *phi = NULL;
@@ -895,7 +913,8 @@ tstatic otrng_result reply_with_non_interactive_auth_msg(string_p *dst,
   otrng_result ret = build_non_interactive_auth_message(auth, otr);
 
   if (ret == OTRNG_SUCCESS) {
-    ret = serialize_and_encode_non_interactive_auth(dst, auth);
+    ret = serialize_and_encode_non_interactive_auth(
+        dst, auth, get_my_serialized_client_profile(otr));
   }
 
   if (!otrng_key_manager_generate_shared_secret(otr->keys, otrng_false)) {
@@ -1026,7 +1045,7 @@ tstatic otrng_result prekey_message_received(const dake_prekey_message_s *m,
   otrng_key_manager_set_their_ecdh(m->Y, otr->keys);
   otrng_key_manager_set_their_dh(m->B, otr->keys);
 
-  if (!otrng_key_manager_generate_ephemeral_keys(otr->keys)) {
+  if (!otrng_key_manager_generate_dake_keys(otr->keys)) {
     return OTRNG_ERROR;
   }
 
@@ -1173,6 +1192,7 @@ tstatic otrng_bool verify_non_interactive_auth_message(
       .client_profile = get_my_client_profile(otr),
       .ecdh = *(otr->keys->our_ecdh->pub),
       .dh = our_dh(otr),
+      .ser_client_profile = get_my_serialized_client_profile(otr),
   };
 
   // clang-format off
@@ -1291,6 +1311,7 @@ tstatic otrng_result non_interactive_auth_message_received(
   otrng_dh_keypair_destroy(otr->keys->our_dh);
   otr->keys->our_dh->priv = otrng_dh_mpi_copy(stored_prekey->our_dh->priv);
   otr->keys->our_dh->pub = otrng_dh_mpi_copy(stored_prekey->our_dh->pub);
+  otrng_key_manager_our_dh_changed(otr->keys);
 
   if (auth->receiver_instance_tag != stored_prekey->sender_instance_tag) {
     return OTRNG_SUCCESS;
@@ -1346,7 +1367,8 @@ tstatic otrng_result receive_non_interactive_auth_message(
 
   dake_non_interactive_auth_message_p auth;
 
-  if (!otrng_dake_non_interactive_auth_message_deserialize(auth, src, len)) {
+  if (!otrng_dake_non_interactive_auth_message_deserialize_no_copy(auth, src,
+                                                                   len)) {
     otrng_error_message(&response->to_send, OTRNG_ERR_MSG_MALFORMED);
     return OTRNG_ERROR;
   }
@@ -1373,7 +1395,7 @@ tstatic otrng_result receive_identity_message_on_state_start(
 
   /* @secret the priv parts will be deleted once the mixed shared secret is
    * derived */
-  if (!otrng_key_manager_generate_ephemeral_keys(otr->keys)) {
+  if (!otrng_key_manager_generate_dake_keys(otr->keys)) {
     return OTRNG_ERROR;
   }
 
@@ -1392,8 +1414,11 @@ tstatic otrng_result receive_identity_message_on_state_start(
 }
 
 tstatic void forget_our_keys(otrng_s *otr) {
+  unsigned int checkpoint_interval = otr->keys->checkpoint_interval;
+
   otrng_key_manager_destroy(otr->keys);
   otrng_key_manager_init(otr->keys);
+  otr->keys->checkpoint_interval = checkpoint_interval;
 }
 
 tstatic otrng_result receive_identity_message_on_waiting_auth_r(
@@ -1427,7 +1452,7 @@ tstatic otrng_result receive_identity_message(string_p *dst,
   otrng_result result = OTRNG_ERROR;
   dake_identity_message_p m;
 
-  if (!otrng_dake_identity_message_deserialize(m, buff, buflen)) {
+  if (!otrng_dake_identity_message_deserialize_no_copy(m, buff, buflen)) {
     otrng_error_message(dst, OTRNG_ERR_MSG_MALFORMED);
     return result;
   }
@@ -1476,7 +1501,7 @@ tstatic otrng_result serialize_and_encode_auth_i(string_p *dst,
     return OTRNG_ERROR;
   }
 
-  *dst = otrl_base64_otr_encode(buff, len);
+  *dst = otrng_base64_otr_encode(buff, len);
 
   free(buff);
   return OTRNG_SUCCESS;
@@ -1555,7 +1580,7 @@ tstatic otrng_result receive_auth_r(string_p *dst, const uint8_t *buff,
   }
 
   dake_auth_r_p auth;
-  if (!otrng_dake_auth_r_deserialize(auth, buff, buff_len)) {
+  if (!otrng_dake_auth_r_deserialize_no_copy(auth, buff, buff_len)) {
     otrng_error_message(dst, OTRNG_ERR_MSG_MALFORMED);
     return OTRNG_ERROR;
   }
@@ -1693,22 +1718,24 @@ tstatic otrng_result receive_auth_i(char **dst, const uint8_t *buff,
 
 // TODO: @refactoring this is the same as otrng_close
 INTERNAL otrng_result otrng_expire_session(string_p *to_send, otrng_s *otr) {
-  size_t serlen = otrng_list_len(otr->keys->skipped_keys) * MAC_KEY_BYTES;
-  uint8_t *ser_mac_keys = otrng_reveal_mac_keys_on_tlv(otr->keys);
-  otr->keys->skipped_keys = NULL;
+  size_t serlen = 0;
+  uint8_t *ser_mac_keys = otrng_reveal_mac_keys_on_tlv(&serlen, otr->keys);
 
-  tlv_list_s *disconnected = otrng_tlv_list_one(
-      otrng_tlv_new(OTRNG_TLV_DISCONNECTED, serlen, ser_mac_keys));
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  otrng_result result = otrng_tlv_writer_append(
+      otr->tlv_writer, OTRNG_TLV_DISCONNECTED, ser_mac_keys, serlen);
   free(ser_mac_keys);
 
-  if (!disconnected) {
+  if (otrng_failed(result)) {
     return OTRNG_ERROR;
   }
 
   otrng_warning warn = OTRNG_WARN_NONE;
   // TODO: we are ignoring the warning/notification happening here
-  otrng_result result = otrng_send_message(to_send, "", &warn, disconnected,
-                                           MSGFLAGS_IGNORE_UNREADABLE, otr);
+  result = otrng_prepare_to_send_serialized_tlvs(
+      to_send, &warn, "", otr->tlv_writer->data, otr->tlv_writer->len, otr,
+      MSGFLAGS_IGNORE_UNREADABLE);
+  otrng_tlv_writer_reset(otr->tlv_writer);
 
   forget_our_keys(otr);
   otr->state = OTRNG_STATE_START;
@@ -1729,7 +1756,8 @@ tstatic tlv_list_s *deserialize_received_tlvs(const uint8_t *src, size_t len) {
 
 tstatic otrng_result decrypt_data_msg(otrng_response_s *response,
                                       const msg_enc_key_p enc_key,
-                                      const data_message_s *msg) {
+                                      const data_message_s *msg,
+                                      otrng_s *otr) {
   string_p *dst = &response->to_display;
 
 #ifdef DEBUG
@@ -1741,8 +1769,9 @@ tstatic otrng_result decrypt_data_msg(otrng_response_s *response,
   otrng_memdump(msg->nonce, DATA_MSG_NONCE_BYTES);
 #endif
 
-  // TODO: @initialization What if msg->enc_msg_len == 0?
-  uint8_t *plain = malloc(msg->enc_msg_len);
+  /* The plaintext is wiped when the scratch arena is reset. An empty
+   * ciphertext gets an empty, but valid, plaintext */
+  uint8_t *plain = otrng_arena_alloc(otr->scratch, msg->enc_msg_len);
   if (!plain) {
     return OTRNG_ERROR;
   }
@@ -1751,7 +1780,6 @@ tstatic otrng_result decrypt_data_msg(otrng_response_s *response,
                               enc_key);
 
   if (err) {
-    free(plain);
     return OTRNG_ERROR;
   }
 
@@ -1761,7 +1789,6 @@ tstatic otrng_result decrypt_data_msg(otrng_response_s *response,
   }
 
   response->tlvs = deserialize_received_tlvs(plain, msg->enc_msg_len);
-  free(plain);
   return OTRNG_SUCCESS;
 }
 
@@ -1797,7 +1824,8 @@ tstatic tlv_s *process_tlv(const tlv_s *tlv, otrng_s *otr) {
   return otrng_process_smp_tlv(tlv, otr);
 }
 
-tstatic otrng_result process_received_tlvs(tlv_list_s **to_send,
+/* The replies are written to the TLV writer as they are made */
+tstatic otrng_result process_received_tlvs(otrng_tlv_writer_s *to_send,
                                            otrng_response_s *response,
                                            otrng_s *otr) {
   const tlv_list_s *current = response->tlvs;
@@ -1809,8 +1837,10 @@ tstatic otrng_result process_received_tlvs(tlv_list_s **to_send,
       continue;
     }
 
-    *to_send = otrng_append_tlv(*to_send, tlv);
-    if (!*to_send) {
+    otrng_result ret =
+        otrng_tlv_writer_append(to_send, tlv->type, tlv->data, tlv->len);
+    otrng_tlv_free(tlv);
+    if (otrng_failed(ret)) {
       return OTRNG_ERROR;
     }
   }
@@ -1818,23 +1848,25 @@ tstatic otrng_result process_received_tlvs(tlv_list_s **to_send,
   return OTRNG_SUCCESS;
 }
 
+/* The SMP callbacks may send a message of their own while the TLVs are
+ * processed, which uses otr->tlv_writer, so the replies get their own */
 tstatic otrng_result receive_tlvs(otrng_response_s *response, otrng_s *otr) {
-  tlv_list_s *reply_tlvs = NULL;
-  otrng_result ret = process_received_tlvs(&reply_tlvs, response, otr);
-  if (!reply_tlvs) {
-    return ret;
-  }
+  otrng_tlv_writer_p to_send;
+  otrng_tlv_writer_init(to_send);
 
-  if (!ret) {
+  otrng_result ret = process_received_tlvs(to_send, response, otr);
+  if (!to_send->len || !ret) {
+    otrng_tlv_writer_destroy(to_send);
     return ret;
   }
 
   // Serialize response message to send
   // TODO: this ignores the warning received. that might
   // be valid, but should be investigated.
-  ret = otrng_send_message(&response->to_send, "", NULL, reply_tlvs,
-                           MSGFLAGS_IGNORE_UNREADABLE, otr);
-  otrng_tlv_list_free(reply_tlvs);
+  ret = otrng_prepare_to_send_serialized_tlvs(
+      &response->to_send, NULL, "", to_send->data, to_send->len, otr,
+      MSGFLAGS_IGNORE_UNREADABLE);
+  otrng_tlv_writer_destroy(to_send);
   return ret;
 }
 
@@ -1851,7 +1883,8 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
   response->to_display = NULL;
 
   size_t read = 0;
-  if (otrng_failed(otrng_data_message_deserialize(msg, buff, buflen, &read))) {
+  if (otrng_failed(
+          otrng_data_message_deserialize_no_copy(msg, buff, buflen, &read))) {
     otrng_error_message(&response->to_send, OTRNG_ERR_MSG_MALFORMED);
     otrng_data_message_free(msg);
     return OTRNG_ERROR;
@@ -1881,8 +1914,12 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
   receiving_ratchet_s *tmp_receiving_ratchet;
   tmp_receiving_ratchet = otrng_receiving_ratchet_new(otr->keys);
 
-  otrng_key_manager_set_their_tmp_keys(msg->ecdh, msg->dh,
-                                       tmp_receiving_ratchet);
+  if (!otrng_key_manager_set_their_tmp_keys(msg->ecdh, msg->dh, otr->keys,
+                                            tmp_receiving_ratchet)) {
+    otrng_receiving_ratchet_destroy(tmp_receiving_ratchet);
+    otrng_data_message_free(msg);
+    return OTRNG_ERROR;
+  }
 
   do {
     /* Try to decrypt the message with a stored skipped message key */
@@ -1905,7 +1942,12 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
           warn);
       tmp_receiving_ratchet->k = tmp_receiving_ratchet->k + 1;
     }
-    if (!otrng_valid_data_message(mac_key, msg)) {
+    /* A DH key we already hold was validated when it was first received */
+    otrng_bool valid =
+        tmp_receiving_ratchet->their_dh_unchanged
+            ? otrng_valid_data_message_known_dh(mac_key, msg)
+            : otrng_valid_data_message(mac_key, msg);
+    if (!valid) {
       sodium_memzero(enc_key, sizeof(enc_key));
       sodium_memzero(mac_key, sizeof(mac_key));
       otrng_data_message_free(msg);
@@ -1923,7 +1965,7 @@ tstatic otrng_result otrng_receive_data_message_after_dake(
       return OTRNG_ERROR;
     }
 
-    if (otrng_failed(decrypt_data_msg(response, enc_key, msg))) {
+    if (otrng_failed(decrypt_data_msg(response, enc_key, msg, otr))) {
 
       if (msg->flags != MSGFLAGS_IGNORE_UNREADABLE) {
         otrng_error_message(&response->to_send, OTRNG_ERR_MSG_UNREADABLE);
@@ -2087,18 +2129,23 @@ tstatic otrng_result receive_decoded_message(otrng_response_s *response,
 
 tstatic otrng_result receive_encoded_message(otrng_response_s *response,
                                              otrng_warning *warn,
-                                             const string_p message,
+                                             const otrng_message_info_s *info,
                                              otrng_s *otr) {
-  size_t dec_len = 0;
-  uint8_t *decoded = NULL;
-  if (otrl_base64_otr_decode(message, &decoded, &dec_len)) {
+  if (!info->payload) {
     return OTRNG_ERROR;
   }
-  otrng_result result =
-      receive_decoded_message(response, warn, decoded, dec_len, otr);
-  free(decoded);
 
-  return result;
+  /* Only needed while the message is handled: the scratch arena releases it */
+  size_t max_len = OTRNG_BASE64_DECODE_LEN(info->payload_len);
+  uint8_t *decoded = otrng_arena_alloc(otr->scratch, max_len);
+  if (!decoded && max_len) {
+    return OTRNG_ERROR;
+  }
+
+  size_t dec_len =
+      otrng_base64_decode_into(decoded, info->payload, info->payload_len);
+
+  return receive_decoded_message(response, warn, decoded, dec_len, otr);
 }
 
 tstatic otrng_result receive_error_message(otrng_response_s *response,
@@ -2132,38 +2179,105 @@ tstatic otrng_result receive_error_message(otrng_response_s *response,
   return OTRNG_ERROR;
 }
 
-API int otrng_get_message_type(const string_p message) {
-  if (message_contains_tag(message)) {
-    return MSG_TAGGED_PLAINTEXT;
+static inline otrng_bool has_prefix(const char *str, const char *prefix,
+                                     size_t prefix_len) {
+  return strncmp(str, prefix, prefix_len) == 0;
+}
+
+INTERNAL void otrng_classify_message(otrng_message_info_s *info,
+                                     const string_p message) {
+  const char *query = NULL;
+  const char *encoded = NULL;
+  const char *encoded_end = NULL;
+
+  memset(info, 0, sizeof(otrng_message_info_s));
+
+  /* Every marker starts with either '?' or a whitespace tag character, so
+   * only those positions are compared against them */
+  for (const char *c = message; *c; c++) {
+    switch (*c) {
+    case ' ':
+    case '\t':
+      if (!info->tag && has_prefix(c, tag_base, WHITESPACE_TAG_BASE_BYTES)) {
+        info->tag = c;
+      }
+
+      if (!info->tag_v4 &&
+          has_prefix(c, tag_version_v4, WHITESPACE_TAG_VERSION_BYTES)) {
+        info->tag_v4 = otrng_true;
+      }
+
+      if (!info->tag_v3 &&
+          has_prefix(c, tag_version_v3, WHITESPACE_TAG_VERSION_BYTES)) {
+        info->tag_v3 = otrng_true;
+      }
+      break;
+
+    case '?':
+      if (!info->dh_commit && has_prefix(c, "?OTR:AAMC", 9)) {
+        info->dh_commit = otrng_true;
+      }
+
+      if (!query && has_prefix(c, query_header, QUERY_MESSAGE_TAG_BYTES)) {
+        query = c;
+      } else if (!encoded && has_prefix(c, otr_header, strlen(otr_header))) {
+        encoded = c;
+      }
+      break;
+
+    case '.':
+      if (encoded && !encoded_end) {
+        encoded_end = c;
+      }
+      break;
+    }
   }
-  if (message_is_query(message)) {
-    return MSG_QUERY_STRING;
-  } else if (message_is_otr_error(message)) {
-    return MSG_OTR_ERROR;
-  } else if (message_is_otr_encoded(message)) {
-    return MSG_OTR_ENCODED;
+
+  /* An encoded message without its terminating '.' has no payload */
+  if (encoded_end) {
+    info->payload = encoded + strlen(otr_header);
+    info->payload_len = encoded_end - info->payload;
+  }
+
+  if (info->tag) {
+    info->type = MSG_TAGGED_PLAINTEXT;
+  } else if (query) {
+    info->type = MSG_QUERY_STRING;
+  } else if (has_prefix(message, otr_error_header,
+                        strlen(otr_error_header))) {
+    info->type = MSG_OTR_ERROR;
+  } else if (encoded) {
+    info->type = MSG_OTR_ENCODED;
+  } else {
+    info->type = MSG_PLAINTEXT;
   }
+}
+
+API int otrng_get_message_type(const string_p message) {
+  otrng_message_info_p info;
+  otrng_classify_message(info, message);
 
-  return MSG_PLAINTEXT;
+  return info->type;
 }
 
 tstatic otrng_result receive_message_v4_only(otrng_response_s *response,
                                              otrng_warning *warn,
                                              const string_p message,
+                                             const otrng_message_info_s *info,
                                              otrng_s *otr) {
-  switch (otrng_get_message_type(message)) {
+  switch (info->type) {
   case MSG_PLAINTEXT:
     receive_plaintext(response, message, otr);
     return OTRNG_SUCCESS;
 
   case MSG_TAGGED_PLAINTEXT:
-    return receive_tagged_plaintext(response, message, otr);
+    return receive_tagged_plaintext(response, message, info, otr);
 
   case MSG_QUERY_STRING:
     return receive_query_message(response, message, otr);
 
   case MSG_OTR_ENCODED:
-    return receive_encoded_message(response, warn, message, otr);
+    return receive_encoded_message(response, warn, info, otr);
 
   case MSG_OTR_ERROR:
     return receive_error_message(response, message + strlen(ERROR_PREFIX));
@@ -2172,6 +2286,38 @@ tstatic otrng_result receive_message_v4_only(otrng_response_s *response,
   return OTRNG_SUCCESS;
 }
 
+/* The payload of an encoded message is decoded as its fragments arrive, and
+ * is handled without going back to text */
+tstatic otrng_result receive_fragment(otrng_response_s *response,
+                                      otrng_warning *warn,
+                                      const string_p message, otrng_s *otr) {
+  uint8_t *defrag = NULL;
+  size_t defrag_len = 0;
+  otrng_bool encoded = otrng_false;
+  if (otrng_failed(otrng_unfragment_and_decode_message(
+          &defrag, &defrag_len, &encoded, &otr->pending_fragments, message,
+          our_instance_tag(otr)))) {
+    return OTRNG_ERROR;
+  }
+
+  if (!defrag) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_result ret;
+  otrng_arena_enter(otr->scratch);
+  if (encoded) {
+    ret = receive_decoded_message(response, warn, defrag, defrag_len, otr);
+  } else {
+    ret = otrng_receive_defragmented_message(response, warn, (char *)defrag,
+                                             otr);
+  }
+  otrng_arena_leave(otr->scratch);
+
+  free(defrag);
+  return ret;
+}
+
 /* Receive a possibly OTR message. */
 INTERNAL otrng_result otrng_receive_message(otrng_response_s *response,
                                             otrng_warning *warn,
@@ -2180,14 +2326,33 @@ INTERNAL otrng_result otrng_receive_message(otrng_response_s *response,
   response->warning = OTRNG_WARN_NONE;
   response->to_display = NULL;
 
+  if (otrng_is_fragment(message) &&
+      otr->running_version != OTRNG_PROTOCOL_VERSION_3) {
+    return receive_fragment(response, warn, message, otr);
+  }
+
+  /* Only fragments are copied: anything else is handled in place. libotr is
+   * given the text of the whole message. */
   char *defrag = NULL;
-  if (otrng_failed(otrng_unfragment_message(&defrag, &otr->pending_fragments,
-                                            message, our_instance_tag(otr)))) {
-    return OTRNG_ERROR;
+  if (otrng_is_fragment(message)) {
+    if (otrng_failed(otrng_unfragment_message(&defrag, &otr->pending_fragments,
+                                              message,
+                                              our_instance_tag(otr)))) {
+      return OTRNG_ERROR;
+    }
+
+    if (!defrag) {
+      return OTRNG_ERROR;
+    }
+
+    message = defrag;
   }
 
+  otrng_arena_enter(otr->scratch);
   otrng_result ret =
-      otrng_receive_defragmented_message(response, warn, defrag, otr);
+      otrng_receive_defragmented_message(response, warn, message, otr);
+  otrng_arena_leave(otr->scratch);
+
   free(defrag);
   return ret;
 }
@@ -2202,8 +2367,11 @@ INTERNAL otrng_result otrng_receive_defragmented_message(
 
   response->to_display = NULL;
 
+  otrng_message_info_p info;
+  otrng_classify_message(info, message);
+
   /* A DH-Commit sets our running version to 3 */
-  if (allow_version(otr, OTRNG_ALLOW_V3) && strstr(message, "?OTR:AAMC")) {
+  if (allow_version(otr, OTRNG_ALLOW_V3) && info->dh_commit) {
     otr->running_version = OTRNG_PROTOCOL_VERSION_3;
   }
 
@@ -2214,7 +2382,7 @@ INTERNAL otrng_result otrng_receive_defragmented_message(
   case OTRNG_PROTOCOL_VERSION_4:
   default:
     // V4 handles every message BUT v3 messages
-    return receive_message_v4_only(response, warn, message, otr);
+    return receive_message_v4_only(response, warn, message, info, otr);
   }
 
   return OTRNG_ERROR;
@@ -2229,17 +2397,23 @@ INTERNAL otrng_result otrng_send_message(string_p *to_send,
     return OTRNG_ERROR;
   }
 
+  otrng_result ret = OTRNG_ERROR;
+
+  otrng_arena_enter(otr->scratch);
   switch (otr->running_version) {
   case OTRNG_PROTOCOL_VERSION_3:
-    return otrng_v3_send_message(to_send, message, tlvs, otr->v3_conn);
+    ret = otrng_v3_send_message(to_send, message, tlvs, otr->v3_conn);
+    break;
   case OTRNG_PROTOCOL_VERSION_4:
-    return otrng_prepare_to_send_data_message(to_send, warn, message, tlvs, otr,
-                                              flags);
+    ret = otrng_prepare_to_send_data_message(to_send, warn, message, tlvs, otr,
+                                             flags);
+    break;
   default:
-    return OTRNG_ERROR;
+    break;
   }
+  otrng_arena_leave(otr->scratch);
 
-  return OTRNG_SUCCESS;
+  return ret;
 }
 
 tstatic otrng_result otrng_close_v4(string_p *to_send, otrng_s *otr) {
@@ -2247,25 +2421,26 @@ tstatic otrng_result otrng_close_v4(string_p *to_send, otrng_s *otr) {
     return OTRNG_SUCCESS;
   }
 
-  size_t serlen = otrng_list_len(otr->keys->skipped_keys) * MAC_KEY_BYTES;
-  uint8_t *ser_mac_keys = otrng_reveal_mac_keys_on_tlv(otr->keys);
-  otr->keys->skipped_keys = NULL;
+  size_t serlen = 0;
+  uint8_t *ser_mac_keys = otrng_reveal_mac_keys_on_tlv(&serlen, otr->keys);
 
-  tlv_list_s *disconnected = otrng_tlv_list_one(
-      otrng_tlv_new(OTRNG_TLV_DISCONNECTED, serlen, ser_mac_keys));
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  otrng_result result = otrng_tlv_writer_append(
+      otr->tlv_writer, OTRNG_TLV_DISCONNECTED, ser_mac_keys, serlen);
   free(ser_mac_keys);
 
-  if (!disconnected) {
+  if (otrng_failed(result)) {
     return OTRNG_ERROR;
   }
 
   otrng_warning warn = OTRNG_WARN_NONE;
   // TODO: we are ignoring the warning here. Send in NULL if we don't care.
   // Otherwise we should act on it.
-  otrng_result result = otrng_send_message(to_send, "", &warn, disconnected,
-                                           MSGFLAGS_IGNORE_UNREADABLE, otr);
+  result = otrng_prepare_to_send_serialized_tlvs(
+      to_send, &warn, "", otr->tlv_writer->data, otr->tlv_writer->len, otr,
+      MSGFLAGS_IGNORE_UNREADABLE);
+  otrng_tlv_writer_reset(otr->tlv_writer);
 
-  otrng_tlv_list_free(disconnected);
   forget_our_keys(otr);
   otr->state = OTRNG_STATE_START;
   gone_insecure_cb_v4(otr->conversation);
@@ -2306,38 +2481,34 @@ tstatic otrng_result otrng_send_symkey_message_v4(
     return OTRNG_ERROR;
   }
 
-  unsigned char *tlv_data = malloc(usedatalen + 4);
-
-  tlv_data[0] = (use >> 24) & 0xff;
-  tlv_data[1] = (use >> 16) & 0xff;
-  tlv_data[2] = (use >> 8) & 0xff;
-  tlv_data[3] = (use)&0xff;
-
-  if (usedatalen > 0) {
-    memmove(tlv_data + 4, usedata, usedatalen);
-  }
+  /* The use and its data are written straight after the TLV header */
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  uint8_t *tlv_data = otrng_tlv_writer_reserve(
+      otr->tlv_writer, OTRNG_TLV_SYM_KEY, usedatalen + 4);
 
   memmove(extra_key, otr->keys->extra_symmetric_key,
           sizeof(extra_symmetric_key_p));
 
-  tlv_list_s *tlvs = otrng_tlv_list_one(
-      otrng_tlv_new(OTRNG_TLV_SYM_KEY, usedatalen + 4, tlv_data));
-  free(tlv_data);
-
   // TODO: @freeing Should not extra_key be zeroed if any error happens from
   // here on?
-  if (!tlvs) {
+  if (!tlv_data) {
     return OTRNG_ERROR;
   }
 
+  otrng_serialize_uint32(tlv_data, use);
+  if (usedatalen > 0) {
+    memmove(tlv_data + 4, usedata, usedatalen);
+  }
+
   otrng_warning warn = OTRNG_WARN_NONE;
   // TODO: @refactoring in v3 the extra_key is passed as a param to this
   // do the same?
   // TODO: if we don't care about the warning, send in NULL. Otherwise
   // act on it
-  otrng_result ret = otrng_send_message(to_send, "", &warn, tlvs,
-                                        MSGFLAGS_IGNORE_UNREADABLE, otr);
-  otrng_tlv_list_free(tlvs);
+  otrng_result ret = otrng_prepare_to_send_serialized_tlvs(
+      to_send, &warn, "", otr->tlv_writer->data, otr->tlv_writer->len, otr,
+      MSGFLAGS_IGNORE_UNREADABLE);
+  otrng_tlv_writer_reset(otr->tlv_writer);
 
   return ret;
 }
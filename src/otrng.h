@@ -30,6 +30,7 @@
 #include "prekey_ensemble.h"
 #include "prekey_profile.h"
 #include "protocol.h"
+#include "shake.h"
 #include "shared.h"
 #include "smp.h"
 #include "str.h"
@@ -50,6 +51,7 @@
   do {                                                                         \
     otrng_v3_init();                                                           \
     otrng_dh_init();                                                           \
+    otrng_shake_init();                                                        \
   } while (0)
 
 #define OTRNG_FREE                                                             \
@@ -64,6 +66,17 @@ typedef struct otrng_server_s {
 } otrng_server_s, otrng_server_p[1];
 // clang-format on
 
+/* What a single scan of an incoming message found */
+typedef struct otrng_message_info_s {
+  int type;
+  const char *tag;      /* The whitespace tag, if any */
+  otrng_bool tag_v4;    /* A v4 whitespace version tag was found */
+  otrng_bool tag_v3;    /* A v3 whitespace version tag was found */
+  const char *payload;  /* The base64 payload of an encoded message */
+  size_t payload_len;
+  otrng_bool dh_commit; /* A v3 DH-Commit was found anywhere in it */
+} otrng_message_info_s, otrng_message_info_p[1];
+
 // TODO: @refactoring The use of "response" as the type name is confusing:
 // - to_display is the RECEIVED plaintext
 // - tlvs is the RECEIVED list of TLVs
@@ -94,6 +107,11 @@ INTERNAL otrng_response_s *otrng_response_new(void);
 
 INTERNAL void otrng_response_free(otrng_response_s *response);
 
+INTERNAL void otrng_response_init(otrng_response_s *response);
+
+/* Frees what the response holds, but not the response itself. */
+INTERNAL void otrng_response_destroy(otrng_response_s *response);
+
 INTERNAL otrng_result otrng_receive_defragmented_message(
     otrng_response_s *response, otrng_warning *warn, const string_p message,
     otrng_s *otr);
@@ -113,6 +131,18 @@ INTERNAL otrng_result otrng_close(string_p *to_send, otrng_s *otr);
 
 INTERNAL otrng_result otrng_expire_session(string_p *to_send, otrng_s *otr);
 
+/**
+ * @brief Does the work of a DAKE that does not depend on the peer: our
+ *        serialized client profile, and the ephemeral keys of our next DAKE
+ *        message, with their serialized forms.
+ *
+ * Meant to be called when idle, so that replying to an Identity message
+ * only needs the ring signature.
+ *
+ * @param [otr]   The otrng connection.
+ */
+API otrng_result otrng_prepare_dake(otrng_s *otr);
+
 API otrng_result otrng_build_whitespace_tag(string_p *whitespace_tag,
                                             const string_p message,
                                             otrng_s *otr);
@@ -143,6 +173,15 @@ API otrng_result otrng_extract_header(otrng_header_s *dst,
                                       const uint8_t *buffer,
                                       const size_t bufflen);
 
+/**
+ * @brief Classifies a message in a single pass over it.
+ *
+ * @param [info]      The result.
+ * @param [message]   The message. info points into it.
+ */
+INTERNAL void otrng_classify_message(otrng_message_info_s *info,
+                                     const string_p message);
+
 API int otrng_get_message_type(const string_p message);
 #ifdef OTRNG_OTRNG_PRIVATE
 
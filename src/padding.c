@@ -20,6 +20,7 @@
 
 #include "padding.h"
 
+#include "serialize.h"
 #include "tlv.h"
 
 static size_t calculate_padding_len(size_t message_len, size_t max) {
@@ -31,31 +32,25 @@ static size_t calculate_padding_len(size_t message_len, size_t max) {
   return max - ((message_len + tlv_header_len + 1) % max);
 }
 
-INTERNAL otrng_result generate_padding(uint8_t **dst, size_t *dstlen,
-                                       size_t message_len, const otrng_s *otr) {
+INTERNAL size_t otrng_padding_tlv_len(size_t message_len, const otrng_s *otr) {
   size_t padding_len =
       calculate_padding_len(message_len, otr->conversation->client->padding);
   if (!padding_len) {
-    return OTRNG_SUCCESS;
+    return 0;
   }
 
-  tlv_s *padding_tlv = otrng_tlv_padding_new(padding_len);
-  if (!padding_tlv) {
-    return OTRNG_ERROR;
-  }
+  return padding_len + 4;
+}
 
-  *dstlen = padding_tlv->len + 4;
-  *dst = malloc(*dstlen);
-  if (!*dst) {
-    otrng_tlv_free(padding_tlv);
-    return OTRNG_ERROR;
+INTERNAL size_t otrng_padding_tlv_serialize(uint8_t *dst, size_t tlv_len) {
+  if (!tlv_len) {
+    return 0;
   }
 
-  size_t ret = otrng_tlv_serialize(*dst, padding_tlv);
-  otrng_tlv_free(padding_tlv);
+  size_t w = 0;
+  w += otrng_serialize_uint16(dst + w, OTRNG_TLV_PADDING);
+  w += otrng_serialize_uint16(dst + w, tlv_len - 4);
+  memset(dst + w, 0, tlv_len - w);
 
-  if (ret == 0) {
-    return OTRNG_ERROR;
-  }
-  return OTRNG_SUCCESS;
+  return tlv_len;
 }
@@ -28,7 +28,18 @@
 #include "otrng.h"
 #include "shared.h"
 
-INTERNAL otrng_result generate_padding(uint8_t **dst, size_t *dstlen,
-                                       size_t message_len, const otrng_s *otr);
+/**
+ * @brief The length of the padding TLV that goes after a plaintext of
+ *        [message_len] bytes, or 0 if it is not padded.
+ */
+INTERNAL size_t otrng_padding_tlv_len(size_t message_len, const otrng_s *otr);
+
+/**
+ * @brief Writes a padding TLV of [tlv_len] bytes, as given by
+ *        otrng_padding_tlv_len, to [dst].
+ *
+ * @return The number of bytes written.
+ */
+INTERNAL size_t otrng_padding_tlv_serialize(uint8_t *dst, size_t tlv_len);
 
 #endif
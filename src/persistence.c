@@ -150,6 +150,7 @@ INTERNAL otrng_result otrng_client_state_instance_tag_write_FILEp(
 
   gcry_error_t ret = otrl_instag_generate_FILEp(state->user_state, instagf,
                                                 account_name, protocol_name);
+  otrng_client_state_forget_instance_tag(state);
 
   free(account_name);
   free(protocol_name);
@@ -167,6 +168,7 @@ INTERNAL otrng_result otrng_client_state_instance_tag_read_FILEp(
   }
 
   gcry_error_t ret = otrl_instag_read_FILEp(state->user_state, instag);
+  otrng_client_state_forget_instance_tag(state);
 
   if (ret) {
     return OTRNG_ERROR;
@@ -228,7 +230,7 @@ INTERNAL otrng_result otrng_client_state_client_profile_read_FILEp(
     return OTRNG_ERROR;
   }
 
-  size_t dec_len = otrl_base64_decode(dec, line, len);
+  size_t dec_len = otrng_base64_decode_into(dec, line, len);
   free(line);
 
   client_profile_s profile[1];
@@ -256,14 +258,17 @@ INTERNAL otrng_result otrng_client_state_client_profile_write_FILEp(
     return OTRNG_ERROR;
   }
 
-  uint8_t *buff = NULL;
+  const uint8_t *buff = NULL;
   size_t s = 0;
-  if (!otrng_client_profile_asprintf(&buff, &s, state->client_profile)) {
+  uint8_t *owned = NULL;
+  if (!otrng_client_profile_get_serialized(&buff, &s, &owned,
+                                           state->client_profile,
+                                           state->ser_client_profile)) {
     return OTRNG_ERROR;
   }
 
   char *encoded = otrng_base64_encode(buff, s);
-  free(buff);
+  free(owned);
   if (!encoded) {
     return OTRNG_ERROR;
   }
@@ -366,7 +371,8 @@ otrng_result read_and_deserialize_prekey(otrng_client_state_s *state,
   int line_len = 0;
   size_t cap;
 
-  otrng_stored_prekeys_s *prekey_msg = malloc(sizeof(otrng_stored_prekeys_s));
+  otrng_stored_prekeys_s *prekey_msg =
+      otrng_secure_alloc(sizeof(otrng_stored_prekeys_s));
   if (!prekey_msg) {
     return OTRNG_ERROR;
   }
@@ -406,7 +412,7 @@ otrng_result read_and_deserialize_prekey(otrng_client_state_s *state,
     return OTRNG_ERROR;
   }
 
-  size_t scalar_len = otrl_base64_decode(dec, line, line_len);
+  size_t scalar_len = otrng_base64_decode_into(dec, line, line_len);
   free(line);
   line = NULL;
 
@@ -432,7 +438,7 @@ otrng_result read_and_deserialize_prekey(otrng_client_state_s *state,
     return OTRNG_ERROR;
   }
 
-  size_t priv_len = otrl_base64_decode(dec, line, line_len - 1);
+  size_t priv_len = otrng_base64_decode_into(dec, line, line_len - 1);
   free(line);
 
   prekey_msg->our_dh->priv = NULL;
@@ -479,14 +485,17 @@ INTERNAL otrng_result otrng_client_state_prekey_profile_write_FILEp(
     return OTRNG_ERROR;
   }
 
-  uint8_t *buff = NULL;
+  const uint8_t *buff = NULL;
   size_t s = 0;
-  if (!otrng_prekey_profile_asprint(&buff, &s, state->prekey_profile)) {
+  uint8_t *owned = NULL;
+  if (!otrng_prekey_profile_get_serialized(&buff, &s, &owned,
+                                           state->prekey_profile,
+                                           state->ser_prekey_profile)) {
     return OTRNG_ERROR;
   }
 
   char *encoded = otrng_base64_encode(buff, s);
-  free(buff);
+  free(owned);
   if (!encoded) {
     return OTRNG_ERROR;
   }
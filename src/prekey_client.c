@@ -110,6 +110,7 @@ otrng_prekey_client_new(const char *server, const char *our_identity,
 
   ret->instance_tag = instance_tag;
   ret->client_profile = client_profile;
+  ret->ser_client_profile = NULL;
   // TODO: Can be null if you dont want to publish it
   ret->prekey_profile = prekey_profile;
   ret->keypair = keypair;
@@ -139,8 +140,8 @@ API void otrng_prekey_client_free(otrng_prekey_client_s *client) {
   free(client);
 }
 
-static otrng_result prekey_decode(const char *message, uint8_t **buffer,
-                                  size_t *buffer_len) {
+INTERNAL otrng_result otrng_prekey_decode(const char *message,
+                                         uint8_t **buffer, size_t *buffer_len) {
   size_t len = strlen(message);
 
   if (!len || '.' != message[len - 1]) {
@@ -153,18 +154,18 @@ static otrng_result prekey_decode(const char *message, uint8_t **buffer,
     return OTRNG_ERROR;
   }
 
-  *buffer_len = otrl_base64_decode(*buffer, message, len - 1);
+  *buffer_len = otrng_base64_decode_into(*buffer, message, len - 1);
 
   return OTRNG_SUCCESS;
 }
 
-static char *prekey_encode(const uint8_t *buffer, size_t buffer_len) {
+INTERNAL char *otrng_prekey_encode(const uint8_t *buffer, size_t buffer_len) {
   char *ret = malloc(OTRNG_BASE64_ENCODE_LEN(buffer_len) + 2);
   if (!ret) {
     return NULL;
   }
 
-  size_t l = otrl_base64_encode(ret, buffer, buffer_len);
+  size_t l = otrng_base64_encode_into(ret, buffer, buffer_len);
   ret[l] = '.';
   ret[l + 1] = 0;
 
@@ -193,7 +194,7 @@ static char *start_dake_and_then_send(otrng_prekey_client_s *client,
     return NULL;
   }
 
-  char *ret = prekey_encode(serialized, serialized_len);
+  char *ret = otrng_prekey_encode(serialized, serialized_len);
   free(serialized);
 
   client->after_dake = next;
@@ -236,7 +237,7 @@ API char *otrng_prekey_client_retrieve_prekeys(const char *identity,
     return NULL;
   }
 
-  char *ret = prekey_encode(serialized, serialized_len);
+  char *ret = otrng_prekey_encode(serialized, serialized_len);
   free(serialized);
   return ret;
 }
@@ -308,11 +309,12 @@ static uint8_t *otrng_prekey_client_get_expected_composite_phi(
 }
 
 static uint8_t usage_auth = 0x11;
-static const char *prekey_hash_domain = "OTR-Prekey-Server";
+static const otrng_shake_domain prekey_hash_domain =
+    OTRNG_SHAKE_DOMAIN_PREKEY_SERVER;
 
 INTERNAL void kdf_init_with_usage(goldilocks_shake256_ctx_p hash,
                                   uint8_t usage) {
-  hash_init_with_usage_and_domain_separation(hash, usage, prekey_hash_domain);
+  hash_init_with_usage_prekey_server(hash, usage);
 }
 
 static otrng_bool
@@ -334,10 +336,13 @@ otrng_prekey_dake2_message_valid(const otrng_prekey_dake2_message_s *msg,
     return otrng_false;
   }
 
-  uint8_t *our_profile = NULL;
+  const uint8_t *our_profile = NULL;
   size_t our_profile_len = 0;
-  if (!otrng_client_profile_asprintf(&our_profile, &our_profile_len,
-                                     client->client_profile)) {
+  uint8_t *owned_profile = NULL;
+  if (!otrng_client_profile_get_serialized(&our_profile, &our_profile_len,
+                                           &owned_profile,
+                                           client->client_profile,
+                                           client->ser_client_profile)) {
     free(composite_phi);
     return otrng_false;
   }
@@ -346,7 +351,7 @@ otrng_prekey_dake2_message_valid(const otrng_prekey_dake2_message_s *msg,
   uint8_t *t = malloc(tlen);
   if (!t) {
     free(composite_phi);
-    free(our_profile);
+    free(owned_profile);
     return otrng_false;
   }
 
@@ -359,7 +364,7 @@ otrng_prekey_dake2_message_valid(const otrng_prekey_dake2_message_s *msg,
 
   shake_256_prekey_server_kdf(t + w, HASH_BYTES, usage_initator_client_profile,
                               our_profile, our_profile_len);
-  free(our_profile);
+  free(owned_profile);
 
   w += HASH_BYTES;
 
@@ -544,10 +549,13 @@ tstatic char *send_dake3(const otrng_prekey_dake2_message_s *msg2,
     return NULL;
   }
 
-  uint8_t *our_profile = NULL;
+  const uint8_t *our_profile = NULL;
   size_t our_profile_len = 0;
-  if (!otrng_client_profile_asprintf(&our_profile, &our_profile_len,
-                                     client->client_profile)) {
+  uint8_t *owned_profile = NULL;
+  if (!otrng_client_profile_get_serialized(&our_profile, &our_profile_len,
+                                           &owned_profile,
+                                           client->client_profile,
+                                           client->ser_client_profile)) {
     return NULL;
   }
 
@@ -555,7 +563,7 @@ tstatic char *send_dake3(const otrng_prekey_dake2_message_s *msg2,
   uint8_t *t = malloc(tlen);
   if (!t) {
     free(composite_phi);
-    free(our_profile);
+    free(owned_profile);
     return NULL;
   }
 
@@ -568,7 +576,7 @@ tstatic char *send_dake3(const otrng_prekey_dake2_message_s *msg2,
 
   shake_256_prekey_server_kdf(t + w, HASH_BYTES, usage_receiver_client_profile,
                               our_profile, our_profile_len);
-  free(our_profile);
+  free(owned_profile);
 
   w += HASH_BYTES;
 
@@ -648,7 +656,7 @@ tstatic char *send_dake3(const otrng_prekey_dake2_message_s *msg2,
     return NULL;
   }
 
-  char *ret = prekey_encode(serialized, serialized_len);
+  char *ret = otrng_prekey_encode(serialized, serialized_len);
   free(serialized);
 
   return ret;
@@ -865,7 +873,7 @@ static void process_received_prekey_ensemble_retrieval(
 
   for (int i = 0; i < msg->num_ensembles; i++) {
     if (!otrng_prekey_ensemble_validate(msg->ensembles[i])) {
-      otrng_prekey_ensemble_destroy(msg->ensembles[i]);
+      otrng_prekey_ensemble_free(msg->ensembles[i]);
       msg->ensembles[i] = NULL;
     }
   }
@@ -964,7 +972,7 @@ API otrng_result otrng_prekey_client_receive(char **tosend, const char *server,
   /* If it fails to decode it was not a prekey server message. */
   uint8_t *serialized = NULL;
   size_t serialized_len = 0;
-  if (!prekey_decode(message, &serialized, &serialized_len)) {
+  if (!otrng_prekey_decode(message, &serialized, &serialized_len)) {
     return OTRNG_ERROR;
   }
 
@@ -1259,8 +1267,8 @@ INTERNAL otrng_result otrng_prekey_ensemble_retrieval_message_deserialize(
       return OTRNG_ERROR;
     }
 
-    if (!otrng_prekey_ensemble_deserialize(dst->ensembles[i], serialized + w,
-                                           serialized_len - w, &read)) {
+    if (!otrng_prekey_ensemble_deserialize_no_copy(
+            dst->ensembles[i], serialized + w, serialized_len - w, &read)) {
       return OTRNG_ERROR;
     }
 
@@ -132,6 +132,8 @@ typedef struct {
   uint32_t instance_tag;
   const otrng_keypair_s *keypair;
   const client_profile_s *client_profile;
+  /* Optional. client_profile, already serialized */
+  const otrng_serialized_profile_s *ser_client_profile;
   const otrng_prekey_profile_s *prekey_profile;
   ecdh_keypair_p ephemeral_ecdh;
 
@@ -166,6 +168,18 @@ API otrng_result otrng_prekey_client_receive(char **tosend, const char *server,
                                              const char *message,
                                              otrng_prekey_client_s *client);
 
+/**
+ * @brief Decodes a prekey server message: base64 followed by a '.'.
+ *
+ * @param [message]     The encoded message.
+ * @param [buffer]      The decoded message, to be freed by the caller.
+ * @param [buffer_len]  The length of the decoded message.
+ */
+INTERNAL otrng_result otrng_prekey_decode(const char *message,
+                                         uint8_t **buffer, size_t *buffer_len);
+
+INTERNAL char *otrng_prekey_encode(const uint8_t *buffer, size_t buffer_len);
+
 API otrng_result otrng_parse_header(uint8_t *message_type, const uint8_t *buf,
                                     size_t buflen, size_t *read);
 
@@ -220,6 +234,10 @@ INTERNAL otrng_result otrng_prekey_ensemble_query_retrieval_message_asprint(
 INTERNAL void otrng_prekey_ensemble_query_retrieval_message_destroy(
     otrng_prekey_ensemble_query_retrieval_message_s *msg);
 
+/*
+ * The client profiles of the ensembles borrow from serialized, which must
+ * outlive the message.
+ */
 INTERNAL otrng_result otrng_prekey_ensemble_retrieval_message_deserialize(
     otrng_prekey_ensemble_retrieval_message_s *dst, const uint8_t *serialized,
     size_t serialized_len);
@@ -71,15 +71,20 @@ otrng_prekey_ensemble_validate(const prekey_ensemble_s *dst) {
   return OTRNG_SUCCESS;
 }
 
-INTERNAL otrng_result otrng_prekey_ensemble_deserialize(prekey_ensemble_s *dst,
-                                                        const uint8_t *src,
-                                                        size_t src_len,
-                                                        size_t *nread) {
+tstatic otrng_result prekey_ensemble_deserialize(prekey_ensemble_s *dst,
+                                                 const uint8_t *src,
+                                                 size_t src_len, size_t *nread,
+                                                 otrng_bool borrow) {
   size_t w = 0;
   size_t read = 0;
 
-  if (!otrng_client_profile_deserialize(dst->client_profile, src, src_len,
-                                        &w)) {
+  if (borrow) {
+    if (!otrng_client_profile_deserialize_no_copy(dst->client_profile, src,
+                                                  src_len, &w)) {
+      return OTRNG_ERROR;
+    }
+  } else if (!otrng_client_profile_deserialize(dst->client_profile, src,
+                                               src_len, &w)) {
     return OTRNG_ERROR;
   }
 
@@ -109,6 +114,18 @@ INTERNAL otrng_result otrng_prekey_ensemble_deserialize(prekey_ensemble_s *dst,
   return OTRNG_SUCCESS;
 }
 
+INTERNAL otrng_result otrng_prekey_ensemble_deserialize(prekey_ensemble_s *dst,
+                                                        const uint8_t *src,
+                                                        size_t src_len,
+                                                        size_t *nread) {
+  return prekey_ensemble_deserialize(dst, src, src_len, nread, otrng_false);
+}
+
+INTERNAL otrng_result otrng_prekey_ensemble_deserialize_no_copy(
+    prekey_ensemble_s *dst, const uint8_t *src, size_t src_len, size_t *nread) {
+  return prekey_ensemble_deserialize(dst, src, src_len, nread, otrng_true);
+}
+
 INTERNAL void otrng_prekey_ensemble_destroy(prekey_ensemble_s *dst) {
   otrng_client_profile_destroy(dst->client_profile);
   otrng_prekey_profile_destroy(dst->prekey_profile);
@@ -42,6 +42,13 @@ INTERNAL otrng_result otrng_prekey_ensemble_deserialize(prekey_ensemble_s *dst,
                                                         size_t src_len,
                                                         size_t *nread);
 
+/*
+ * As otrng_prekey_ensemble_deserialize, but the client profile borrows from
+ * src. See otrng_client_profile_deserialize_no_copy.
+ */
+INTERNAL otrng_result otrng_prekey_ensemble_deserialize_no_copy(
+    prekey_ensemble_s *dst, const uint8_t *src, size_t src_len, size_t *nread);
+
 INTERNAL void otrng_prekey_ensemble_free(prekey_ensemble_s *dst);
 
 INTERNAL void otrng_prekey_ensemble_destroy(prekey_ensemble_s *dst);
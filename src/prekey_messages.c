@@ -22,6 +22,7 @@
 #include "client_profile.h"
 #include "deserialize.h"
 #include "prekey_client.h"
+#include "str.h"
 
 INTERNAL otrng_result otrng_prekey_success_message_deserialize(
     otrng_prekey_success_message_s *dst, const uint8_t *src, size_t src_len) {
@@ -231,3 +232,85 @@ INTERNAL otrng_result otrng_prekey_publication_message_deserialize(
 
   return OTRNG_SUCCESS;
 }
+
+INTERNAL otrng_result otrng_prekey_dake1_message_deserialize(
+    otrng_prekey_dake1_message_s *dst, const uint8_t *src, size_t src_len) {
+  size_t w = 0;
+  size_t read = 0;
+
+  uint8_t message_type = 0;
+  if (!otrng_parse_header(&message_type, src, src_len, &w)) {
+    return OTRNG_ERROR;
+  }
+
+  if (message_type != OTRNG_PREKEY_DAKE1_MSG) {
+    return OTRNG_ERROR;
+  }
+
+  if (!otrng_deserialize_uint32(&dst->client_instance_tag, src + w,
+                                src_len - w, &read)) {
+    return OTRNG_ERROR;
+  }
+
+  w += read;
+
+  if (!otrng_client_profile_deserialize(dst->client_profile, src + w,
+                                        src_len - w, &read)) {
+    return OTRNG_ERROR;
+  }
+
+  w += read;
+
+  return otrng_deserialize_ec_point(dst->I, src + w, src_len - w);
+}
+
+INTERNAL otrng_result otrng_prekey_ensemble_query_retrieval_message_deserialize(
+    otrng_prekey_ensemble_query_retrieval_message_s *dst, const uint8_t *src,
+    size_t src_len) {
+  size_t w = 0;
+  size_t read = 0;
+
+  dst->identity = NULL;
+  dst->versions = NULL;
+
+  uint8_t message_type = 0;
+  if (!otrng_parse_header(&message_type, src, src_len, &w)) {
+    return OTRNG_ERROR;
+  }
+
+  if (message_type != OTRNG_PREKEY_ENSEMBLE_QUERY_RETRIEVAL_MSG) {
+    return OTRNG_ERROR;
+  }
+
+  if (!otrng_deserialize_uint32(&dst->instance_tag, src + w, src_len - w,
+                                &read)) {
+    return OTRNG_ERROR;
+  }
+
+  w += read;
+
+  const uint8_t *identity = NULL;
+  size_t identity_len = 0;
+  if (!otrng_deserialize_data_no_copy(&identity, &identity_len, src + w,
+                                      src_len - w, &read)) {
+    return OTRNG_ERROR;
+  }
+
+  w += read;
+
+  const uint8_t *versions = NULL;
+  size_t versions_len = 0;
+  if (!otrng_deserialize_data_no_copy(&versions, &versions_len, src + w,
+                                      src_len - w, &read)) {
+    return OTRNG_ERROR;
+  }
+
+  dst->identity = otrng_strndup((const char *)identity, identity_len);
+  dst->versions = otrng_strndup((const char *)versions, versions_len);
+  if (!dst->identity || !dst->versions) {
+    otrng_prekey_ensemble_query_retrieval_message_destroy(dst);
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
@@ -33,4 +33,11 @@ INTERNAL otrng_result otrng_prekey_publication_message_deserialize(
     otrng_prekey_publication_message_s *dst, const uint8_t *src,
     size_t src_len);
 
+INTERNAL otrng_result otrng_prekey_dake1_message_deserialize(
+    otrng_prekey_dake1_message_s *dst, const uint8_t *src, size_t src_len);
+
+INTERNAL otrng_result otrng_prekey_ensemble_query_retrieval_message_deserialize(
+    otrng_prekey_ensemble_query_retrieval_message_s *dst, const uint8_t *src,
+    size_t src_len);
+
 #endif
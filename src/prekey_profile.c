@@ -166,7 +166,7 @@ tstatic otrng_result otrng_prekey_profile_body_asprint(
 }
 
 INTERNAL otrng_result otrng_prekey_profile_asprint(
-    uint8_t **dst, size_t *nbytes, otrng_prekey_profile_s *profile) {
+    uint8_t **dst, size_t *nbytes, const otrng_prekey_profile_s *profile) {
   size_t s = PREKEY_PROFILE_BODY_BYTES + sizeof(eddsa_signature_p);
   uint8_t *buff = malloc(s);
   if (!buff) {
@@ -198,6 +198,25 @@ INTERNAL otrng_result otrng_prekey_profile_asprint(
   return OTRNG_SUCCESS;
 }
 
+INTERNAL otrng_result otrng_prekey_profile_get_serialized(
+    const uint8_t **dst, size_t *dst_len, uint8_t **owned,
+    const otrng_prekey_profile_s *profile,
+    const otrng_serialized_profile_s *ser) {
+  *owned = NULL;
+  if (ser && ser->data) {
+    *dst = ser->data;
+    *dst_len = ser->len;
+    return OTRNG_SUCCESS;
+  }
+
+  if (!otrng_prekey_profile_asprint(owned, dst_len, profile)) {
+    return OTRNG_ERROR;
+  }
+
+  *dst = *owned;
+  return OTRNG_SUCCESS;
+}
+
 INTERNAL otrng_result prekey_profile_sign(
     otrng_prekey_profile_s *profile, const otrng_keypair_s *longterm_pair) {
   uint8_t *body = NULL;
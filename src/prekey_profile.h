@@ -23,6 +23,7 @@
 
 #include "ed448.h"
 #include "keys.h"
+#include "serialize.h"
 #include <stdint.h>
 
 typedef struct prekey_profile_s {
@@ -51,9 +52,25 @@ INTERNAL otrng_bool otrng_prekey_profile_valid(
 INTERNAL otrng_result prekey_profile_sign(otrng_prekey_profile_s *profile,
                                           const otrng_keypair_s *longterm_pair);
 
-INTERNAL otrng_result otrng_prekey_profile_asprint(uint8_t **dst,
-                                                   size_t *dstlen,
-                                                   otrng_prekey_profile_s *p);
+INTERNAL otrng_result
+otrng_prekey_profile_asprint(uint8_t **dst, size_t *dstlen,
+                             const otrng_prekey_profile_s *p);
+
+/**
+ * @brief Get a profile in its serialized form, from ser when it holds it or
+ *        else by serializing the profile.
+ *
+ * @param [dst]       The serialized profile.
+ * @param [dst_len]   Its length.
+ * @param [owned]     Set to the new serialization, to be freed by the
+ *                    caller, or to NULL.
+ * @param [profile]   The profile.
+ * @param [ser]       Optional. The profile, already serialized.
+ */
+INTERNAL otrng_result otrng_prekey_profile_get_serialized(
+    const uint8_t **dst, size_t *dst_len, uint8_t **owned,
+    const otrng_prekey_profile_s *profile,
+    const otrng_serialized_profile_s *ser);
 
 INTERNAL otrng_result otrng_prekey_profile_deserialize(
     otrng_prekey_profile_s *target, const uint8_t *buffer, size_t buflen,
@@ -0,0 +1,1067 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "prekey_server.h"
+
+#include "client_profile.h"
+#include "dake.h"
+#include "deserialize.h"
+#include "prekey_client.h"
+#include "prekey_messages.h"
+#include "prekey_profile.h"
+#include "random.h"
+#include "serialize.h"
+#include "shake.h"
+#include "str.h"
+
+static uint8_t usage_auth = 0x11;
+static const otrng_shake_domain prekey_hash_domain =
+    OTRNG_SHAKE_DOMAIN_PREKEY_SERVER;
+static const char *no_prekeys_message = "No Prekey Messages available";
+
+static void blob_destroy(otrng_prekey_server_blob_s *blob) {
+  free(blob->data);
+  blob->data = NULL;
+  blob->len = 0;
+}
+
+static otrng_result blob_copy(otrng_prekey_server_blob_s *dst,
+                              const uint8_t *src, size_t src_len) {
+  uint8_t *data = malloc(src_len);
+  if (!data) {
+    return OTRNG_ERROR;
+  }
+
+  memcpy(data, src, src_len);
+
+  free(dst->data);
+  dst->data = data;
+  dst->len = src_len;
+
+  return OTRNG_SUCCESS;
+}
+
+/* One bit per digit of a versions string, such as "34" */
+static uint16_t versions_mask(const char *versions) {
+  uint16_t mask = 0;
+  for (; *versions; versions++) {
+    if (*versions >= '0' && *versions <= '9') {
+      mask |= 1 << (*versions - '0');
+    }
+  }
+
+  return mask;
+}
+
+/* FNV-1a */
+static size_t identity_bucket(const char *identity, size_t identity_len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < identity_len; i++) {
+    hash ^= (uint8_t)identity[i];
+    hash *= 16777619u;
+  }
+
+  return hash % OTRNG_PREKEY_SERVER_BUCKETS;
+}
+
+static void entry_free(void *data) {
+  otrng_prekey_server_entry_s *entry = data;
+
+  free(entry->identity);
+  blob_destroy(&entry->client_profile);
+  blob_destroy(&entry->prekey_profile);
+
+  for (size_t i = 0; i < entry->num_prekey_messages; i++) {
+    size_t j = (entry->first_prekey_message + i) %
+               entry->prekey_messages_capacity;
+    blob_destroy(&entry->prekey_messages[j]);
+  }
+
+  free(entry->prekey_messages);
+  free(entry);
+}
+
+static otrng_prekey_server_entry_s *
+get_entry(const char *identity, uint32_t instance_tag,
+          const otrng_prekey_server_s *server) {
+  size_t bucket = identity_bucket(identity, strlen(identity));
+
+  for (list_element_s *current = server->entries[bucket]; current;
+       current = current->next) {
+    otrng_prekey_server_entry_s *entry = current->data;
+    if (entry->instance_tag == instance_tag &&
+        strcmp(entry->identity, identity) == 0) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static otrng_prekey_server_entry_s *
+get_or_create_entry(const char *identity, uint32_t instance_tag,
+                    otrng_prekey_server_s *server) {
+  otrng_prekey_server_entry_s *entry =
+      get_entry(identity, instance_tag, server);
+  if (entry) {
+    return entry;
+  }
+
+  entry = malloc(sizeof(otrng_prekey_server_entry_s));
+  if (!entry) {
+    return NULL;
+  }
+
+  entry->identity = otrng_strdup(identity);
+  if (!entry->identity) {
+    free(entry);
+    return NULL;
+  }
+
+  entry->instance_tag = instance_tag;
+  entry->client_profile.data = NULL;
+  entry->client_profile.len = 0;
+  entry->prekey_profile.data = NULL;
+  entry->prekey_profile.len = 0;
+  entry->versions = 0;
+  entry->prekey_messages = NULL;
+  entry->first_prekey_message = 0;
+  entry->num_prekey_messages = 0;
+  entry->prekey_messages_capacity = 0;
+
+  size_t bucket = identity_bucket(identity, strlen(identity));
+  list_element_s *entries = otrng_list_add(entry, server->entries[bucket]);
+  if (!entries) {
+    entry_free(entry);
+    return NULL;
+  }
+
+  server->entries[bucket] = entries;
+
+  return entry;
+}
+
+static otrng_result push_prekey_message(otrng_prekey_server_entry_s *entry,
+                                        const uint8_t *src, size_t src_len) {
+  if (entry->num_prekey_messages == entry->prekey_messages_capacity) {
+    size_t capacity = entry->prekey_messages_capacity
+                          ? 2 * entry->prekey_messages_capacity
+                          : 8;
+    otrng_prekey_server_blob_s *messages =
+        malloc(capacity * sizeof(otrng_prekey_server_blob_s));
+    if (!messages) {
+      return OTRNG_ERROR;
+    }
+
+    /* Unwrap the queue, so it starts at the beginning again */
+    for (size_t i = 0; i < entry->num_prekey_messages; i++) {
+      size_t j = (entry->first_prekey_message + i) %
+                 entry->prekey_messages_capacity;
+      messages[i] = entry->prekey_messages[j];
+    }
+
+    free(entry->prekey_messages);
+    entry->prekey_messages = messages;
+    entry->prekey_messages_capacity = capacity;
+    entry->first_prekey_message = 0;
+  }
+
+  size_t last = (entry->first_prekey_message + entry->num_prekey_messages) %
+                entry->prekey_messages_capacity;
+  otrng_prekey_server_blob_s *blob = &entry->prekey_messages[last];
+  blob->data = NULL;
+  if (!blob_copy(blob, src, src_len)) {
+    return OTRNG_ERROR;
+  }
+
+  entry->num_prekey_messages++;
+
+  return OTRNG_SUCCESS;
+}
+
+/* The caller owns the returned message */
+static otrng_prekey_server_blob_s
+pop_prekey_message(otrng_prekey_server_entry_s *entry) {
+  otrng_prekey_server_blob_s ret =
+      entry->prekey_messages[entry->first_prekey_message];
+
+  entry->first_prekey_message =
+      (entry->first_prekey_message + 1) % entry->prekey_messages_capacity;
+  entry->num_prekey_messages--;
+
+  return ret;
+}
+
+/* An ensemble can only be built for clients that published their profiles
+ * and still have prekey messages. */
+static otrng_bool
+has_prekey_ensemble(const otrng_prekey_server_entry_s *entry) {
+  return entry->client_profile.data && entry->prekey_profile.data &&
+         entry->num_prekey_messages > 0;
+}
+
+static void session_free(void *data) {
+  otrng_prekey_server_session_s *session = data;
+
+  free(session->identity);
+  otrng_ec_point_destroy(session->client_pub);
+  blob_destroy(&session->client_profile);
+  otrng_ec_point_destroy(session->I);
+  otrng_ecdh_keypair_destroy(session->S);
+
+  free(session);
+}
+
+static list_element_s *get_session(const char *identity,
+                                   uint32_t instance_tag,
+                                   const otrng_prekey_server_s *server) {
+  for (list_element_s *current = server->sessions; current;
+       current = current->next) {
+    otrng_prekey_server_session_s *session = current->data;
+    if (session->instance_tag == instance_tag &&
+        strcmp(session->identity, identity) == 0) {
+      return current;
+    }
+  }
+
+  return NULL;
+}
+
+static void remove_session(list_element_s *element,
+                           otrng_prekey_server_s *server) {
+  server->sessions = otrng_list_remove_element(element, server->sessions);
+  otrng_list_free(element, session_free);
+  server->num_sessions--;
+}
+
+/* Sessions are added last, so the ones that timed out come first */
+static void expire_sessions(time_t now, otrng_prekey_server_s *server) {
+  while (server->sessions) {
+    const otrng_prekey_server_session_s *session = server->sessions->data;
+    if (difftime(now, session->started) <=
+        OTRNG_PREKEY_SERVER_SESSION_TIMEOUT) {
+      return;
+    }
+
+    remove_session(server->sessions, server);
+  }
+}
+
+API otrng_prekey_server_s *
+otrng_prekey_server_new(const char *identity,
+                        const uint8_t sym[ED448_PRIVATE_BYTES]) {
+  if (!identity) {
+    return NULL;
+  }
+
+  otrng_prekey_server_s *ret = malloc(sizeof(otrng_prekey_server_s));
+  if (!ret) {
+    return NULL;
+  }
+
+  size_t identity_len = strlen(identity);
+
+  ret->identity = otrng_strdup(identity);
+  ret->keypair = otrng_keypair_new();
+  ret->composite_identity_len = 4 + identity_len + ED448_PUBKEY_BYTES;
+  ret->composite_identity = malloc(ret->composite_identity_len);
+  ret->sessions = NULL;
+  ret->num_sessions = 0;
+
+  for (int i = 0; i < OTRNG_PREKEY_SERVER_BUCKETS; i++) {
+    ret->entries[i] = NULL;
+  }
+
+  if (!ret->identity || !ret->keypair || !ret->composite_identity) {
+    otrng_prekey_server_free(ret);
+    return NULL;
+  }
+
+  otrng_keypair_generate(ret->keypair, sym);
+
+  size_t w = otrng_serialize_data(ret->composite_identity,
+                                  (const uint8_t *)identity, identity_len);
+  otrng_serialize_public_key(ret->composite_identity + w, ret->keypair->pub);
+
+  return ret;
+}
+
+API void otrng_prekey_server_free(otrng_prekey_server_s *server) {
+  if (!server) {
+    return;
+  }
+
+  for (int i = 0; i < OTRNG_PREKEY_SERVER_BUCKETS; i++) {
+    otrng_list_free(server->entries[i], entry_free);
+    server->entries[i] = NULL;
+  }
+
+  otrng_list_free(server->sessions, session_free);
+  server->sessions = NULL;
+  server->num_sessions = 0;
+
+  otrng_keypair_free(server->keypair);
+  server->keypair = NULL;
+
+  free(server->composite_identity);
+  server->composite_identity = NULL;
+
+  free(server->identity);
+  server->identity = NULL;
+
+  free(server);
+}
+
+API size_t
+otrng_prekey_server_count_prekey_messages(const char *identity,
+                                          uint32_t instance_tag,
+                                          const otrng_prekey_server_s *server) {
+  const otrng_prekey_server_entry_s *entry =
+      get_entry(identity, instance_tag, server);
+  if (!entry) {
+    return 0;
+  }
+
+  return entry->num_prekey_messages;
+}
+
+/*
+ * t = first || KDF(usage_profile, Client Profile, 64)
+ *     || KDF(usage_identity, Prekey Server Composite Identity, 64)
+ *     || I || S || KDF(usage_phi, Prekey Composite PHI, 64)
+ */
+static uint8_t *build_t(size_t *tlen, uint8_t first, uint8_t usage_profile,
+                        uint8_t usage_identity, uint8_t usage_phi,
+                        const otrng_prekey_server_session_s *session,
+                        const otrng_prekey_server_s *server) {
+  size_t client_identity_len = strlen(session->identity);
+  size_t server_identity_len = strlen(server->identity);
+  size_t composite_phi_len = 4 + client_identity_len + 4 + server_identity_len;
+  uint8_t *composite_phi = malloc(composite_phi_len);
+  if (!composite_phi) {
+    return NULL;
+  }
+
+  size_t w = 0;
+  w += otrng_serialize_data(composite_phi + w,
+                            (const uint8_t *)session->identity,
+                            client_identity_len);
+  w += otrng_serialize_data(composite_phi + w,
+                            (const uint8_t *)server->identity,
+                            server_identity_len);
+
+  *tlen = 1 + 3 * HASH_BYTES + 2 * ED448_POINT_BYTES;
+  uint8_t *t = malloc(*tlen);
+  if (!t) {
+    free(composite_phi);
+    return NULL;
+  }
+
+  *t = first;
+  w = 1;
+
+  shake_256_prekey_server_kdf(t + w, HASH_BYTES, usage_profile,
+                              session->client_profile.data,
+                              session->client_profile.len);
+  w += HASH_BYTES;
+
+  shake_256_prekey_server_kdf(t + w, HASH_BYTES, usage_identity,
+                              server->composite_identity,
+                              server->composite_identity_len);
+  w += HASH_BYTES;
+
+  w += otrng_serialize_ec_point(t + w, session->I);
+  w += otrng_serialize_ec_point(t + w, session->S->pub);
+
+  shake_256_prekey_server_kdf(t + w, HASH_BYTES, usage_phi, composite_phi,
+                              composite_phi_len);
+  free(composite_phi);
+
+  return t;
+}
+
+static otrng_result dake2_asprint(uint8_t **dst, size_t *dst_len,
+                                  const otrng_prekey_server_session_s *session,
+                                  const otrng_prekey_server_s *server) {
+  uint8_t usage_initator_client_profile = 0x02;
+  uint8_t usage_initiator_prekey_composite_identity = 0x03;
+  uint8_t usage_initiator_prekey_composite_phi = 0x04;
+
+  size_t tlen = 0;
+  uint8_t *t =
+      build_t(&tlen, 0x0, usage_initator_client_profile,
+              usage_initiator_prekey_composite_identity,
+              usage_initiator_prekey_composite_phi, session, server);
+  if (!t) {
+    return OTRNG_ERROR;
+  }
+
+  /* H_s, sk_hs, {H_a, H_s, I}, t */
+  ring_sig_p sigma;
+  otrng_result success = otrng_rsig_authenticate_with_usage_and_domain(
+      usage_auth, prekey_hash_domain, sigma, server->keypair->priv,
+      server->keypair->pub, session->client_pub, server->keypair->pub,
+      session->I, t, tlen);
+  free(t);
+
+  if (!success) {
+    return OTRNG_ERROR;
+  }
+
+  size_t len = 2 + 1 + 4 + server->composite_identity_len + ED448_POINT_BYTES +
+               RING_SIG_BYTES;
+  uint8_t *ret = malloc(len);
+  if (!ret) {
+    otrng_ring_sig_destroy(sigma);
+    return OTRNG_ERROR;
+  }
+
+  size_t w = 0;
+  w += otrng_serialize_uint16(ret + w, OTRNG_PROTOCOL_VERSION_4);
+  w += otrng_serialize_uint8(ret + w, OTRNG_PREKEY_DAKE2_MSG);
+  w += otrng_serialize_uint32(ret + w, session->instance_tag);
+  w += otrng_serialize_bytes_array(ret + w, server->composite_identity,
+                                   server->composite_identity_len);
+  w += otrng_serialize_ec_point(ret + w, session->S->pub);
+  w += otrng_serialize_ring_sig(ret + w, sigma);
+  otrng_ring_sig_destroy(sigma);
+
+  *dst = ret;
+  *dst_len = w;
+
+  return OTRNG_SUCCESS;
+}
+
+static otrng_result receive_dake1(uint8_t **reply, size_t *reply_len,
+                                  const uint8_t *decoded, size_t decoded_len,
+                                  const char *from,
+                                  otrng_prekey_server_s *server) {
+  otrng_prekey_dake1_message_s msg[1];
+  memset(msg, 0, sizeof(otrng_prekey_dake1_message_s));
+
+  if (!otrng_prekey_dake1_message_deserialize(msg, decoded, decoded_len) ||
+      !otrng_client_profile_valid(msg->client_profile,
+                                  msg->client_instance_tag) ||
+      !otrng_ec_point_valid(msg->I)) {
+    otrng_prekey_dake1_message_destroy(msg);
+    return OTRNG_ERROR;
+  }
+
+  otrng_prekey_server_session_s *session =
+      malloc(sizeof(otrng_prekey_server_session_s));
+  if (!session) {
+    otrng_prekey_dake1_message_destroy(msg);
+    return OTRNG_ERROR;
+  }
+
+  session->identity = otrng_strdup(from);
+  session->instance_tag = msg->client_instance_tag;
+  session->started = time(NULL);
+  otrng_ec_point_copy(session->client_pub,
+                      msg->client_profile->long_term_pub_key);
+  otrng_ec_point_copy(session->I, msg->I);
+  otrng_prekey_dake1_message_destroy(msg);
+
+  /* I is the last field, so the profile is everything between the header and
+   * it. It is kept as received to generate `t`. */
+  session->client_profile.data = NULL;
+  if (!session->identity ||
+      !blob_copy(&session->client_profile, decoded + 7,
+                 decoded_len - 7 - ED448_POINT_BYTES)) {
+    free(session->identity);
+    otrng_ec_point_destroy(session->client_pub);
+    otrng_ec_point_destroy(session->I);
+    free(session);
+    return OTRNG_ERROR;
+  }
+
+  uint8_t sym[ED448_PRIVATE_BYTES] = {0};
+  random_bytes(sym, ED448_PRIVATE_BYTES);
+  otrng_ecdh_keypair_generate(session->S, sym);
+  goldilocks_bzero(sym, ED448_PRIVATE_BYTES);
+
+  /* A new DAKE replaces the one the client had in progress */
+  list_element_s *previous =
+      get_session(session->identity, session->instance_tag, server);
+  if (previous) {
+    remove_session(previous, server);
+  }
+
+  expire_sessions(session->started, server);
+  if (server->num_sessions == OTRNG_PREKEY_SERVER_MAX_SESSIONS) {
+    remove_session(server->sessions, server);
+  }
+
+  list_element_s *sessions = otrng_list_add(session, server->sessions);
+  if (!sessions) {
+    session_free(session);
+    return OTRNG_ERROR;
+  }
+
+  server->sessions = sessions;
+  server->num_sessions++;
+
+  return dake2_asprint(reply, reply_len, session, server);
+}
+
+static otrng_result result_asprint(uint8_t **dst, size_t *dst_len,
+                                   uint8_t message_type, uint8_t usage,
+                                   uint32_t instance_tag,
+                                   const uint8_t mac_key[MAC_KEY_BYTES]) {
+  uint8_t *ret = malloc(OTRNG_PREKEY_SUCCESS_MSG_LEN);
+  if (!ret) {
+    return OTRNG_ERROR;
+  }
+
+  size_t w = 0;
+  w += otrng_serialize_uint16(ret + w, OTRNG_PROTOCOL_VERSION_4);
+  w += otrng_serialize_uint8(ret + w, message_type);
+  w += otrng_serialize_uint32(ret + w, instance_tag);
+
+  /* KDF(usage, prekey_mac_k || message type || receiver instance tag, 64) */
+  goldilocks_shake256_ctx_p hash;
+  kdf_init_with_usage(hash, usage);
+  hash_update(hash, mac_key, MAC_KEY_BYTES);
+  hash_update(hash, ret + 2, 5);
+  hash_final(hash, ret + w, HASH_BYTES);
+  hash_destroy(hash);
+
+  *dst = ret;
+  *dst_len = w + HASH_BYTES;
+
+  return OTRNG_SUCCESS;
+}
+
+static otrng_result
+storage_status_asprint(uint8_t **dst, size_t *dst_len,
+                       const otrng_prekey_server_session_s *session,
+                       const uint8_t mac_key[MAC_KEY_BYTES],
+                       const otrng_prekey_server_s *server) {
+  uint32_t stored = otrng_prekey_server_count_prekey_messages(
+      session->identity, session->instance_tag, server);
+
+  size_t len = 2 + 1 + 4 + 4 + HASH_BYTES;
+  uint8_t *ret = malloc(len);
+  if (!ret) {
+    return OTRNG_ERROR;
+  }
+
+  size_t w = 0;
+  w += otrng_serialize_uint16(ret + w, OTRNG_PROTOCOL_VERSION_4);
+  w += otrng_serialize_uint8(ret + w, OTRNG_PREKEY_STORAGE_STATUS_MSG);
+  w += otrng_serialize_uint32(ret + w, session->instance_tag);
+  w += otrng_serialize_uint32(ret + w, stored);
+
+  /* KDF(usage_status_MAC, prekey_mac_k || message type || receiver instance
+     tag || Stored Prekey Messages Number, 64) */
+  uint8_t usage_status_MAC = 0x0B;
+
+  goldilocks_shake256_ctx_p hmac;
+  kdf_init_with_usage(hmac, usage_status_MAC);
+  hash_update(hmac, mac_key, MAC_KEY_BYTES);
+  hash_update(hmac, ret + 2, w - 2);
+  hash_final(hmac, ret + w, HASH_BYTES);
+  hash_destroy(hmac);
+
+  *dst = ret;
+  *dst_len = w + HASH_BYTES;
+
+  return OTRNG_SUCCESS;
+}
+
+static otrng_bool
+storage_information_request_valid(const uint8_t *src, size_t src_len,
+                                  const uint8_t mac_key[MAC_KEY_BYTES]) {
+  if (src_len != 2 + 1 + HASH_BYTES) {
+    return otrng_false;
+  }
+
+  /* MAC: KDF(usage_storage_info_MAC, prekey_mac_k || message type, 64) */
+  uint8_t usage_storage_info_MAC = 0x0A;
+  uint8_t mac_tag[HASH_BYTES];
+
+  goldilocks_shake256_ctx_p hmac;
+  kdf_init_with_usage(hmac, usage_storage_info_MAC);
+  hash_update(hmac, mac_key, MAC_KEY_BYTES);
+  hash_update(hmac, src + 2, 1);
+  hash_final(hmac, mac_tag, HASH_BYTES);
+  hash_destroy(hmac);
+
+  otrng_bool ret = otrl_mem_differ(mac_tag, src + 3, HASH_BYTES) == 0;
+  sodium_memzero(mac_tag, sizeof(mac_tag));
+
+  return ret;
+}
+
+/* Validates a prekey publication message and stores what it carries */
+static otrng_result
+store_publication(const uint8_t *src, size_t src_len,
+                  const uint8_t mac_key[MAC_KEY_BYTES],
+                  const otrng_prekey_server_session_s *session,
+                  otrng_prekey_server_s *server) {
+  size_t w = 2 + 1;
+  size_t read = 0;
+
+  uint8_t num_prekey_messages = 0;
+  if (!otrng_deserialize_uint8(&num_prekey_messages, src + w, src_len - w,
+                               &read)) {
+    return OTRNG_ERROR;
+  }
+
+  w += read;
+
+  const uint8_t *prekey_messages = src + w;
+  size_t prekey_message_lens[UINT8_MAX];
+
+  for (int i = 0; i < num_prekey_messages; i++) {
+    dake_prekey_message_s prekey_message[1];
+    if (!otrng_dake_prekey_message_deserialize(prekey_message, src + w,
+                                               src_len - w, &read)) {
+      return OTRNG_ERROR;
+    }
+
+    otrng_bool valid =
+        prekey_message->sender_instance_tag == session->instance_tag &&
+        otrng_ec_point_valid(prekey_message->Y);
+    otrng_dake_prekey_message_destroy(prekey_message);
+
+    if (!valid) {
+      return OTRNG_ERROR;
+    }
+
+    prekey_message_lens[i] = read;
+    w += read;
+  }
+
+  uint8_t usage_prekey_message = 0x0E;
+  uint8_t prekey_messages_kdf[HASH_BYTES];
+  shake_256_prekey_server_kdf(prekey_messages_kdf, HASH_BYTES,
+                              usage_prekey_message, prekey_messages,
+                              src + w - prekey_messages);
+
+  uint8_t num_client_profiles = 0;
+  if (!otrng_deserialize_uint8(&num_client_profiles, src + w, src_len - w,
+                               &read) ||
+      num_client_profiles > 1) {
+    return OTRNG_ERROR;
+  }
+
+  w += read;
+
+  /* The prekey profile is signed with the key from the client profile */
+  otrng_public_key_p pub;
+  otrng_ec_point_copy(pub, session->client_pub);
+
+  const uint8_t *client_profile = src + w;
+  size_t client_profile_len = 0;
+  uint16_t versions = 0;
+  if (num_client_profiles) {
+    client_profile_p profile;
+    if (!otrng_client_profile_deserialize_no_copy(profile, src + w,
+                                                  src_len - w, &read)) {
+      otrng_client_profile_destroy(profile);
+      return OTRNG_ERROR;
+    }
+
+    otrng_bool valid =
+        otrng_client_profile_valid(profile, session->instance_tag);
+    otrng_ec_point_copy(pub, profile->long_term_pub_key);
+    versions = versions_mask(profile->versions);
+    otrng_client_profile_destroy(profile);
+
+    if (!valid) {
+      return OTRNG_ERROR;
+    }
+
+    client_profile_len = read;
+    w += read;
+  }
+
+  uint8_t num_prekey_profiles = 0;
+  if (!otrng_deserialize_uint8(&num_prekey_profiles, src + w, src_len - w,
+                               &read) ||
+      num_prekey_profiles > 1) {
+    return OTRNG_ERROR;
+  }
+
+  w += read;
+
+  const uint8_t *prekey_profile = src + w;
+  size_t prekey_profile_len = 0;
+  if (num_prekey_profiles) {
+    otrng_prekey_profile_s profile[1];
+    if (!otrng_prekey_profile_deserialize(profile, src + w, src_len - w,
+                                          &read)) {
+      return OTRNG_ERROR;
+    }
+
+    otrng_bool valid =
+        otrng_prekey_profile_valid(profile, session->instance_tag, pub);
+    otrng_prekey_profile_destroy(profile);
+
+    if (!valid) {
+      return OTRNG_ERROR;
+    }
+
+    prekey_profile_len = read;
+    w += read;
+  }
+
+  if (src_len - w != HASH_BYTES) {
+    return OTRNG_ERROR;
+  }
+
+  /* MAC: KDF(usage_preMAC, prekey_mac_k || message type
+            || N || KDF(usage_prekey_message, Prekey Messages, 64)
+            || K || KDF(usage_client_profile, Client Profile, 64)
+            || J || KDF(usage_prekey_profile, Prekey Profile, 64),
+        64) */
+  uint8_t usage_pre_MAC = 0x09;
+  uint8_t mac_tag[HASH_BYTES];
+
+  goldilocks_shake256_ctx_p hd;
+  kdf_init_with_usage(hd, usage_pre_MAC);
+  hash_update(hd, mac_key, MAC_KEY_BYTES);
+  hash_update(hd, src + 2, 1);
+  hash_update(hd, &num_prekey_messages, 1);
+  hash_update(hd, prekey_messages_kdf, HASH_BYTES);
+
+  hash_update(hd, &num_client_profiles, 1);
+  if (num_client_profiles) {
+    uint8_t usage_client_profile = 0x0F;
+    uint8_t client_profile_kdf[HASH_BYTES];
+    shake_256_prekey_server_kdf(client_profile_kdf, HASH_BYTES,
+                                usage_client_profile, client_profile,
+                                client_profile_len);
+    hash_update(hd, client_profile_kdf, HASH_BYTES);
+  }
+
+  hash_update(hd, &num_prekey_profiles, 1);
+  if (num_prekey_profiles) {
+    uint8_t usage_prekey_profile = 0x10;
+    uint8_t prekey_profile_kdf[HASH_BYTES];
+    shake_256_prekey_server_kdf(prekey_profile_kdf, HASH_BYTES,
+                                usage_prekey_profile, prekey_profile,
+                                prekey_profile_len);
+    hash_update(hd, prekey_profile_kdf, HASH_BYTES);
+  }
+
+  hash_final(hd, mac_tag, HASH_BYTES);
+  hash_destroy(hd);
+
+  otrng_bool mac_valid = otrl_mem_differ(mac_tag, src + w, HASH_BYTES) == 0;
+  sodium_memzero(mac_tag, sizeof(mac_tag));
+
+  if (!mac_valid) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_prekey_server_entry_s *entry = get_or_create_entry(
+      session->identity, session->instance_tag, server);
+  if (!entry) {
+    return OTRNG_ERROR;
+  }
+
+  if (num_client_profiles) {
+    if (!blob_copy(&entry->client_profile, client_profile,
+                   client_profile_len)) {
+      return OTRNG_ERROR;
+    }
+
+    entry->versions = versions;
+  }
+
+  if (num_prekey_profiles &&
+      !blob_copy(&entry->prekey_profile, prekey_profile, prekey_profile_len)) {
+    return OTRNG_ERROR;
+  }
+
+  for (int i = 0; i < num_prekey_messages; i++) {
+    if (!push_prekey_message(entry, prekey_messages,
+                             prekey_message_lens[i])) {
+      return OTRNG_ERROR;
+    }
+
+    prekey_messages += prekey_message_lens[i];
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+static otrng_result
+process_dake3(uint8_t **reply, size_t *reply_len,
+              const otrng_prekey_dake3_message_s *msg,
+              const otrng_prekey_server_session_s *session,
+              otrng_prekey_server_s *server) {
+  uint8_t usage_receiver_client_profile = 0x05;
+  uint8_t usage_receiver_prekey_composite_identity = 0x06;
+  uint8_t usage_receiver_prekey_composite_phi = 0x07;
+
+  size_t tlen = 0;
+  uint8_t *t =
+      build_t(&tlen, 0x1, usage_receiver_client_profile,
+              usage_receiver_prekey_composite_identity,
+              usage_receiver_prekey_composite_phi, session, server);
+  if (!t) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_bool valid = otrng_rsig_verify_with_usage_and_domain(
+      usage_auth, prekey_hash_domain, msg->sigma, session->client_pub,
+      server->keypair->pub, session->S->pub, t, tlen);
+  free(t);
+
+  if (!valid) {
+    return OTRNG_ERROR;
+  }
+
+  uint8_t message_type = 0;
+  if (!otrng_parse_header(&message_type, msg->message, msg->message_len,
+                          NULL)) {
+    return OTRNG_ERROR;
+  }
+
+  /* ECDH(s, I) */
+  uint8_t shared_secret[HASH_BYTES] = {0};
+  uint8_t ecdh_shared[ED448_POINT_BYTES] = {0};
+  uint8_t mac_key[MAC_KEY_BYTES] = {0};
+  if (!otrng_ecdh_shared_secret(ecdh_shared, sizeof(ecdh_shared),
+                                session->S->priv, session->I)) {
+    return OTRNG_ERROR;
+  }
+
+  uint8_t usage_SK = 0x01;
+  uint8_t usage_preMAC_key = 0x08;
+
+  /* SK = KDF(0x01, ECDH(s, I), 64) */
+  shake_256_prekey_server_kdf(shared_secret, HASH_BYTES, usage_SK, ecdh_shared,
+                              ED448_POINT_BYTES);
+  sodium_memzero(ecdh_shared, sizeof(ecdh_shared));
+
+  /* prekey_mac_k = KDF(0x08, SK, 64) */
+  shake_256_prekey_server_kdf(mac_key, MAC_KEY_BYTES, usage_preMAC_key,
+                              shared_secret, HASH_BYTES);
+  sodium_memzero(shared_secret, sizeof(shared_secret));
+
+  otrng_result ret = OTRNG_ERROR;
+
+  if (message_type == OTRNG_PREKEY_STORAGE_INFO_REQ_MSG) {
+    if (storage_information_request_valid(msg->message, msg->message_len,
+                                          mac_key)) {
+      ret = storage_status_asprint(reply, reply_len, session, mac_key,
+                                   server);
+    }
+  } else if (message_type == OTRNG_PREKEY_PUBLICATION_MSG) {
+    uint8_t usage_success_MAC = 0x0C;
+    uint8_t usage_failure_MAC = 0x0D;
+
+    if (store_publication(msg->message, msg->message_len, mac_key, session,
+                          server)) {
+      ret = result_asprint(reply, reply_len, OTRNG_PREKEY_SUCCESS_MSG,
+                           usage_success_MAC, session->instance_tag, mac_key);
+    } else {
+      ret = result_asprint(reply, reply_len, OTRNG_PREKEY_FAILURE_MSG,
+                           usage_failure_MAC, session->instance_tag, mac_key);
+    }
+  }
+
+  sodium_memzero(mac_key, sizeof(mac_key));
+
+  return ret;
+}
+
+static otrng_result receive_dake3(uint8_t **reply, size_t *reply_len,
+                                  const uint8_t *decoded, size_t decoded_len,
+                                  const char *from,
+                                  otrng_prekey_server_s *server) {
+  otrng_prekey_dake3_message_s msg[1];
+  msg->message = NULL;
+
+  if (!otrng_prekey_dake3_message_deserialize(msg, decoded, decoded_len)) {
+    otrng_prekey_dake3_message_destroy(msg);
+    return OTRNG_ERROR;
+  }
+
+  expire_sessions(time(NULL), server);
+  list_element_s *session =
+      get_session(from, msg->client_instance_tag, server);
+  if (!session) {
+    otrng_prekey_dake3_message_destroy(msg);
+    return OTRNG_ERROR;
+  }
+
+  otrng_result ret =
+      process_dake3(reply, reply_len, msg, session->data, server);
+  otrng_prekey_dake3_message_destroy(msg);
+
+  /* Whatever the outcome, a DAKE can only be finished once */
+  remove_session(session, server);
+
+  return ret;
+}
+
+static otrng_result receive_ensemble_query(uint8_t **reply, size_t *reply_len,
+                                           const uint8_t *decoded,
+                                           size_t decoded_len,
+                                           otrng_prekey_server_s *server) {
+  otrng_prekey_ensemble_query_retrieval_message_s msg[1];
+
+  if (!otrng_prekey_ensemble_query_retrieval_message_deserialize(
+          msg, decoded, decoded_len)) {
+    otrng_prekey_ensemble_query_retrieval_message_destroy(msg);
+    return OTRNG_ERROR;
+  }
+
+  /* Only the clients that support one of the versions asked for */
+  uint16_t versions = versions_mask(msg->versions);
+  size_t bucket = identity_bucket(msg->identity, strlen(msg->identity));
+  uint8_t num_ensembles = 0;
+  size_t len = 2 + 1 + 4 + 1;
+
+  for (list_element_s *current = server->entries[bucket];
+       current && num_ensembles < UINT8_MAX; current = current->next) {
+    const otrng_prekey_server_entry_s *entry = current->data;
+    if (strcmp(entry->identity, msg->identity) != 0 ||
+        !(entry->versions & versions) || !has_prekey_ensemble(entry)) {
+      continue;
+    }
+
+    num_ensembles++;
+    len += entry->client_profile.len + entry->prekey_profile.len +
+           entry->prekey_messages[entry->first_prekey_message].len;
+  }
+
+  if (!num_ensembles) {
+    size_t no_prekeys_message_len = strlen(no_prekeys_message);
+    len = 2 + 1 + 4 + 4 + no_prekeys_message_len;
+    *reply = malloc(len);
+    if (!*reply) {
+      otrng_prekey_ensemble_query_retrieval_message_destroy(msg);
+      return OTRNG_ERROR;
+    }
+
+    size_t w = 0;
+    w += otrng_serialize_uint16(*reply + w, OTRNG_PROTOCOL_VERSION_4);
+    w += otrng_serialize_uint8(*reply + w,
+                               OTRNG_PREKEY_NO_PREKEY_IN_STORAGE_MSG);
+    w += otrng_serialize_uint32(*reply + w, msg->instance_tag);
+    w += otrng_serialize_data(*reply + w, (const uint8_t *)no_prekeys_message,
+                              no_prekeys_message_len);
+    *reply_len = w;
+
+    otrng_prekey_ensemble_query_retrieval_message_destroy(msg);
+    return OTRNG_SUCCESS;
+  }
+
+  uint8_t *ret = malloc(len);
+  if (!ret) {
+    otrng_prekey_ensemble_query_retrieval_message_destroy(msg);
+    return OTRNG_ERROR;
+  }
+
+  size_t w = 0;
+  w += otrng_serialize_uint16(ret + w, OTRNG_PROTOCOL_VERSION_4);
+  w += otrng_serialize_uint8(ret + w, OTRNG_PREKEY_ENSEMBLE_RETRIEVAL_MSG);
+  w += otrng_serialize_uint32(ret + w, msg->instance_tag);
+  w += otrng_serialize_uint8(ret + w, num_ensembles);
+
+  /* Each prekey message is handed out once, so it is removed as it is
+   * written */
+  uint8_t written = 0;
+  for (list_element_s *current = server->entries[bucket];
+       current && written < num_ensembles; current = current->next) {
+    otrng_prekey_server_entry_s *entry = current->data;
+    if (strcmp(entry->identity, msg->identity) != 0 ||
+        !(entry->versions & versions) || !has_prekey_ensemble(entry)) {
+      continue;
+    }
+
+    otrng_prekey_server_blob_s prekey_message = pop_prekey_message(entry);
+
+    w += otrng_serialize_bytes_array(ret + w, entry->client_profile.data,
+                                     entry->client_profile.len);
+    w += otrng_serialize_bytes_array(ret + w, entry->prekey_profile.data,
+                                     entry->prekey_profile.len);
+    w += otrng_serialize_bytes_array(ret + w, prekey_message.data,
+                                     prekey_message.len);
+    blob_destroy(&prekey_message);
+    written++;
+  }
+
+  otrng_prekey_ensemble_query_retrieval_message_destroy(msg);
+
+  *reply = ret;
+  *reply_len = w;
+
+  return OTRNG_SUCCESS;
+}
+
+API otrng_result otrng_prekey_server_receive(char **tosend, const char *from,
+                                             const char *message,
+                                             otrng_prekey_server_s *server) {
+  *tosend = NULL;
+
+  /* Sessions and entries are kept by the identity of the client */
+  if (!from || !message) {
+    return OTRNG_ERROR;
+  }
+
+  uint8_t *decoded = NULL;
+  size_t decoded_len = 0;
+  if (!otrng_prekey_decode(message, &decoded, &decoded_len)) {
+    return OTRNG_ERROR;
+  }
+
+  uint8_t message_type = 0;
+  if (!otrng_parse_header(&message_type, decoded, decoded_len, NULL)) {
+    free(decoded);
+    return OTRNG_ERROR;
+  }
+
+  uint8_t *reply = NULL;
+  size_t reply_len = 0;
+  otrng_result ret = OTRNG_ERROR;
+
+  if (message_type == OTRNG_PREKEY_DAKE1_MSG) {
+    ret = receive_dake1(&reply, &reply_len, decoded, decoded_len, from, server);
+  } else if (message_type == OTRNG_PREKEY_DAKE3_MSG) {
+    ret = receive_dake3(&reply, &reply_len, decoded, decoded_len, from, server);
+  } else if (message_type == OTRNG_PREKEY_ENSEMBLE_QUERY_RETRIEVAL_MSG) {
+    ret = receive_ensemble_query(&reply, &reply_len, decoded, decoded_len,
+                                 server);
+  }
+
+  free(decoded);
+
+  if (!ret) {
+    return OTRNG_ERROR;
+  }
+
+  *tosend = otrng_prekey_encode(reply, reply_len);
+  free(reply);
+
+  if (!*tosend) {
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A reference implementation of the prekey server side of the protocol. It
+ * is meant to stand in for a real server when testing or load testing
+ * clients: messages are handed to it as they would arrive from the network,
+ * and it answers with the message to send back. It does no I/O of its own.
+ */
+
+#ifndef OTRNG_PREKEY_SERVER_H
+#define OTRNG_PREKEY_SERVER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "ed448.h"
+#include "keys.h"
+#include "list.h"
+#include "shared.h"
+
+/* The number of buckets of the storage index. Stored clients are spread
+ * between them by their identity. */
+#define OTRNG_PREKEY_SERVER_BUCKETS 256
+
+/* The most DAKEs in progress at once. Starting another one drops the oldest
+ * one. */
+#define OTRNG_PREKEY_SERVER_MAX_SESSIONS 1024
+
+/* The seconds a client has to finish a DAKE */
+#define OTRNG_PREKEY_SERVER_SESSION_TIMEOUT 60
+
+typedef struct otrng_prekey_server_blob_s {
+  uint8_t *data;
+  size_t len;
+} otrng_prekey_server_blob_s;
+
+/* What is stored for a client: an identity and instance tag pair */
+typedef struct otrng_prekey_server_entry_s {
+  char *identity;
+  uint32_t instance_tag;
+
+  otrng_prekey_server_blob_s client_profile;
+  otrng_prekey_server_blob_s prekey_profile;
+
+  /* One bit per version in the client profile, as in versions_mask */
+  uint16_t versions;
+
+  /* A queue of the serialized prekey messages, oldest first. Each one is
+   * handed out only once. */
+  otrng_prekey_server_blob_s *prekey_messages;
+  size_t first_prekey_message;
+  size_t num_prekey_messages;
+  size_t prekey_messages_capacity;
+} otrng_prekey_server_entry_s;
+
+/* A DAKE in progress */
+typedef struct otrng_prekey_server_session_s {
+  char *identity;
+  uint32_t instance_tag;
+
+  otrng_public_key_p client_pub;
+  otrng_prekey_server_blob_s client_profile;
+  ec_point_p I;
+  ecdh_keypair_p S;
+
+  time_t started;
+} otrng_prekey_server_session_s;
+
+typedef struct otrng_prekey_server_s {
+  char *identity;
+  otrng_keypair_s *keypair;
+
+  /* DATA(identity) || long-term public key */
+  uint8_t *composite_identity;
+  size_t composite_identity_len;
+
+  list_element_s *entries[OTRNG_PREKEY_SERVER_BUCKETS];
+  /* The DAKEs in progress, oldest first */
+  list_element_s *sessions;
+  size_t num_sessions;
+} otrng_prekey_server_s;
+
+/**
+ * @brief Creates a prekey server.
+ *
+ * @param [identity]  The identity of the server, as the clients know it.
+ * @param [sym]       The symmetric key its long-term keypair derives from.
+ */
+API otrng_prekey_server_s *
+otrng_prekey_server_new(const char *identity,
+                        const uint8_t sym[ED448_PRIVATE_BYTES]);
+
+API void otrng_prekey_server_free(otrng_prekey_server_s *server);
+
+/**
+ * @brief Processes a message from a prekey client.
+ *
+ * @param [tosend]   The reply to send to the client, if there is one.
+ * @param [from]     The identity of the client.
+ * @param [message]  The received message.
+ * @param [server]   The server.
+ *
+ * @return OTRNG_ERROR if the message was not a valid prekey client message.
+ */
+API otrng_result otrng_prekey_server_receive(char **tosend, const char *from,
+                                             const char *message,
+                                             otrng_prekey_server_s *server);
+
+/**
+ * @brief The number of prekey messages stored for a client.
+ */
+API size_t
+otrng_prekey_server_count_prekey_messages(const char *identity,
+                                          uint32_t instance_tag,
+                                          const otrng_prekey_server_s *server);
+
+#endif
@@ -20,13 +20,13 @@
 
 #include "protocol.h"
 
+#include "base64.h"
 #include "data_message.h"
 #include "padding.h"
 #include "random.h"
 #include "serialize.h"
-#include <libotr/b64.h>
 
-INTERNAL void maybe_create_keys(const otrng_client_state_s *state) {
+INTERNAL void maybe_create_keys(otrng_client_state_s *state) {
   const otrng_client_callbacks_s *cb = state->callbacks;
   const void *client_id = state->client_id;
 
@@ -58,6 +58,13 @@ INTERNAL const client_profile_s *get_my_client_profile(otrng_s *otr) {
   return otrng_client_state_get_client_profile(state);
 }
 
+INTERNAL otrng_serialized_profile_s *
+get_my_serialized_client_profile(otrng_s *otr) {
+  maybe_create_keys(otr->conversation->client);
+  otrng_client_state_s *state = otr->conversation->client;
+  return otrng_client_state_get_serialized_client_profile(state);
+}
+
 INTERNAL uint32_t our_instance_tag(const otrng_s *otr) {
   return otrng_client_state_get_instance_tag(otr->conversation->client);
 }
@@ -138,6 +145,11 @@ tstatic otrng_result encrypt_data_message(data_message_s *data_msg,
 
 tstatic data_message_s *generate_data_msg(const otrng_s *otr,
                                           const uint32_t ratchet_id) {
+  const uint8_t *dh = otrng_key_manager_get_our_dh_fixed(otr->keys);
+  if (!dh) {
+    return NULL;
+  }
+
   data_message_s *data_msg = otrng_data_message_new();
   if (!data_msg) {
     return NULL;
@@ -149,7 +161,7 @@ tstatic data_message_s *generate_data_msg(const otrng_s *otr,
   data_msg->ratchet_id = ratchet_id;
   data_msg->message_id = otr->keys->j;
   otrng_ec_point_copy(data_msg->ecdh, our_ecdh(otr));
-  data_msg->dh = otrng_dh_mpi_copy(our_dh(otr));
+  memcpy(data_msg->dh, dh, sizeof(dh_public_key_fixed_p));
 
   return data_msg;
 }
@@ -186,27 +198,26 @@ tstatic otrng_result serialize_and_encode_data_msg(
                                 to_reveal_mac_keys, to_reveal_mac_keys_len);
   }
 
-  *dst = otrl_base64_otr_encode(ser, serlen);
+  *dst = otrng_base64_otr_encode(ser, serlen);
 
   free(ser);
   return OTRNG_SUCCESS;
 }
 
-tstatic otrng_result send_data_message(string_p *to_send,
-                                       const uint8_t *message,
-                                       size_t message_len, otrng_s *otr,
-                                       unsigned char flags,
+/* Derives the keys of the next message we send, and starts its data
+ * message */
+tstatic data_message_s *start_data_msg(msg_enc_key_p enc_key,
+                                       msg_mac_key_p mac_key,
+                                       unsigned char flags, otrng_s *otr,
                                        otrng_warning *warn) {
   data_message_s *data_msg = NULL;
   uint32_t ratchet_id = otr->keys->i;
-  msg_enc_key_p enc_key;
-  msg_mac_key_p mac_key;
 
   /* if j == 0 */
   if (!otrng_key_manager_derive_dh_ratchet_keys(
           otr->keys, otr->conversation->client->max_stored_msg_keys, NULL,
           otr->keys->j, 0, 's', warn)) {
-    return OTRNG_ERROR;
+    return NULL;
   }
 
   memset(enc_key, 0, sizeof(msg_enc_key_p));
@@ -220,13 +231,43 @@ tstatic otrng_result send_data_message(string_p *to_send,
   if (!data_msg) {
     sodium_memzero(enc_key, sizeof(msg_enc_key_p));
     sodium_memzero(mac_key, sizeof(msg_mac_key_p));
-    return OTRNG_ERROR;
+    return NULL;
   }
 
   data_msg->flags = flags;
   data_msg->sender_instance_tag = our_instance_tag(otr);
   data_msg->receiver_instance_tag = otr->their_instance_tag;
 
+  return data_msg;
+}
+
+/* The old MAC keys are revealed with the first message of a ratchet */
+tstatic uint8_t *take_mac_keys_to_reveal(size_t *len, otrng_s *otr) {
+  *len = 0;
+  if (otr->keys->j != 0) {
+    return NULL;
+  }
+
+  *len = otrng_list_len(otr->keys->old_mac_keys) * MAC_KEY_BYTES;
+  uint8_t *ser_mac_keys = otrng_serialize_old_mac_keys(otr->keys->old_mac_keys);
+  otr->keys->old_mac_keys = NULL;
+
+  return ser_mac_keys;
+}
+
+tstatic otrng_result send_data_message(string_p *to_send,
+                                       const uint8_t *message,
+                                       size_t message_len, otrng_s *otr,
+                                       unsigned char flags,
+                                       otrng_warning *warn) {
+  msg_enc_key_p enc_key;
+  msg_mac_key_p mac_key;
+
+  data_message_s *data_msg = start_data_msg(enc_key, mac_key, flags, otr, warn);
+  if (!data_msg) {
+    return OTRNG_ERROR;
+  }
+
   if (!encrypt_data_message(data_msg, message, message_len, enc_key)) {
     otrng_error_message(to_send, OTRNG_ERR_MSG_ENCRYPTION_ERROR);
 
@@ -240,28 +281,17 @@ tstatic otrng_result send_data_message(string_p *to_send,
 
   /* Authenticator = KDF_1(0x1A || MKmac || KDF_1(usage_authenticator ||
    * data_message_sections, 64), 64) */
-  if (otr->keys->j == 0) {
-    size_t ser_mac_keys_len =
-        otrng_list_len(otr->keys->old_mac_keys) * MAC_KEY_BYTES;
-    uint8_t *ser_mac_keys =
-        otrng_serialize_old_mac_keys(otr->keys->old_mac_keys);
-    otr->keys->old_mac_keys = NULL;
-
-    if (!serialize_and_encode_data_msg(to_send, mac_key, ser_mac_keys,
-                                       ser_mac_keys_len, data_msg)) {
-      sodium_memzero(mac_key, sizeof(msg_mac_key_p));
-      free(ser_mac_keys);
-      otrng_data_message_free(data_msg);
-      return OTRNG_ERROR;
-    }
+  size_t ser_mac_keys_len = 0;
+  uint8_t *ser_mac_keys = take_mac_keys_to_reveal(&ser_mac_keys_len, otr);
+
+  if (!serialize_and_encode_data_msg(to_send, mac_key, ser_mac_keys,
+                                     ser_mac_keys_len, data_msg)) {
+    sodium_memzero(mac_key, sizeof(msg_mac_key_p));
     free(ser_mac_keys);
-  } else {
-    if (!serialize_and_encode_data_msg(to_send, mac_key, NULL, 0, data_msg)) {
-      sodium_memzero(mac_key, sizeof(msg_mac_key_p));
-      otrng_data_message_free(data_msg);
-      return OTRNG_ERROR;
-    }
+    otrng_data_message_free(data_msg);
+    return OTRNG_ERROR;
   }
+  free(ser_mac_keys);
 
   otr->keys->j++;
 
@@ -271,76 +301,65 @@ tstatic otrng_result send_data_message(string_p *to_send,
   return OTRNG_SUCCESS;
 }
 
-tstatic otrng_result serialize_tlvs(uint8_t **dst, size_t *dstlen,
-                                    const tlv_list_s *tlvs) {
-  const tlv_list_s *current = tlvs;
-  uint8_t *cursor = NULL;
+/* What goes after the message in the plaintext: NUL || TLVs || padding. Its
+ * length is known before anything is written, so it is written in place. */
+tstatic size_t plaintext_tail_len(size_t *padding_len, size_t message_len,
+                                  size_t tlvs_len, const otrng_s *otr) {
+  size_t len = 1 + tlvs_len;
+  *padding_len = otrng_padding_tlv_len(message_len + len, otr);
 
-  *dst = NULL;
-  *dstlen = 0;
+  return len + *padding_len;
+}
 
-  if (!tlvs) {
-    return OTRNG_SUCCESS;
+tstatic void serialize_plaintext_tail(uint8_t *dst, const uint8_t *tlvs,
+                                      size_t tlvs_len, size_t padding_len) {
+  *dst++ = 0;
+  if (tlvs_len) {
+    memcpy(dst, tlvs, tlvs_len);
   }
+  otrng_padding_tlv_serialize(dst + tlvs_len, padding_len);
+}
 
-  for (*dstlen = 0; current; current = current->next) {
-    *dstlen += current->data->len + 4;
-  }
+tstatic otrng_result append_serialized_tlvs(uint8_t **dst, size_t *dst_len,
+                                            const string_p message,
+                                            const uint8_t *tlvs,
+                                            size_t tlvs_len, otrng_s *otr) {
+  size_t message_len = strlen(message);
+  size_t padding_len = 0;
+  *dst_len = message_len +
+             plaintext_tail_len(&padding_len, message_len, tlvs_len, otr);
 
-  *dst = malloc(*dstlen);
+  /* The plaintext is wiped when the scratch arena is reset */
+  *dst = otrng_arena_alloc(otr->scratch, *dst_len);
   if (!*dst) {
     return OTRNG_ERROR;
   }
 
-  cursor = *dst;
-  for (current = tlvs; current; current = current->next) {
-    cursor += otrng_tlv_serialize(cursor, current->data);
-  }
+  memcpy(*dst, message, message_len);
+  serialize_plaintext_tail(*dst + message_len, tlvs, tlvs_len, padding_len);
 
   return OTRNG_SUCCESS;
 }
 
 tstatic otrng_result append_tlvs(uint8_t **dst, size_t *dst_len,
                                  const string_p message, const tlv_list_s *tlvs,
-                                 const otrng_s *otr) {
-  uint8_t *ser = NULL;
-  size_t len = 0;
-
-  if (!serialize_tlvs(&ser, &len, tlvs)) {
-    return OTRNG_ERROR;
-  }
-
-  // Append padding
-  size_t message_len = strlen(message) + 1 + len;
-  uint8_t *padding = NULL;
-  size_t padding_len = 0;
-  if (!generate_padding(&padding, &padding_len, message_len, otr)) {
-    free(ser);
-    return OTRNG_ERROR;
-  }
-
-  *dst_len = message_len + padding_len;
-  *dst = malloc(*dst_len);
-  if (!*dst) {
-    free(ser);
-    free(padding);
+                                 otrng_s *otr) {
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  if (!otrng_tlv_writer_append_list(otr->tlv_writer, tlvs)) {
     return OTRNG_ERROR;
   }
 
-  memcpy(otrng_stpcpy((char *)*dst, message) + 1, ser, len);
+  otrng_result ret =
+      append_serialized_tlvs(dst, dst_len, message, otr->tlv_writer->data,
+                             otr->tlv_writer->len, otr);
+  otrng_tlv_writer_reset(otr->tlv_writer);
 
-  if (padding) {
-    memcpy(*dst + message_len, padding, padding_len);
-  }
-
-  free(ser);
-  free(padding);
-  return OTRNG_SUCCESS;
+  return ret;
 }
 
-INTERNAL otrng_result otrng_prepare_to_send_data_message(
+INTERNAL otrng_result otrng_prepare_to_send_serialized_tlvs(
     string_p *to_send, otrng_warning *warn, const string_p message,
-    const tlv_list_s *tlvs, otrng_s *otr, unsigned char flags) {
+    const uint8_t *tlvs, size_t tlvs_len, otrng_s *otr, unsigned char flags) {
   uint8_t *msg = NULL;
   size_t msg_len = 0;
 
@@ -355,7 +374,9 @@ INTERNAL otrng_result otrng_prepare_to_send_data_message(
     return OTRNG_ERROR;
   }
 
-  if (!append_tlvs(&msg, &msg_len, message, tlvs, otr)) {
+  otrng_arena_enter(otr->scratch);
+  if (!append_serialized_tlvs(&msg, &msg_len, message, tlvs, tlvs_len, otr)) {
+    otrng_arena_leave(otr->scratch);
     return OTRNG_ERROR;
   }
 
@@ -363,8 +384,130 @@ INTERNAL otrng_result otrng_prepare_to_send_data_message(
       send_data_message(to_send, msg, msg_len, otr, flags, warn);
 
   otr->last_sent = time(NULL);
+  otrng_arena_leave(otr->scratch);
+
+  return result;
+}
 
-  free(msg);
+INTERNAL otrng_result otrng_prepare_to_send_data_message(
+    string_p *to_send, otrng_warning *warn, const string_p message,
+    const tlv_list_s *tlvs, otrng_s *otr, unsigned char flags) {
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  if (!otrng_tlv_writer_append_list(otr->tlv_writer, tlvs)) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_result result = otrng_prepare_to_send_serialized_tlvs(
+      to_send, warn, message, otr->tlv_writer->data, otr->tlv_writer->len, otr,
+      flags);
+  otrng_tlv_writer_reset(otr->tlv_writer);
 
   return result;
 }
+
+tstatic otrng_result build_plaintext_tail(uint8_t **dst, size_t *dst_len,
+                                          size_t message_len,
+                                          const tlv_list_s *tlvs,
+                                          otrng_s *otr) {
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  if (!otrng_tlv_writer_append_list(otr->tlv_writer, tlvs)) {
+    return OTRNG_ERROR;
+  }
+
+  size_t padding_len = 0;
+  *dst_len = plaintext_tail_len(&padding_len, message_len,
+                                otr->tlv_writer->len, otr);
+
+  *dst = malloc(*dst_len);
+  if (!*dst) {
+    otrng_tlv_writer_reset(otr->tlv_writer);
+    return OTRNG_ERROR;
+  }
+
+  serialize_plaintext_tail(*dst, otr->tlv_writer->data, otr->tlv_writer->len,
+                           padding_len);
+  otrng_tlv_writer_reset(otr->tlv_writer);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_send_stream_start(
+    otrng_send_stream_s *stream, size_t message_len, const tlv_list_s *tlvs,
+    unsigned char flags, int max_size, otrng_send_stream_emit_fn emit,
+    void *ctx, otrng_s *otr) {
+  if (otr->state != OTRNG_STATE_ENCRYPTED_MESSAGES) {
+    return OTRNG_ERROR;
+  }
+
+  uint8_t *tail = NULL;
+  size_t tail_len = 0;
+  if (!build_plaintext_tail(&tail, &tail_len, message_len, tlvs, otr)) {
+    return OTRNG_ERROR;
+  }
+
+  msg_enc_key_p enc_key;
+  msg_mac_key_p mac_key;
+  data_message_s *data_msg = start_data_msg(enc_key, mac_key, flags, otr, NULL);
+  if (!data_msg) {
+    free(tail);
+    return OTRNG_ERROR;
+  }
+
+  random_bytes(data_msg->nonce, sizeof(data_msg->nonce));
+
+  size_t ser_mac_keys_len = 0;
+  uint8_t *ser_mac_keys = take_mac_keys_to_reveal(&ser_mac_keys_len, otr);
+
+  otrng_result ret = otrng_send_stream_init(
+      stream, data_msg, enc_key, mac_key, ser_mac_keys, ser_mac_keys_len,
+      message_len + tail_len, max_size, emit, ctx);
+
+  sodium_memzero(enc_key, sizeof(msg_enc_key_p));
+  sodium_memzero(mac_key, sizeof(msg_mac_key_p));
+  otrng_data_message_free(data_msg);
+
+  stream->tail = tail;
+  stream->tail_len = tail_len;
+  stream->message_len = message_len;
+  stream->message_written = 0;
+
+  if (otrng_failed(ret)) {
+    otrng_send_stream_destroy(stream);
+    return OTRNG_ERROR;
+  }
+
+  /* The keys of this message are used: the next one must not reuse them,
+   * even if this one is never finished */
+  otr->keys->j++;
+  otr->last_sent = time(NULL);
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_send_stream_write(otrng_send_stream_s *stream,
+                                              const uint8_t *message,
+                                              size_t len) {
+  if (len > stream->message_len - stream->message_written) {
+    return OTRNG_ERROR;
+  }
+
+  if (memchr(message, 0, len)) {
+    return OTRNG_ERROR;
+  }
+
+  stream->message_written += len;
+  return otrng_send_stream_update(stream, message, len);
+}
+
+INTERNAL otrng_result otrng_send_stream_finish(otrng_send_stream_s *stream) {
+  if (stream->message_written != stream->message_len) {
+    return OTRNG_ERROR;
+  }
+
+  if (otrng_failed(
+          otrng_send_stream_update(stream, stream->tail, stream->tail_len))) {
+    return OTRNG_ERROR;
+  }
+
+  return otrng_send_stream_final(stream);
+}
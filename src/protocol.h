@@ -21,7 +21,9 @@
 #ifndef OTRNG_PROTOCOL_H
 #define OTRNG_PROTOCOL_H
 
+#include "arena.h"
 #include "key_management.h"
+#include "send_stream.h"
 #include "smp_protocol.h"
 #include "v3.h"
 
@@ -79,12 +81,23 @@ typedef struct otrng_s {
   time_t last_sent; // TODO: @refactoring not sure if the best place to put
 
   char *shared_session_state;
+
+  /* Scratch memory for a single receive or send call */
+  otrng_arena_p scratch;
+
+  /* The TLVs of the data message being sent, serialized */
+  otrng_tlv_writer_p tlv_writer;
 } otrng_s, otrng_p[1];
 
-INTERNAL void maybe_create_keys(const otrng_client_state_s *state);
+INTERNAL void maybe_create_keys(otrng_client_state_s *state);
 
 INTERNAL const client_profile_s *get_my_client_profile(otrng_s *otr);
 
+/* Our client profile, serialized, or NULL to let it be serialized where it is
+ * used */
+INTERNAL otrng_serialized_profile_s *
+get_my_serialized_client_profile(otrng_s *otr);
+
 INTERNAL struct goldilocks_448_point_s *our_ecdh(const otrng_s *otr);
 
 INTERNAL dh_public_key_p our_dh(const otrng_s *otr);
@@ -95,13 +108,63 @@ INTERNAL otrng_result otrng_prepare_to_send_data_message(
     string_p *to_send, otrng_warning *warn, const string_p message,
     const tlv_list_s *tlvs, otrng_s *otr, unsigned char flags);
 
+/**
+ * @brief Sends [message] with TLVs that are already serialized, as
+ *        otrng_tlv_writer_s writes them.
+ *
+ * @param [tlvs]      The serialized TLVs, or NULL if there are none.
+ * @param [tlvs_len]  Their length.
+ */
+INTERNAL otrng_result otrng_prepare_to_send_serialized_tlvs(
+    string_p *to_send, otrng_warning *warn, const string_p message,
+    const uint8_t *tlvs, size_t tlvs_len, otrng_s *otr, unsigned char flags);
+
 INTERNAL void otrng_error_message(string_p *to_send, otrng_err_code err_code);
 
+/**
+ * @brief Starts sending a message of [message_len] bytes a part at a time.
+ *        It is sent as otrng_prepare_to_send_data_message would send it,
+ *        but is never held whole in memory.
+ *
+ * @param [stream]       The stream. It is destroyed if this fails, and must
+ *                       be destroyed with otrng_send_stream_destroy after
+ *                       otrng_send_stream_finish otherwise.
+ * @param [message_len]  The length of the message, without a NUL.
+ * @param [tlvs]         The TLVs to send with it.
+ * @param [flags]        The data message flags.
+ * @param [max_size]     The maximum size of a fragment, or 0 not to
+ *                       fragment.
+ * @param [emit]         Where the output goes.
+ * @param [ctx]          Given to emit.
+ * @param [otr]          The otrng connection.
+ */
+INTERNAL otrng_result otrng_send_stream_start(
+    otrng_send_stream_s *stream, size_t message_len, const tlv_list_s *tlvs,
+    unsigned char flags, int max_size, otrng_send_stream_emit_fn emit,
+    void *ctx, otrng_s *otr);
+
+/**
+ * @brief Sends the next part of the message. It must not contain a NUL.
+ */
+INTERNAL otrng_result otrng_send_stream_write(otrng_send_stream_s *stream,
+                                              const uint8_t *message,
+                                              size_t len);
+
+/**
+ * @brief Sends the rest of the data message, once the whole message was
+ *        written.
+ */
+INTERNAL otrng_result otrng_send_stream_finish(otrng_send_stream_s *stream);
+
 #ifdef OTRNG_PROTOCOL_PRIVATE
 
 tstatic otrng_result serialize_and_encode_data_msg(
     string_p *dst, const msg_mac_key_p mac_key, uint8_t *to_reveal_mac_keys,
     size_t to_reveal_mac_keys_len, const data_message_s *data_msg);
+
+tstatic otrng_result append_tlvs(uint8_t **dst, size_t *dst_len,
+                                 const string_p message, const tlv_list_s *tlvs,
+                                 otrng_s *otr);
 #endif
 
 #endif
@@ -0,0 +1,311 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sodium.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OTRNG_SEND_STREAM_PRIVATE
+
+#include "fragment.h"
+#include "random.h"
+#include "send_stream.h"
+#include "serialize.h"
+
+/* The fragment header, without the comma that ends the fragment */
+#define FRAGMENT_PREFIX_LEN (FRAGMENT_HEADER_LEN - 1)
+
+tstatic size_t out_limit(const otrng_send_stream_s *stream) {
+  if (stream->max_size > 0) {
+    return stream->max_size - FRAGMENT_HEADER_LEN;
+  }
+
+  return stream->out_capacity;
+}
+
+tstatic char *out_cursor(const otrng_send_stream_s *stream) {
+  if (stream->max_size > 0) {
+    return stream->out + FRAGMENT_PREFIX_LEN + stream->out_len;
+  }
+
+  return stream->out + stream->out_len;
+}
+
+tstatic otrng_result flush_out(otrng_send_stream_s *stream) {
+  if (stream->max_size <= 0) {
+    otrng_result ret = stream->emit(stream->out, stream->out_len, stream->ctx);
+    stream->out_len = 0;
+    return ret;
+  }
+
+  if (stream->current_fragment == stream->total_fragments) {
+    return OTRNG_ERROR;
+  }
+
+  stream->current_fragment++;
+
+  char header[FRAGMENT_HEADER_LEN + 1];
+  snprintf(header, sizeof(header), FRAGMENT_FORMAT, stream->identifier,
+           stream->our_instance, stream->their_instance,
+           stream->current_fragment, stream->total_fragments, 0, "");
+  memcpy(stream->out, header, FRAGMENT_PREFIX_LEN);
+
+  char *end = out_cursor(stream);
+  *end = ',';
+
+  otrng_result ret =
+      stream->emit(stream->out, end + 1 - stream->out, stream->ctx);
+  stream->out_len = 0;
+
+  return ret;
+}
+
+/* A full fragment is only emitted when more output comes, so the last one is
+ * never empty */
+tstatic otrng_result write_out(otrng_send_stream_s *stream, const char *src,
+                               size_t len) {
+  size_t limit = out_limit(stream);
+
+  while (len > 0) {
+    if (stream->out_len == limit) {
+      if (otrng_failed(flush_out(stream))) {
+        return OTRNG_ERROR;
+      }
+    }
+
+    size_t n = limit - stream->out_len;
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(out_cursor(stream), src, n);
+    stream->out_len += n;
+    src += n;
+    len -= n;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result encode(otrng_send_stream_s *stream, const uint8_t *src,
+                            size_t len) {
+  while (len > 0) {
+    size_t n = OTRNG_SEND_STREAM_CHUNK_BYTES;
+    if (n > len) {
+      n = len;
+    }
+
+    size_t written =
+        otrng_base64_encoder_update(stream->encoder, stream->encoded, src, n);
+    if (otrng_failed(write_out(stream, stream->encoded, written))) {
+      return OTRNG_ERROR;
+    }
+
+    src += n;
+    len -= n;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result encrypt_chunk(otrng_send_stream_s *stream) {
+  /* encrypted is a multiple of the block size, so the chunk starts at a
+   * block */
+  if (crypto_stream_xsalsa20_xor_ic(stream->chunk, stream->chunk,
+                                    stream->chunk_len, stream->nonce,
+                                    stream->encrypted / 64, stream->enc_key)) {
+    return OTRNG_ERROR;
+  }
+
+  hash_update(stream->sections, stream->chunk, stream->chunk_len);
+  if (otrng_failed(encode(stream, stream->chunk, stream->chunk_len))) {
+    return OTRNG_ERROR;
+  }
+
+  stream->encrypted += stream->chunk_len;
+  stream->chunk_len = 0;
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_send_stream_init(
+    otrng_send_stream_s *stream, const data_message_s *header,
+    const msg_enc_key_p enc_key, const msg_mac_key_p mac_key,
+    uint8_t *revealed_mac_keys, size_t revealed_mac_keys_len,
+    size_t plaintext_len, int max_size, otrng_send_stream_emit_fn emit,
+    void *ctx) {
+  memset(stream, 0, sizeof(otrng_send_stream_s));
+  stream->revealed_mac_keys = revealed_mac_keys;
+  stream->revealed_mac_keys_len = revealed_mac_keys_len;
+
+  if (plaintext_len > UINT32_MAX) {
+    return OTRNG_ERROR;
+  }
+
+  if (max_size > 0 && max_size <= FRAGMENT_HEADER_LEN) {
+    return OTRNG_ERROR;
+  }
+
+  stream->emit = emit;
+  stream->ctx = ctx;
+
+  memcpy(stream->enc_key, enc_key, sizeof(msg_enc_key_p));
+  memcpy(stream->nonce, header->nonce, DATA_MSG_NONCE_BYTES);
+  stream->plaintext_len = plaintext_len;
+
+  memcpy(stream->mac_key, mac_key, sizeof(msg_mac_key_p));
+  otrng_data_message_sections_hash_init(stream->sections);
+
+  otrng_base64_encoder_init(stream->encoder);
+
+  uint8_t ser[DATA_MESSAGE_MAX_BYTES];
+  size_t ser_len = otrng_data_message_serialize_header(ser, header);
+  ser_len += otrng_serialize_uint32(ser + ser_len, plaintext_len);
+
+  /* "?OTR:" + base64 + "." */
+  size_t serlen =
+      ser_len + plaintext_len + DATA_MSG_MAC_BYTES + revealed_mac_keys_len;
+  size_t encoded_len = 5 + OTRNG_BASE64_ENCODE_LEN(serlen) + 1;
+
+  stream->max_size = max_size;
+  if (max_size > 0) {
+    size_t limit = max_size - FRAGMENT_HEADER_LEN;
+    size_t total = ((encoded_len - 1) / limit) + 1;
+    if (total > 65535) {
+      return OTRNG_ERROR;
+    }
+
+    stream->total_fragments = total;
+    stream->our_instance = header->sender_instance_tag;
+    stream->their_instance = header->receiver_instance_tag;
+    random_bytes(&stream->identifier, sizeof(stream->identifier));
+
+    /* The fragment, and the NUL snprintf writes after its header */
+    stream->out_capacity = max_size + 1;
+  } else {
+    stream->out_capacity = OTRNG_SEND_STREAM_CHUNK_BYTES;
+  }
+
+  stream->out = malloc(stream->out_capacity);
+  if (!stream->out) {
+    return OTRNG_ERROR;
+  }
+
+  hash_update(stream->sections, ser, ser_len);
+
+  if (otrng_failed(write_out(stream, "?OTR:", 5))) {
+    return OTRNG_ERROR;
+  }
+
+  return encode(stream, ser, ser_len);
+}
+
+INTERNAL otrng_result otrng_send_stream_update(otrng_send_stream_s *stream,
+                                               const uint8_t *plaintext,
+                                               size_t len) {
+  if (len > stream->plaintext_len - stream->encrypted - stream->chunk_len) {
+    return OTRNG_ERROR;
+  }
+
+  while (len > 0) {
+    size_t n = OTRNG_SEND_STREAM_CHUNK_BYTES - stream->chunk_len;
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(stream->chunk + stream->chunk_len, plaintext, n);
+    stream->chunk_len += n;
+    plaintext += n;
+    len -= n;
+
+    if (stream->chunk_len == OTRNG_SEND_STREAM_CHUNK_BYTES) {
+      if (otrng_failed(encrypt_chunk(stream))) {
+        return OTRNG_ERROR;
+      }
+    }
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_send_stream_final(otrng_send_stream_s *stream) {
+  if (stream->encrypted + stream->chunk_len != stream->plaintext_len) {
+    return OTRNG_ERROR;
+  }
+
+  if (stream->chunk_len > 0) {
+    if (otrng_failed(encrypt_chunk(stream))) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  /* Authenticator = KDF_1(usage_authenticator || MKmac ||
+   * KDF_1(usage_data_msg_sections || data_message_sections, 64), 64) */
+  uint8_t sections[HASH_BYTES];
+  hash_final(stream->sections, sections, HASH_BYTES);
+  hash_destroy(stream->sections);
+
+  uint8_t mac[DATA_MSG_MAC_BYTES];
+  otrng_key_manager_calculate_authenticator(mac, stream->mac_key, sections);
+  sodium_memzero(sections, HASH_BYTES);
+
+  if (otrng_failed(encode(stream, mac, DATA_MSG_MAC_BYTES))) {
+    return OTRNG_ERROR;
+  }
+
+  if (otrng_failed(encode(stream, stream->revealed_mac_keys,
+                          stream->revealed_mac_keys_len))) {
+    return OTRNG_ERROR;
+  }
+
+  size_t written = otrng_base64_encoder_final(stream->encoder, stream->encoded);
+  if (otrng_failed(write_out(stream, stream->encoded, written)) ||
+      otrng_failed(write_out(stream, ".", 1)) ||
+      otrng_failed(flush_out(stream))) {
+    return OTRNG_ERROR;
+  }
+
+  if (stream->current_fragment != stream->total_fragments) {
+    return OTRNG_ERROR;
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL void otrng_send_stream_destroy(otrng_send_stream_s *stream) {
+  sodium_memzero(stream->enc_key, sizeof(msg_enc_key_p));
+  sodium_memzero(stream->mac_key, sizeof(msg_mac_key_p));
+  sodium_memzero(stream->chunk, sizeof(stream->chunk));
+  stream->chunk_len = 0;
+  hash_destroy(stream->sections);
+
+  free(stream->revealed_mac_keys);
+  stream->revealed_mac_keys = NULL;
+
+  free(stream->out);
+  stream->out = NULL;
+
+  if (stream->tail) {
+    sodium_memzero(stream->tail, stream->tail_len);
+  }
+  free(stream->tail);
+  stream->tail = NULL;
+}
@@ -0,0 +1,163 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Builds a data message a piece at a time: the plaintext is encrypted, added
+ * to the authenticator, base64 encoded and fragmented as it is given, so only
+ * a chunk of it is held in memory at any time. The output is the same as
+ * serializing, encoding and fragmenting the whole message at once.
+ */
+
+#ifndef OTRNG_SEND_STREAM_H
+#define OTRNG_SEND_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "base64.h"
+#include "data_message.h"
+#include "key_management.h"
+#include "shared.h"
+
+/* A multiple of both the XSalsa20 block (64 bytes) and the base64 group (3
+ * bytes), so every chunk but the last is encrypted and encoded whole. */
+#define OTRNG_SEND_STREAM_CHUNK_BYTES 3072
+
+/* Where the output goes. With a maximum fragment size, it is called once per
+ * fragment; otherwise it is given the encoded message a part at a time. */
+typedef otrng_result (*otrng_send_stream_emit_fn)(const char *data, size_t len,
+                                                  void *ctx);
+
+typedef struct otrng_send_stream_s {
+  otrng_send_stream_emit_fn emit;
+  void *ctx;
+
+  /* Encryption */
+  msg_enc_key_p enc_key;
+  uint8_t nonce[DATA_MSG_NONCE_BYTES];
+  size_t plaintext_len;
+  size_t encrypted;
+  uint8_t chunk[OTRNG_SEND_STREAM_CHUNK_BYTES];
+  size_t chunk_len;
+
+  /* Authentication */
+  msg_mac_key_p mac_key;
+  goldilocks_shake256_ctx_p sections;
+  uint8_t *revealed_mac_keys;
+  size_t revealed_mac_keys_len;
+
+  /* Encoding */
+  otrng_base64_encoder_p encoder;
+  char encoded[OTRNG_BASE64_ENCODE_LEN(OTRNG_SEND_STREAM_CHUNK_BYTES + 2)];
+
+  /* Fragmentation. out holds the fragment, or the part of the encoded
+   * message, being filled. */
+  int max_size;
+  uint32_t identifier;
+  uint32_t our_instance;
+  uint32_t their_instance;
+  uint16_t current_fragment;
+  uint16_t total_fragments;
+  char *out;
+  size_t out_len;
+  size_t out_capacity;
+
+  /* Used by otrng_send_stream_start and the functions that follow it: what
+   * goes after the message in the plaintext (its NUL, the TLVs and the
+   * padding) */
+  uint8_t *tail;
+  size_t tail_len;
+  size_t message_len;
+  size_t message_written;
+} otrng_send_stream_s, otrng_send_stream_p[1];
+
+/**
+ * @brief Starts the data message described by [header], whose plaintext is
+ *        [plaintext_len] bytes long.
+ *
+ * @param [stream]             The stream.
+ * @param [header]             The data message, with its nonce. enc_msg is
+ *                             not used.
+ * @param [enc_key]            The message encryption key.
+ * @param [mac_key]            The message MAC key.
+ * @param [revealed_mac_keys]  The old MAC keys to reveal, or NULL. The
+ *                             stream takes them.
+ * @param [revealed_mac_keys_len]  Their length.
+ * @param [plaintext_len]      The length of the whole plaintext.
+ * @param [max_size]           The maximum size of a fragment, or 0 not to
+ *                             fragment.
+ * @param [emit]               Where the output goes.
+ * @param [ctx]                Given to emit.
+ */
+INTERNAL otrng_result otrng_send_stream_init(
+    otrng_send_stream_s *stream, const data_message_s *header,
+    const msg_enc_key_p enc_key, const msg_mac_key_p mac_key,
+    uint8_t *revealed_mac_keys, size_t revealed_mac_keys_len,
+    size_t plaintext_len, int max_size, otrng_send_stream_emit_fn emit,
+    void *ctx);
+
+/**
+ * @brief Adds the next part of the plaintext.
+ */
+INTERNAL otrng_result otrng_send_stream_update(otrng_send_stream_s *stream,
+                                               const uint8_t *plaintext,
+                                               size_t len);
+
+/**
+ * @brief Adds the authenticator and the revealed MAC keys, and emits what is
+ *        left. It fails if the plaintext was not as long as announced.
+ */
+INTERNAL otrng_result otrng_send_stream_final(otrng_send_stream_s *stream);
+
+/**
+ * @brief Wipes the keys and frees what the stream holds, but not the stream.
+ */
+INTERNAL void otrng_send_stream_destroy(otrng_send_stream_s *stream);
+
+#ifdef OTRNG_SEND_STREAM_PRIVATE
+
+/**
+ * @brief The room in out for the encoded message: a fragment without its
+ *        header, or the whole buffer when not fragmenting.
+ */
+tstatic size_t out_limit(const otrng_send_stream_s *stream);
+
+tstatic char *out_cursor(const otrng_send_stream_s *stream);
+
+/**
+ * @brief Emits what out holds, as the next fragment when fragmenting.
+ */
+tstatic otrng_result flush_out(otrng_send_stream_s *stream);
+
+tstatic otrng_result write_out(otrng_send_stream_s *stream, const char *src,
+                               size_t len);
+
+tstatic otrng_result encode(otrng_send_stream_s *stream, const uint8_t *src,
+                            size_t len);
+
+/**
+ * @brief Encrypts the chunk, and adds it to the authenticator and the
+ *        output.
+ */
+tstatic otrng_result encrypt_chunk(otrng_send_stream_s *stream);
+
+#endif
+
+#endif
@@ -22,7 +22,9 @@
 
 #define OTRNG_SERIALIZE_PRIVATE
 
+#include "key_management.h"
 #include "serialize.h"
+#include "shake.h"
 
 INTERNAL size_t serialize_uint(uint8_t *target, const uint64_t data,
                                const size_t offset) {
@@ -175,7 +177,9 @@ INTERNAL uint8_t *otrng_serialize_old_mac_keys(list_element_s *old_mac_keys) {
 
   for (unsigned int i = 0; i < num_mac_keys; i++) {
     list_element_s *last = otrng_list_get_last(old_mac_keys);
-    memcpy(ser_mac_keys + i * MAC_KEY_BYTES, last->data, MAC_KEY_BYTES);
+    const old_mac_key_s *old_mac_key = last->data;
+    memcpy(ser_mac_keys + i * MAC_KEY_BYTES, old_mac_key->mac_key,
+           MAC_KEY_BYTES);
     old_mac_keys = otrng_list_remove_element(last, old_mac_keys);
     otrng_list_free_full(last);
   }
@@ -207,3 +211,32 @@ INTERNAL size_t otrng_serialize_phi(uint8_t *dst,
 
   return cursor - dst;
 }
+
+INTERNAL void otrng_serialized_profile_init(otrng_serialized_profile_s *ser) {
+  memset(ser, 0, sizeof(otrng_serialized_profile_s));
+}
+
+INTERNAL void
+otrng_serialized_profile_destroy(otrng_serialized_profile_s *ser) {
+  free(ser->data);
+  otrng_serialized_profile_init(ser);
+}
+
+INTERNAL void otrng_serialized_profile_digest(uint8_t dst[HASH_BYTES],
+                                              uint8_t usage,
+                                              otrng_serialized_profile_s *ser) {
+  for (size_t i = 0; i < ser->num_digests; i++) {
+    if (ser->digest_usages[i] == usage) {
+      memcpy(dst, ser->digests[i], HASH_BYTES);
+      return;
+    }
+  }
+
+  shake_256_kdf1(dst, HASH_BYTES, usage, ser->data, ser->len);
+
+  if (ser->num_digests < OTRNG_SERIALIZED_PROFILE_DIGESTS) {
+    ser->digest_usages[ser->num_digests] = usage;
+    memcpy(ser->digests[ser->num_digests], dst, HASH_BYTES);
+    ser->num_digests++;
+  }
+}
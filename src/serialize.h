@@ -24,6 +24,7 @@
 #include <stdint.h>
 
 #include "auth.h"
+#include "constants.h"
 #include "dh.h"
 #include "ed448.h"
 #include "error.h"
@@ -95,6 +96,41 @@ INTERNAL size_t otrng_serialize_phi(uint8_t *dst,
                                     uint16_t sender_instance_tag,
                                     uint16_t receiver_instance_tag);
 
+#define OTRNG_SERIALIZED_PROFILE_DIGESTS 4
+
+/* one of our profiles in its serialized form, with the digests
+ * KDF_1(usage || profile, 64) taken of it so far. It is kept for as long as
+ * the profile does not change. */
+typedef struct otrng_serialized_profile_s {
+  uint8_t *data;
+  size_t len;
+  uint8_t digest_usages[OTRNG_SERIALIZED_PROFILE_DIGESTS];
+  uint8_t digests[OTRNG_SERIALIZED_PROFILE_DIGESTS][HASH_BYTES];
+  size_t num_digests;
+} otrng_serialized_profile_s, otrng_serialized_profile_p[1];
+
+INTERNAL void otrng_serialized_profile_init(otrng_serialized_profile_s *ser);
+
+/**
+ * @brief Forget the serialized profile and its digests.
+ *
+ * @param [ser]   The serialized profile.
+ */
+INTERNAL void
+otrng_serialized_profile_destroy(otrng_serialized_profile_s *ser);
+
+/**
+ * @brief Get KDF_1(usage || profile, 64), computing it only the first time
+ *        it is asked for.
+ *
+ * @param [dst]     The digest.
+ * @param [usage]   The usage.
+ * @param [ser]     The serialized profile.
+ */
+INTERNAL void otrng_serialized_profile_digest(uint8_t dst[HASH_BYTES],
+                                              uint8_t usage,
+                                              otrng_serialized_profile_s *ser);
+
 #ifdef OTRNG_SERIALIZE_PRIVATE
 #endif
 
@@ -22,26 +22,47 @@
 
 #include "shake.h"
 
-void hash_init_with_dom(goldilocks_shake256_ctx_p hash) {
-  hash_init(hash);
+static const char *const domains[OTRNG_SHAKE_DOMAINS] = {
+    "OTRv4",
+    "OTR-Prekey-Server",
+};
+
+/* Sponges that have already absorbed a domain string, by otrng_shake_domain.
+ * Every hash in that domain starts as a copy of one of them. They are only
+ * written by otrng_shake_init. */
+static goldilocks_shake256_ctx_p prefixes[OTRNG_SHAKE_DOMAINS];
+static int prefixes_initialized = 0;
+
+void otrng_shake_init(void) {
+  if (prefixes_initialized) {
+    return;
+  }
+
+  for (int i = 0; i < OTRNG_SHAKE_DOMAINS; i++) {
+    hash_init(prefixes[i]);
+    hash_update(prefixes[i], (const unsigned char *)domains[i],
+                strlen(domains[i]));
+  }
+
+  prefixes_initialized = 1;
+}
 
-  const char *domain = "OTRv4";
-  hash_update(hash, (const unsigned char *)domain, strlen(domain));
+void hash_init_with_dom(goldilocks_shake256_ctx_p hash) {
+  memcpy(hash, prefixes[OTRNG_SHAKE_DOMAIN_OTRV4],
+         sizeof(goldilocks_shake256_ctx_p));
 }
 
 void hash_init_with_usage_and_domain_separation(goldilocks_shake256_ctx_p hash,
                                                 uint8_t usage,
-                                                const char *domain) {
-  hash_init(hash);
-  // TODO: why we cast here?
-  hash_update(hash, (const unsigned char *)domain, strlen(domain));
+                                                otrng_shake_domain domain) {
+  memcpy(hash, prefixes[domain], sizeof(goldilocks_shake256_ctx_p));
   hash_update(hash, &usage, 1);
 }
 
 void hash_init_with_usage_prekey_server(goldilocks_shake256_ctx_p hash,
                                         uint8_t usage) {
-  const char *domain = "OTR-Prekey-Server";
-  hash_init_with_usage_and_domain_separation(hash, usage, domain);
+  hash_init_with_usage_and_domain_separation(hash, usage,
+                                             OTRNG_SHAKE_DOMAIN_PREKEY_SERVER);
 }
 
 void hash_init_with_usage(goldilocks_shake256_ctx_p hash, uint8_t usage) {
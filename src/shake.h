@@ -30,14 +30,29 @@
 #define hash_destroy goldilocks_shake256_destroy
 #define hash_hash goldilocks_shake256_hash
 
+/* The domain separation strings: "OTRv4" and "OTR-Prekey-Server" */
+typedef enum {
+  OTRNG_SHAKE_DOMAIN_OTRV4 = 0,
+  OTRNG_SHAKE_DOMAIN_PREKEY_SERVER = 1,
+} otrng_shake_domain;
+
+#define OTRNG_SHAKE_DOMAINS 2
+
+/* Absorbs the domain strings once. OTRNG_INIT calls it, and nothing can be
+ * hashed before. */
+void otrng_shake_init(void);
+
 void hash_init_with_dom(goldilocks_shake256_ctx_p hash);
 
 void hash_init_with_usage_and_domain_separation(goldilocks_shake256_ctx_p hash,
                                                 uint8_t usage,
-                                                const char *domain);
+                                                otrng_shake_domain domain);
 
 void hash_init_with_usage(goldilocks_shake256_ctx_p hash, uint8_t usage);
 
+void hash_init_with_usage_prekey_server(goldilocks_shake256_ctx_p hash,
+                                        uint8_t usage);
+
 void shake_kkdf(uint8_t *dst, size_t dstlen, const uint8_t *key, size_t keylen,
                 const uint8_t *secret, size_t secretlen);
 
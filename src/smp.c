@@ -215,6 +215,24 @@ tstatic tlv_s *otrng_smp_initiate(const client_profile_s *initiator_profile,
   return NULL;
 }
 
+/* Sends a data message with no text and the SMP TLV [tlv], serialized
+ * without building a list of TLVs */
+tstatic otrng_result send_smp_tlv(string_p *to_send, otrng_warning *warn,
+                                  const tlv_s *tlv, otrng_s *otr) {
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  if (!otrng_tlv_writer_append(otr->tlv_writer, tlv->type, tlv->data,
+                               tlv->len)) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_result ret = otrng_prepare_to_send_serialized_tlvs(
+      to_send, warn, "", otr->tlv_writer->data, otr->tlv_writer->len, otr,
+      MSGFLAGS_IGNORE_UNREADABLE);
+  otrng_tlv_writer_reset(otr->tlv_writer);
+
+  return ret;
+}
+
 INTERNAL otrng_result otrng_smp_start(string_p *to_send,
                                       const uint8_t *question,
                                       const size_t q_len, const uint8_t *answer,
@@ -241,16 +259,10 @@ INTERNAL otrng_result otrng_smp_start(string_p *to_send,
       return OTRNG_ERROR;
     }
 
-    tlv_list_s *tlvs = otrng_tlv_list_one(smp_start_tlv);
-    if (!tlvs) {
-      return OTRNG_ERROR;
-    }
-
     otrng_warning warn = OTRNG_WARN_NONE;
     // TODO: do something about warn
-    otrng_result ret = otrng_prepare_to_send_data_message(
-        to_send, &warn, "", tlvs, otr, MSGFLAGS_IGNORE_UNREADABLE);
-    otrng_tlv_list_free(tlvs);
+    otrng_result ret = send_smp_tlv(to_send, &warn, smp_start_tlv, otr);
+    otrng_tlv_free(smp_start_tlv);
     return ret;
   case 0:
     return OTRNG_ERROR;
@@ -295,11 +307,11 @@ tstatic otrng_result smp_continue_v4(string_p *to_send, const uint8_t *secret,
   }
 
   otrng_smp_event_t event = OTRNG_SMP_EVENT_NONE;
-  tlv_list_s *tlvs = otrng_tlv_list_one(otrng_smp_provide_secret(
+  tlv_s *smp_reply = otrng_smp_provide_secret(
       &event, otr->smp, get_my_client_profile(otr), otr->their_client_profile,
-      otr->keys->ssid, secret, secretlen));
+      otr->keys->ssid, secret, secretlen);
 
-  if (!tlvs) {
+  if (!smp_reply) {
     return OTRNG_ERROR;
   }
 
@@ -312,9 +324,8 @@ tstatic otrng_result smp_continue_v4(string_p *to_send, const uint8_t *secret,
 
   otrng_warning warn = OTRNG_WARN_NONE;
   // TODO: warn
-  otrng_result ret = otrng_prepare_to_send_data_message(
-      to_send, &warn, "", tlvs, otr, MSGFLAGS_IGNORE_UNREADABLE);
-  otrng_tlv_list_free(tlvs);
+  otrng_result ret = send_smp_tlv(to_send, &warn, smp_reply, otr);
+  otrng_tlv_free(smp_reply);
 
   return ret;
 }
@@ -336,19 +347,18 @@ INTERNAL otrng_result otrng_smp_continue(string_p *to_send,
 }
 
 tstatic otrng_result otrng_smp_abort_v4(string_p *to_send, otrng_s *otr) {
-  tlv_list_s *tlvs =
-      otrng_tlv_list_one(otrng_tlv_new(OTRL_TLV_SMP_ABORT, 0, NULL));
-
-  if (!tlvs) {
+  otrng_tlv_writer_reset(otr->tlv_writer);
+  if (!otrng_tlv_writer_append(otr->tlv_writer, OTRL_TLV_SMP_ABORT, NULL, 0)) {
     return OTRNG_ERROR;
   }
 
   otr->smp->state_expect = '1';
   otrng_warning warn = OTRNG_WARN_NONE;
   // TODO: warn
-  otrng_result ret = otrng_prepare_to_send_data_message(
-      to_send, &warn, "", tlvs, otr, MSGFLAGS_IGNORE_UNREADABLE);
-  otrng_tlv_list_free(tlvs);
+  otrng_result ret = otrng_prepare_to_send_serialized_tlvs(
+      to_send, &warn, "", otr->tlv_writer->data, otr->tlv_writer->len, otr,
+      MSGFLAGS_IGNORE_UNREADABLE);
+  otrng_tlv_writer_reset(otr->tlv_writer);
   return ret;
 }
 
@@ -33,6 +33,7 @@
 #define OTRNG_SMP_PROTOCOL_PRIVATE
 #define OTRNG_TLV_PRIVATE
 #define OTRNG_USER_PROFILE_PRIVATE
+#define OTRNG_V3_PRIVATE
 #define OTRNG_MESSAGING_PRIVATE
 
 #include "../otrng.h"
@@ -42,7 +43,10 @@
 #include "test_fixtures.h"
 // clang-format on
 
+#include "test_alloc.c"
 #include "test_api.c"
+#include "test_arena.c"
+#include "test_base64.c"
 #include "test_client.c"
 #include "test_dake.c"
 #include "test_data_message.c"
@@ -59,6 +63,7 @@
 #include "test_prekey_ensemble.c"
 #include "test_prekey_profile.c"
 #include "test_serialize.c"
+#include "test_shake.c"
 #include "test_standard.c"
 #include "test_smp.c"
 #include "test_tlv.c"
@@ -68,6 +73,8 @@
 #include "test_prekey_server_client.c"
 #include "test_prekey_client.c"
 #include "test_prekey_messages.c"
+#include "test_prekey_server.c"
+#include "test_send_stream.c"
 
 int main(int argc, char **argv) {
   if (!gcry_check_version(GCRYPT_VERSION))
@@ -114,10 +121,25 @@ int main(int argc, char **argv) {
   g_test_add_func("/list/length", test_otrng_list_len);
   g_test_add_func("/list/empty_size", test_list_empty_size);
 
+  g_test_add_func("/alloc/set_allocator", test_otrng_set_allocator);
+  g_test_add_func("/alloc/secure_pool", test_otrng_secure_pool);
+
+  g_test_add_func("/arena/alloc", test_otrng_arena_alloc);
+  g_test_add_func("/arena/reset", test_otrng_arena_reset);
+  g_test_add_func("/arena/nested_calls", test_otrng_arena_nested_calls);
+
+  g_test_add_func("/base64/encode", test_base64_encode_matches_libotr);
+  g_test_add_func("/base64/decode", test_base64_decode_matches_libotr);
+  g_test_add_func("/base64/streaming", test_base64_streaming);
+  g_test_add_func("/base64/otr_encoding", test_base64_otr_encoding);
+
+  g_test_add_func("/shake/prefixed_kdfs", test_shake_prefixed_kdfs);
+
   g_test_add_func("/dh/api", dh_test_api);
   g_test_add_func("/dh/serialize", dh_test_serialize);
   g_test_add_func("/dh/shared-secret", dh_test_shared_secret);
   g_test_add_func("/dh/destroy", dh_test_keypair_destroy);
+  g_test_add_func("/dh/fixed_public_key", dh_test_fixed_public_key);
 
   g_test_add_func("/ring-signature/rsig_auth", test_rsig_auth);
   g_test_add_func("/ring-signature/calculate_c", test_rsig_calculate_c);
@@ -137,6 +159,8 @@ int main(int argc, char **argv) {
   g_test_add_func("/serialize/otrng-symmetric-key",
                   test_serialize_otrng_symmetric_key);
   g_test_add_func("/serialize/fingerprint", test_serializes_fingerprint);
+  g_test_add_func("/serialize/serialized_profile_digest",
+                  test_serialized_profile_digest);
 
   g_test_add_func("/client_profile/build_client_profile",
                   test_otrng_client_profile_build);
@@ -146,6 +170,8 @@ int main(int argc, char **argv) {
   g_test_add_func("/client_profile/serialize", test_client_profile_serializes);
   g_test_add_func("/client_profile/deserializes",
                   test_otrng_client_profile_deserializes);
+  g_test_add_func("/client_profile/deserializes_no_copy",
+                  test_otrng_client_profile_deserializes_no_copy);
   g_test_add_func("/client_profile/sign_and_verifies",
                   test_client_profile_signs_and_verify);
   g_test_add_func("/client_profile/transitional_signature",
@@ -179,10 +205,14 @@ int main(int argc, char **argv) {
                   test_data_message_serializes_absent_dh);
   g_test_add_func("/data_message/deserialize",
                   test_otrng_data_message_deserializes);
+  g_test_add_func("/data_message/deserialize_no_copy",
+                  test_otrng_data_message_deserializes_no_copy);
 
   g_test_add_func("/fragment/create_fragments_smaller_than_max_size",
                   test_create_fragments_smaller_than_max_size);
   g_test_add_func("/fragment/create_fragments", test_create_fragments);
+  g_test_add_func("/fragment/create_fragments_into_buffer",
+                  test_create_fragments_into_buffer);
   g_test_add_func("/fragment/defragment_message",
                   test_defragment_valid_message);
   g_test_add_func("/fragment/defragment_single_fragment",
@@ -201,6 +231,12 @@ int main(int argc, char **argv) {
                   test_defragment_regular_otr_message);
   g_test_add_func("/fragment/defragment_two_messages",
                   test_defragment_two_messages);
+  g_test_add_func("/fragment/defragment_and_decode_out_of_order",
+                  test_defragment_and_decode_out_of_order);
+  g_test_add_func("/fragment/defragment_and_decode_uneven_fragments",
+                  test_defragment_and_decode_uneven_fragments);
+  g_test_add_func("/fragment/defragment_and_decode_too_long_fails",
+                  test_defragment_and_decode_too_long_fails);
   g_test_add_func("/fragment/expiration_of_fragments",
                   test_expiration_of_fragments);
 
@@ -210,6 +246,15 @@ int main(int argc, char **argv) {
   g_test_add_func("/key_management/extra_symm_key",
                   test_calculate_extra_symm_key);
   g_test_add_func("/key_management/brace_key", test_calculate_brace_key);
+  g_test_add_func("/key_management/brace_key_memoized",
+                  test_calculate_brace_key_memoized);
+  g_test_add_func("/key_management/chain_kdf_step", test_chain_kdf_step);
+  g_test_add_func("/key_management/skipped_keys_checkpoints",
+                  test_skipped_keys_checkpoints);
+  g_test_add_func("/key_management/expire_stored_keys",
+                  test_expire_stored_keys);
+  g_test_add_func("/key_management/prepared_ephemeral_keys",
+                  test_prepared_ephemeral_keys);
 
   g_test_add_func("/smp/state_machine", test_smp_state_machine);
   g_test_add_func("/smp/state_machine_abort", test_smp_state_machine_abort);
@@ -219,6 +264,10 @@ int main(int argc, char **argv) {
   g_test_add_func("/tlv/parse", test_tlv_parse);
   g_test_add_func("/tlv/append", test_otrng_append_tlv);
   g_test_add_func("/tlv/append_padding", test_otrng_append_padding_tlv);
+  g_test_add_func("/tlv/writer_serializes_tlvs",
+                  test_tlv_writer_serializes_tlvs);
+  g_test_add_func("/tlv/writer_grows", test_tlv_writer_grows);
+  g_test_add_func("/tlv/reader_reads_tlvs", test_tlv_reader_reads_tlvs);
 
   g_test_add("/otrng/builds_query_message", otrng_fixture_s, NULL,
              otrng_fixture_set_up, test_otrng_builds_query_message,
@@ -250,12 +299,17 @@ int main(int argc, char **argv) {
   g_test_add("/otrng/receives_plaintext_with_ws_tag_v3", otrng_fixture_s, NULL,
              otrng_fixture_set_up, test_otrng_receives_plaintext_with_ws_tag_v3,
              otrng_fixture_teardown);
+  g_test_add("/otrng/pads_plaintext_in_place", otrng_fixture_s, NULL,
+             otrng_fixture_set_up, test_otrng_pads_plaintext_in_place,
+             otrng_fixture_teardown);
   g_test_add("/otrng/receives_query_message", otrng_fixture_s, NULL,
              otrng_fixture_set_up, test_otrng_receives_query_message,
              otrng_fixture_teardown);
   g_test_add("/otrng/receives_query_message_v3", otrng_fixture_s, NULL,
              otrng_fixture_set_up, test_otrng_receives_query_message_v3,
              otrng_fixture_teardown);
+  g_test_add_func("/otrng/classifies_messages",
+                  test_otrng_classifies_messages);
   g_test_add_func("/otrng/destroy", test_otrng_destroy);
 
   g_test_add_func("/otrng/callbacks/shared_session_state",
@@ -297,6 +351,22 @@ int main(int argc, char **argv) {
   g_test_add_func("/prekey_messages/deserialize_prekey_dake3_message",
                   test_deserialize_prekey_dake3_message);
 
+  g_test_add_func("/prekey_server/local/publishes_and_retrieves",
+                  test_prekey_server_publishes_and_retrieves);
+  g_test_add_func("/prekey_server/local/rejects_unknown_dake",
+                  test_prekey_server_rejects_unknown_dake);
+  g_test_add_func("/prekey_server/local/expires_dake",
+                  test_prekey_server_expires_dake);
+  g_test_add_func("/prekey_server/local/publishes_replaced_profiles",
+                  test_prekey_server_publishes_replaced_profiles);
+
+  g_test_add_func("/send_stream/matches_whole_message",
+                  test_send_stream_matches_whole_message);
+  g_test_add_func("/send_stream/matches_fragmented_message",
+                  test_send_stream_matches_fragmented_message);
+  g_test_add_func("/send_stream/rejects_short_plaintext",
+                  test_send_stream_rejects_short_plaintext);
+
   g_test_add_func("/client/conversation_api", test_client_conversation_api);
   g_test_add_func("/client/api", test_client_api);
   g_test_add_func("/client/get_our_fingerprint",
@@ -309,6 +379,9 @@ int main(int argc, char **argv) {
                   test_client_receives_fragmented_message);
   g_test_add_func("/client/expires_old_fragments",
                   test_client_expires_old_fragments);
+  g_test_add_func("/client/reuses_result", test_client_reuses_result);
+  g_test_add_func("/client/sends_streamed_message",
+                  test_client_sends_streamed_message);
 
   g_test_add_func("/client/conversation_data_message_multiple_locations",
                   test_conversation_with_multiple_locations);
@@ -346,10 +419,19 @@ int main(int argc, char **argv) {
   g_test_add_func("/api/conversation_errors_1", test_api_conversation_errors_1);
   g_test_add_func("/api/conversation_errors_2", test_api_conversation_errors_2);
   g_test_add_func("/api/conversation/v3", test_api_conversation_v3);
+  g_test_add_func("/api/v3_caches_account_and_protocol",
+                  test_api_v3_caches_account_and_protocol);
+  g_test_add_func("/api/v3_queues_injected_messages",
+                  test_api_v3_queues_injected_messages);
+  g_test_add_func("/api/v3_tlvs_are_shared_when_sending",
+                  test_api_v3_tlvs_are_shared_when_sending);
+  g_test_add_func("/api/v3_tlvs_are_moved_when_receiving",
+                  test_api_v3_tlvs_are_moved_when_receiving);
   g_test_add_func("/api/smp", test_api_smp);
   g_test_add_func("/api/smp_abort", test_api_smp_abort);
   /* g_test_add_func("/api/messaging", test_api_messaging); */
   g_test_add_func("/api/instance_tag", test_instance_tag_api);
+  g_test_add_func("/api/instance_tag_is_cached", test_instance_tag_is_cached);
   g_test_add_func("/api/extra_symm_key", test_api_extra_sym_key);
   g_test_add_func("/api/heartbeat_messages", test_heartbeat_messages);
 
@@ -0,0 +1,102 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../alloc.h"
+
+static int test_allocations = 0;
+static int test_frees = 0;
+
+static void *counting_malloc(size_t size) {
+  test_allocations++;
+  return malloc(size);
+}
+
+static void counting_free(void *ptr) {
+  test_frees++;
+  free(ptr);
+}
+
+void test_otrng_set_allocator() {
+  otrng_allocator_p allocator = {{
+      .malloc = counting_malloc,
+      .free = counting_free,
+  }};
+
+  test_allocations = 0;
+  test_frees = 0;
+  otrng_set_allocator(allocator);
+
+  otrng_arena_p arena;
+  otrng_arena_init(arena, 0);
+  otrng_assert(otrng_arena_alloc(arena, 16));
+  otrng_arena_destroy(arena);
+
+  /* Unset members fall back to the default implementation */
+  void *p = otrng_secure_alloc(8);
+  otrng_assert(p);
+  otrng_secure_free(p, 8);
+
+  otrng_set_allocator(NULL);
+
+  g_assert_cmpint(test_allocations, ==, 1);
+  g_assert_cmpint(test_frees, ==, 1);
+
+  p = otrng_mem_alloc(8);
+  otrng_mem_free(p);
+  g_assert_cmpint(test_allocations, ==, 1);
+}
+
+void test_otrng_secure_pool() {
+  otrng_secure_pool_stats_p before, after;
+  otrng_secure_pool_get_stats(before);
+
+  uint8_t *one = otrng_secure_alloc(100);
+  uint8_t *two = otrng_secure_alloc(100);
+  otrng_assert(one);
+  otrng_assert(two);
+  g_assert_cmpint((uintptr_t)one % 16, ==, 0);
+  memset(one, 0xAA, 100);
+  memset(two, 0xBB, 100);
+
+  otrng_secure_pool_get_stats(after);
+  g_assert_cmpint(after->slots_in_use, ==, before->slots_in_use + 2);
+  otrng_assert(after->slabs <= before->slabs + 1);
+
+  otrng_secure_free(one, 100);
+  otrng_secure_free(two, 100);
+
+  /* Freed slots are reused without asking for a new slab */
+  size_t slabs = after->slabs;
+  one = otrng_secure_alloc(100);
+  otrng_secure_pool_get_stats(after);
+  g_assert_cmpint(after->slabs, ==, slabs);
+  otrng_secure_free(one, 100);
+
+  uint8_t *big = otrng_secure_alloc(OTRNG_SECURE_POOL_MAX_SLOT * 2);
+  otrng_assert(big);
+  otrng_secure_pool_get_stats(after);
+  g_assert_cmpint(after->direct_allocations, ==,
+                  before->direct_allocations + 1);
+  otrng_secure_free(big, OTRNG_SECURE_POOL_MAX_SLOT * 2);
+
+  otrng_secure_pool_get_stats(after);
+  g_assert_cmpint(after->slots_in_use, ==, before->slots_in_use);
+  g_assert_cmpint(after->direct_allocations, ==, before->direct_allocations);
+}
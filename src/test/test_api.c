@@ -805,6 +805,155 @@ void test_api_conversation_v3(void) {
   otrng_client_state_free_all(alice_client_state, bob_client_state);
 }
 
+void test_api_v3_caches_account_and_protocol(void) {
+  otrng_client_state_s *client_state = otrng_client_state_new(ALICE_IDENTITY);
+  set_up_client_state(client_state, ALICE_IDENTITY, 1);
+
+  otrng_v3_conn_s *conn = otrng_v3_conn_new(client_state, "bob");
+  g_assert_cmpstr(conn->account_name, ==, ALICE_IDENTITY);
+  g_assert_cmpstr(conn->protocol_name, ==, "otr");
+
+  // The cached names are kept until they are forgotten
+  client_state->client_id = BOB_IDENTITY;
+  char *to_send = NULL;
+  otrng_v3_close(&to_send, conn);
+  otrng_assert(!to_send);
+  g_assert_cmpstr(conn->account_name, ==, ALICE_IDENTITY);
+
+  otrng_v3_conn_forget_account_and_protocol(conn);
+  otrng_assert(!conn->account_name);
+  otrng_assert(!conn->protocol_name);
+
+  otrng_v3_close(&to_send, conn);
+  otrng_assert(!to_send);
+  g_assert_cmpstr(conn->account_name, ==, BOB_IDENTITY);
+
+  otrng_v3_conn_free(conn);
+  otrl_userstate_free(client_state->user_state);
+  otrng_client_state_free(client_state);
+}
+
+void test_api_v3_queues_injected_messages(void) {
+  otrng_client_state_s *client_state = otrng_client_state_new(ALICE_IDENTITY);
+  set_up_client_state(client_state, ALICE_IDENTITY, 1);
+
+  otrng_v3_conn_s *conn = otrng_v3_conn_new(client_state, "bob");
+
+  // libotr injects more than once during a single call
+  otrng_v3_store_injected_message("one", conn);
+  otrng_v3_store_injected_message("two", conn);
+  otrng_v3_store_injected_message("three", conn);
+
+  char *to_send = otrng_v3_take_injected_message(conn);
+  g_assert_cmpstr(to_send, ==, "three");
+  free(to_send);
+
+  // None of them was lost
+  otrng_message_to_send_s batch[1];
+  otrng_assert_is_success(otrng_v3_flush_injected_messages(batch, conn));
+  g_assert_cmpint(batch->total, ==, 2);
+  g_assert_cmpstr(batch->pieces[0], ==, "one");
+  g_assert_cmpstr(batch->pieces[1], ==, "two");
+  free(batch->pieces[0]);
+  free(batch->pieces[1]);
+  free(batch->pieces);
+
+  otrng_assert_is_success(otrng_v3_flush_injected_messages(batch, conn));
+  g_assert_cmpint(batch->total, ==, 0);
+  otrng_assert(!batch->pieces);
+  otrng_assert(!otrng_v3_take_injected_message(conn));
+
+  // The next call does not hand out what was left from the previous one
+  otrng_v3_store_injected_message("stale", conn);
+  otrng_v3_close(&to_send, conn);
+  otrng_assert(!to_send);
+  g_assert_cmpint(conn->num_injected_messages, ==, 0);
+  otrng_assert(!conn->injected_messages);
+
+  // Only the last ones are kept when nobody flushes them
+  for (int i = 0; i <= OTRNG_V3_MAX_INJECTED_MESSAGES; i++) {
+    otrng_v3_store_injected_message(i ? "newer" : "oldest", conn);
+  }
+
+  g_assert_cmpint(conn->num_injected_messages, ==,
+                  OTRNG_V3_MAX_INJECTED_MESSAGES);
+  to_send = otrng_v3_retrieve_injected_message(conn);
+  g_assert_cmpstr(to_send, ==, "newer");
+  free(to_send);
+
+  otrng_v3_conn_free(conn);
+  otrl_userstate_free(client_state->user_state);
+  otrng_client_state_free(client_state);
+}
+
+void test_api_v3_tlvs_are_shared_when_sending(void) {
+  uint8_t usedata[4] = {0x00, 0x00, 0x00, 0x01};
+  tlv_list_s *tlvs =
+      otrng_tlv_list_one(otrng_tlv_new(OTRNG_TLV_SYM_KEY, 4, usedata));
+  tlvs = otrng_append_tlv(tlvs, otrng_tlv_disconnected_new());
+
+  OtrlTLV *tlvs_v3 = NULL;
+  otrng_assert_is_success(v3_tlvs_borrow(&tlvs_v3, tlvs));
+
+  otrng_assert(tlvs_v3);
+  g_assert_cmpint(tlvs_v3->type, ==, OTRL_TLV_SYMKEY);
+  g_assert_cmpint(tlvs_v3->len, ==, 4);
+  otrng_assert(tlvs_v3->data == tlvs->data->data);
+
+  otrng_assert(tlvs_v3->next);
+  g_assert_cmpint(tlvs_v3->next->type, ==, OTRL_TLV_DISCONNECTED);
+  g_assert_cmpint(tlvs_v3->next->len, ==, 0);
+  otrng_assert(!tlvs_v3->next->next);
+
+  v3_tlvs_free_borrowed(tlvs_v3);
+  otrng_tlv_list_free(tlvs);
+}
+
+void test_api_v3_tlvs_are_moved_when_receiving(void) {
+  const unsigned char usedata[4] = {0x00, 0x00, 0x00, 0x01};
+  OtrlTLV *tlvs_v3 = otrl_tlv_new(OTRL_TLV_SYMKEY, 4, usedata);
+  // It has no question, so it is malformed
+  tlvs_v3->next = otrl_tlv_new(OTRL_TLV_SMP1Q, 0, NULL);
+  tlvs_v3->next->next = otrl_tlv_new(OTRL_TLV_SMP_ABORT, 0, NULL);
+  const unsigned char smp1q[5] = {'Q', '?', 0x00, 0xAA, 0xBB};
+  tlvs_v3->next->next->next = otrl_tlv_new(OTRL_TLV_SMP1Q, 5, smp1q);
+  const unsigned char smp1[2] = {0xAA, 0xBB};
+  tlvs_v3->next->next->next->next = otrl_tlv_new(OTRL_TLV_SMP1, 2, smp1);
+  unsigned char *payload = tlvs_v3->data;
+
+  tlv_list_s *tlvs = NULL;
+  otrng_assert_is_success(v3_tlvs_take(&tlvs, tlvs_v3));
+
+  otrng_assert(tlvs);
+  g_assert_cmpint(tlvs->data->type, ==, OTRNG_TLV_SYM_KEY);
+  g_assert_cmpint(tlvs->data->len, ==, 4);
+  otrng_assert(tlvs->data->data == payload);
+  otrng_assert(!tlvs_v3->data);
+
+  otrng_assert(tlvs->next);
+  g_assert_cmpint(tlvs->next->data->type, ==, OTRNG_TLV_SMP_ABORT);
+
+  // The question comes first, as in a v4 SMP message 1
+  const tlv_list_s *smp = tlvs->next->next;
+  otrng_assert(smp);
+  g_assert_cmpint(smp->data->type, ==, OTRNG_TLV_SMP_MSG_1);
+  const uint8_t with_question[8] = {0x00, 0x00, 0x00, 0x02, 'Q', '?', 0xAA,
+                                    0xBB};
+  g_assert_cmpint(smp->data->len, ==, sizeof(with_question));
+  otrng_assert_cmpmem(with_question, smp->data->data, sizeof(with_question));
+
+  otrng_assert(smp->next);
+  g_assert_cmpint(smp->next->data->type, ==, OTRNG_TLV_SMP_MSG_1);
+  const uint8_t without_question[6] = {0x00, 0x00, 0x00, 0x00, 0xAA, 0xBB};
+  g_assert_cmpint(smp->next->data->len, ==, sizeof(without_question));
+  otrng_assert_cmpmem(without_question, smp->next->data->data,
+                      sizeof(without_question));
+  otrng_assert(!smp->next->next);
+
+  otrl_tlv_free(tlvs_v3);
+  otrng_tlv_list_free(tlvs);
+}
+
 void test_api_multiple_clients(void) {
   otrng_bool send_response = otrng_true;
   otrng_result result;
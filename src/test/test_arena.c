@@ -0,0 +1,108 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../arena.h"
+
+void test_otrng_arena_alloc() {
+  otrng_arena_p arena;
+  otrng_arena_init(arena, 64);
+
+  uint8_t *one = otrng_arena_alloc(arena, 3);
+  uint8_t *two = otrng_arena_alloc(arena, 5);
+  otrng_assert(one);
+  otrng_assert(two);
+  otrng_assert(one != two);
+  g_assert_cmpint((uintptr_t)one % OTRNG_ARENA_ALIGNMENT, ==, 0);
+  g_assert_cmpint((uintptr_t)two % OTRNG_ARENA_ALIGNMENT, ==, 0);
+
+  g_assert_cmpint(arena->allocations, ==, 2);
+  g_assert_cmpint(arena->heap_allocations, ==, 1);
+
+  /* Bigger than a block */
+  uint8_t *big = otrng_arena_calloc(arena, 200);
+  otrng_assert(big);
+  g_assert_cmpint(big[199], ==, 0);
+  g_assert_cmpint(arena->heap_allocations, ==, 2);
+
+  /* Not NULL, which would be an allocation failure */
+  otrng_assert(otrng_arena_alloc(arena, 0));
+
+  otrng_arena_destroy(arena);
+}
+
+void test_otrng_arena_reset() {
+  otrng_arena_p arena;
+  otrng_arena_init(arena, 64);
+
+  uint8_t *secret = otrng_arena_alloc(arena, 8);
+  memset(secret, 0xAA, 8);
+  otrng_assert(otrng_arena_alloc(arena, 200));
+
+  otrng_arena_reset(arena);
+
+  /* Only the regular block survives, and it has been wiped */
+  otrng_assert(arena->blocks);
+  otrng_assert(!arena->blocks->next);
+  g_assert_cmpint(arena->blocks->used, ==, 0);
+  uint8_t zero[8] = {0};
+  otrng_assert_cmpmem(zero, secret, 8);
+
+  /* Steady state: no more heap allocations per message */
+  for (int i = 0; i < 10; i++) {
+    otrng_assert(otrng_arena_alloc(arena, 32));
+    otrng_arena_reset(arena);
+  }
+  g_assert_cmpint(arena->heap_allocations, ==, 2);
+  g_assert_cmpint(arena->resets, ==, 11);
+
+  otrng_arena_stats_s stats[1];
+  otrng_arena_get_stats(stats, arena);
+  g_assert_cmpint(stats->allocations, ==, 12);
+  g_assert_cmpint(stats->heap_allocations, ==, 2);
+  g_assert_cmpint(stats->resets, ==, 11);
+  g_assert_cmpint(stats->bytes, ==, sizeof(arena_block_s) + 64);
+
+  otrng_arena_destroy(arena);
+  otrng_assert(!arena->blocks);
+}
+
+void test_otrng_arena_nested_calls() {
+  otrng_arena_p arena;
+  otrng_arena_init(arena, 0);
+  g_assert_cmpint(arena->block_size, ==, OTRNG_ARENA_BLOCK_SIZE);
+
+  otrng_arena_enter(arena);
+  uint8_t *outer = otrng_arena_alloc(arena, 4);
+  memset(outer, 0x01, 4);
+
+  otrng_arena_enter(arena);
+  otrng_assert(otrng_arena_alloc(arena, 4));
+  otrng_arena_leave(arena);
+
+  /* Leaving a nested call must not reset the arena */
+  g_assert_cmpint(arena->resets, ==, 0);
+  g_assert_cmpint(outer[3], ==, 0x01);
+
+  otrng_arena_leave(arena);
+  g_assert_cmpint(arena->resets, ==, 1);
+  g_assert_cmpint(arena->depth, ==, 0);
+
+  otrng_arena_destroy(arena);
+}
@@ -203,6 +203,6 @@ void test_rsig_compatible_with_prekey_server() {
       otrng_deserialize_ring_sig(proof, rsig, sizeof(rsig), NULL));
 
   otrng_assert(otrng_rsig_verify_with_usage_and_domain(
-      0x11, "OTR-Prekey-Server", proof, p1->pub, p2->pub, p3->pub,
+      0x11, OTRNG_SHAKE_DOMAIN_PREKEY_SERVER, proof, p1->pub, p2->pub, p3->pub,
       (const uint8_t *)msg, 2));
 }
@@ -0,0 +1,134 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../base64.h"
+#include "../random.h"
+
+#define BASE64_FUZZ_ROUNDS 500
+
+void test_base64_encode_matches_libotr() {
+  uint8_t src[300];
+  char expected[OTRNG_BASE64_ENCODE_LEN(sizeof(src))];
+  char got[OTRNG_BASE64_ENCODE_LEN(sizeof(src))];
+
+  for (int i = 0; i < BASE64_FUZZ_ROUNDS; i++) {
+    size_t len = g_random_int_range(0, sizeof(src) + 1);
+    random_bytes(src, len);
+
+    size_t expected_len = otrl_base64_encode(expected, src, len);
+    size_t got_len = otrng_base64_encode_into(got, src, len);
+
+    g_assert_cmpint(got_len, ==, expected_len);
+    otrng_assert_cmpmem(expected, got, got_len);
+  }
+}
+
+void test_base64_decode_matches_libotr() {
+  uint8_t src[200];
+  char encoded[OTRNG_BASE64_ENCODE_LEN(sizeof(src)) + 16];
+  uint8_t expected[OTRNG_BASE64_DECODE_LEN(sizeof(encoded))];
+  uint8_t got[OTRNG_BASE64_DECODE_LEN(sizeof(encoded))];
+  const char noise[] = " \r\n\t.-=!~\x80\xff";
+
+  for (int i = 0; i < BASE64_FUZZ_ROUNDS; i++) {
+    size_t len = g_random_int_range(0, sizeof(src) + 1);
+    random_bytes(src, len);
+    size_t encoded_len = otrl_base64_encode(encoded, src, len);
+
+    /* Characters outside the alphabet and early terminators */
+    int insertions = g_random_int_range(0, 5);
+    for (int j = 0; j < insertions; j++) {
+      size_t at = g_random_int_range(0, encoded_len + 1);
+      memmove(encoded + at + 1, encoded + at, encoded_len - at);
+      encoded[at] = noise[g_random_int_range(0, sizeof(noise) - 1)];
+      encoded_len++;
+    }
+
+    size_t expected_len = otrl_base64_decode(expected, encoded, encoded_len);
+    size_t got_len = otrng_base64_decode_into(got, encoded, encoded_len);
+
+    g_assert_cmpint(got_len, ==, expected_len);
+    otrng_assert_cmpmem(expected, got, got_len);
+  }
+}
+
+void test_base64_streaming() {
+  uint8_t src[1000];
+  char encoded[OTRNG_BASE64_ENCODE_LEN(sizeof(src))];
+  char streamed[OTRNG_BASE64_ENCODE_LEN(sizeof(src) + 2)];
+  uint8_t decoded[OTRNG_BASE64_DECODE_LEN(sizeof(encoded) + 3)];
+
+  random_bytes(src, sizeof(src));
+  size_t encoded_len = otrng_base64_encode_into(encoded, src, sizeof(src));
+
+  otrng_base64_encoder_p encoder;
+  otrng_base64_encoder_init(encoder);
+
+  size_t written = 0;
+  for (size_t at = 0, chunk = 1; at < sizeof(src); chunk = chunk % 7 + 1) {
+    if (chunk > sizeof(src) - at) {
+      chunk = sizeof(src) - at;
+    }
+
+    written += otrng_base64_encoder_update(encoder, streamed + written,
+                                           src + at, chunk);
+    at += chunk;
+  }
+  written += otrng_base64_encoder_final(encoder, streamed + written);
+
+  g_assert_cmpint(written, ==, encoded_len);
+  otrng_assert_cmpmem(encoded, streamed, encoded_len);
+
+  otrng_base64_decoder_p decoder;
+  otrng_base64_decoder_init(decoder);
+
+  written = 0;
+  for (size_t at = 0, chunk = 1; at < encoded_len; chunk = chunk % 9 + 1) {
+    if (chunk > encoded_len - at) {
+      chunk = encoded_len - at;
+    }
+
+    written += otrng_base64_decoder_update(decoder, decoded + written,
+                                           encoded + at, chunk);
+    at += chunk;
+  }
+  written += otrng_base64_decoder_final(decoder, decoded + written);
+
+  g_assert_cmpint(written, ==, sizeof(src));
+  otrng_assert_cmpmem(src, decoded, sizeof(src));
+}
+
+void test_base64_otr_encoding() {
+  const uint8_t msg[] = {0x00, 0x04, 0x03, 0xff, 0x10};
+  char *expected = otrl_base64_otr_encode(msg, sizeof(msg));
+  char *encoded = otrng_base64_otr_encode(msg, sizeof(msg));
+
+  g_assert_cmpstr(encoded, ==, expected);
+  free(expected);
+
+  /* The payload sits between "?OTR:" and "." */
+  uint8_t decoded[sizeof(msg)];
+  size_t decoded_len =
+      otrng_base64_decode_into(decoded, encoded + 5, strlen(encoded) - 6);
+  g_assert_cmpint(decoded_len, ==, sizeof(msg));
+  otrng_assert_cmpmem(msg, decoded, sizeof(msg));
+
+  free(encoded);
+}
@@ -1166,3 +1166,77 @@ void test_client_sends_fragmented_message(void) {
   otrng_client_state_free_all(alice_client_state, bob_client_state);
   otrng_client_free_all(alice, bob);
 }
+
+void test_client_reuses_result(void) {
+  otrng_client_state_s *alice_client_state =
+      otrng_client_state_new(ALICE_IDENTITY);
+  otrng_client_state_s *bob_client_state = otrng_client_state_new(BOB_IDENTITY);
+
+  otrng_client_s *alice = set_up_client(alice_client_state, ALICE_IDENTITY, 1);
+  otrng_client_s *bob = set_up_client(bob_client_state, BOB_IDENTITY, 2);
+
+  otrng_client_result_p from_alice, from_bob;
+  otrng_client_result_init(from_alice);
+  otrng_client_result_init(from_bob);
+
+  char *query_msg_to_bob =
+      otrng_client_query_message(BOB_IDENTITY, "Hi bob", alice);
+  otrng_assert(query_msg_to_bob);
+
+  /* Bob receives query message, sends identity msg */
+  otrng_assert_is_success(otrng_client_receive_into(
+      from_bob, query_msg_to_bob, ALICE_IDENTITY, bob));
+  free(query_msg_to_bob);
+  otrng_assert(from_bob->to_send);
+
+  /* Alice receives identity message, sends Auth-R message */
+  otrng_assert_is_success(otrng_client_receive_into(
+      from_alice, from_bob->to_send, BOB_IDENTITY, alice));
+  otrng_assert(from_alice->to_send);
+
+  /* Bob receives Auth-R message, sends Auth-I message */
+  otrng_assert_is_success(otrng_client_receive_into(
+      from_bob, from_alice->to_send, ALICE_IDENTITY, bob));
+  otrng_assert(from_bob->to_send);
+
+  /* Alice receives Auth-I message, sends the initial data message */
+  otrng_assert_is_success(otrng_client_receive_into(
+      from_alice, from_bob->to_send, BOB_IDENTITY, alice));
+  otrng_assert(from_alice->to_send);
+
+  /* Bob receives the initial data message */
+  otrng_assert_is_success(otrng_client_receive_into(
+      from_bob, from_alice->to_send, ALICE_IDENTITY, bob));
+  otrng_assert(!from_bob->to_send);
+  otrng_assert(!from_bob->to_display);
+  otrng_assert(!from_bob->should_ignore);
+
+  otrng_assert_is_success(
+      otrng_client_send_into(from_alice, "hello bob", BOB_IDENTITY, alice));
+  otrng_assert(from_alice->to_send);
+  otrng_assert_is_success(otrng_client_receive_into(
+      from_bob, from_alice->to_send, ALICE_IDENTITY, bob));
+  g_assert_cmpstr(from_bob->to_display, ==, "hello bob");
+
+  /* A message that fits reuses the buffers */
+  const char *to_send_buffer = from_alice->to_send_buffer;
+  const char *to_display_buffer = from_bob->to_display_buffer;
+
+  otrng_assert_is_success(
+      otrng_client_send_into(from_alice, "hi bob", BOB_IDENTITY, alice));
+  otrng_assert(from_alice->to_send == to_send_buffer);
+  otrng_assert_is_success(otrng_client_receive_into(
+      from_bob, from_alice->to_send, ALICE_IDENTITY, bob));
+  g_assert_cmpstr(from_bob->to_display, ==, "hi bob");
+  otrng_assert(from_bob->to_display == to_display_buffer);
+
+  otrng_client_result_destroy(from_alice);
+  otrng_client_result_destroy(from_bob);
+
+  otrl_userstate_free(alice_client_state->user_state);
+  otrl_userstate_free(bob_client_state->user_state);
+  otrng_client_state_free(alice_client_state);
+  otrng_client_state_free(bob_client_state);
+  otrng_client_free(alice);
+  otrng_client_free(bob);
+}
@@ -146,6 +146,48 @@ void test_otrng_client_profile_deserializes() {
   otrng_client_profile_destroy(deserialized);
 }
 
+void test_otrng_client_profile_deserializes_no_copy() {
+  otrng_keypair_p keypair;
+  uint8_t sym[ED448_PRIVATE_BYTES] = {1};
+  otrng_keypair_generate(keypair, sym);
+
+  client_profile_s *profile = client_profile_new("4");
+  otrng_assert(profile != NULL);
+
+  profile->sender_instance_tag = 4;
+  profile->transitional_signature = malloc(OTRv3_DSA_SIG_BYTES);
+  memset(profile->transitional_signature, 0xA, OTRv3_DSA_SIG_BYTES);
+  client_profile_sign(profile, keypair);
+
+  size_t written = 0;
+  uint8_t *serialized = NULL;
+  otrng_assert_is_success(
+      otrng_client_profile_asprintf(&serialized, &written, profile));
+
+  client_profile_p borrowed;
+  otrng_assert_is_success(otrng_client_profile_deserialize_no_copy(
+      borrowed, serialized, written, NULL));
+  otrng_assert_client_profile_eq(borrowed, profile);
+  otrng_assert(borrowed->borrowed);
+  otrng_assert(borrowed->transitional_signature > serialized);
+  otrng_assert(borrowed->transitional_signature < serialized + written);
+  otrng_assert_cmpmem(borrowed->transitional_signature,
+                      profile->transitional_signature, OTRv3_DSA_SIG_BYTES);
+
+  client_profile_p copy;
+  otrng_client_profile_copy(copy, borrowed);
+  otrng_assert(!copy->borrowed);
+  otrng_client_profile_destroy(borrowed);
+  free(serialized);
+
+  otrng_assert_client_profile_eq(copy, profile);
+  otrng_assert_cmpmem(copy->transitional_signature,
+                      profile->transitional_signature, OTRv3_DSA_SIG_BYTES);
+
+  otrng_client_profile_free(profile);
+  otrng_client_profile_destroy(copy);
+}
+
 void test_client_profile_signs_and_verify() {
   otrng_keypair_p keypair;
   uint8_t sym[ED448_PRIVATE_BYTES] = {1};
@@ -410,6 +410,34 @@ void test_build_interactive_rsign_tag() {
 
   free(dst);
 
+  // The same tag, from values serialized ahead
+  ephemeral_pub_ser_s ser_ephemeral;
+  otrng_serialize_ec_point(ser_ephemeral.ecdh, responder_ecdh);
+  otrng_assert_is_success(otrng_serialize_dh_public_key(
+      ser_ephemeral.dh, sizeof(ser_ephemeral.dh), &ser_ephemeral.dh_len,
+      responder_dh));
+
+  otrng_serialized_profile_s ser_profile;
+  otrng_serialized_profile_init(&ser_profile);
+  ser_profile.data = responder_profile_s;
+  ser_profile.len = sizeof(responder_profile_s);
+
+  const otrng_dake_participant_data_s prepared_responder = {
+      .client_profile = NULL,
+      .ecdh = *(responder_ecdh),
+      .dh = NULL,
+      .ser_client_profile = &ser_profile,
+      .ser_ephemeral = &ser_ephemeral,
+  };
+
+  otrng_assert_is_success(build_interactive_rsign_tag(
+      &dst, &dstlen, 'r', &initiator, &prepared_responder, phi, sizeof(phi)));
+
+  otrng_assert(dstlen == 1083);
+  otrng_assert_cmpmem(dst, expected_t2, dstlen);
+
+  free(dst);
+
   otrng_dh_mpi_release(initiator_dh);
   otrng_dh_mpi_release(responder_dh);
   otrng_client_profile_destroy(initiator_profile);
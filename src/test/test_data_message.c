@@ -70,9 +70,7 @@ static data_message_s *set_up_data_msg() {
       0xa7, 0xf7, 0xd9, 0x90, 0xc8, 0xcf, 0x53, 0xf2, 0xb7, 0x8a, 0xa8, 0x54,
       0x8a, 0xac, 0xb1, 0xe0, 0x1,  0x8d, 0xc7, 0x3f, 0xac, 0x3,  0x73};
 
-  gcry_error_t err =
-      gcry_mpi_scan(&data_msg->dh, GCRYMPI_FMT_USG, dh_data, 383, NULL);
-  otrng_assert(!err);
+  memcpy(data_msg->dh + 1, dh_data, 383);
 
   memset(data_msg->nonce, 0xF, sizeof(data_msg->nonce));
   data_msg->enc_msg = malloc(3);
@@ -118,12 +116,10 @@ void test_data_message_serializes() {
 
   cursor += ser_len;
 
-  uint8_t serialized_b[DH3072_MOD_LEN_BYTES] = {0};
-  size_t mpi_len = 0;
-  otrng_assert_is_success(otrng_dh_mpi_serialize(
-      serialized_b, DH3072_MOD_LEN_BYTES, &mpi_len, data_msg->dh));
+  size_t mpi_len = otrng_dh_fixed_len(data_msg->dh);
+  g_assert_cmpint(mpi_len, ==, 383);
   // Skip first 4 because they are the size (mpi_len)
-  otrng_assert_cmpmem(cursor + 4, serialized_b, mpi_len);
+  otrng_assert_cmpmem(cursor + 4, data_msg->dh + 1, mpi_len);
 
   cursor += 4 + mpi_len;
 
@@ -143,8 +139,7 @@ void test_data_message_serializes_absent_dh() {
   data_message_s *data_msg = set_up_data_msg();
 
   // Serialize with an empty DH
-  otrng_dh_mpi_release(data_msg->dh);
-  data_msg->dh = NULL;
+  memset(data_msg->dh, 0, sizeof(data_msg->dh));
 
   uint8_t *serialized = NULL;
   size_t serlen = 0;
@@ -201,7 +196,8 @@ void test_otrng_data_message_deserializes() {
   otrng_assert(data_msg->ratchet_id == deserialized->ratchet_id);
   otrng_assert(data_msg->message_id == deserialized->message_id);
   otrng_assert_cmpmem(data_msg->ecdh, deserialized->ecdh, ED448_POINT_BYTES);
-  otrng_assert(dh_mpi_cmp(data_msg->dh, deserialized->dh) == 0);
+  otrng_assert_cmpmem(data_msg->dh, deserialized->dh,
+                      sizeof(dh_public_key_fixed_p));
   otrng_assert_cmpmem(data_msg->nonce, deserialized->nonce,
                       DATA_MSG_NONCE_BYTES);
   otrng_assert_cmpmem(data_msg->enc_msg, deserialized->enc_msg,
@@ -214,6 +210,36 @@ void test_otrng_data_message_deserializes() {
   free(serialized);
 }
 
+void test_otrng_data_message_deserializes_no_copy() {
+  data_message_s *data_msg = set_up_data_msg();
+
+  uint8_t *serialized = NULL;
+  size_t serlen = 0;
+  otrng_assert_is_success(
+      otrng_data_message_body_asprintf(&serialized, &serlen, data_msg));
+
+  serialized = realloc(serialized, serlen + DATA_MSG_MAC_BYTES);
+  memset(serialized + serlen, 0x1, DATA_MSG_MAC_BYTES);
+
+  data_message_s *deserialized = otrng_data_message_new();
+  otrng_assert_is_success(otrng_data_message_deserialize_no_copy(
+      deserialized, serialized, serlen + DATA_MSG_MAC_BYTES, NULL));
+
+  otrng_assert(deserialized->enc_msg_borrowed);
+  otrng_assert(deserialized->enc_msg > serialized);
+  otrng_assert(deserialized->enc_msg < serialized + serlen);
+  otrng_assert(data_msg->enc_msg_len == deserialized->enc_msg_len);
+  otrng_assert_cmpmem(data_msg->enc_msg, deserialized->enc_msg,
+                      data_msg->enc_msg_len);
+  otrng_assert_cmpmem(data_msg->nonce, deserialized->nonce,
+                      DATA_MSG_NONCE_BYTES);
+
+  // It does not free the buffer it borrows from
+  otrng_data_message_free(deserialized);
+  otrng_data_message_free(data_msg);
+  free(serialized);
+}
+
 void test_data_message_valid() {
   data_message_s *data_msg = set_up_data_msg();
 
@@ -236,12 +262,12 @@ void test_data_message_valid() {
   otrng_assert(otrng_valid_data_message(mac_key, data_msg) == otrng_true);
 
   // Overwrite DH with an invalid value
-  gcry_mpi_set_ui(data_msg->dh, 1);
+  memset(data_msg->dh, 0, sizeof(data_msg->dh));
+  data_msg->dh[DH3072_MOD_LEN_BYTES - 1] = 1;
   otrng_assert(otrng_valid_data_message(mac_key, data_msg) == otrng_false);
 
   // A data message without a DH key is also valid.
-  otrng_dh_mpi_release(data_msg->dh);
-  data_msg->dh = NULL;
+  memset(data_msg->dh, 0, sizeof(data_msg->dh));
 
   otrng_assert_is_success(
       otrng_data_message_body_asprintf(&body, &bodylen, data_msg));
@@ -176,3 +176,39 @@ void dh_test_keypair_destroy() {
   otrng_assert(!alice->priv);
   otrng_assert(!alice->pub);
 }
+
+void dh_test_fixed_public_key() {
+  dh_keypair_p alice;
+  otrng_dh_keypair_generate(alice);
+
+  dh_public_key_fixed_p fixed;
+  otrng_assert_is_success(otrng_dh_mpi_serialize_fixed(fixed, alice->pub));
+  otrng_assert(otrng_dh_fixed_valid(fixed));
+
+  uint8_t buf[DH3072_MOD_LEN_BYTES] = {0};
+  size_t mpi_len = 0;
+  otrng_assert_is_success(
+      otrng_dh_mpi_serialize(buf, DH3072_MOD_LEN_BYTES, &mpi_len, alice->pub));
+  g_assert_cmpint(otrng_dh_fixed_len(fixed), ==, mpi_len);
+  otrng_assert_cmpmem(fixed + DH3072_MOD_LEN_BYTES - mpi_len, buf, mpi_len);
+
+  dh_mpi_p parsed = NULL;
+  otrng_assert_is_success(otrng_dh_mpi_deserialize_fixed(&parsed, fixed));
+  otrng_assert_dh_public_key_eq(parsed, alice->pub);
+  otrng_dh_mpi_release(parsed);
+
+  // An absent key
+  otrng_assert_is_success(otrng_dh_mpi_serialize_fixed(fixed, NULL));
+  g_assert_cmpint(otrng_dh_fixed_len(fixed), ==, 0);
+  otrng_assert(!otrng_dh_fixed_valid(fixed));
+  otrng_assert_is_success(otrng_dh_mpi_deserialize_fixed(&parsed, fixed));
+  otrng_assert(!parsed);
+
+  // Out of range values
+  fixed[DH3072_MOD_LEN_BYTES - 1] = 1;
+  otrng_assert(!otrng_dh_fixed_valid(fixed));
+  memset(fixed, 0xff, DH3072_MOD_LEN_BYTES);
+  otrng_assert(!otrng_dh_fixed_valid(fixed));
+
+  otrng_dh_keypair_destroy(alice);
+}
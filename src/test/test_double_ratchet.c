@@ -473,7 +473,8 @@ void test_double_ratchet_corrupted_ratchet(void) {
   corrupted_data_msg->enc_msg = (uint8_t *)otrng_strdup("hduejo");
   corrupted_data_msg->enc_msg_len = 7;
   otrng_ec_point_copy(corrupted_data_msg->ecdh, bob->keys->our_ecdh->pub);
-  corrupted_data_msg->dh = otrng_dh_mpi_copy(bob->keys->our_dh->pub);
+  otrng_dh_mpi_serialize_fixed(corrupted_data_msg->dh,
+                               bob->keys->our_dh->pub);
   memset(corrupted_data_msg->nonce, 0, DATA_MSG_NONCE_BYTES);
   msg_mac_key_p mac_key;
   memset(mac_key, 0, sizeof mac_key);
@@ -67,6 +67,53 @@ void test_create_fragments_smaller_than_max_size(void) {
   otrng_message_free(frag_message);
 }
 
+void test_create_fragments_into_buffer(void) {
+  const char *message = "one two tree";
+  otrng_fragment_buffer_p buffer;
+  otrng_fragment_buffer_init(buffer);
+
+  int total = 0;
+  otrng_assert_is_success(
+      otrng_fragment_message_into(buffer, &total, 48, 1, 2, message));
+  g_assert_cmpint(total, ==, 4);
+
+  otrng_message_to_send_s *frag_message = otrng_message_new();
+  otrng_assert_is_success(
+      otrng_fragment_message(48, frag_message, 1, 2, message));
+
+  /* They only differ by their identifier */
+  for (int i = 0; i < total; i++) {
+    g_assert_cmpint(buffer->spans[i].len, ==, strlen(frag_message->pieces[i]));
+    otrng_assert_cmpmem(buffer->spans[i].data, frag_message->pieces[i], 5);
+    otrng_assert_cmpmem(buffer->spans[i].data + 13,
+                        frag_message->pieces[i] + 13,
+                        buffer->spans[i].len - 13);
+  }
+
+  /* The spans are contiguous */
+  otrng_assert(buffer->spans[1].data ==
+               buffer->spans[0].data + buffer->spans[0].len);
+
+  /* A shorter message reuses the buffer */
+  const char *data = buffer->data;
+  otrng_assert_is_success(
+      otrng_fragment_message_into(buffer, &total, 48, 1, 2, "one"));
+  g_assert_cmpint(total, ==, 1);
+  otrng_assert(buffer->spans[0].data == data);
+  g_assert_cmpint(buffer->spans[0].len, ==, FRAGMENT_HEADER_LEN + 3);
+  otrng_assert_cmpmem(buffer->spans[0].data + 14,
+                      "00000001|00000002,00001,00001,one,",
+                      buffer->spans[0].len - 14);
+
+  /* There is nothing to fragment */
+  otrng_assert_is_success(
+      otrng_fragment_message_into(buffer, &total, 48, 1, 2, NULL));
+  g_assert_cmpint(total, ==, 0);
+
+  otrng_message_free(frag_message);
+  otrng_fragment_buffer_destroy(buffer);
+}
+
 void test_defragment_valid_message(void) {
   const string_p fragments[2];
   fragments[0] = "?OTR|00000000|00000001|00000002,00001,00002,one ,";
@@ -283,6 +330,105 @@ void test_defragment_two_messages(void) {
   otrng_list_free_nodes(list);
 }
 
+void test_defragment_and_decode_out_of_order(void) {
+  uint8_t payload[200];
+  for (int i = 0; i < 200; i++) {
+    payload[i] = i;
+  }
+
+  char *msg = otrng_base64_otr_encode(payload, sizeof(payload));
+  otrng_message_to_send_s *fragments = otrng_message_new();
+  otrng_assert_is_success(otrng_fragment_message(80, fragments, 1, 2, msg));
+  free(msg);
+  otrng_assert(fragments->total > 2);
+
+  list_element_s *list = NULL;
+  uint8_t *decoded = NULL;
+  size_t decoded_len = 0;
+  otrng_bool encoded = otrng_false;
+
+  /* The last one first, so where it goes is not known yet */
+  for (int i = fragments->total - 1; i > 0; i--) {
+    otrng_assert_is_success(otrng_unfragment_and_decode_message(
+        &decoded, &decoded_len, &encoded, &list, fragments->pieces[i], 2));
+    otrng_assert(!decoded);
+    g_assert_cmpint(otrng_list_len(list), ==, 1);
+  }
+
+  otrng_assert_is_success(otrng_unfragment_and_decode_message(
+      &decoded, &decoded_len, &encoded, &list, fragments->pieces[0], 2));
+  otrng_assert(encoded);
+  g_assert_cmpint(decoded_len, ==, sizeof(payload));
+  otrng_assert_cmpmem(decoded, payload, sizeof(payload));
+  otrng_assert(list == NULL);
+
+  free(decoded);
+  otrng_message_free(fragments);
+}
+
+void test_defragment_and_decode_uneven_fragments(void) {
+  const string_p fragments[3];
+  fragments[0] = "?OTR|00000000|00000001|00000002,00001,00003,one ,";
+  fragments[1] = "?OTR|00000000|00000001|00000002,00002,00003,fragment ,";
+  fragments[2] = "?OTR|00000000|00000001|00000002,00003,00003,more,";
+
+  list_element_s *list = NULL;
+  uint8_t *unfrag = NULL;
+  size_t unfrag_len = 0;
+  otrng_bool encoded = otrng_false;
+
+  /* The longer one waits for the first */
+  otrng_assert_is_success(otrng_unfragment_and_decode_message(
+      &unfrag, &unfrag_len, &encoded, &list, fragments[1], 2));
+  otrng_assert_is_success(otrng_unfragment_and_decode_message(
+      &unfrag, &unfrag_len, &encoded, &list, fragments[0], 2));
+  otrng_assert(!unfrag);
+
+  otrng_assert_is_success(otrng_unfragment_and_decode_message(
+      &unfrag, &unfrag_len, &encoded, &list, fragments[2], 2));
+  otrng_assert(!encoded);
+  g_assert_cmpstr((char *)unfrag, ==, "one fragment more");
+  g_assert_cmpint(unfrag_len, ==, strlen("one fragment more"));
+  otrng_assert(list == NULL);
+
+  free(unfrag);
+}
+
+void test_defragment_and_decode_too_long_fails(void) {
+  size_t len = OTRNG_FRAGMENT_MAX_MESSAGE_BYTES / 2 + 1;
+  char *piece = malloc(len + 1);
+  memset(piece, 'a', len);
+  piece[len] = '\0';
+
+  /* Two fragments this long are over the maximum */
+  char *first =
+      g_strdup_printf("?OTR|00000000|00000001|00000002,00001,00003,%s,", piece);
+  char *second =
+      g_strdup_printf("?OTR|00000000|00000001|00000002,00002,00003,%s,", piece);
+  free(piece);
+
+  list_element_s *list = NULL;
+  uint8_t *unfrag = NULL;
+  size_t unfrag_len = 0;
+  otrng_bool encoded = otrng_false;
+
+  otrng_assert_is_success(otrng_unfragment_and_decode_message(
+      &unfrag, &unfrag_len, &encoded, &list, first, 2));
+  otrng_assert_is_error(otrng_unfragment_and_decode_message(
+      &unfrag, &unfrag_len, &encoded, &list, second, 2));
+  otrng_assert(!unfrag);
+
+  /* What was received is dropped */
+  fragment_context_s *context = list->data;
+  otrng_assert(!context->buffer);
+  g_assert_cmpint(context->count, ==, 0);
+
+  g_free(first);
+  g_free(second);
+  otrng_fragment_context_free(context);
+  otrng_list_free_nodes(list);
+}
+
 void test_expiration_of_fragments(void) {
   time_t HOUR_IN_SEC = 3600;
   list_element_s *list = NULL;
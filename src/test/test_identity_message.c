@@ -39,7 +39,7 @@ void test_dake_identity_message_serializes(dake_fixture_s *f,
 
   uint8_t *serialized = NULL;
   otrng_assert_is_success(otrng_dake_identity_message_asprintf(
-      &serialized, NULL, identity_message));
+      &serialized, NULL, identity_message, NULL));
 
   char expected[] = {
       0x0,
@@ -105,7 +105,7 @@ void test_otrng_dake_identity_message_deserializes(dake_fixture_s *f,
   size_t serialized_len = 0;
   uint8_t *serialized = NULL;
   otrng_assert_is_success(otrng_dake_identity_message_asprintf(
-      &serialized, &serialized_len, identity_message));
+      &serialized, &serialized_len, identity_message, NULL));
 
   dake_identity_message_s *deserialized =
       malloc(sizeof(dake_identity_message_s));
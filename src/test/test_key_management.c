@@ -145,3 +145,303 @@ void test_calculate_brace_key() {
   otrng_key_manager_destroy(manager);
   free(manager);
 }
+
+void test_calculate_brace_key_memoized() {
+  key_manager_s *manager = malloc(sizeof(key_manager_s));
+  otrng_key_manager_init(manager);
+
+  const uint8_t their_public[5] = {0x3};
+  otrng_assert_is_success(otrng_dh_mpi_deserialize(
+      &manager->their_dh, their_public, sizeof their_public, NULL));
+
+  const uint8_t our_secret[5] = {0x2};
+  manager->our_dh->pub = NULL;
+  otrng_assert_is_success(
+      otrng_dh_mpi_deserialize(&manager->our_dh->priv, our_secret, 5, NULL));
+
+  manager->i = 0;
+  otrng_assert_is_success(calculate_brace_key(manager, NULL, 's'));
+  otrng_assert(manager->their_dh_cached);
+  otrng_assert(manager->k_dh_cached);
+
+  brace_key_p first_brace_key;
+  memcpy(first_brace_key, manager->brace_key, BRACE_KEY_BYTES);
+
+  // The memoized k_dh gives the same brace key
+  otrng_assert_is_success(calculate_brace_key(manager, NULL, 's'));
+  otrng_assert_cmpmem(first_brace_key, manager->brace_key, BRACE_KEY_BYTES);
+
+  // A new their_dh forgets it
+  dh_public_key_p their_dh = NULL;
+  const uint8_t their_public_2[5] = {0x5};
+  otrng_assert_is_success(otrng_dh_mpi_deserialize(
+      &their_dh, their_public_2, sizeof their_public_2, NULL));
+  otrng_key_manager_set_their_dh(their_dh, manager);
+  otrng_dh_mpi_release(their_dh);
+
+  otrng_assert(!manager->their_dh_cached);
+  otrng_assert(!manager->k_dh_cached);
+
+  otrng_assert_is_success(calculate_brace_key(manager, NULL, 's'));
+  otrng_assert(memcmp(first_brace_key, manager->brace_key, BRACE_KEY_BYTES));
+
+  otrng_key_manager_destroy(manager);
+  free(manager);
+}
+
+void test_chain_kdf_step() {
+  receiving_chain_key_p chain_key;
+  receiving_chain_key_p expected_chain_key;
+  msg_enc_key_p enc_key, expected_enc_key;
+  extra_symmetric_key_p extra_key, expected_extra_key;
+  uint8_t magic[1] = {0xFF};
+
+  random_bytes(chain_key, sizeof(receiving_chain_key_p));
+
+  chain_kdf_s kdf[1];
+  chain_kdf_init(kdf);
+
+  for (int i = 0; i < 3; i++) {
+    shake_256_kdf1(expected_enc_key, sizeof(msg_enc_key_p), 0x16, chain_key,
+                   sizeof(receiving_chain_key_p));
+
+    goldilocks_shake256_ctx_p hd;
+    hash_init_with_usage(hd, 0x18);
+    hash_update(hd, magic, 1);
+    hash_update(hd, chain_key, sizeof(receiving_chain_key_p));
+    hash_final(hd, expected_extra_key, sizeof(extra_symmetric_key_p));
+    hash_destroy(hd);
+
+    shake_256_kdf1(expected_chain_key, sizeof(receiving_chain_key_p), 0x15,
+                   chain_key, sizeof(receiving_chain_key_p));
+
+    chain_kdf_step(enc_key, extra_key, chain_key, kdf);
+
+    otrng_assert_cmpmem(expected_enc_key, enc_key, sizeof(msg_enc_key_p));
+    otrng_assert_cmpmem(expected_extra_key, extra_key,
+                        sizeof(extra_symmetric_key_p));
+    otrng_assert_cmpmem(expected_chain_key, chain_key,
+                        sizeof(receiving_chain_key_p));
+  }
+
+  chain_kdf_destroy(kdf);
+}
+
+void test_skipped_keys_checkpoints() {
+  key_manager_s *manager = malloc(sizeof(key_manager_s));
+  otrng_key_manager_init(manager);
+  manager->checkpoint_interval = 4;
+
+  random_bytes(manager->current->chain_r, sizeof(receiving_chain_key_p));
+
+  /* The keys of the first 11 messages of the chain */
+  msg_enc_key_p expected_enc_keys[11];
+  extra_symmetric_key_p expected_extra_keys[11];
+  receiving_chain_key_p chain_key;
+  memcpy(chain_key, manager->current->chain_r, sizeof(receiving_chain_key_p));
+
+  chain_kdf_s kdf[1];
+  chain_kdf_init(kdf);
+  for (int i = 0; i < 11; i++) {
+    chain_kdf_step(expected_enc_keys[i], expected_extra_keys[i], chain_key,
+                   kdf);
+  }
+  chain_kdf_destroy(kdf);
+
+  receiving_ratchet_s *tmp = otrng_receiving_ratchet_new(manager);
+  msg_enc_key_p enc_key;
+  msg_mac_key_p mac_key;
+
+  // Message 10 arrives first: 0 to 9 are kept as 3 chain keys
+  otrng_assert_is_success(otrng_key_manager_derive_chain_keys(
+      enc_key, mac_key, manager, tmp, 1000, 10, 'r', NULL));
+  otrng_assert_cmpmem(expected_enc_keys[10], enc_key, sizeof(msg_enc_key_p));
+  g_assert_cmpint(otrng_list_len(tmp->new_checkpoints), ==, 3);
+  otrng_assert(!manager->checkpoints);
+  otrng_assert(!tmp->new_skipped_keys);
+
+  // They are kept once the message is authenticated
+  apply_checkpoint_changes(manager, tmp);
+  otrng_receiving_ratchet_destroy(tmp);
+  g_assert_cmpint(otrng_list_len(manager->checkpoints), ==, 3);
+
+  // Message 5 leaves the keys of message 4 behind
+  tmp = otrng_receiving_ratchet_new(manager);
+  otrng_assert_is_success(
+      otrng_key_get_skipped_keys(enc_key, mac_key, 0, 5, manager, tmp));
+  otrng_assert_cmpmem(expected_enc_keys[5], enc_key, sizeof(msg_enc_key_p));
+  otrng_assert_cmpmem(expected_extra_keys[5], tmp->extra_symmetric_key,
+                      sizeof(extra_symmetric_key_p));
+  g_assert_cmpint(otrng_list_len(tmp->new_skipped_keys), ==, 1);
+
+  // A message that is not authenticated changes nothing
+  otrng_receiving_ratchet_destroy(tmp);
+  otrng_assert(!manager->skipped_keys);
+  g_assert_cmpint(otrng_list_len(manager->checkpoints), ==, 3);
+
+  tmp = otrng_receiving_ratchet_new(manager);
+  otrng_assert_is_success(
+      otrng_key_get_skipped_keys(enc_key, mac_key, 0, 5, manager, tmp));
+  otrng_assert_cmpmem(expected_enc_keys[5], enc_key, sizeof(msg_enc_key_p));
+  apply_checkpoint_changes(manager, tmp);
+  otrng_receiving_ratchet_destroy(tmp);
+  g_assert_cmpint(otrng_list_len(manager->skipped_keys), ==, 1);
+
+  tmp = otrng_receiving_ratchet_new(manager);
+  otrng_assert_is_success(
+      otrng_key_get_skipped_keys(enc_key, mac_key, 0, 4, manager, tmp));
+  otrng_assert_cmpmem(expected_enc_keys[4], enc_key, sizeof(msg_enc_key_p));
+  otrng_assert(!tmp->skipped_keys);
+  manager->skipped_keys = tmp->skipped_keys;
+  otrng_receiving_ratchet_destroy(tmp);
+
+  // A checkpoint is dropped once every key it covers is used
+  for (int j = 6; j < 8; j++) {
+    tmp = otrng_receiving_ratchet_new(manager);
+    otrng_assert_is_success(
+        otrng_key_get_skipped_keys(enc_key, mac_key, 0, j, manager, tmp));
+    otrng_assert_cmpmem(expected_enc_keys[j], enc_key, sizeof(msg_enc_key_p));
+    apply_checkpoint_changes(manager, tmp);
+    otrng_receiving_ratchet_destroy(tmp);
+  }
+  g_assert_cmpint(otrng_list_len(manager->checkpoints), ==, 2);
+
+  // Used keys cannot be derived again
+  tmp = otrng_receiving_ratchet_new(manager);
+  otrng_assert(
+      !otrng_key_get_skipped_keys(enc_key, mac_key, 0, 5, manager, tmp));
+  otrng_receiving_ratchet_destroy(tmp);
+
+  // What is left is revealed: 0 to 3, and 8 and 9
+  int left[6] = {0, 1, 2, 3, 8, 9};
+  size_t len = 0;
+  uint8_t *revealed = otrng_reveal_mac_keys_on_tlv(&len, manager);
+  g_assert_cmpint(len, ==, 6 * MAC_KEY_BYTES);
+  for (int n = 0; n < 6; n++) {
+    shake_256_kdf1(mac_key, MAC_KEY_BYTES, 0x17, expected_enc_keys[left[n]],
+                   sizeof(msg_enc_key_p));
+    otrng_assert_cmpmem(revealed + n * MAC_KEY_BYTES, mac_key, MAC_KEY_BYTES);
+  }
+  otrng_assert(!manager->checkpoints);
+  otrng_assert(!manager->skipped_keys);
+  free(revealed);
+
+  otrng_key_manager_destroy(manager);
+  free(manager);
+}
+
+static void add_skipped_keys(key_manager_s *manager, unsigned int j,
+                             time_t stored_at) {
+  skipped_keys_s *skipped = malloc(sizeof(skipped_keys_s));
+  memset(skipped, 0, sizeof(skipped_keys_s));
+  skipped->j = j;
+  skipped->stored_at = stored_at;
+  manager->skipped_keys = otrng_list_add(skipped, manager->skipped_keys);
+}
+
+void test_expire_stored_keys() {
+  key_manager_s *manager = malloc(sizeof(key_manager_s));
+  otrng_key_manager_init(manager);
+
+  msg_mac_key_p mac_key;
+  random_bytes(mac_key, sizeof(msg_mac_key_p));
+
+  add_skipped_keys(manager, 0, 100);
+  add_skipped_keys(manager, 1, 300);
+  otrng_assert_is_success(otrng_store_old_mac_keys(manager, mac_key));
+  otrng_assert_is_success(otrng_store_old_mac_keys(manager, mac_key));
+  ((old_mac_key_s *)manager->old_mac_keys->data)->stored_at = 200;
+  ((old_mac_key_s *)manager->old_mac_keys->next->data)->stored_at = 400;
+
+  // Keys derived from a checkpoint are kept in the order they were stored
+  receiving_ratchet_s *tmp = otrng_receiving_ratchet_new(manager);
+  add_skipped_keys(manager, 2, 50);
+  tmp->new_skipped_keys = manager->skipped_keys->next->next;
+  manager->skipped_keys->next->next = NULL;
+  apply_checkpoint_changes(manager, tmp);
+  otrng_receiving_ratchet_destroy(tmp);
+  otrng_assert(((skipped_keys_s *)manager->skipped_keys->data)->j == 2);
+
+  time_t oldest;
+  otrng_assert(otrng_key_manager_oldest_key(&oldest, manager));
+  g_assert_cmpint(oldest, ==, 50);
+  g_assert_cmpint(otrng_key_manager_evict_oldest_key(manager), >, 0);
+
+  otrng_stored_keys_stats_s stats[1];
+  otrng_key_manager_stored_keys_stats(stats, manager);
+  g_assert_cmpint(stats->skipped_keys, ==, 2);
+  g_assert_cmpint(stats->old_mac_keys, ==, 2);
+  g_assert_cmpint(stats->evicted_keys, ==, 1);
+  size_t bytes = stats->bytes;
+
+  // Nothing is dropped without limits
+  g_assert_cmpint(
+      otrng_key_manager_expire_stored_keys(manager, 1000, 0, 0), ==, 0);
+
+  // By age
+  g_assert_cmpint(
+      otrng_key_manager_expire_stored_keys(manager, 1000, 750, 0), ==, 2);
+  otrng_key_manager_stored_keys_stats(stats, manager);
+  g_assert_cmpint(stats->skipped_keys, ==, 1);
+  g_assert_cmpint(stats->old_mac_keys, ==, 1);
+  g_assert_cmpint(stats->evicted_keys, ==, 3);
+  g_assert_cmpint(stats->bytes, ==, bytes / 2);
+  otrng_assert(((skipped_keys_s *)manager->skipped_keys->data)->j == 1);
+
+  otrng_assert(otrng_key_manager_oldest_key(&oldest, manager));
+  g_assert_cmpint(oldest, ==, 300);
+
+  // By size, oldest first
+  g_assert_cmpint(otrng_key_manager_expire_stored_keys(manager, 1000, 0,
+                                                       stats->bytes - 1),
+                  ==, 1);
+  otrng_key_manager_stored_keys_stats(stats, manager);
+  g_assert_cmpint(stats->skipped_keys, ==, 0);
+  g_assert_cmpint(stats->old_mac_keys, ==, 1);
+  g_assert_cmpint(stats->evicted_keys, ==, 4);
+
+  g_assert_cmpint(otrng_key_manager_evict_oldest_key(manager), ==,
+                  stats->bytes);
+  otrng_assert(!otrng_key_manager_oldest_key(&oldest, manager));
+  g_assert_cmpint(otrng_key_manager_evict_oldest_key(manager), ==, 0);
+
+  otrng_key_manager_destroy(manager);
+  free(manager);
+}
+
+void test_prepared_ephemeral_keys() {
+  key_manager_s *manager = otrng_key_manager_new();
+
+  otrng_assert_is_success(otrng_key_manager_prepare_ephemeral_keys(manager));
+  otrng_assert(manager->next_keys_ready);
+
+  ephemeral_pub_ser_s expected;
+  memcpy(&expected, &manager->next_pub, sizeof(ephemeral_pub_ser_s));
+  otrng_assert(!otrng_key_manager_get_our_pub(manager));
+
+  // Only the DAKE uses the prepared keys
+  otrng_assert_is_success(otrng_key_manager_generate_ephemeral_keys(manager));
+  otrng_assert(manager->next_keys_ready);
+
+  // The prepared keys become ours
+  otrng_assert_is_success(otrng_key_manager_generate_dake_keys(manager));
+  otrng_assert(!manager->next_keys_ready);
+
+  const ephemeral_pub_ser_s *our_pub = otrng_key_manager_get_our_pub(manager);
+  otrng_assert(our_pub);
+  otrng_assert_cmpmem(our_pub->ecdh, expected.ecdh, ED448_POINT_BYTES);
+  g_assert_cmpint(our_pub->dh_len, ==, expected.dh_len);
+  otrng_assert_cmpmem(our_pub->dh, expected.dh, expected.dh_len);
+
+  ephemeral_pub_ser_s ser;
+  otrng_assert_is_success(
+      otrng_ephemeral_pub_serialize(&ser, manager->our_ecdh, manager->our_dh));
+  otrng_assert_cmpmem(ser.ecdh, expected.ecdh, ED448_POINT_BYTES);
+  otrng_assert_cmpmem(ser.dh, expected.dh, expected.dh_len);
+
+  // Keys generated on the spot do not come serialized
+  otrng_assert_is_success(otrng_key_manager_generate_ephemeral_keys(manager));
+  otrng_assert(!otrng_key_manager_get_our_pub(manager));
+
+  otrng_key_manager_free(manager);
+}
@@ -225,3 +225,37 @@ void test_instance_tag_api(void) {
   otrl_userstate_free(alice->user_state);
   otrng_client_state_free(alice);
 }
+
+void test_instance_tag_is_cached(void) {
+  const char *alice_protocol = "otr";
+  unsigned int instance_tag = 0x9abcdef0;
+
+  otrng_client_state_s *alice = otrng_client_state_new(alice_account);
+  alice->callbacks = test_callbacks;
+  alice->user_state = otrl_userstate_create();
+
+  otrng_assert_is_success(
+      otrng_client_state_add_instance_tag(alice, instance_tag));
+
+  /* Once known, the tag is not looked up in the user state again */
+  alice->callbacks = NULL;
+  g_assert_cmpuint(otrng_client_state_get_instance_tag(alice), ==,
+                   instance_tag);
+
+  /* Until the instance tags there may have changed */
+  alice->callbacks = test_callbacks;
+  FILE *instagFILEp = tmpfile();
+  fprintf(instagFILEp, "%s\t%s\t%08x\n", alice_account, alice_protocol,
+          instance_tag);
+  rewind(instagFILEp);
+  otrng_client_state_instance_tag_read_FILEp(alice, instagFILEp);
+  fclose(instagFILEp);
+
+  g_assert_cmpuint(alice->instance_tag, ==, 0);
+  g_assert_cmpuint(otrng_client_state_get_instance_tag(alice), ==,
+                   instance_tag);
+  g_assert_cmpuint(alice->instance_tag, ==, instance_tag);
+
+  otrl_userstate_free(alice->user_state);
+  otrng_client_state_free(alice);
+}
@@ -185,8 +185,8 @@ void test_dake_non_interactive_auth_message_serializes(dake_fixture_s *f,
 
   uint8_t *serialized = NULL;
   size_t len = 0;
-  otrng_assert_is_success(
-      otrng_dake_non_interactive_auth_message_asprintf(&serialized, &len, msg));
+  otrng_assert_is_success(otrng_dake_non_interactive_auth_message_asprintf(
+      &serialized, &len, msg, NULL));
 
   uint8_t expected_header[] = {
       0x00,
@@ -255,7 +255,7 @@ void test_otrng_dake_non_interactive_auth_message_deserializes(
   uint8_t *serialized = NULL;
   size_t len = 0;
   otrng_assert_is_success(otrng_dake_non_interactive_auth_message_asprintf(
-      &serialized, &len, expected));
+      &serialized, &len, expected, NULL));
 
   dake_non_interactive_auth_message_p deserialized;
   otrng_assert_is_success(otrng_dake_non_interactive_auth_message_deserialize(
@@ -202,6 +202,84 @@ void test_otrng_receives_identity_message_invalid_on_start(
   otrng_response_free(response);
 }
 
+void test_otrng_classifies_messages() {
+  otrng_message_info_p info;
+
+  otrng_classify_message(info, "Some random text.");
+  g_assert_cmpint(info->type, ==, MSG_PLAINTEXT);
+  otrng_assert(!info->tag);
+  otrng_assert(!info->payload);
+
+  const string_p tagged =
+      "Hi \t  \t\t\t\t \t \t \t    \t\t \t  there";
+  otrng_classify_message(info, tagged);
+  g_assert_cmpint(info->type, ==, MSG_TAGGED_PLAINTEXT);
+  otrng_assert(info->tag == tagged + 2);
+  otrng_assert(info->tag_v4);
+  otrng_assert(!info->tag_v3);
+
+  otrng_classify_message(info, "?OTRv43? Bob wants to talk.");
+  g_assert_cmpint(info->type, ==, MSG_QUERY_STRING);
+
+  otrng_classify_message(info, "?OTR Error: ERROR_1: Unreadable");
+  g_assert_cmpint(info->type, ==, MSG_OTR_ERROR);
+
+  const string_p encoded = "?OTR:AAQD.";
+  otrng_classify_message(info, encoded);
+  g_assert_cmpint(info->type, ==, MSG_OTR_ENCODED);
+  otrng_assert(info->payload == encoded + 5);
+  g_assert_cmpint(info->payload_len, ==, 4);
+
+  otrng_classify_message(info, "?OTR:AAQD");
+  g_assert_cmpint(info->type, ==, MSG_OTR_ENCODED);
+  otrng_assert(!info->payload);
+  otrng_assert(!info->dh_commit);
+
+  /* A DH-Commit is found even if it is not the first encoded message */
+  otrng_classify_message(info, "?OTR:AAQD. ?OTR:AAMC.");
+  otrng_assert(info->dh_commit);
+}
+
+void test_otrng_pads_plaintext_in_place(otrng_fixture_s *otrng_fixture,
+                                        gconstpointer data) {
+  uint8_t smp2_data[2] = {0x03, 0x04};
+  tlv_list_s *tlvs = otrng_tlv_list_one(
+      otrng_tlv_new(OTRNG_TLV_SMP_MSG_2, sizeof(smp2_data), smp2_data));
+
+  /* "hi" || NUL || the SMP TLV */
+  uint8_t expected[] = {'h', 'i', 0, 0x00, 0x03, 0x00, 0x02, 0x03, 0x04};
+  size_t granularities[] = {0, 16, 100, 256};
+
+  for (int i = 0; i < 4; i++) {
+    otrng_client_state_set_padding(granularities[i], otrng_fixture->state);
+
+    uint8_t *msg = NULL;
+    size_t msg_len = 0;
+    otrng_arena_enter(otrng_fixture->otr->scratch);
+    otrng_assert_is_success(
+        append_tlvs(&msg, &msg_len, "hi", tlvs, otrng_fixture->otr));
+    otrng_assert_cmpmem(msg, expected, sizeof(expected));
+
+    if (granularities[i] == 0) {
+      g_assert_cmpint(msg_len, ==, sizeof(expected));
+    } else {
+      g_assert_cmpint((msg_len + 1) % granularities[i], ==, 0);
+
+      /* The padding TLV, with its data zeroed */
+      const uint8_t *padding = msg + sizeof(expected);
+      size_t padding_len = msg_len - sizeof(expected) - 4;
+      g_assert_cmpint(padding[0] << 8 | padding[1], ==, OTRNG_TLV_PADDING);
+      g_assert_cmpint(padding[2] << 8 | padding[3], ==, padding_len);
+      for (size_t j = 0; j < padding_len; j++) {
+        g_assert_cmpint(padding[4 + j], ==, 0);
+      }
+    }
+    otrng_arena_leave(otrng_fixture->otr->scratch);
+  }
+
+  otrng_tlv_list_free(tlvs);
+}
+
 void test_otrng_destroy() {
   otrng_client_state_s *state = otrng_client_state_new(NULL);
 
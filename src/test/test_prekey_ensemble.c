@@ -37,6 +37,7 @@ void test_prekey_ensemble_validate(void) {
   ensemble->client_profile->expires = time(NULL) + 60 * 60 * 24; // one day
   ensemble->client_profile->transitional_signature = NULL;
   ensemble->client_profile->dsa_key = NULL;
+  ensemble->client_profile->borrowed = otrng_false;
   otrng_assert_is_success(
       client_profile_sign(ensemble->client_profile, keypair));
 
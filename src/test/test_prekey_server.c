@@ -0,0 +1,416 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../prekey_server.h"
+
+#define PREKEY_SERVER_IDENTITY "prekey@otr.example"
+
+typedef struct {
+  otrng_client_s *client;
+  int errors;
+  int successes;
+  int failures;
+  uint32_t stored_prekeys;
+  int no_prekeys;
+  int ensembles;
+} prekey_server_test_ctx_s;
+
+static void test_prekey_notify_error(int error, void *ctx) {
+  (void)error;
+  ((prekey_server_test_ctx_s *)ctx)->errors++;
+}
+
+static void test_prekey_storage_status_received(
+    const otrng_prekey_storage_status_message_s *msg, void *ctx) {
+  ((prekey_server_test_ctx_s *)ctx)->stored_prekeys = msg->stored_prekeys;
+}
+
+static void test_prekey_success_received(void *ctx) {
+  ((prekey_server_test_ctx_s *)ctx)->successes++;
+}
+
+static void test_prekey_failure_received(void *ctx) {
+  ((prekey_server_test_ctx_s *)ctx)->failures++;
+}
+
+static void test_prekey_no_prekey_in_storage_received(void *ctx) {
+  ((prekey_server_test_ctx_s *)ctx)->no_prekeys++;
+}
+
+static void test_prekey_low_prekey_messages_in_storage(char *server_identity,
+                                                       void *ctx) {
+  (void)server_identity;
+  (void)ctx;
+}
+
+static void
+test_prekey_ensembles_received(prekey_ensemble_s *const *const ensembles,
+                               uint8_t num_ensembles, void *ctx) {
+  for (int i = 0; i < num_ensembles; i++) {
+    if (ensembles[i]) {
+      ((prekey_server_test_ctx_s *)ctx)->ensembles++;
+    }
+  }
+}
+
+static int test_prekey_build_publication_message(
+    otrng_prekey_publication_message_s *pub_msg,
+    unsigned int max_published_prekey_msg, void *ctx) {
+  (void)max_published_prekey_msg;
+  otrng_client_s *client = ((prekey_server_test_ctx_s *)ctx)->client;
+
+  pub_msg->num_prekey_messages = 2;
+  pub_msg->prekey_messages = otrng_client_build_prekey_messages(2, client);
+
+  pub_msg->client_profile = malloc(sizeof(client_profile_s));
+  otrng_client_profile_copy(
+      pub_msg->client_profile,
+      otrng_client_state_get_client_profile(client->state));
+
+  pub_msg->prekey_profile = malloc(sizeof(otrng_prekey_profile_s));
+  otrng_prekey_profile_copy(
+      pub_msg->prekey_profile,
+      otrng_client_state_get_prekey_profile(client->state));
+
+  return pub_msg->prekey_messages != NULL;
+}
+
+static otrng_prekey_client_s *
+set_up_prekey_client(otrng_prekey_client_callbacks_s *callbacks,
+                     prekey_server_test_ctx_s *ctx, const char *identity) {
+  otrng_client_s *client = ctx->client;
+
+  callbacks->ctx = ctx;
+  callbacks->notify_error = test_prekey_notify_error;
+  callbacks->storage_status_received = test_prekey_storage_status_received;
+  callbacks->success_received = test_prekey_success_received;
+  callbacks->failure_received = test_prekey_failure_received;
+  callbacks->no_prekey_in_storage_received =
+      test_prekey_no_prekey_in_storage_received;
+  callbacks->low_prekey_messages_in_storage =
+      test_prekey_low_prekey_messages_in_storage;
+  callbacks->prekey_ensembles_received = test_prekey_ensembles_received;
+  callbacks->build_prekey_publication_message =
+      test_prekey_build_publication_message;
+
+  client->prekey_client = otrng_prekey_client_new(
+      PREKEY_SERVER_IDENTITY, identity,
+      otrng_client_state_get_instance_tag(client->state),
+      otrng_client_state_get_keypair_v4(client->state),
+      otrng_client_state_get_client_profile(client->state),
+      otrng_client_state_get_prekey_profile(client->state),
+      otrng_client_state_get_max_published_prekey_msg(client->state),
+      otrng_client_state_get_minimum_stored_prekey_msg(client->state));
+  client->prekey_client->callbacks = callbacks;
+
+  return client->prekey_client;
+}
+
+/* Runs a DAKE between a prekey client and the server, and gives the client
+ * the server's answer to its DAKE-3 */
+static void run_prekey_server_dake(char *dake_1, const char *identity,
+                                   otrng_prekey_client_s *prekey_client,
+                                   otrng_prekey_server_s *server) {
+  char *dake_2 = NULL;
+  otrng_assert_is_success(
+      otrng_prekey_server_receive(&dake_2, identity, dake_1, server));
+  otrng_assert(dake_2);
+  free(dake_1);
+
+  char *dake_3 = NULL;
+  otrng_assert_is_success(otrng_prekey_client_receive(
+      &dake_3, PREKEY_SERVER_IDENTITY, dake_2, prekey_client));
+  otrng_assert(dake_3);
+  free(dake_2);
+
+  char *reply = NULL;
+  otrng_assert_is_success(
+      otrng_prekey_server_receive(&reply, identity, dake_3, server));
+  otrng_assert(reply);
+  free(dake_3);
+
+  char *to_send = NULL;
+  otrng_assert_is_success(otrng_prekey_client_receive(
+      &to_send, PREKEY_SERVER_IDENTITY, reply, prekey_client));
+  otrng_assert(!to_send);
+  free(reply);
+}
+
+void test_prekey_server_publishes_and_retrieves(void) {
+  uint8_t sym[ED448_PRIVATE_BYTES] = {0x1B};
+  otrng_prekey_server_s *server =
+      otrng_prekey_server_new(PREKEY_SERVER_IDENTITY, sym);
+  otrng_assert(server);
+
+  otrng_client_state_s *alice_client_state =
+      otrng_client_state_new(ALICE_IDENTITY);
+  otrng_client_s *alice = set_up_client(alice_client_state, ALICE_IDENTITY, 1);
+  otrng_client_state_s *bob_client_state = otrng_client_state_new(BOB_IDENTITY);
+  otrng_client_s *bob = set_up_client(bob_client_state, BOB_IDENTITY, 2);
+
+  otrng_prekey_client_callbacks_s alice_callbacks[1];
+  prekey_server_test_ctx_s alice_ctx[1] = {{alice, 0, 0, 0, 0, 0, 0}};
+  otrng_prekey_client_s *alice_prekey_client =
+      set_up_prekey_client(alice_callbacks, alice_ctx, ALICE_IDENTITY);
+
+  otrng_prekey_client_callbacks_s bob_callbacks[1];
+  prekey_server_test_ctx_s bob_ctx[1] = {{bob, 0, 0, 0, 0, 0, 0}};
+  otrng_prekey_client_s *bob_prekey_client =
+      set_up_prekey_client(bob_callbacks, bob_ctx, BOB_IDENTITY);
+
+  uint32_t alice_instance_tag = alice_prekey_client->instance_tag;
+
+  /* Alice publishes */
+  char *dake_1 = otrng_prekey_client_publish_prekeys(alice_prekey_client);
+  run_prekey_server_dake(dake_1, ALICE_IDENTITY, alice_prekey_client, server);
+  g_assert_cmpint(alice_ctx->successes, ==, 1);
+  g_assert_cmpint(alice_ctx->errors, ==, 0);
+  g_assert_cmpint(otrng_prekey_server_count_prekey_messages(
+                      ALICE_IDENTITY, alice_instance_tag, server),
+                  ==, 2);
+
+  /* And asks how many prekey messages are stored */
+  dake_1 = otrng_prekey_client_request_storage_information(alice_prekey_client);
+  run_prekey_server_dake(dake_1, ALICE_IDENTITY, alice_prekey_client, server);
+  g_assert_cmpint(alice_ctx->stored_prekeys, ==, 2);
+  g_assert_cmpint(alice_ctx->errors, ==, 0);
+
+  /* Alice does not support version 3 */
+  char *query = otrng_prekey_client_retrieve_prekeys(ALICE_IDENTITY, "3",
+                                                     bob_prekey_client);
+  char *reply = NULL;
+  otrng_assert_is_success(
+      otrng_prekey_server_receive(&reply, BOB_IDENTITY, query, server));
+  free(query);
+
+  char *to_send = NULL;
+  otrng_assert_is_success(otrng_prekey_client_receive(
+      &to_send, PREKEY_SERVER_IDENTITY, reply, bob_prekey_client));
+  free(reply);
+  g_assert_cmpint(bob_ctx->no_prekeys, ==, 1);
+  g_assert_cmpint(otrng_prekey_server_count_prekey_messages(
+                      ALICE_IDENTITY, alice_instance_tag, server),
+                  ==, 2);
+
+  /* Bob retrieves Alice's ensembles, one prekey message at a time */
+  for (int i = 0; i < 3; i++) {
+    char *query = otrng_prekey_client_retrieve_prekeys(ALICE_IDENTITY, "4",
+                                                       bob_prekey_client);
+    char *reply = NULL;
+    otrng_assert_is_success(
+        otrng_prekey_server_receive(&reply, BOB_IDENTITY, query, server));
+    otrng_assert(reply);
+    free(query);
+
+    char *to_send = NULL;
+    otrng_assert_is_success(otrng_prekey_client_receive(
+        &to_send, PREKEY_SERVER_IDENTITY, reply, bob_prekey_client));
+    otrng_assert(!to_send);
+    free(reply);
+  }
+
+  g_assert_cmpint(bob_ctx->ensembles, ==, 2);
+  g_assert_cmpint(bob_ctx->no_prekeys, ==, 2);
+  g_assert_cmpint(bob_ctx->errors, ==, 0);
+  g_assert_cmpint(otrng_prekey_server_count_prekey_messages(
+                      ALICE_IDENTITY, alice_instance_tag, server),
+                  ==, 0);
+
+  otrng_prekey_server_free(server);
+
+  otrl_userstate_free(alice_client_state->user_state);
+  otrng_client_state_free(alice_client_state);
+  otrng_client_free(alice);
+
+  otrl_userstate_free(bob_client_state->user_state);
+  otrng_client_state_free(bob_client_state);
+  otrng_client_free(bob);
+}
+
+void test_prekey_server_rejects_unknown_dake(void) {
+  uint8_t sym[ED448_PRIVATE_BYTES] = {0x1B};
+  otrng_prekey_server_s *server =
+      otrng_prekey_server_new(PREKEY_SERVER_IDENTITY, sym);
+
+  otrng_client_state_s *alice_client_state =
+      otrng_client_state_new(ALICE_IDENTITY);
+  otrng_client_s *alice = set_up_client(alice_client_state, ALICE_IDENTITY, 1);
+
+  otrng_prekey_client_callbacks_s callbacks[1];
+  prekey_server_test_ctx_s ctx[1] = {{alice, 0, 0, 0, 0, 0, 0}};
+  otrng_prekey_client_s *prekey_client =
+      set_up_prekey_client(callbacks, ctx, ALICE_IDENTITY);
+
+  char *dake_1 = otrng_prekey_client_publish_prekeys(prekey_client);
+  char *dake_2 = NULL;
+
+  /* Nobody sent it */
+  otrng_assert_is_error(
+      otrng_prekey_server_receive(&dake_2, NULL, dake_1, server));
+  otrng_assert(!dake_2);
+
+  otrng_assert_is_success(
+      otrng_prekey_server_receive(&dake_2, ALICE_IDENTITY, dake_1, server));
+  free(dake_1);
+
+  char *dake_3 = NULL;
+  otrng_assert_is_success(otrng_prekey_client_receive(
+      &dake_3, PREKEY_SERVER_IDENTITY, dake_2, prekey_client));
+  free(dake_2);
+
+  /* The DAKE was started by someone else */
+  char *reply = NULL;
+  otrng_assert_is_error(
+      otrng_prekey_server_receive(&reply, BOB_IDENTITY, dake_3, server));
+  otrng_assert(!reply);
+
+  /* A DAKE can only be finished once */
+  otrng_assert_is_success(
+      otrng_prekey_server_receive(&reply, ALICE_IDENTITY, dake_3, server));
+  free(reply);
+  otrng_assert_is_error(
+      otrng_prekey_server_receive(&reply, ALICE_IDENTITY, dake_3, server));
+  otrng_assert(!reply);
+  free(dake_3);
+
+  otrng_prekey_server_free(server);
+
+  otrl_userstate_free(alice_client_state->user_state);
+  otrng_client_state_free(alice_client_state);
+  otrng_client_free(alice);
+}
+
+void test_prekey_server_expires_dake(void) {
+  uint8_t sym[ED448_PRIVATE_BYTES] = {0x1B};
+  otrng_prekey_server_s *server =
+      otrng_prekey_server_new(PREKEY_SERVER_IDENTITY, sym);
+
+  otrng_client_state_s *alice_client_state =
+      otrng_client_state_new(ALICE_IDENTITY);
+  otrng_client_s *alice = set_up_client(alice_client_state, ALICE_IDENTITY, 1);
+
+  otrng_prekey_client_callbacks_s callbacks[1];
+  prekey_server_test_ctx_s ctx[1] = {{alice, 0, 0, 0, 0, 0, 0}};
+  otrng_prekey_client_s *prekey_client =
+      set_up_prekey_client(callbacks, ctx, ALICE_IDENTITY);
+
+  char *dake_1 = otrng_prekey_client_publish_prekeys(prekey_client);
+  char *dake_2 = NULL;
+  otrng_assert_is_success(
+      otrng_prekey_server_receive(&dake_2, ALICE_IDENTITY, dake_1, server));
+  free(dake_1);
+  g_assert_cmpint(server->num_sessions, ==, 1);
+
+  char *dake_3 = NULL;
+  otrng_assert_is_success(otrng_prekey_client_receive(
+      &dake_3, PREKEY_SERVER_IDENTITY, dake_2, prekey_client));
+  free(dake_2);
+
+  /* The DAKE was not finished in time */
+  otrng_prekey_server_session_s *session = server->sessions->data;
+  session->started -= OTRNG_PREKEY_SERVER_SESSION_TIMEOUT + 1;
+
+  char *reply = NULL;
+  otrng_assert_is_error(
+      otrng_prekey_server_receive(&reply, ALICE_IDENTITY, dake_3, server));
+  otrng_assert(!reply);
+  otrng_assert(!server->sessions);
+  g_assert_cmpint(server->num_sessions, ==, 0);
+  free(dake_3);
+
+  otrng_prekey_server_free(server);
+
+  otrl_userstate_free(alice_client_state->user_state);
+  otrng_client_state_free(alice_client_state);
+  otrng_client_free(alice);
+}
+
+void test_prekey_server_publishes_replaced_profiles(void) {
+  uint8_t sym[ED448_PRIVATE_BYTES] = {0x1B};
+  otrng_prekey_server_s *server =
+      otrng_prekey_server_new(PREKEY_SERVER_IDENTITY, sym);
+
+  otrng_client_state_s *alice_client_state =
+      otrng_client_state_new(ALICE_IDENTITY);
+  otrng_client_s *alice = set_up_client(alice_client_state, ALICE_IDENTITY, 1);
+  otrng_client_state_s *bob_client_state = otrng_client_state_new(BOB_IDENTITY);
+  otrng_client_s *bob = set_up_client(bob_client_state, BOB_IDENTITY, 2);
+
+  otrng_prekey_client_callbacks_s alice_callbacks[1];
+  prekey_server_test_ctx_s alice_ctx[1] = {{alice, 0, 0, 0, 0, 0, 0}};
+  otrng_prekey_client_s *alice_prekey_client =
+      set_up_prekey_client(alice_callbacks, alice_ctx, ALICE_IDENTITY);
+
+  otrng_prekey_client_callbacks_s bob_callbacks[1];
+  prekey_server_test_ctx_s bob_ctx[1] = {{bob, 0, 0, 0, 0, 0, 0}};
+  otrng_prekey_client_s *bob_prekey_client =
+      set_up_prekey_client(bob_callbacks, bob_ctx, BOB_IDENTITY);
+
+  /* The prekey client was given the profiles before they are replaced */
+  uint32_t instance_tag = alice_prekey_client->instance_tag;
+  client_profile_s *client_profile = otrng_client_profile_build(
+      instance_tag, "4", otrng_client_state_get_keypair_v4(alice->state));
+  otrng_prekey_profile_s *prekey_profile =
+      otrng_client_state_build_default_prekey_profile(alice->state);
+  otrng_assert(client_profile);
+  otrng_assert(prekey_profile);
+
+  otrng_assert_is_success(otrng_client_state_replace_client_profile(
+      alice->state, client_profile));
+  otrng_assert_is_success(otrng_client_state_replace_prekey_profile(
+      alice->state, prekey_profile));
+  otrng_assert(alice_prekey_client->client_profile ==
+               otrng_client_state_get_client_profile(alice->state));
+  otrng_client_profile_free(client_profile);
+  otrng_prekey_profile_free(prekey_profile);
+
+  char *dake_1 = otrng_prekey_client_publish_prekeys(alice_prekey_client);
+  run_prekey_server_dake(dake_1, ALICE_IDENTITY, alice_prekey_client, server);
+  g_assert_cmpint(alice_ctx->successes, ==, 1);
+  g_assert_cmpint(alice_ctx->errors, ==, 0);
+
+  /* The new client profile was published: it only supports version 4 */
+  char *query = otrng_prekey_client_retrieve_prekeys(ALICE_IDENTITY, "3",
+                                                     bob_prekey_client);
+  char *reply = NULL;
+  otrng_assert_is_success(
+      otrng_prekey_server_receive(&reply, BOB_IDENTITY, query, server));
+  free(query);
+
+  char *to_send = NULL;
+  otrng_assert_is_success(otrng_prekey_client_receive(
+      &to_send, PREKEY_SERVER_IDENTITY, reply, bob_prekey_client));
+  free(reply);
+  g_assert_cmpint(bob_ctx->no_prekeys, ==, 1);
+  g_assert_cmpint(
+      otrng_prekey_server_count_prekey_messages(ALICE_IDENTITY, instance_tag,
+                                                server),
+      ==, 2);
+
+  otrng_prekey_server_free(server);
+
+  otrl_userstate_free(alice_client_state->user_state);
+  otrng_client_state_free(alice_client_state);
+  otrng_client_free(alice);
+
+  otrl_userstate_free(bob_client_state->user_state);
+  otrng_client_state_free(bob_client_state);
+  otrng_client_free(bob);
+}
@@ -0,0 +1,279 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../send_stream.h"
+
+#define SEND_STREAM_PLAINTEXT_LEN 10000
+
+/* Keeps each piece the stream emits */
+static otrng_result collect_pieces(const char *data, size_t len, void *ctx) {
+  g_ptr_array_add((GPtrArray *)ctx, g_strndup(data, len));
+  return OTRNG_SUCCESS;
+}
+
+static char *join_pieces(GPtrArray *pieces) {
+  g_ptr_array_add(pieces, NULL);
+  char *joined = g_strjoinv("", (char **)pieces->pdata);
+  g_ptr_array_remove_index(pieces, pieces->len - 1);
+
+  return joined;
+}
+
+/* Encrypts and encodes the whole message at once, as send_data_message
+ * does */
+static char *encode_whole_data_msg(data_message_s *data_msg,
+                                   const uint8_t *plaintext,
+                                   const msg_enc_key_p enc_key,
+                                   const msg_mac_key_p mac_key,
+                                   const uint8_t *revealed,
+                                   size_t revealed_len) {
+  free(data_msg->enc_msg);
+  data_msg->enc_msg = malloc(SEND_STREAM_PLAINTEXT_LEN);
+  data_msg->enc_msg_len = SEND_STREAM_PLAINTEXT_LEN;
+  crypto_stream_xor(data_msg->enc_msg, plaintext, SEND_STREAM_PLAINTEXT_LEN,
+                    data_msg->nonce, enc_key);
+
+  uint8_t *to_reveal = malloc(revealed_len);
+  memcpy(to_reveal, revealed, revealed_len);
+
+  string_p encoded = NULL;
+  otrng_assert_is_success(serialize_and_encode_data_msg(
+      &encoded, mac_key, to_reveal, revealed_len, data_msg));
+  free(to_reveal);
+
+  return encoded;
+}
+
+/* Gives the plaintext to the stream in parts of uneven sizes */
+static void stream_data_msg(GPtrArray *pieces, const data_message_s *data_msg,
+                            const uint8_t *plaintext,
+                            const msg_enc_key_p enc_key,
+                            const msg_mac_key_p mac_key,
+                            const uint8_t *revealed, size_t revealed_len,
+                            int max_size) {
+  uint8_t *to_reveal = malloc(revealed_len);
+  memcpy(to_reveal, revealed, revealed_len);
+
+  otrng_send_stream_p stream;
+  otrng_assert_is_success(otrng_send_stream_init(
+      stream, data_msg, enc_key, mac_key, to_reveal, revealed_len,
+      SEND_STREAM_PLAINTEXT_LEN, max_size, collect_pieces, pieces));
+
+  size_t written = 0, step = 1;
+  while (written < SEND_STREAM_PLAINTEXT_LEN) {
+    size_t n = SEND_STREAM_PLAINTEXT_LEN - written;
+    if (n > step) {
+      n = step;
+    }
+
+    otrng_assert_is_success(
+        otrng_send_stream_update(stream, plaintext + written, n));
+    written += n;
+    step = step * 3 + 1;
+  }
+
+  /* Nothing more than announced */
+  otrng_assert_is_error(otrng_send_stream_update(stream, plaintext, 1));
+
+  otrng_assert_is_success(otrng_send_stream_final(stream));
+  otrng_send_stream_destroy(stream);
+}
+
+void test_send_stream_matches_whole_message(void) {
+  data_message_s *data_msg = set_up_data_msg();
+
+  uint8_t plaintext[SEND_STREAM_PLAINTEXT_LEN];
+  for (int i = 0; i < SEND_STREAM_PLAINTEXT_LEN; i++) {
+    plaintext[i] = i % 251;
+  }
+
+  msg_enc_key_p enc_key;
+  memset(enc_key, 0x1C, sizeof(msg_enc_key_p));
+  msg_mac_key_p mac_key;
+  memset(mac_key, 0x2D, sizeof(msg_mac_key_p));
+  uint8_t revealed[2 * MAC_KEY_BYTES];
+  memset(revealed, 0x3E, sizeof(revealed));
+
+  char *expected = encode_whole_data_msg(data_msg, plaintext, enc_key, mac_key,
+                                         revealed, sizeof(revealed));
+
+  GPtrArray *pieces = g_ptr_array_new_with_free_func(g_free);
+  stream_data_msg(pieces, data_msg, plaintext, enc_key, mac_key, revealed,
+                  sizeof(revealed), 0);
+
+  otrng_assert(pieces->len > 1);
+  char *streamed = join_pieces(pieces);
+  g_assert_cmpstr(streamed, ==, expected);
+
+  g_free(streamed);
+  g_ptr_array_free(pieces, TRUE);
+  free(expected);
+  otrng_data_message_free(data_msg);
+}
+
+void test_send_stream_matches_fragmented_message(void) {
+  data_message_s *data_msg = set_up_data_msg();
+
+  uint8_t plaintext[SEND_STREAM_PLAINTEXT_LEN];
+  for (int i = 0; i < SEND_STREAM_PLAINTEXT_LEN; i++) {
+    plaintext[i] = i % 241;
+  }
+
+  msg_enc_key_p enc_key;
+  memset(enc_key, 0x4F, sizeof(msg_enc_key_p));
+  msg_mac_key_p mac_key;
+  memset(mac_key, 0x5A, sizeof(msg_mac_key_p));
+  uint8_t revealed[MAC_KEY_BYTES];
+  memset(revealed, 0x6B, sizeof(revealed));
+
+  char *whole = encode_whole_data_msg(data_msg, plaintext, enc_key, mac_key,
+                                      revealed, sizeof(revealed));
+
+  otrng_message_to_send_s *expected = otrng_message_new();
+  otrng_assert_is_success(otrng_fragment_message(
+      500, expected, data_msg->sender_instance_tag,
+      data_msg->receiver_instance_tag, whole));
+
+  GPtrArray *pieces = g_ptr_array_new_with_free_func(g_free);
+  stream_data_msg(pieces, data_msg, plaintext, enc_key, mac_key, revealed,
+                  sizeof(revealed), 500);
+
+  g_assert_cmpint(pieces->len, ==, expected->total);
+  for (int i = 0; i < expected->total; i++) {
+    const char *piece = g_ptr_array_index(pieces, i);
+    otrng_assert(strlen(piece) <= 500);
+
+    /* Only the identifier, "?OTR|XXXXXXXX|", is chosen at random */
+    g_assert_cmpint(strlen(piece), ==, strlen(expected->pieces[i]));
+    otrng_assert_cmpmem(piece, expected->pieces[i], 5);
+    g_assert_cmpstr(piece + 13, ==, expected->pieces[i] + 13);
+  }
+
+  g_ptr_array_free(pieces, TRUE);
+  otrng_message_free(expected);
+  free(whole);
+  otrng_data_message_free(data_msg);
+}
+
+void test_send_stream_rejects_short_plaintext(void) {
+  data_message_s *data_msg = set_up_data_msg();
+
+  msg_enc_key_p enc_key;
+  memset(enc_key, 0x1C, sizeof(msg_enc_key_p));
+  msg_mac_key_p mac_key;
+  memset(mac_key, 0x2D, sizeof(msg_mac_key_p));
+  uint8_t plaintext[10] = {0};
+
+  GPtrArray *pieces = g_ptr_array_new_with_free_func(g_free);
+  otrng_send_stream_p stream;
+  otrng_assert_is_success(otrng_send_stream_init(stream, data_msg, enc_key,
+                                                 mac_key, NULL, 0, 11, 0,
+                                                 collect_pieces, pieces));
+
+  otrng_assert_is_success(otrng_send_stream_update(stream, plaintext, 10));
+  otrng_assert_is_error(otrng_send_stream_final(stream));
+  otrng_send_stream_destroy(stream);
+
+  g_ptr_array_free(pieces, TRUE);
+  otrng_data_message_free(data_msg);
+}
+
+void test_client_sends_streamed_message(void) {
+  otrng_bool ignore = otrng_false;
+  otrng_client_state_s *alice_client_state =
+      otrng_client_state_new(ALICE_IDENTITY);
+  otrng_client_state_s *bob_client_state = otrng_client_state_new(BOB_IDENTITY);
+
+  otrng_client_s *alice = set_up_client(alice_client_state, ALICE_IDENTITY, 1);
+  otrng_client_s *bob = set_up_client(bob_client_state, BOB_IDENTITY, 2);
+
+  char *query_msg_to_bob =
+      otrng_client_query_message(BOB_IDENTITY, "Hi bob", alice);
+  char *from_alice_to_bob = NULL, *from_bob = NULL, *to_display = NULL;
+
+  /* Bob receives query message, sends identity msg */
+  otrng_client_receive(&from_bob, &to_display, query_msg_to_bob, ALICE_IDENTITY,
+                       bob, &ignore);
+  free(query_msg_to_bob);
+
+  /* Alice receives identity message (from Bob), sends Auth-R message */
+  otrng_client_receive(&from_alice_to_bob, &to_display, from_bob, BOB_IDENTITY,
+                       alice, &ignore);
+  free(from_bob);
+  from_bob = NULL;
+
+  /* Bob receives Auth-R message, sends Auth-I message */
+  otrng_client_receive(&from_bob, &to_display, from_alice_to_bob,
+                       ALICE_IDENTITY, bob, &ignore);
+  free(from_alice_to_bob);
+  from_alice_to_bob = NULL;
+
+  /* Alice receives Auth-I message (from Bob) */
+  otrng_client_receive(&from_alice_to_bob, &to_display, from_bob, BOB_IDENTITY,
+                       alice, &ignore);
+  free(from_bob);
+  from_bob = NULL;
+
+  /* Bob receives the initial data message */
+  otrng_client_receive(&from_bob, &to_display, from_alice_to_bob,
+                       ALICE_IDENTITY, bob, &ignore);
+  free(from_alice_to_bob);
+  otrng_assert(!from_bob);
+  otrng_assert(!to_display);
+
+  char message[SEND_STREAM_PLAINTEXT_LEN + 1];
+  for (int i = 0; i < SEND_STREAM_PLAINTEXT_LEN; i++) {
+    message[i] = 'a' + i % 26;
+  }
+  message[SEND_STREAM_PLAINTEXT_LEN] = 0;
+
+  /* Alice streams the message, a line at a time */
+  GPtrArray *pieces = g_ptr_array_new_with_free_func(g_free);
+  otrng_send_stream_p stream;
+  otrng_assert_is_success(otrng_client_send_stream_start(
+      stream, SEND_STREAM_PLAINTEXT_LEN, 1000, collect_pieces, pieces,
+      BOB_IDENTITY, alice));
+  for (int i = 0; i < SEND_STREAM_PLAINTEXT_LEN; i += 80) {
+    otrng_assert_is_success(otrng_client_send_stream_write(
+        stream, (const uint8_t *)message + i, 80));
+  }
+  otrng_assert_is_success(otrng_client_send_stream_finish(stream));
+
+  otrng_assert(pieces->len > 1);
+  for (guint i = 0; i < pieces->len; i++) {
+    /* Bob receives the fragments */
+    otrng_client_receive(&from_bob, &to_display, g_ptr_array_index(pieces, i),
+                         ALICE_IDENTITY, bob, &ignore);
+    otrng_assert(!from_bob);
+
+    if (pieces->len - 1 == i) {
+      g_assert_cmpstr(to_display, ==, message);
+    } else {
+      otrng_assert(!to_display);
+    }
+  }
+
+  free(to_display);
+  g_ptr_array_free(pieces, TRUE);
+  otrng_user_state_free_all(alice_client_state->user_state,
+                            bob_client_state->user_state);
+  otrng_client_state_free_all(alice_client_state, bob_client_state);
+  otrng_client_free_all(alice, bob);
+}
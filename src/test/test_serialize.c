@@ -199,4 +199,36 @@ void test_serializes_fingerprint() {
   otrng_assert_cmpmem(expected_fp, dst, sizeof(otrng_fingerprint_p));
 }
 
+void test_serialized_profile_digest() {
+  otrng_serialized_profile_p ser;
+  otrng_serialized_profile_init(ser);
+  ser->len = 3;
+  ser->data = malloc(ser->len);
+  otrng_assert(ser->data);
+  memcpy(ser->data, "abc", ser->len);
+
+  uint8_t expected[HASH_BYTES];
+  shake_256_kdf1(expected, HASH_BYTES, 0x05, ser->data, ser->len);
+
+  uint8_t dst[HASH_BYTES] = {0};
+  otrng_serialized_profile_digest(dst, 0x05, ser);
+  otrng_assert_cmpmem(expected, dst, HASH_BYTES);
+  g_assert_cmpuint(ser->num_digests, ==, 1);
+
+  // The second time it comes from the cache
+  memset(dst, 0, HASH_BYTES);
+  otrng_serialized_profile_digest(dst, 0x05, ser);
+  otrng_assert_cmpmem(expected, dst, HASH_BYTES);
+  g_assert_cmpuint(ser->num_digests, ==, 1);
+
+  shake_256_kdf1(expected, HASH_BYTES, 0x06, ser->data, ser->len);
+  otrng_serialized_profile_digest(dst, 0x06, ser);
+  otrng_assert_cmpmem(expected, dst, HASH_BYTES);
+  g_assert_cmpuint(ser->num_digests, ==, 2);
+
+  otrng_serialized_profile_destroy(ser);
+  otrng_assert(!ser->data);
+  g_assert_cmpuint(ser->num_digests, ==, 0);
+}
+
 // TODO: ADD test for otrng_serialize_ring_sig
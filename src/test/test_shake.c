@@ -0,0 +1,63 @@
+/*
+ *  This file is part of the Off-the-Record Next Generation Messaging
+ *  library (libotr-ng).
+ *
+ *  Copyright (C) 2016-2018, the libotr-ng contributors.
+ *
+ *  This library is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../shake.h"
+
+static void hash_with_domain(uint8_t *dst, size_t dstlen, const char *domain,
+                             uint8_t usage, const uint8_t *values,
+                             size_t valueslen) {
+  goldilocks_shake256_ctx_p hd;
+  hash_init(hd);
+  hash_update(hd, (const unsigned char *)domain, strlen(domain));
+  hash_update(hd, &usage, 1);
+  hash_update(hd, values, valueslen);
+  hash_final(hd, dst, dstlen);
+  hash_destroy(hd);
+}
+
+void test_shake_prefixed_kdfs() {
+  const uint8_t values[3] = {0x01, 0x02, 0x03};
+  uint8_t expected[64];
+  uint8_t got[64];
+
+  for (int usage = 0; usage < 0x20; usage++) {
+    hash_with_domain(expected, sizeof expected, "OTRv4", usage, values,
+                     sizeof values);
+    shake_256_kdf1(got, sizeof got, usage, values, sizeof values);
+    otrng_assert_cmpmem(expected, got, sizeof got);
+
+    hash_with_domain(expected, sizeof expected, "OTR-Prekey-Server", usage,
+                     values, sizeof values);
+    shake_256_prekey_server_kdf(got, sizeof got, usage, values, sizeof values);
+    otrng_assert_cmpmem(expected, got, sizeof got);
+  }
+
+  /* The ring signatures name their domain */
+  goldilocks_shake256_ctx_p hd;
+  hash_init_with_usage_and_domain_separation(hd, 0x05,
+                                             OTRNG_SHAKE_DOMAIN_PREKEY_SERVER);
+  hash_update(hd, values, sizeof values);
+  hash_final(hd, got, sizeof got);
+  hash_destroy(hd);
+
+  hash_with_domain(expected, sizeof expected, "OTR-Prekey-Server", 0x05,
+                   values, sizeof values);
+  otrng_assert_cmpmem(expected, got, sizeof got);
+}
@@ -105,3 +105,93 @@ void test_otrng_append_padding_tlv() {
   // otrng_assert(tlvs);
   // otrng_tlv_list_free(tlvs);
 }
+
+void test_tlv_writer_serializes_tlvs() {
+  uint8_t smp2_data[2] = {0x03, 0x04};
+  uint8_t expected[] = {0x00, 0x03, 0x00, 0x02, 0x03, 0x04, 0x00,
+                        0x06, 0x00, 0x00, 0x00, 0x07, 0x00, 0x03,
+                        0xaa, 0xbb, 0xcc, 0x00, 0x03, 0x00, 0x02,
+                        0x03, 0x04};
+
+  otrng_tlv_writer_p writer;
+  otrng_tlv_writer_init(writer);
+  otrng_assert_is_success(otrng_tlv_writer_append(
+      writer, OTRNG_TLV_SMP_MSG_2, smp2_data, sizeof(smp2_data)));
+  otrng_assert_is_success(
+      otrng_tlv_writer_append(writer, OTRNG_TLV_SMP_ABORT, NULL, 0));
+
+  uint8_t *data = otrng_tlv_writer_reserve(writer, OTRNG_TLV_SYM_KEY, 3);
+  otrng_assert(data);
+  data[0] = 0xaa;
+  data[1] = 0xbb;
+  data[2] = 0xcc;
+
+  /* A list is written as otrng_tlv_serialize writes each of its TLVs */
+  tlv_list_s *tlvs = otrng_tlv_list_one(
+      otrng_tlv_new(OTRNG_TLV_SMP_MSG_2, sizeof(smp2_data), smp2_data));
+  otrng_assert_is_success(otrng_tlv_writer_append_list(writer, tlvs));
+  otrng_tlv_list_free(tlvs);
+
+  g_assert_cmpint(writer->len, ==, sizeof(expected));
+  otrng_assert_cmpmem(writer->data, expected, sizeof(expected));
+
+  otrng_assert(!otrng_tlv_writer_reserve(writer, OTRNG_TLV_SYM_KEY, 65536));
+  otrng_assert_is_error(
+      otrng_tlv_writer_append(writer, OTRNG_TLV_SMP_MSG_1, NULL, 1));
+  g_assert_cmpint(writer->len, ==, sizeof(expected));
+
+  /* The buffer is kept for the next message */
+  otrng_tlv_writer_reset(writer);
+  g_assert_cmpint(writer->len, ==, 0);
+  otrng_assert(writer->capacity > 0);
+
+  otrng_tlv_writer_destroy(writer);
+  otrng_assert(!writer->data);
+}
+
+void test_tlv_writer_grows() {
+  uint8_t big[1000];
+  memset(big, 0x2a, sizeof(big));
+
+  otrng_tlv_writer_p writer;
+  otrng_tlv_writer_init(writer);
+  for (int i = 0; i < 5; i++) {
+    otrng_assert_is_success(otrng_tlv_writer_append(
+        writer, OTRNG_TLV_PADDING, big, sizeof(big)));
+  }
+
+  g_assert_cmpint(writer->len, ==, 5 * (sizeof(big) + 4));
+  for (int i = 0; i < 5; i++) {
+    const uint8_t *tlv = writer->data + i * (sizeof(big) + 4);
+    g_assert_cmpint(tlv[2] << 8 | tlv[3], ==, sizeof(big));
+    otrng_assert_cmpmem(tlv + 4, big, sizeof(big));
+  }
+
+  otrng_tlv_writer_destroy(writer);
+}
+
+void test_tlv_reader_reads_tlvs() {
+  /* SMP abort, an unknown type, and a TLV longer than what is left */
+  uint8_t msg[17] = {0x00, 0x06, 0x00, 0x03, 0x08, 0x05, 0x09, 0x00, 0x42,
+                     0x00, 0x01, 0xac, 0x00, 0x05, 0x00, 0x03, 0x08};
+
+  otrng_tlv_reader_p reader;
+  otrng_tlv_view_s tlv;
+  otrng_tlv_reader_init(reader, msg, sizeof(msg));
+
+  otrng_assert(otrng_tlv_reader_next(&tlv, reader));
+  otrng_assert(tlv.type == OTRNG_TLV_SMP_ABORT);
+  g_assert_cmpint(tlv.len, ==, 3);
+  otrng_assert(tlv.data == msg + 4);
+
+  otrng_assert(otrng_tlv_reader_next(&tlv, reader));
+  otrng_assert(tlv.type == OTRNG_TLV_NONE);
+  g_assert_cmpint(tlv.len, ==, 1);
+  otrng_assert(tlv.data == msg + 11);
+
+  otrng_assert(!otrng_tlv_reader_next(&tlv, reader));
+
+  /* Nor is half a header read */
+  otrng_tlv_reader_init(reader, msg, 3);
+  otrng_assert(!otrng_tlv_reader_next(&tlv, reader));
+}
@@ -18,8 +18,10 @@
  *  along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <sodium.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define OTRNG_TLV_PRIVATE
 
@@ -35,62 +37,12 @@ const otrng_tlv_type_t tlv_types[] = {
 
 const size_t TLV_TYPES_LENGTH = OTRNG_TLV_SYM_KEY + 1;
 
-tstatic void set_tlv_type(tlv_s *tlv, uint16_t tlv_type) {
-  tlv->type = OTRNG_TLV_NONE;
-
-  if (tlv_type >= 0 && tlv_type < TLV_TYPES_LENGTH) {
-    tlv->type = tlv_types[tlv_type];
-  }
-}
-
-tstatic tlv_s *parse_tlv(const uint8_t *src, size_t len, size_t *read) {
-  tlv_s *tlv = otrng_tlv_new(OTRNG_TLV_NONE, 0, NULL);
-  if (!tlv) {
-    return NULL;
-  }
-
-  size_t w = 0;
-  uint16_t tlv_type = -1;
-  const uint8_t *cursor = src;
-
-  if (!otrng_deserialize_uint16(&tlv_type, cursor, len, &w)) {
-    otrng_tlv_free(tlv);
-    return NULL;
-  }
-
-  set_tlv_type(tlv, tlv_type);
-
-  len -= w;
-  cursor += w;
-
-  if (!otrng_deserialize_uint16(&tlv->len, cursor, len, &w)) {
-    otrng_tlv_free(tlv);
-    return NULL;
-  }
-
-  len -= w;
-  cursor += w;
-
-  if (len < tlv->len) {
-    otrng_tlv_free(tlv);
-    return NULL;
+tstatic otrng_tlv_type_t tlv_type_from_wire(uint16_t tlv_type) {
+  if (tlv_type < TLV_TYPES_LENGTH) {
+    return tlv_types[tlv_type];
   }
 
-  tlv->data = malloc(tlv->len);
-
-  if (!tlv->data) {
-    otrng_tlv_free(tlv);
-    return NULL;
-  }
-
-  memcpy(tlv->data, cursor, tlv->len);
-  cursor += tlv->len;
-
-  if (read) {
-    *read = cursor - src;
-  }
-
-  return tlv;
+  return OTRNG_TLV_NONE;
 }
 
 INTERNAL tlv_list_s *otrng_append_tlv(tlv_list_s *head, tlv_s *tlv) {
@@ -116,16 +68,17 @@ INTERNAL tlv_list_s *otrng_append_tlv(tlv_list_s *head, tlv_s *tlv) {
 
 INTERNAL tlv_list_s *otrng_parse_tlvs(const uint8_t *src, size_t len) {
   tlv_list_s *ret = NULL;
-  while (len > 0) {
-    size_t read = 0;
-    tlv_s *tlv = parse_tlv(src, len, &read);
+  otrng_tlv_reader_p reader;
+  otrng_tlv_view_s view;
+
+  otrng_tlv_reader_init(reader, src, len);
+  while (otrng_tlv_reader_next(&view, reader)) {
+    tlv_s *tlv = otrng_tlv_new(view.type, view.len, view.data);
     if (!tlv) {
       break;
     }
 
     ret = otrng_append_tlv(ret, tlv);
-    src += read;
-    len -= read;
   }
 
   return ret;
@@ -220,3 +173,127 @@ INTERNAL size_t otrng_tlv_serialize(uint8_t *dst, const tlv_s *tlv) {
   w += otrng_serialize_bytes_array(dst + w, tlv->data, tlv->len);
   return w;
 }
+
+INTERNAL void otrng_tlv_writer_init(otrng_tlv_writer_s *writer) {
+  writer->data = NULL;
+  writer->len = 0;
+  writer->capacity = 0;
+}
+
+INTERNAL void otrng_tlv_writer_reset(otrng_tlv_writer_s *writer) {
+  if (writer->data) {
+    sodium_memzero(writer->data, writer->len);
+  }
+
+  writer->len = 0;
+}
+
+INTERNAL void otrng_tlv_writer_destroy(otrng_tlv_writer_s *writer) {
+  otrng_tlv_writer_reset(writer);
+  free(writer->data);
+  otrng_tlv_writer_init(writer);
+}
+
+INTERNAL uint8_t *otrng_tlv_writer_reserve(otrng_tlv_writer_s *writer,
+                                           uint16_t type, size_t len) {
+  if (len > UINT16_MAX) {
+    return NULL;
+  }
+
+  size_t needed = writer->len + OTRNG_TLV_HEADER_BYTES + len;
+  if (needed > writer->capacity) {
+    size_t capacity = writer->capacity ? writer->capacity * 2 : 64;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+
+    uint8_t *data = malloc(capacity);
+    if (!data) {
+      return NULL;
+    }
+
+    /* The old buffer may hold keys, so it is wiped rather than realloc'd */
+    if (writer->data) {
+      memcpy(data, writer->data, writer->len);
+      sodium_memzero(writer->data, writer->len);
+      free(writer->data);
+    }
+
+    writer->data = data;
+    writer->capacity = capacity;
+  }
+
+  uint8_t *cursor = writer->data + writer->len;
+  cursor += otrng_serialize_uint16(cursor, type);
+  cursor += otrng_serialize_uint16(cursor, len);
+  writer->len = needed;
+
+  return cursor;
+}
+
+INTERNAL otrng_result otrng_tlv_writer_append(otrng_tlv_writer_s *writer,
+                                              uint16_t type,
+                                              const uint8_t *data, size_t len) {
+  if (len && !data) {
+    return OTRNG_ERROR;
+  }
+
+  uint8_t *dst = otrng_tlv_writer_reserve(writer, type, len);
+  if (!dst) {
+    return OTRNG_ERROR;
+  }
+
+  if (len) {
+    memcpy(dst, data, len);
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL otrng_result otrng_tlv_writer_append_list(otrng_tlv_writer_s *writer,
+                                                   const tlv_list_s *tlvs) {
+  for (const tlv_list_s *current = tlvs; current; current = current->next) {
+    const tlv_s *tlv = current->data;
+    if (otrng_failed(
+            otrng_tlv_writer_append(writer, tlv->type, tlv->data, tlv->len))) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+INTERNAL void otrng_tlv_reader_init(otrng_tlv_reader_s *reader,
+                                    const uint8_t *src, size_t len) {
+  reader->cursor = src;
+  reader->len = len;
+}
+
+INTERNAL otrng_bool otrng_tlv_reader_next(otrng_tlv_view_s *tlv,
+                                          otrng_tlv_reader_s *reader) {
+  uint16_t tlv_type = 0, tlv_len = 0;
+  size_t read = 0;
+
+  if (otrng_failed(otrng_deserialize_uint16(&tlv_type, reader->cursor,
+                                            reader->len, &read))) {
+    return otrng_false;
+  }
+
+  if (otrng_failed(otrng_deserialize_uint16(&tlv_len, reader->cursor + read,
+                                            reader->len - read, &read))) {
+    return otrng_false;
+  }
+
+  if (reader->len - OTRNG_TLV_HEADER_BYTES < tlv_len) {
+    return otrng_false;
+  }
+
+  tlv->type = tlv_type_from_wire(tlv_type);
+  tlv->len = tlv_len;
+  tlv->data = reader->cursor + OTRNG_TLV_HEADER_BYTES;
+
+  reader->cursor += OTRNG_TLV_HEADER_BYTES + tlv_len;
+  reader->len -= OTRNG_TLV_HEADER_BYTES + tlv_len;
+
+  return otrng_true;
+}
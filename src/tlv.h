@@ -24,6 +24,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "error.h"
 #include "shared.h"
 
 typedef enum {
@@ -63,6 +64,43 @@ typedef struct tlv_list_s {
   struct tlv_list_s *next;
 } tlv_list_s;
 
+/* The length of the type and length of a serialized TLV */
+#define OTRNG_TLV_HEADER_BYTES 4
+
+/**
+ * @brief The otrng_tlv_writer_s structure holds TLVs serialized one after the
+ *    other, as they are sent in a data message.
+ *
+ *  [data]     the serialized TLVs. the buffer is kept, and grown as needed,
+ *             when the writer is reset.
+ *  [len]      the length of the serialized TLVs.
+ *  [capacity] the size of [data].
+ **/
+typedef struct otrng_tlv_writer_s {
+  uint8_t *data;
+  size_t len;
+  size_t capacity;
+} otrng_tlv_writer_s, otrng_tlv_writer_p[1];
+
+/**
+ * @brief The otrng_tlv_view_s structure is one TLV read from a buffer. Its
+ *    data is not copied: it points into that buffer.
+ **/
+typedef struct otrng_tlv_view_s {
+  otrng_tlv_type_t type;
+  uint16_t len;
+  const uint8_t *data;
+} otrng_tlv_view_s;
+
+/**
+ * @brief The otrng_tlv_reader_s structure goes through the TLVs serialized
+ *    in a buffer, one at a time.
+ **/
+typedef struct otrng_tlv_reader_s {
+  const uint8_t *cursor;
+  size_t len;
+} otrng_tlv_reader_s, otrng_tlv_reader_p[1];
+
 /**
  * @brief Frees the given list of TLVs
  *
@@ -146,4 +184,57 @@ INTERNAL void otrng_tlv_free(tlv_s *tlv);
 
 INTERNAL size_t otrng_tlv_serialize(uint8_t *dst, const tlv_s *tlv);
 
+INTERNAL void otrng_tlv_writer_init(otrng_tlv_writer_s *writer);
+
+/**
+ * @brief Empties the writer. The TLVs it held are wiped, but its buffer is
+ *    kept for the next ones.
+ **/
+INTERNAL void otrng_tlv_writer_reset(otrng_tlv_writer_s *writer);
+
+INTERNAL void otrng_tlv_writer_destroy(otrng_tlv_writer_s *writer);
+
+/**
+ * @brief Adds a TLV, and leaves its data to be written by the caller.
+ *
+ * @param [type] the type of the TLV.
+ * @param [len]  the length of its data. at most 65535.
+ *
+ * @return where the [len] bytes of data go. it is valid until the writer is
+ *    used again. returns NULL if something goes wrong.
+ **/
+INTERNAL uint8_t *otrng_tlv_writer_reserve(otrng_tlv_writer_s *writer,
+                                           uint16_t type, size_t len);
+
+/**
+ * @brief Adds a TLV, copying [len] bytes of [data]. [data] can be NULL, but
+ *    only if [len] is 0.
+ **/
+INTERNAL otrng_result otrng_tlv_writer_append(otrng_tlv_writer_s *writer,
+                                              uint16_t type,
+                                              const uint8_t *data, size_t len);
+
+/**
+ * @brief Adds every TLV of the list [tlvs]. can be NULL.
+ **/
+INTERNAL otrng_result otrng_tlv_writer_append_list(otrng_tlv_writer_s *writer,
+                                                   const tlv_list_s *tlvs);
+
+/**
+ * @brief Starts reading the TLVs in the memory region from [src] to
+ *    [src]+[len].
+ **/
+INTERNAL void otrng_tlv_reader_init(otrng_tlv_reader_s *reader,
+                                    const uint8_t *src, size_t len);
+
+/**
+ * @brief Reads the next TLV. A type that is not one of otrng_tlv_type_t is
+ *    read as OTRNG_TLV_NONE.
+ *
+ * @return otrng_false when there are no more TLVs, or when what is left is
+ *    not a whole TLV.
+ **/
+INTERNAL otrng_bool otrng_tlv_reader_next(otrng_tlv_view_s *tlv,
+                                          otrng_tlv_reader_s *reader);
+
 #endif
@@ -22,6 +22,7 @@
 
 #include "v3.h"
 #include "otrng.h"
+#include "serialize.h"
 
 tstatic void create_privkey_cb_v3(const otrng_v3_conn_s *conn) {
   if (!conn || !conn->state) {
@@ -562,10 +563,18 @@ INTERNAL otrng_v3_conn_s *otrng_v3_conn_new(otrng_client_state_s *state,
   ret->ops = &v3_callbacks;
   ret->ctx = NULL;
   ret->opdata = NULL;
-  ret->injected_message = NULL;
+  ret->injected_messages = NULL;
+  ret->num_injected_messages = 0;
 
   ret->peer = otrng_strdup(peer);
 
+  ret->account_name = NULL;
+  ret->protocol_name = NULL;
+  // It may fail if the callbacks are not set yet. We will try again when the
+  // names are needed.
+  otrng_client_state_get_account_and_protocol(&ret->account_name,
+                                              &ret->protocol_name, state);
+
   return ret;
 }
 
@@ -574,40 +583,262 @@ INTERNAL void otrng_v3_conn_free(otrng_v3_conn_s *conn) {
     return;
   }
 
-  free(conn->injected_message);
-  conn->injected_message = NULL;
+  otrng_v3_forget_injected_messages(conn);
 
   free(conn->peer);
   conn->peer = NULL;
 
+  otrng_v3_conn_forget_account_and_protocol(conn);
+
   free(conn);
 }
 
+INTERNAL void otrng_v3_conn_forget_account_and_protocol(otrng_v3_conn_s *conn) {
+  free(conn->account_name);
+  conn->account_name = NULL;
+
+  free(conn->protocol_name);
+  conn->protocol_name = NULL;
+}
+
+tstatic otrng_result v3_conn_get_account_and_protocol(const char **account,
+                                                      const char **protocol,
+                                                      otrng_v3_conn_s *conn) {
+  if (!conn->account_name || !conn->protocol_name) {
+    otrng_v3_conn_forget_account_and_protocol(conn);
+    if (!otrng_client_state_get_account_and_protocol(
+            &conn->account_name, &conn->protocol_name, conn->state)) {
+      return OTRNG_ERROR;
+    }
+  }
+
+  *account = conn->account_name;
+  *protocol = conn->protocol_name;
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_bool tlv_type_to_v3(unsigned short *dst,
+                                  otrng_tlv_type_t type) {
+  switch (type) {
+  case OTRNG_TLV_PADDING:
+    *dst = OTRL_TLV_PADDING;
+    return otrng_true;
+  case OTRNG_TLV_DISCONNECTED:
+    *dst = OTRL_TLV_DISCONNECTED;
+    return otrng_true;
+  case OTRNG_TLV_SMP_MSG_1:
+    *dst = OTRL_TLV_SMP1;
+    return otrng_true;
+  case OTRNG_TLV_SMP_MSG_2:
+    *dst = OTRL_TLV_SMP2;
+    return otrng_true;
+  case OTRNG_TLV_SMP_MSG_3:
+    *dst = OTRL_TLV_SMP3;
+    return otrng_true;
+  case OTRNG_TLV_SMP_MSG_4:
+    *dst = OTRL_TLV_SMP4;
+    return otrng_true;
+  case OTRNG_TLV_SMP_ABORT:
+    *dst = OTRL_TLV_SMP_ABORT;
+    return otrng_true;
+  case OTRNG_TLV_SYM_KEY:
+    *dst = OTRL_TLV_SYMKEY;
+    return otrng_true;
+  case OTRNG_TLV_NONE:
+    break;
+  }
+
+  return otrng_false;
+}
+
+/* v4 always sends a question: OTRL_TLV_SMP1 and OTRL_TLV_SMP1Q both become
+ * OTRNG_TLV_SMP_MSG_1. */
+tstatic otrng_bool tlv_type_from_v3(otrng_tlv_type_t *dst,
+                                    unsigned short type) {
+  switch (type) {
+  case OTRL_TLV_PADDING:
+    *dst = OTRNG_TLV_PADDING;
+    return otrng_true;
+  case OTRL_TLV_DISCONNECTED:
+    *dst = OTRNG_TLV_DISCONNECTED;
+    return otrng_true;
+  case OTRL_TLV_SMP1:
+  case OTRL_TLV_SMP1Q:
+    *dst = OTRNG_TLV_SMP_MSG_1;
+    return otrng_true;
+  case OTRL_TLV_SMP2:
+    *dst = OTRNG_TLV_SMP_MSG_2;
+    return otrng_true;
+  case OTRL_TLV_SMP3:
+    *dst = OTRNG_TLV_SMP_MSG_3;
+    return otrng_true;
+  case OTRL_TLV_SMP4:
+    *dst = OTRNG_TLV_SMP_MSG_4;
+    return otrng_true;
+  case OTRL_TLV_SMP_ABORT:
+    *dst = OTRNG_TLV_SMP_ABORT;
+    return otrng_true;
+  case OTRL_TLV_SYMKEY:
+    *dst = OTRNG_TLV_SYM_KEY;
+    return otrng_true;
+  }
+
+  return otrng_false;
+}
+
+tstatic void v3_tlvs_free_borrowed(OtrlTLV *tlvs) {
+  while (tlvs) {
+    OtrlTLV *next = tlvs->next;
+    free(tlvs);
+    tlvs = next;
+  }
+}
+
+tstatic otrng_result v3_tlvs_borrow(OtrlTLV **dst, const tlv_list_s *tlvs) {
+  OtrlTLV *head = NULL;
+  OtrlTLV **tail = &head;
+
+  for (; tlvs; tlvs = tlvs->next) {
+    unsigned short type;
+    if (!tlv_type_to_v3(&type, tlvs->data->type)) {
+      continue;
+    }
+
+    OtrlTLV *tlv = malloc(sizeof(OtrlTLV));
+    if (!tlv) {
+      v3_tlvs_free_borrowed(head);
+      return OTRNG_ERROR;
+    }
+
+    tlv->type = type;
+    tlv->len = tlvs->data->len;
+    tlv->data = tlvs->data->data;
+    tlv->next = NULL;
+
+    *tail = tlv;
+    tail = &tlv->next;
+  }
+
+  *dst = head;
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_bool v3_smp1_has_question(const OtrlTLV *tlv) {
+  if (tlv->type != OTRL_TLV_SMP1Q) {
+    return otrng_false;
+  }
+
+  return tlv->data && memchr(tlv->data, 0, tlv->len);
+}
+
+tstatic otrng_result v3_smp1_with_question(tlv_s *dst, const OtrlTLV *tlv) {
+  size_t q_len = 0;
+  size_t skip = 0;
+  if (v3_smp1_has_question(tlv)) {
+    q_len = (const uint8_t *)memchr(tlv->data, 0, tlv->len) - tlv->data;
+    skip = q_len + 1;
+  }
+
+  dst->len = 4 + q_len + tlv->len - skip;
+  dst->data = malloc(dst->len);
+  if (!dst->data) {
+    return OTRNG_ERROR;
+  }
+
+  size_t w = otrng_serialize_uint32(dst->data, q_len);
+  if (q_len) {
+    memcpy(dst->data + w, tlv->data, q_len);
+  }
+  if (tlv->len > skip) {
+    memcpy(dst->data + w + q_len, tlv->data + skip, tlv->len - skip);
+  }
+
+  return OTRNG_SUCCESS;
+}
+
+tstatic otrng_result v3_tlvs_take(tlv_list_s **dst, OtrlTLV *tlvs_v3) {
+  tlv_list_s *head = NULL;
+  tlv_list_s **tail = &head;
+
+  for (; tlvs_v3; tlvs_v3 = tlvs_v3->next) {
+    otrng_tlv_type_t type;
+    if (!tlv_type_from_v3(&type, tlvs_v3->type)) {
+      continue;
+    }
+
+    /* Its question ends at the first NUL */
+    if (tlvs_v3->type == OTRL_TLV_SMP1Q && !v3_smp1_has_question(tlvs_v3)) {
+      continue;
+    }
+
+    tlv_s *tlv = malloc(sizeof(tlv_s));
+    if (!tlv) {
+      otrng_tlv_list_free(head);
+      return OTRNG_ERROR;
+    }
+
+    tlv->type = type;
+    if (type == OTRNG_TLV_SMP_MSG_1) {
+      if (!v3_smp1_with_question(tlv, tlvs_v3)) {
+        free(tlv);
+        otrng_tlv_list_free(head);
+        return OTRNG_ERROR;
+      }
+    } else {
+      tlv->len = tlvs_v3->len;
+      tlv->data = tlvs_v3->data;
+    }
+
+    *tail = otrng_tlv_list_one(tlv);
+    if (!*tail) {
+      if (type == OTRNG_TLV_SMP_MSG_1) {
+        free(tlv->data);
+      }
+      free(tlv);
+      otrng_tlv_list_free(head);
+      return OTRNG_ERROR;
+    }
+
+    /* The data now belongs to the new list */
+    if (type != OTRNG_TLV_SMP_MSG_1) {
+      tlvs_v3->data = NULL;
+    }
+    tail = &(*tail)->next;
+  }
+
+  *dst = head;
+  return OTRNG_SUCCESS;
+}
+
 INTERNAL otrng_result otrng_v3_send_message(char **newmessage,
                                             const char *message,
                                             const tlv_list_s *tlvs,
                                             otrng_v3_conn_s *conn) {
-  // TODO: @client convert TLVs
   OtrlTLV *tlvsv3 = NULL;
 
   if (!conn) {
     return OTRNG_ERROR;
   }
 
-  char *account_name = NULL;
-  char *protocol_name = NULL;
-  if (!otrng_client_state_get_account_and_protocol(
-          &account_name, &protocol_name, conn->state)) {
+  const char *account_name = NULL;
+  const char *protocol_name = NULL;
+  if (!v3_conn_get_account_and_protocol(&account_name, &protocol_name, conn)) {
     return OTRNG_ERROR;
   }
 
+  /* libotr only reads the TLVs, so they can point to the payloads we were
+   * given */
+  if (!v3_tlvs_borrow(&tlvsv3, tlvs)) {
+    return OTRNG_ERROR;
+  }
+
+  otrng_v3_forget_injected_messages(conn);
   int err = otrl_message_sending(
       conn->state->user_state, conn->ops, conn->opdata, account_name,
       protocol_name, conn->peer, OTRL_INSTAG_RECENT, message, tlvsv3,
       newmessage, OTRL_FRAGMENT_SEND_SKIP, &conn->ctx, NULL, NULL);
 
-  free(account_name);
-  free(protocol_name);
+  v3_tlvs_free_borrowed(tlvsv3);
 
   if (!err) {
     return OTRNG_SUCCESS;
@@ -629,25 +860,22 @@ INTERNAL otrng_result otrng_v3_receive_message(char **to_send,
     return OTRNG_ERROR;
   }
 
-  char *account_name = NULL;
-  char *protocol_name = NULL;
-  if (!otrng_client_state_get_account_and_protocol(
-          &account_name, &protocol_name, conn->state)) {
+  const char *account_name = NULL;
+  const char *protocol_name = NULL;
+  if (!v3_conn_get_account_and_protocol(&account_name, &protocol_name, conn)) {
     return OTRNG_ERROR;
   }
 
   char *newmessage = NULL;
+  otrng_v3_forget_injected_messages(conn);
   ignore_message =
       otrl_message_receiving(conn->state->user_state, conn->ops, conn->opdata,
                              account_name, protocol_name, conn->peer, message,
                              &newmessage, &tlvs_v3, &conn->ctx, NULL, NULL);
 
-  free(account_name);
-  free(protocol_name);
-
   (void)ignore_message;
 
-  *to_send = otrng_v3_retrieve_injected_message(conn);
+  *to_send = otrng_v3_take_injected_message(conn);
 
   if (to_display && newmessage) {
     *to_display = otrng_strdup(newmessage);
@@ -665,7 +893,10 @@ INTERNAL otrng_result otrng_v3_receive_message(char **to_send,
     gone_insecure_cb_v3(s);
   }
 
-  // TODO: Copy from tlvs_v3 to tlvs.
+  otrng_result ret = OTRNG_SUCCESS;
+  if (tlvs) {
+    ret = v3_tlvs_take(tlvs, tlvs_v3);
+  }
 
   otrl_tlv_free(tlvs_v3);
   otrl_message_free(newmessage);
@@ -673,36 +904,35 @@ INTERNAL otrng_result otrng_v3_receive_message(char **to_send,
   // TODO: @client Here we can use contextp to get information we might need
   // about the state, for example (context->msgstate)
 
-  return OTRNG_SUCCESS;
+  return ret;
 }
 
 INTERNAL void otrng_v3_close(char **to_send, otrng_v3_conn_s *conn) {
-  // TODO: @client there is also: otrl_message_disconnect, which only
-  // disconnects one instance
-
-  char *account_name = NULL;
-  char *protocol_name = NULL;
+  const char *account_name = NULL;
+  const char *protocol_name = NULL;
 
   // TODO: Error?
-  otrng_client_state_get_account_and_protocol(&account_name, &protocol_name,
-                                              conn->state);
+  v3_conn_get_account_and_protocol(&account_name, &protocol_name, conn);
 
-  otrl_message_disconnect_all_instances(conn->state->user_state, conn->ops,
-                                        conn->opdata, account_name,
-                                        protocol_name, conn->peer);
-  free(account_name);
-  free(protocol_name);
+  /* Only the instance of this conversation, as with OTRv4: there is a single
+   * to_send message for its disconnect */
+  otrl_instag_t instance =
+      conn->ctx ? conn->ctx->their_instance : OTRL_INSTAG_BEST;
+  otrng_v3_forget_injected_messages(conn);
+  otrl_message_disconnect(conn->state->user_state, conn->ops, conn->opdata,
+                          account_name, protocol_name, conn->peer, instance);
 
-  *to_send = otrng_v3_retrieve_injected_message(conn);
+  *to_send = otrng_v3_take_injected_message(conn);
 }
 
 INTERNAL otrng_result otrng_v3_send_symkey_message(
     char **to_send, otrng_v3_conn_s *conn, unsigned int use,
     const unsigned char *usedata, size_t usedatalen, unsigned char *extra_key) {
+  otrng_v3_forget_injected_messages(conn);
   otrl_message_symkey(conn->state->user_state, conn->ops, conn->opdata,
                       conn->ctx, use, usedata, usedatalen, extra_key);
 
-  *to_send = otrng_v3_retrieve_injected_message(conn);
+  *to_send = otrng_v3_take_injected_message(conn);
   return OTRNG_SUCCESS;
 }
 
@@ -721,6 +951,7 @@ INTERNAL otrng_result otrng_v3_smp_start(char **to_send,
     q[q_len] = 0;
   }
 
+  otrng_v3_forget_injected_messages(conn);
   if (question) {
     otrl_message_initiate_smp_q(conn->state->user_state, conn->ops,
                                 conn->opdata, conn->ctx, q, secret, secretlen);
@@ -729,7 +960,7 @@ INTERNAL otrng_result otrng_v3_smp_start(char **to_send,
                               conn->ctx, secret, secretlen);
   }
 
-  *to_send = otrng_v3_retrieve_injected_message(conn);
+  *to_send = otrng_v3_take_injected_message(conn);
   return OTRNG_SUCCESS;
 }
 
@@ -737,14 +968,16 @@ INTERNAL otrng_result otrng_v3_smp_continue(char **to_send,
                                             const uint8_t *secret,
                                             const size_t secretlen,
                                             otrng_v3_conn_s *conn) {
+  otrng_v3_forget_injected_messages(conn);
   otrl_message_respond_smp(conn->state->user_state, conn->ops, conn->opdata,
                            conn->ctx, secret, secretlen);
 
-  *to_send = otrng_v3_retrieve_injected_message(conn);
+  *to_send = otrng_v3_take_injected_message(conn);
   return OTRNG_SUCCESS;
 }
 
 INTERNAL otrng_result otrng_v3_smp_abort(otrng_v3_conn_s *conn) {
+  otrng_v3_forget_injected_messages(conn);
   otrl_message_abort_smp(conn->state->user_state, conn->ops, conn->opdata,
                          conn->ctx);
   return OTRNG_SUCCESS;
@@ -756,21 +989,89 @@ tstatic void otrng_v3_store_injected_message(const char *message,
     return;
   }
 
-  // TODO: @client This is where we should ADD a new element to the list.
-  // We are just ignoring for now.
-  if (conn->injected_message && message) {
-    free(conn->injected_message);
+  char *copy = otrng_strdup(message);
+  if (!copy) {
+    return;
   }
 
-  conn->injected_message = otrng_strdup(message);
+  list_element_s *injected_messages =
+      otrng_list_add(copy, conn->injected_messages);
+  if (!injected_messages) {
+    free(copy);
+    return;
+  }
+
+  conn->injected_messages = injected_messages;
+  conn->num_injected_messages++;
+
+  /* Nobody flushed them */
+  if (conn->num_injected_messages > OTRNG_V3_MAX_INJECTED_MESSAGES) {
+    free(otrng_v3_retrieve_injected_message(conn));
+  }
 }
 
 tstatic char *otrng_v3_retrieve_injected_message(otrng_v3_conn_s *conn) {
-  // TODO: @client As this is stored from a callback it MAY be the case a
-  // message was lost (if the callback was invoked multiple times before we
-  // consume this injected_message). Ideally this would be a list.
-  char *to_send = conn->injected_message;
-  conn->injected_message = NULL;
+  list_element_s *first = conn->injected_messages;
+  if (!first) {
+    return NULL;
+  }
+
+  char *to_send = first->data;
+  conn->injected_messages = first->next;
+  conn->num_injected_messages--;
+
+  first->data = NULL;
+  first->next = NULL;
+  otrng_list_free_nodes(first);
+
+  return to_send;
+}
+
+/* The last message libotr injected, which used to be the only one kept */
+tstatic char *otrng_v3_take_injected_message(otrng_v3_conn_s *conn) {
+  list_element_s *last = otrng_list_get_last(conn->injected_messages);
+  if (!last) {
+    return NULL;
+  }
+
+  char *to_send = last->data;
+  conn->injected_messages =
+      otrng_list_remove_element(last, conn->injected_messages);
+  conn->num_injected_messages--;
+
+  last->data = NULL;
+  otrng_list_free_nodes(last);
 
   return to_send;
 }
+
+/* What was not flushed after the previous call is not sent anymore */
+tstatic void otrng_v3_forget_injected_messages(otrng_v3_conn_s *conn) {
+  otrng_list_free(conn->injected_messages, free);
+  conn->injected_messages = NULL;
+  conn->num_injected_messages = 0;
+}
+
+INTERNAL otrng_result
+otrng_v3_flush_injected_messages(otrng_message_to_send_s *batch,
+                                 otrng_v3_conn_s *conn) {
+  size_t len = conn->num_injected_messages;
+
+  batch->pieces = NULL;
+  batch->total = 0;
+
+  if (len == 0) {
+    return OTRNG_SUCCESS;
+  }
+
+  batch->pieces = malloc(len * sizeof(string_p));
+  if (!batch->pieces) {
+    return OTRNG_ERROR;
+  }
+
+  for (; batch->total < (int)len; batch->total++) {
+    batch->pieces[batch->total] = otrng_v3_retrieve_injected_message(conn);
+  }
+
+  return OTRNG_SUCCESS;
+}
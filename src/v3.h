@@ -31,6 +31,12 @@
 #include "str.h"
 #include "tlv.h"
 #include "client_state.h"
+#include "fragment.h"
+#include "list.h"
+
+/* The most messages waiting to be injected. Past it, the oldest ones are
+ * dropped. */
+#define OTRNG_V3_MAX_INJECTED_MESSAGES 64
 
 typedef struct otrng_v3_conn_s {
   otrng_client_state_s *state;
@@ -42,7 +48,16 @@ typedef struct otrng_v3_conn_s {
   // could be initialized by otrng_s.
   char *peer;
 
-  char *injected_message;
+  /* The account and protocol names of our client, as libotr knows them.
+   * They are resolved once and kept until
+   * otrng_v3_conn_forget_account_and_protocol is called. */
+  char *account_name;
+  char *protocol_name;
+
+  /* The messages libotr asked us to inject during the last call, oldest
+   * first. It may ask for more than one. */
+  list_element_s *injected_messages;
+  size_t num_injected_messages;
   void *opdata; // v4 conn for use in callbacks
 
   OtrlMessageAppOps *ops;
@@ -54,6 +69,12 @@ INTERNAL otrng_v3_conn_s *otrng_v3_conn_new(otrng_client_state_s *state,
 
 INTERNAL void otrng_v3_conn_free(otrng_v3_conn_s *conn);
 
+/**
+ * @brief Discards the cached account and protocol names, so they are asked
+ *        for again on the next use of the connection.
+ */
+INTERNAL void otrng_v3_conn_forget_account_and_protocol(otrng_v3_conn_s *conn);
+
 INTERNAL otrng_result otrng_v3_send_message(char **newmessage,
                                             const char *message,
                                             const tlv_list_s *tlvs,
@@ -67,6 +88,21 @@ INTERNAL otrng_result otrng_v3_receive_message(char **to_send,
 
 INTERNAL void otrng_v3_close(char **to_send, otrng_v3_conn_s *conn);
 
+/**
+ * @brief Takes the messages libotr injected during the last call, oldest
+ *        first.
+ *
+ * The functions that return a single to_send message hand out the last one.
+ * The others stay queued until they are flushed, or until the next call into
+ * libotr, which drops them.
+ *
+ * @param [batch]  An empty batch, that receives the messages.
+ * @param [conn]   The v3 connection.
+ */
+INTERNAL otrng_result
+otrng_v3_flush_injected_messages(otrng_message_to_send_s *batch,
+                                 otrng_v3_conn_s *conn);
+
 INTERNAL otrng_result otrng_v3_send_symkey_message(
     char **to_send, otrng_v3_conn_s *conn, unsigned int use,
     const unsigned char *usedata, size_t usedatalen, unsigned char *symkey);
@@ -86,11 +122,37 @@ INTERNAL otrng_result otrng_v3_smp_abort(otrng_v3_conn_s *conn);
 
 #ifdef OTRNG_V3_PRIVATE
 
+tstatic otrng_result v3_conn_get_account_and_protocol(const char **account,
+                                                      const char **protocol,
+                                                      otrng_v3_conn_s *conn);
+
 tstatic void otrng_v3_store_injected_message(const char *message,
                                              otrng_v3_conn_s *conn);
 
 tstatic char *otrng_v3_retrieve_injected_message(otrng_v3_conn_s *conn);
 
+tstatic char *otrng_v3_take_injected_message(otrng_v3_conn_s *conn);
+
+tstatic void otrng_v3_forget_injected_messages(otrng_v3_conn_s *conn);
+
+/* Builds an OtrlTLV chain that shares the payloads of tlvs. Only the chain
+ * must be freed, with v3_tlvs_free_borrowed. */
+tstatic otrng_result v3_tlvs_borrow(OtrlTLV **dst, const tlv_list_s *tlvs);
+
+tstatic void v3_tlvs_free_borrowed(OtrlTLV *tlvs);
+
+tstatic otrng_bool v3_smp1_has_question(const OtrlTLV *tlv);
+
+/* Copies the payload of a v3 SMP message 1 with its question in front, as a
+ * v4 one has it: a 4-byte length and the question, which is empty for an
+ * OTRL_TLV_SMP1. The rest is kept as libotr sent it. */
+tstatic otrng_result v3_smp1_with_question(tlv_s *dst, const OtrlTLV *tlv);
+
+/* Moves the payloads of tlvs_v3 to a new tlv_list_s. SMP messages 1 are
+ * copied instead, with v3_smp1_with_question. tlvs_v3 must still be freed,
+ * with otrl_tlv_free. */
+tstatic otrng_result v3_tlvs_take(tlv_list_s **dst, OtrlTLV *tlvs_v3);
+
 #endif
 
 #endif